@@ -53,9 +53,17 @@ int main(int argc, char *argv[])
     }
 
     // 设置audio参数
+    // 采样率、声道与默认输入设备一致时 coreaudio 源不需要重采样
     struct obs_audio_info ai;
-    ai.samples_per_sec = 44100;
+    ai.samples_per_sec = 48000;
     ai.speakers = SPEAKERS_MONO;
+    uint32_t sample_rate = 0, channels = 0;
+    if (Util::default_input_format(sample_rate, channels)) {
+        if (sample_rate == 44100 || sample_rate == 48000)
+            ai.samples_per_sec = sample_rate;
+        ai.speakers = channels > 1 ? SPEAKERS_STEREO : SPEAKERS_MONO;
+        qDebug() << "default input" << sample_rate << "Hz" << channels << "ch";
+    }
     retb = obs_reset_audio(&ai);
     if (!retb) {
         qDebug() << "obs_reset_audio failed";
@@ -1,6 +1,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdint.h>
 
 class Util
 {
@@ -8,6 +9,8 @@ public:
     Util();
 
     static bool is_in_bundle();
+    // 默认输入设备的采样率和声道数
+    static bool default_input_format(uint32_t &sample_rate, uint32_t &channels);
 };
 
 #endif // UTIL_H
@@ -1,5 +1,8 @@
 #include "util.h"
 #import <AppKit/AppKit.h>
+#import <CoreAudio/CoreAudio.h>
+
+#include <stdlib.h>
 
 Util::Util()
 {
@@ -11,3 +14,43 @@ bool Util::is_in_bundle()
     NSRunningApplication *app = [NSRunningApplication currentApplication];
     return [app bundleIdentifier] != nil;
 }
+
+bool Util::default_input_format(uint32_t &sample_rate, uint32_t &channels)
+{
+    AudioObjectPropertyAddress addr = {
+        kAudioHardwarePropertyDefaultInputDevice,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMaster
+    };
+    AudioDeviceID device = kAudioObjectUnknown;
+    UInt32 size = sizeof(device);
+    if (AudioObjectGetPropertyData(kAudioObjectSystemObject, &addr, 0, NULL,
+                                   &size, &device) != noErr ||
+            device == kAudioObjectUnknown)
+        return false;
+
+    Float64 rate = 0.0;
+    addr.mSelector = kAudioDevicePropertyNominalSampleRate;
+    size = sizeof(rate);
+    if (AudioObjectGetPropertyData(device, &addr, 0, NULL, &size,
+                                   &rate) != noErr)
+        return false;
+
+    // 输入流的声道数为各缓冲区声道数之和
+    addr.mSelector = kAudioDevicePropertyStreamConfiguration;
+    addr.mScope = kAudioDevicePropertyScopeInput;
+    if (AudioObjectGetPropertyDataSize(device, &addr, 0, NULL, &size) != noErr)
+        return false;
+    AudioBufferList *buffers = (AudioBufferList *)malloc(size);
+    if (!buffers)
+        return false;
+    bool ok = AudioObjectGetPropertyData(device, &addr, 0, NULL, &size,
+                                         buffers) == noErr;
+    channels = 0;
+    for (UInt32 i = 0; ok && i < buffers->mNumberBuffers; i++)
+        channels += buffers->mBuffers[i].mNumberChannels;
+    free(buffers);
+
+    sample_rate = (uint32_t)rate;
+    return ok && channels > 0;
+}
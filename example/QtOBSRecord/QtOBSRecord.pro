@@ -1,28 +1,101 @@
-#-------------------------------------------------
-#
-# Project created by QtCreator 2020-05-28T11:24:26
-#
-#-------------------------------------------------
-
-QT       += core gui winextras network
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG   += c++11
-
-TARGET = QtOBSRecord
-TEMPLATE = app
-
-INCLUDEPATH += $$PWD/obs-studio/libobs
-INCLUDEPATH += $$PWD/obs-studio/dependencies2015/win32/include
-LIBS += $$PWD/obs-studio/build/lib/obs.lib
-
-
-SOURCES += main.cpp\
-        dialog.cpp \
-    obs-wrapper.cpp
-
-HEADERS  += dialog.h \
-    obs-wrapper.h
-
-FORMS    += dialog.ui
+#-------------------------------------------------
+#
+# Project created by QtCreator 2020-05-28T11:24:26
+#
+#-------------------------------------------------
+
+QT       += core gui winextras network
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG   += c++11
+
+TARGET = QtOBSRecord
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/obs-studio/libobs
+INCLUDEPATH += $$PWD/obs-studio/dependencies2015/win32/include
+LIBS += $$PWD/obs-studio/build/lib/obs.lib
+LIBS += -L$$PWD/obs-studio/dependencies2015/win32/bin -lavcodec -lavutil
+LIBS += -lole32
+
+# obs-block-writer 在 Linux 下通过 io_uring 写盘，没有 liburing 时使用写线程
+unix:!macx {
+    packagesExist(liburing) {
+        CONFIG    += link_pkgconfig
+        PKGCONFIG += liburing
+        DEFINES   += HAVE_LIBURING
+    }
+}
+
+
+SOURCES += main.cpp\
+        dialog.cpp \
+    obs-wrapper.cpp \
+    obs-profiler-stats.cpp \
+    obs-llhls-output.cpp \
+    obs-packet-sink.cpp \
+    obs-video-quality.cpp \
+    obs-encoder-probe.cpp \
+    obs-thread-topology.cpp \
+    obs-vad-filter.cpp \
+    obs-audio-meter.cpp \
+    obs-audio-device-registry.cpp \
+    obs-window-resolver.cpp \
+    obs-scene-layout.cpp \
+    obs-worker-protocol.cpp \
+    obs-record-worker.cpp \
+    obs-worker-supervisor.cpp \
+    frame-export-reader.cpp \
+    obs-frame-export.cpp \
+    obs-raw-tap.cpp \
+    obs-snapshot.cpp \
+    obs-fmp4-mux.cpp \
+    obs-block-writer.cpp \
+    obs-block-file-output.cpp \
+    obs-post-process.cpp \
+    obs-event-bus.cpp \
+    obs-flight-recorder.cpp \
+    flight-recorder-reader.cpp \
+    obs-raw-capture.cpp \
+    obs-rd-bench.cpp \
+    obs-av-sync.cpp \
+    obs-roi-encoder.cpp \
+    obs-audio-format.cpp \
+    obs-init-graph.cpp
+
+HEADERS  += dialog.h \
+    obs-wrapper.h \
+    obs-profiler-stats.h \
+    obs-llhls-output.h \
+    obs-packet-sink.h \
+    obs-video-quality.h \
+    obs-encoder-probe.h \
+    obs-thread-topology.h \
+    obs-vad-filter.h \
+    obs-audio-meter.h \
+    obs-audio-device-registry.h \
+    obs-window-resolver.h \
+    obs-scene-layout.h \
+    obs-worker-protocol.h \
+    obs-record-worker.h \
+    obs-worker-supervisor.h \
+    frame-export-reader.h \
+    obs-frame-export.h \
+    obs-raw-tap.h \
+    obs-snapshot.h \
+    obs-fmp4-mux.h \
+    obs-block-writer.h \
+    obs-block-file-output.h \
+    obs-post-process.h \
+    obs-event-bus.h \
+    obs-flight-recorder.h \
+    flight-recorder-reader.h \
+    obs-raw-capture.h \
+    obs-rd-bench.h \
+    obs-av-sync.h \
+    obs-roi-encoder.h \
+    obs-audio-format.h \
+    obs-init-graph.h
+
+FORMS    += dialog.ui
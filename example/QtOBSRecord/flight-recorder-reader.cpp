@@ -0,0 +1,236 @@
+﻿#include "flight-recorder-reader.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+static_assert(sizeof(FlightRecord) == FLIGHT_RECORD_SIZE,
+              "FlightRecord size mismatch");
+static_assert(sizeof(FlightRecorderHeader) <= FLIGHT_RECORDER_HEADER_SIZE,
+              "FlightRecorderHeader too large");
+
+static const char *metricNames[FLIGHT_METRIC_COUNT] = {
+    "record_bytes",
+    "record_frames",
+    "record_dropped",
+    "stream_bytes",
+    "stream_frames",
+    "stream_dropped",
+    "lagged_frames",
+    "skipped_frames",
+    "frame_time_us",
+    "active_fps_x100",
+    "cpu_x100",
+    "free_disk_mb",
+    "audio_drift_us"
+};
+
+const char *FlightMetricName(int metric)
+{
+    if (metric < 0 || metric >= FLIGHT_METRIC_COUNT)
+        return "unknown";
+    return metricNames[metric];
+}
+
+static const char *LevelName(int level)
+{
+    // 与 libobs 的 LOG_ERROR/LOG_WARNING/LOG_INFO/LOG_DEBUG 一致
+    switch (level) {
+    case 100: return "error";
+    case 200: return "warning";
+    case 300: return "info";
+    case 400: return "debug";
+    default:  return "log";
+    }
+}
+
+static std::string FormatTime(int64_t ms)
+{
+    time_t seconds = (time_t)(ms / 1000);
+    struct tm *t = localtime(&seconds);
+    char buf[64];
+    if (!t)
+        snprintf(buf, sizeof(buf), "%lld", (long long)ms);
+    else
+        snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%03d",
+                 t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                 t->tm_hour, t->tm_min, t->tm_sec, (int)(ms % 1000));
+    return buf;
+}
+
+static void WriteCsvString(FILE *out, const std::string &text)
+{
+    fputc('"', out);
+    for (char c : text) {
+        if (c == '"')
+            fputc('"', out);
+        fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+bool FlightRecorderReader::open(const std::string &path)
+{
+    list.clear();
+    fileInfo    = FlightRecorderInfo();
+    tornRecords = 0;
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    if (data.size() < FLIGHT_RECORDER_HEADER_SIZE)
+        return false;
+
+    const FlightRecorderHeader *header =
+            reinterpret_cast<const FlightRecorderHeader *>(data.data());
+    if (header->magic != FLIGHT_RECORDER_MAGIC ||
+            header->version != FLIGHT_RECORDER_VERSION ||
+            header->recordSize != FLIGHT_RECORD_SIZE ||
+            header->metricRecords == 0 ||
+            header->recordCount <= header->metricRecords)
+        return false;
+
+    uint64_t count = header->recordCount;
+    if (data.size() < FLIGHT_RECORDER_HEADER_SIZE + count * FLIGHT_RECORD_SIZE)
+        return false;
+
+    fileInfo.recordCount   = header->recordCount;
+    fileInfo.metricRecords = header->metricRecords;
+    fileInfo.metricCount   = header->metricCount;
+    fileInfo.pid           = header->pid;
+    fileInfo.next          = header->next.load(std::memory_order_relaxed);
+    fileInfo.nextMetric    = header->nextMetric.load(std::memory_order_relaxed);
+    fileInfo.wallClockMs   = header->wallClockMs;
+    fileInfo.monotonicNs   = header->monotonicNs;
+
+    const FlightRecord *records = reinterpret_cast<const FlightRecord *>(
+            data.data() + FLIGHT_RECORDER_HEADER_SIZE);
+
+    // 先读指标环，再读日志和事件环
+    uint64_t metricCount = fileInfo.metricRecords;
+    uint64_t logCount    = count - metricCount;
+    uint64_t metricFirst = fileInfo.nextMetric > metricCount ?
+                           fileInfo.nextMetric - metricCount : 0;
+    uint64_t logFirst    = fileInfo.next > logCount ?
+                           fileInfo.next - logCount : 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        const FlightRecord &r = records[i];
+        uint64_t seq = r.seq.load(std::memory_order_relaxed);
+        if (!seq)
+            continue;
+
+        bool metricRing = i < metricCount;
+        uint64_t ringCount = metricRing ? metricCount : logCount;
+        uint64_t slot      = metricRing ? i : i - metricCount;
+        uint64_t first     = metricRing ? metricFirst : logFirst;
+        uint64_t next      = metricRing ? fileInfo.nextMetric : fileInfo.next;
+
+        seq--;
+        if (seq < first || seq >= next || seq % ringCount != slot)
+            continue;
+
+        FlightRecordCopy copy;
+        copy.seq         = seq;
+        copy.timestamp   = r.timestamp;
+        copy.wallClockMs = fileInfo.wallClockMs +
+                           ((int64_t)r.timestamp -
+                            (int64_t)fileInfo.monotonicNs) / 1000000;
+        copy.type        = r.type;
+        copy.level       = r.level;
+
+        if (r.type == FLIGHT_RECORD_METRICS) {
+            int metrics = std::min<int>(std::max<int>(r.count, 0),
+                                        FLIGHT_RECORD_MAX_METRICS);
+            copy.metrics.assign(r.metrics, r.metrics + metrics);
+        } else {
+            size_t len = std::min<size_t>((size_t)std::max<int>(r.count, 0),
+                                          FLIGHT_RECORD_PAYLOAD_SIZE);
+            copy.text.assign(r.text, len);
+        }
+        list.push_back(copy);
+    }
+
+    // 两个环的序号互不相关，按写入时间合并
+    std::stable_sort(list.begin(), list.end(),
+                     [] (const FlightRecordCopy &a, const FlightRecordCopy &b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    // 范围内缺失的序号：崩溃时正在写入的记录
+    tornRecords = (fileInfo.nextMetric - metricFirst) +
+                  (fileInfo.next - logFirst) - list.size();
+    return true;
+}
+
+void FlightRecorderReader::writeText(FILE *out) const
+{
+    fprintf(out, "# pid %u, records %u (%u metrics), next %llu, "
+                 "next metric %llu, torn %llu\n",
+            fileInfo.pid, fileInfo.recordCount, fileInfo.metricRecords,
+            (unsigned long long)fileInfo.next,
+            (unsigned long long)fileInfo.nextMetric,
+            (unsigned long long)tornRecords);
+
+    for (const FlightRecordCopy &r : list) {
+        std::string time = FormatTime(r.wallClockMs);
+        switch (r.type) {
+        case FLIGHT_RECORD_METRICS:
+            fprintf(out, "%s METRICS", time.c_str());
+            for (size_t i = 0; i < r.metrics.size(); i++)
+                fprintf(out, " %s=%lld", FlightMetricName((int)i),
+                        (long long)r.metrics[i]);
+            fputc('\n', out);
+            break;
+        case FLIGHT_RECORD_LOG:
+            fprintf(out, "%s [%s] %s\n", time.c_str(), LevelName(r.level),
+                    r.text.c_str());
+            break;
+        case FLIGHT_RECORD_EVENT:
+            fprintf(out, "%s EVENT code=%d %s\n", time.c_str(), r.level,
+                    r.text.c_str());
+            break;
+        }
+    }
+}
+
+void FlightRecorderReader::writeCsv(FILE *out) const
+{
+    int metricCount = std::min<int>((int)fileInfo.metricCount,
+                                    FLIGHT_RECORD_MAX_METRICS);
+
+    fprintf(out, "seq,time,type");
+    for (int i = 0; i < metricCount; i++)
+        fprintf(out, ",%s", FlightMetricName(i));
+    fprintf(out, ",level,text\n");
+
+    for (const FlightRecordCopy &r : list) {
+        const char *type = r.type == FLIGHT_RECORD_METRICS ? "metrics" :
+                           r.type == FLIGHT_RECORD_LOG ? "log" : "event";
+        fprintf(out, "%llu,%s,%s", (unsigned long long)r.seq,
+                FormatTime(r.wallClockMs).c_str(), type);
+        for (int i = 0; i < metricCount; i++) {
+            if ((size_t)i < r.metrics.size())
+                fprintf(out, ",%lld", (long long)r.metrics[i]);
+            else
+                fputc(',', out);
+        }
+
+        if (r.type == FLIGHT_RECORD_METRICS) {
+            fprintf(out, ",,\n");
+        } else {
+            fprintf(out, ",%d,", r.level);
+            WriteCsvString(out, r.text);
+            fputc('\n', out);
+        }
+    }
+}
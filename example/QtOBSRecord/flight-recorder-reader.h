@@ -0,0 +1,135 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * 飞行记录器的文件布局和读取端。本文件不依赖 libobs，离线分析只需要
+ * flight-recorder-reader.h/.cpp（或 QtOBSRecord --flight-dump）。
+ *
+ * 文件 = FlightRecorderHeader（一页） | FlightRecord[recordCount]
+ *
+ * 前 metricRecords 条是指标专用的环，其余是日志和事件的环，各自有独立的序号
+ * （nextMetric / next），日志突增不会挤掉指标的历史。
+ *
+ * 写端（obs-flight-recorder.h）通过文件映射写入，进程崩溃后内容仍由系统写回文件。
+ * 环内第 n 条记录写在 n % 环的容量，seq 先清零、写完内容后置为 n + 1，
+ * 读端据此丢弃崩溃时写了一半的记录和已被覆盖的旧记录。
+ * 快照是同样格式的文件，读取方式相同。
+ */
+#define FLIGHT_RECORDER_MAGIC       0x52464f51u   // "QOFR"
+#define FLIGHT_RECORDER_VERSION     2
+#define FLIGHT_RECORDER_HEADER_SIZE 4096
+#define FLIGHT_RECORD_SIZE          256
+#define FLIGHT_RECORD_PAYLOAD_SIZE  (FLIGHT_RECORD_SIZE - 24)
+#define FLIGHT_RECORD_MAX_METRICS   (FLIGHT_RECORD_PAYLOAD_SIZE / 8)
+
+enum FlightRecordType {
+    FLIGHT_RECORD_EMPTY,
+    FLIGHT_RECORD_METRICS,    // metrics[FlightMetric]
+    FLIGHT_RECORD_LOG,        // level 为 blog 级别，text 为日志内容
+    FLIGHT_RECORD_EVENT       // level 为输出错误码，text 为 "输出名: last_error"
+};
+
+/* 指标记录中各列的含义，只能在末尾追加 */
+enum FlightMetric {
+    FLIGHT_METRIC_RECORD_BYTES,
+    FLIGHT_METRIC_RECORD_FRAMES,
+    FLIGHT_METRIC_RECORD_DROPPED,
+    FLIGHT_METRIC_STREAM_BYTES,
+    FLIGHT_METRIC_STREAM_FRAMES,
+    FLIGHT_METRIC_STREAM_DROPPED,
+    FLIGHT_METRIC_LAGGED_FRAMES,     // 渲染线程累计未按时完成的帧
+    FLIGHT_METRIC_SKIPPED_FRAMES,    // 编码累计跳过的帧
+    FLIGHT_METRIC_FRAME_TIME_US,     // 平均渲染耗时
+    FLIGHT_METRIC_ACTIVE_FPS_X100,
+    FLIGHT_METRIC_CPU_X100,          // 本进程 CPU 占用（百分比 * 100）
+    FLIGHT_METRIC_FREE_DISK_MB,      // 录制目录所在磁盘的剩余空间
+    FLIGHT_METRIC_AUDIO_DRIFT_US,    // 音频设备相对视频时钟的漂移（obs-av-sync.h）
+    FLIGHT_METRIC_COUNT
+};
+
+struct FlightRecord
+{
+    std::atomic<uint64_t> seq;        // 0 为空或正在写入，否则为序号 + 1
+    uint64_t              timestamp;  // os_gettime_ns()
+    uint16_t              type;       // FlightRecordType
+    int16_t               count;      // 指标个数或文本长度
+    int32_t               level;
+    union {
+        int64_t metrics[FLIGHT_RECORD_MAX_METRICS];
+        char    text[FLIGHT_RECORD_PAYLOAD_SIZE];
+    };
+};
+
+struct FlightRecorderHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t recordCount;
+    uint64_t generation;             // 写端打开时的 os_gettime_ns()
+    int64_t  wallClockMs;            // 打开时的 UTC 毫秒，用于换算 timestamp
+    uint64_t monotonicNs;            // 与 wallClockMs 同一时刻的 os_gettime_ns()
+    uint32_t pid;
+    uint32_t metricCount;            // 写端的 FLIGHT_METRIC_COUNT
+    uint32_t closed;                 // 写端正常关闭时置 1
+    uint32_t metricRecords;          // 指标环的容量，位于记录区开头
+    std::atomic<uint64_t> next;      // 日志和事件环下一条记录的序号
+    std::atomic<uint64_t> nextMetric; // 指标环下一条记录的序号
+};
+
+/* 读取到的文件信息 */
+struct FlightRecorderInfo
+{
+    uint32_t recordCount   = 0;
+    uint32_t metricRecords = 0;
+    uint32_t metricCount   = 0;
+    uint32_t pid           = 0;
+    uint64_t next          = 0;
+    uint64_t nextMetric    = 0;
+    int64_t  wallClockMs   = 0;
+    uint64_t monotonicNs   = 0;
+};
+
+/* 读取到的一条记录（拷贝） */
+struct FlightRecordCopy
+{
+    uint64_t             seq;        // 所在环内的序号
+    uint64_t             timestamp;
+    int64_t              wallClockMs;
+    int                  type;
+    int                  level;
+    std::vector<int64_t> metrics;
+    std::string          text;
+};
+
+const char *FlightMetricName(int metric);
+
+/* 读取 ring 文件或快照，两个环的记录合并后按时间排序 */
+class FlightRecorderReader
+{
+public:
+    bool open(const std::string &path);
+
+    const FlightRecorderInfo &info() const { return fileInfo; }
+    const std::vector<FlightRecordCopy> &records() const { return list; }
+    uint64_t torn() const { return tornRecords; }
+
+    void writeText(FILE *out) const;
+    // 指标一行一条；日志和事件的 level/text 放在最后两列
+    void writeCsv(FILE *out) const;
+
+private:
+    FlightRecorderInfo            fileInfo;
+    std::vector<FlightRecordCopy> list;
+    uint64_t                      tornRecords = 0;
+};
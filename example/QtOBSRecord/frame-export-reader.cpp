@@ -0,0 +1,323 @@
+﻿#include "frame-export-reader.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define READ_RETRIES 4
+
+static uint64_t AlignUp(uint64_t value)
+{
+    return (value + FRAME_EXPORT_ALIGN - 1) & ~(uint64_t)(FRAME_EXPORT_ALIGN - 1);
+}
+
+uint64_t FrameExportSlotsOffset()
+{
+    return AlignUp(sizeof(FrameExportHeader));
+}
+
+uint64_t FrameExportDataOffset(uint32_t slotCount)
+{
+    return AlignUp(FrameExportSlotsOffset() +
+                   (uint64_t)slotCount * sizeof(FrameExportSlot));
+}
+
+/* ------------------------------------------------------------------------- */
+/* 共享内存 */
+
+SharedMemoryRegion::SharedMemoryRegion() : base(nullptr), length(0),
+    owner(false), handle(nullptr), fd(-1)
+{
+}
+
+SharedMemoryRegion::~SharedMemoryRegion()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+static std::string MappingName(const std::string &name)
+{
+    return "Local\\" + name;
+}
+
+bool SharedMemoryRegion::create(const std::string &name_, uint64_t size)
+{
+    close();
+
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr,
+                                        PAGE_READWRITE, (DWORD)(size >> 32),
+                                        (DWORD)size,
+                                        MappingName(name_).c_str());
+    if (!mapping)
+        return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    name   = name_;
+    handle = mapping;
+    base   = static_cast<uint8_t *>(view);
+    length = size;
+    owner  = true;
+    return true;
+}
+
+bool SharedMemoryRegion::open(const std::string &name_)
+{
+    close();
+
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE,
+                                      MappingName(name_).c_str());
+    if (!mapping)
+        return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    MEMORY_BASIC_INFORMATION mbi;
+    VirtualQuery(view, &mbi, sizeof(mbi));
+
+    name   = name_;
+    handle = mapping;
+    base   = static_cast<uint8_t *>(view);
+    length = mbi.RegionSize;
+    owner  = false;
+    return true;
+}
+
+void SharedMemoryRegion::close()
+{
+    if (base)
+        UnmapViewOfFile(base);
+    if (handle)
+        CloseHandle(static_cast<HANDLE>(handle));
+    base   = nullptr;
+    handle = nullptr;
+    length = 0;
+    owner  = false;
+}
+
+#else
+
+static std::string ShmName(const std::string &name)
+{
+    return "/" + name;
+}
+
+bool SharedMemoryRegion::create(const std::string &name_, uint64_t size)
+{
+    close();
+
+    // 写端异常退出时可能残留同名对象，先删除
+    shm_unlink(ShmName(name_).c_str());
+    int f = shm_open(ShmName(name_).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (f < 0)
+        return false;
+    if (ftruncate(f, (off_t)size) != 0) {
+        ::close(f);
+        shm_unlink(ShmName(name_).c_str());
+        return false;
+    }
+
+    void *view = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, f, 0);
+    if (view == MAP_FAILED) {
+        ::close(f);
+        shm_unlink(ShmName(name_).c_str());
+        return false;
+    }
+
+    name   = name_;
+    fd     = f;
+    base   = static_cast<uint8_t *>(view);
+    length = size;
+    owner  = true;
+    return true;
+}
+
+bool SharedMemoryRegion::open(const std::string &name_)
+{
+    close();
+
+    int f = shm_open(ShmName(name_).c_str(), O_RDONLY, 0);
+    if (f < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(f, &st) != 0 || st.st_size <= 0) {
+        ::close(f);
+        return false;
+    }
+
+    void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, f, 0);
+    if (view == MAP_FAILED) {
+        ::close(f);
+        return false;
+    }
+
+    name   = name_;
+    fd     = f;
+    base   = static_cast<uint8_t *>(view);
+    length = (uint64_t)st.st_size;
+    owner  = false;
+    return true;
+}
+
+void SharedMemoryRegion::close()
+{
+    if (base)
+        munmap(base, (size_t)length);
+    if (fd >= 0)
+        ::close(fd);
+    // 已打开的读端仍然可以继续访问，直到它们 munmap
+    if (owner)
+        shm_unlink(ShmName(name).c_str());
+    base   = nullptr;
+    fd     = -1;
+    length = 0;
+    owner  = false;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* 读取端 */
+
+FrameExportReader::FrameExportReader() : header(nullptr), slots(nullptr),
+    slotData(nullptr), generation(0), nextSeq(0), receivedCount(0),
+    droppedCount(0)
+{
+}
+
+FrameExportReader::~FrameExportReader()
+{
+    detach();
+}
+
+bool FrameExportReader::attach(const std::string &name)
+{
+    detach();
+
+    if (!region.open(name))
+        return false;
+
+    const FrameExportHeader *h =
+            reinterpret_cast<const FrameExportHeader *>(region.data());
+    if (region.size() < sizeof(FrameExportHeader) ||
+            h->magic != FRAME_EXPORT_MAGIC ||
+            h->version != FRAME_EXPORT_VERSION ||
+            h->totalSize > region.size() || !h->slotCount) {
+        region.close();
+        return false;
+    }
+
+    header     = h;
+    slots      = reinterpret_cast<const FrameExportSlot *>(
+                     region.data() + FrameExportSlotsOffset());
+    slotData   = region.data() + FrameExportDataOffset(h->slotCount);
+    generation = h->generation;
+    // 从最新一帧开始读，不回放 attach 之前的积压
+    nextSeq    = h->writeSeq.load(std::memory_order_acquire);
+    return true;
+}
+
+void FrameExportReader::detach()
+{
+    region.close();
+    header   = nullptr;
+    slots    = nullptr;
+    slotData = nullptr;
+}
+
+FrameExportReader::ReadResult FrameExportReader::read(
+        uint64_t seq, std::vector<uint8_t> &buffer, FrameExportFrame &frame)
+{
+    const FrameExportSlot &slot = slots[seq % header->slotCount];
+    const uint8_t *data = slotData + (seq % header->slotCount) * header->slotSize;
+
+    uint64_t expected = seq * 2 + 2;
+    uint64_t before = slot.seq.load(std::memory_order_acquire);
+    if (before != expected)
+        return ReadNoData;
+
+    uint32_t size = slot.size;
+    if (size > header->slotSize)
+        return ReadNoData;
+
+    frame.seq       = seq;
+    frame.timestamp = slot.timestamp;
+    frame.size      = size;
+    frame.frames    = slot.frames;
+    buffer.resize(size);
+    memcpy(buffer.data(), data, size);
+
+    // 拷贝期间被写端覆盖则数据无效
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != expected)
+        return ReadNoData;
+    return ReadOk;
+}
+
+FrameExportReader::ReadResult FrameExportReader::readNext(
+        std::vector<uint8_t> &buffer, FrameExportFrame &frame)
+{
+    if (!header)
+        return ReadRestarted;
+    if (header->closed.load(std::memory_order_acquire) ||
+            header->generation != generation)
+        return ReadRestarted;
+
+    for (int retry = 0; retry < READ_RETRIES; retry++) {
+        uint64_t written = header->writeSeq.load(std::memory_order_acquire);
+        if (nextSeq >= written)
+            return ReadNoData;
+
+        // 落后超过一圈的帧已被覆盖；再留一个槽位给正在写入的帧
+        uint64_t oldest = written > header->slotCount ?
+                          written - header->slotCount + 1 : 0;
+        if (nextSeq < oldest) {
+            droppedCount += oldest - nextSeq;
+            nextSeq = oldest;
+        }
+
+        if (read(nextSeq, buffer, frame) == ReadOk) {
+            nextSeq++;
+            receivedCount++;
+            return ReadOk;
+        }
+
+        // 读取期间被覆盖，跳过这一帧
+        droppedCount++;
+        nextSeq++;
+    }
+    return ReadNoData;
+}
+
+FrameExportReader::ReadResult FrameExportReader::readLatest(
+        std::vector<uint8_t> &buffer, FrameExportFrame &frame)
+{
+    if (!header)
+        return ReadRestarted;
+
+    uint64_t written = header->writeSeq.load(std::memory_order_acquire);
+    if (written > nextSeq + 1) {
+        droppedCount += written - 1 - nextSeq;
+        nextSeq = written - 1;
+    }
+    return readNext(buffer, frame);
+}
@@ -0,0 +1,147 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * 帧导出的共享内存布局和读取端。本文件不依赖 libobs，外部进程（分析程序）
+ * 只需要 frame-export-reader.h/.cpp 即可读取 QtOBSContext 输出的画面和音频。
+ *
+ * 共享内存 = FrameExportHeader | FrameExportSlot[slotCount] | 数据区[slotCount * slotSize]
+ *
+ * 写端（obs-frame-export.h）只有一个，按序号 n 写入第 n % slotCount 个槽位，
+ * 从不等待读端：慢的读端会被覆盖（读到的槽位序号变化），只统计为丢帧。
+ * 读端可以随时打开/关闭，写端重启后 generation 改变，读端需要重新 attach。
+ */
+#define FRAME_EXPORT_MAGIC      0x5846424fu   // "OBFX"
+#define FRAME_EXPORT_VERSION    1
+#define FRAME_EXPORT_MAX_PLANES 4
+#define FRAME_EXPORT_ALIGN      64
+
+enum FrameExportKind {
+    FRAME_EXPORT_VIDEO,
+    FRAME_EXPORT_AUDIO
+};
+
+struct FrameExportSlot
+{
+    std::atomic<uint64_t> seq;        // 2n+1 正在写入序号 n，2n+2 序号 n 已写完
+    uint64_t              timestamp;  // libobs 时间戳（纳秒）
+    uint32_t              size;       // 有效数据字节数
+    uint32_t              frames;     // 音频的采样帧数，视频为 1
+    uint8_t               reserved[FRAME_EXPORT_ALIGN - 24];
+};
+
+struct FrameExportHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;             // FrameExportKind
+    uint32_t slotCount;
+    uint64_t slotSize;         // 每个槽位数据区的字节数
+    uint64_t totalSize;        // 整个共享内存的字节数
+    uint64_t generation;       // 写端创建时的时间戳
+
+    // 视频：平面紧密排列，plane i 位于数据区 planeOffset[i]，每行 linesize[i] 字节
+    uint32_t format;           // libobs enum video_format 的值
+    uint32_t width;
+    uint32_t height;
+    uint32_t fpsNum;
+    uint32_t fpsDen;
+    uint32_t planes;
+    uint32_t linesize[FRAME_EXPORT_MAX_PLANES];
+    uint32_t planeOffset[FRAME_EXPORT_MAX_PLANES];
+
+    // 音频：32 位浮点平面格式，声道 i 位于数据区 i * frames * 4
+    uint32_t sampleRate;
+    uint32_t channels;
+
+    uint8_t  reserved[FRAME_EXPORT_ALIGN];
+
+    std::atomic<uint64_t> writeSeq;      // 已发布的帧数，最新一帧的序号为 writeSeq - 1
+    std::atomic<uint64_t> heartbeatNs;   // 写端最近一次写入的时间
+    std::atomic<uint32_t> closed;        // 写端已停止
+};
+
+// 命名共享内存：Windows 下为 CreateFileMapping（Local\\ 前缀），其它平台为 shm_open
+class SharedMemoryRegion
+{
+public:
+    SharedMemoryRegion();
+    ~SharedMemoryRegion();
+
+    bool create(const std::string &name, uint64_t size);
+    bool open(const std::string &name);
+    void close();
+
+    uint8_t *data() const { return base; }
+    uint64_t size() const { return length; }
+
+private:
+    std::string name;
+    uint8_t     *base;
+    uint64_t    length;
+    bool        owner;
+    void        *handle;
+    int         fd;
+};
+
+struct FrameExportFrame
+{
+    uint64_t seq;
+    uint64_t timestamp;
+    uint32_t size;
+    uint32_t frames;
+};
+
+class FrameExportReader
+{
+public:
+    enum ReadResult {
+        ReadOk,
+        ReadNoData,      // 没有新数据
+        ReadRestarted,   // 写端已停止或重启，需要重新 attach
+    };
+
+    FrameExportReader();
+    ~FrameExportReader();
+
+    // name 与写端 start 时相同；写端不存在或格式不兼容时返回 false
+    bool attach(const std::string &name);
+    void detach();
+    bool attached() const { return header != nullptr; }
+
+    const FrameExportHeader *info() const { return header; }
+
+    // 按顺序读取下一帧，落后超过一圈时跳到仍然有效的最旧一帧
+    ReadResult readNext(std::vector<uint8_t> &buffer, FrameExportFrame &frame);
+    // 跳过积压，读取最新一帧
+    ReadResult readLatest(std::vector<uint8_t> &buffer, FrameExportFrame &frame);
+
+    uint64_t received() const { return receivedCount; }
+    uint64_t dropped() const { return droppedCount; }
+
+private:
+    ReadResult read(uint64_t seq, std::vector<uint8_t> &buffer,
+                    FrameExportFrame &frame);
+
+    SharedMemoryRegion       region;
+    const FrameExportHeader  *header;
+    const FrameExportSlot    *slots;
+    const uint8_t            *slotData;
+    uint64_t                 generation;
+    uint64_t                 nextSeq;
+    uint64_t                 receivedCount;
+    uint64_t                 droppedCount;
+};
+
+// 共享内存的大小和各部分的偏移
+uint64_t FrameExportSlotsOffset();
+uint64_t FrameExportDataOffset(uint32_t slotCount);
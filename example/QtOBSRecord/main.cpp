@@ -1,15 +1,117 @@
-﻿#include "dialog.h"
-#include <QApplication>
-#include <QTextCodec>
-
-int main(int argc, char *argv[])
-{
-    QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
-    QTextCodec::setCodecForLocale(QTextCodec::codecForName("UTF-8"));
-
-    QApplication a(argc, argv);
-    Dialog w;
-    w.show();
-
-    return a.exec();
-}
+﻿#include "dialog.h"
+#include "obs-record-worker.h"
+#include "obs-worker-supervisor.h"
+#include "obs-thread-topology.h"
+#include "flight-recorder-reader.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QStandardPaths>
+#include <QTextCodec>
+#include <QTimer>
+#include <QDir>
+
+#define SUPERVISOR_LOG_INTERVAL_MS 60000
+
+// 录制工作进程：QtOBSRecord --worker <序号> --server <名称> [--cpus <列表>]
+static int RunWorker(QApplication &a, const QCommandLineParser &parser)
+{
+    // 在 libobs 创建线程之前绑定 CPU，之后的线程都会继承
+    std::vector<int> cpus;
+    ParseCpuList(parser.value("cpus").toStdString().c_str(), cpus);
+    if (!cpus.empty())
+        SetCurrentProcessCpus(cpus);
+
+    RecordWorker worker(parser.value("worker").toInt(),
+                        parser.value("server"));
+    if (!worker.start())
+        return 1;
+
+    return a.exec();
+}
+
+// 多进程录制：QtOBSRecord --supervisor <会话配置文件>
+static int RunSupervisor(QApplication &a, const QCommandLineParser &parser)
+{
+    QList<WorkerSession> sessions;
+    if (!WorkerSupervisor::loadSessions(parser.value("supervisor"), sessions))
+        return 1;
+
+    QString dataDirPath =
+            QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataDirPath);
+
+    WorkerSupervisor supervisor;
+    if (!supervisor.start(dataDirPath, sessions))
+        return 1;
+    supervisor.startRecord();
+
+    QTimer statsTimer;
+    QObject::connect(&statsTimer, &QTimer::timeout,
+                     &supervisor, &WorkerSupervisor::logStats);
+    statsTimer.start(SUPERVISOR_LOG_INTERVAL_MS);
+
+    QObject::connect(&a, &QCoreApplication::aboutToQuit,
+                     &supervisor, &WorkerSupervisor::stop);
+    return a.exec();
+}
+
+// 飞行记录器转换：QtOBSRecord --flight-dump <ring 或快照> [--csv] [--out <文件>]
+static int RunFlightDump(const QCommandLineParser &parser)
+{
+    FlightRecorderReader reader;
+    if (!reader.open(QDir::toNativeSeparators(parser.value("flight-dump"))
+                     .toLocal8Bit().toStdString())) {
+        fprintf(stderr, "invalid flight recorder file\n");
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (parser.isSet("out")) {
+        out = fopen(parser.value("out").toLocal8Bit().constData(), "wb");
+        if (!out) {
+            fprintf(stderr, "failed to open output file\n");
+            return 1;
+        }
+    }
+
+    if (parser.isSet("csv"))
+        reader.writeCsv(out);
+    else
+        reader.writeText(out);
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
+    QTextCodec::setCodecForLocale(QTextCodec::codecForName("UTF-8"));
+
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addOption(QCommandLineOption("worker", "worker index", "index"));
+    parser.addOption(QCommandLineOption("server", "supervisor socket", "name"));
+    parser.addOption(QCommandLineOption("cpus", "cpu list", "cpus"));
+    parser.addOption(QCommandLineOption("supervisor", "sessions file", "file"));
+    parser.addOption(QCommandLineOption("flight-dump", "flight recorder file", "file"));
+    parser.addOption(QCommandLineOption("csv", "flight dump as csv"));
+    parser.addOption(QCommandLineOption("out", "flight dump output", "file"));
+    parser.process(a);
+
+    if (parser.isSet("flight-dump"))
+        return RunFlightDump(parser);
+
+    if (parser.isSet("worker"))
+        return RunWorker(a, parser);
+    if (parser.isSet("supervisor"))
+        return RunSupervisor(a, parser);
+
+    Dialog w;
+    w.show();
+
+    return a.exec();
+}
@@ -0,0 +1,667 @@
+﻿#include "obs-audio-device-registry.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+#include <functiondiscoverykeys_devpkey.h>
+#endif
+
+#include <algorithm>
+
+static void EnumerateSourceDevices(const std::string &sourceId, bool input,
+                                   std::vector<AudioDeviceInfo> &devices)
+{
+    obs_properties_t *props = obs_get_source_properties(sourceId.c_str());
+    if (!props)
+        return;
+
+    obs_property_t *list = obs_properties_get(props, "device_id");
+    size_t count = list ? obs_property_list_item_count(list) : 0;
+    for (size_t i = 0; i < count; i++) {
+        const char *name = obs_property_list_item_name(list, i);
+        const char *id = obs_property_list_item_string(list, i);
+        if (!id)
+            continue;
+        devices.push_back(AudioDeviceInfo(id, name ? name : "", input));
+    }
+    obs_properties_destroy(props);
+}
+
+/* ------------------------------------------------------------------------- */
+/* OBSAudioDeviceBackend */
+
+#if defined(_WIN32)
+
+struct OBSAudioDeviceBackend::Notifier : public IMMNotificationClient
+{
+    volatile LONG        refs;
+    std::mutex           mutex;
+    AudioDeviceListener  *listener;
+    IMMDeviceEnumerator  *enumerator;
+    bool                 comInitialized;
+    DWORD                comThread;
+
+    Notifier() : refs(1), listener(nullptr), enumerator(nullptr),
+        comInitialized(false), comThread(0) {}
+
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return (ULONG)InterlockedIncrement(&refs);
+    }
+
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG count = (ULONG)InterlockedDecrement(&refs);
+        if (!count)
+            delete this;
+        return count;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ptr) override
+    {
+        if (riid == IID_IUnknown || riid == __uuidof(IMMNotificationClient)) {
+            *ptr = static_cast<IMMNotificationClient *>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ptr = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR id,
+                                                   DWORD state) override
+    {
+        if (state == DEVICE_STATE_ACTIVE)
+            notifyAdded(id);
+        else
+            notifyRemoved(id);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR id) override
+    {
+        notifyAdded(id);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR id) override
+    {
+        notifyRemoved(id);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow, ERole,
+                                                     LPCWSTR) override
+    {
+        // 采集源使用 "default" 时由 wasapi 插件自己跟随默认设备
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR id,
+                                                     const PROPERTYKEY key) override
+    {
+        if (key.fmtid == PKEY_Device_FriendlyName.fmtid &&
+                key.pid == PKEY_Device_FriendlyName.pid)
+            notifyAdded(id);
+        return S_OK;
+    }
+
+    static std::string ToUTF8(LPCWSTR str)
+    {
+        std::string result;
+        char *utf8 = nullptr;
+        if (str && os_wcs_to_utf8_ptr(str, 0, &utf8))
+            result = utf8;
+        bfree(utf8);
+        return result;
+    }
+
+    // 只上报处于活动状态的设备，名称和方向从 IMMDevice 读取
+    void notifyAdded(LPCWSTR id)
+    {
+        // 整个过程持锁，stop 释放 enumerator 时不会与之并发
+        std::lock_guard<std::mutex> lock(mutex);
+        IMMDevice *device = nullptr;
+        if (!listener || !enumerator ||
+                FAILED(enumerator->GetDevice(id, &device)))
+            return;
+
+        DWORD state = 0;
+        IMMEndpoint *endpoint = nullptr;
+        IPropertyStore *store = nullptr;
+        EDataFlow flow = eAll;
+        std::string name;
+
+        if (SUCCEEDED(device->GetState(&state)) && state == DEVICE_STATE_ACTIVE &&
+                SUCCEEDED(device->QueryInterface(__uuidof(IMMEndpoint),
+                                                 (void **)&endpoint)) &&
+                SUCCEEDED(endpoint->GetDataFlow(&flow)) &&
+                SUCCEEDED(device->OpenPropertyStore(STGM_READ, &store))) {
+            PROPVARIANT value;
+            PropVariantInit(&value);
+            if (SUCCEEDED(store->GetValue(PKEY_Device_FriendlyName, &value)) &&
+                    value.vt == VT_LPWSTR)
+                name = ToUTF8(value.pwszVal);
+            PropVariantClear(&value);
+        }
+
+        if (store)
+            store->Release();
+        if (endpoint)
+            endpoint->Release();
+        device->Release();
+
+        if (name.empty() || (flow != eCapture && flow != eRender))
+            return;
+
+        listener->deviceAdded(AudioDeviceInfo(ToUTF8(id), name,
+                                              flow == eCapture));
+    }
+
+    void notifyRemoved(LPCWSTR id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (listener)
+            listener->deviceRemoved(ToUTF8(id));
+    }
+};
+
+// 与 win-wasapi 相同：默认采集设备取通信角色，默认播放设备取控制台角色
+static bool QueryMixFormat(bool input, const std::string &id,
+                           AudioDeviceFormat &format)
+{
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    bool comInitialized = SUCCEEDED(hr);
+
+    IMMDeviceEnumerator *enumerator = nullptr;
+    IMMDevice *device = nullptr;
+    IAudioClient *client = nullptr;
+    WAVEFORMATEX *wfex = nullptr;
+    bool ok = false;
+
+    hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL,
+                          __uuidof(IMMDeviceEnumerator), (void **)&enumerator);
+    if (SUCCEEDED(hr)) {
+        if (id.empty() || id == "default") {
+            hr = enumerator->GetDefaultAudioEndpoint(
+                    input ? eCapture : eRender,
+                    input ? eCommunications : eConsole, &device);
+        } else {
+            wchar_t *wid = nullptr;
+            os_utf8_to_wcs_ptr(id.c_str(), 0, &wid);
+            hr = wid ? enumerator->GetDevice(wid, &device) : E_INVALIDARG;
+            bfree(wid);
+        }
+    }
+    if (SUCCEEDED(hr))
+        hr = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                              (void **)&client);
+    if (SUCCEEDED(hr))
+        hr = client->GetMixFormat(&wfex);
+    if (SUCCEEDED(hr) && wfex) {
+        format.sampleRate = wfex->nSamplesPerSec;
+        format.channels   = wfex->nChannels;
+        ok = true;
+    }
+
+    if (wfex)
+        CoTaskMemFree(wfex);
+    if (client)
+        client->Release();
+    if (device)
+        device->Release();
+    if (enumerator)
+        enumerator->Release();
+    if (comInitialized)
+        CoUninitialize();
+
+    if (!ok)
+        blog(LOG_WARNING, "audio device registry: query format of '%s' "
+                          "failed (0x%08lX)", id.c_str(), hr);
+    return ok;
+}
+
+#else
+
+struct OBSAudioDeviceBackend::Notifier
+{
+};
+
+#endif
+
+OBSAudioDeviceBackend::OBSAudioDeviceBackend(const char *inputSourceId,
+                                             const char *outputSourceId)
+    : inputSourceId(inputSourceId), outputSourceId(outputSourceId),
+      notifier(nullptr)
+{
+}
+
+OBSAudioDeviceBackend::~OBSAudioDeviceBackend()
+{
+    stop();
+}
+
+void OBSAudioDeviceBackend::enumerate(bool input,
+                                      std::vector<AudioDeviceInfo> &devices)
+{
+    EnumerateSourceDevices(input ? inputSourceId : outputSourceId, input,
+                           devices);
+}
+
+void OBSAudioDeviceBackend::start(AudioDeviceListener *listener)
+{
+#if defined(_WIN32)
+    if (notifier)
+        return;
+
+    notifier = new Notifier();
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    notifier->comInitialized = SUCCEEDED(hr);
+    notifier->comThread = GetCurrentThreadId();
+
+    hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL,
+                          __uuidof(IMMDeviceEnumerator),
+                          (void **)&notifier->enumerator);
+    if (FAILED(hr)) {
+        blog(LOG_WARNING, "audio device registry: failed to create device "
+                          "enumerator (0x%08lX), hotplug disabled", hr);
+        return;
+    }
+
+    notifier->listener = listener;
+    hr = notifier->enumerator->RegisterEndpointNotificationCallback(notifier);
+    if (FAILED(hr))
+        blog(LOG_WARNING, "audio device registry: failed to register "
+                          "notification callback (0x%08lX)", hr);
+#else
+    UNUSED_PARAMETER(listener);
+    blog(LOG_INFO, "audio device registry: no hotplug notification on this "
+                   "platform, use refresh()");
+#endif
+}
+
+void OBSAudioDeviceBackend::stop()
+{
+#if defined(_WIN32)
+    if (!notifier)
+        return;
+
+    if (notifier->enumerator)
+        notifier->enumerator->UnregisterEndpointNotificationCallback(notifier);
+    {
+        std::lock_guard<std::mutex> lock(notifier->mutex);
+        notifier->listener = nullptr;
+        if (notifier->enumerator)
+            notifier->enumerator->Release();
+        notifier->enumerator = nullptr;
+    }
+
+    // CoUninitialize 必须与 CoInitializeEx 在同一线程
+    bool uninit = notifier->comInitialized &&
+                  notifier->comThread == GetCurrentThreadId();
+    notifier->Release();
+    notifier = nullptr;
+    if (uninit)
+        CoUninitialize();
+#endif
+}
+
+bool OBSAudioDeviceBackend::queryFormat(bool input, const std::string &id,
+                                        AudioDeviceFormat &format)
+{
+#if defined(_WIN32)
+    return QueryMixFormat(input, id, format);
+#else
+    UNUSED_PARAMETER(input);
+    UNUSED_PARAMETER(id);
+    UNUSED_PARAMETER(format);
+    return false;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* FakeAudioDeviceBackend */
+
+FakeAudioDeviceBackend::FakeAudioDeviceBackend() : listener(nullptr),
+    nextIndex(0)
+{
+}
+
+void FakeAudioDeviceBackend::enumerate(bool input,
+                                       std::vector<AudioDeviceInfo> &list)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const AudioDeviceInfo &device : devices) {
+        if (device.input == input)
+            list.push_back(device);
+    }
+}
+
+void FakeAudioDeviceBackend::start(AudioDeviceListener *listener_)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    listener = listener_;
+}
+
+void FakeAudioDeviceBackend::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    listener = nullptr;
+}
+
+bool FakeAudioDeviceBackend::queryFormat(bool input, const std::string &id,
+                                         AudioDeviceFormat &format)
+{
+    UNUSED_PARAMETER(input);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = formats.find(id);
+    if (it == formats.end())
+        return false;
+    format = it->second;
+    return true;
+}
+
+void FakeAudioDeviceBackend::setFormat(const std::string &id,
+                                       const AudioDeviceFormat &format)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    formats[id] = format;
+}
+
+void FakeAudioDeviceBackend::addDevice(const AudioDeviceInfo &device)
+{
+    AudioDeviceListener *target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(devices.begin(), devices.end(),
+                               [&] (const AudioDeviceInfo &d) {
+            return d.id == device.id;
+        });
+        if (it != devices.end())
+            *it = device;
+        else
+            devices.push_back(device);
+        target = listener;
+    }
+    if (target)
+        target->deviceAdded(device);
+}
+
+void FakeAudioDeviceBackend::removeDevice(const std::string &id)
+{
+    AudioDeviceListener *target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(devices.begin(), devices.end(),
+                               [&] (const AudioDeviceInfo &d) {
+            return d.id == id;
+        });
+        if (it == devices.end())
+            return;
+        devices.erase(it);
+        target = listener;
+    }
+    if (target)
+        target->deviceRemoved(id);
+}
+
+void FakeAudioDeviceBackend::simulateHotplug(int steps, uint32_t seed)
+{
+    for (int i = 0; i < steps; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t r = seed >> 8;
+
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            count = devices.size();
+        }
+
+        if (count < 2 || (r & 1)) {
+            bool input = (r & 2) != 0;
+            int n = nextIndex++;
+            std::string id = std::string(input ? "fake-in-" : "fake-out-") +
+                             std::to_string(n);
+            std::string name = std::string(input ? "Fake Microphone "
+                                                 : "Fake Speakers ") +
+                               std::to_string(n);
+            addDevice(AudioDeviceInfo(id, name, input));
+        } else {
+            std::string id;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                id = devices[(r >> 2) % devices.size()].id;
+            }
+            removeDevice(id);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* AudioDeviceRegistry */
+
+void AudioDeviceRegistry::Index::rebuild()
+{
+    byId.clear();
+    byName.clear();
+    for (size_t i = 0; i < ordered.size(); i++) {
+        byId[ordered[i].id] = i;
+        byName.insert(std::make_pair(ordered[i].name, i));
+    }
+}
+
+AudioDeviceRegistry::AudioDeviceRegistry(AudioDeviceBackend *backend_)
+    : backend(backend_), changes(0), enumerated(false),
+      started(false)
+{
+}
+
+AudioDeviceRegistry::~AudioDeviceRegistry()
+{
+    stop();
+}
+
+void AudioDeviceRegistry::load(bool input,
+                               const std::vector<AudioDeviceInfo> &devices)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Index &idx = index[input ? 1 : 0];
+    idx.ordered = devices;
+    idx.rebuild();
+    changes++;
+}
+
+void AudioDeviceRegistry::enumerate()
+{
+    if (started || !backend)
+        return;
+
+    uint64_t begin = os_gettime_ns();
+    std::vector<AudioDeviceInfo> inputs, outputs;
+    backend->enumerate(true, inputs);
+    backend->enumerate(false, outputs);
+    load(true, inputs);
+    load(false, outputs);
+    enumerated = true;
+
+    blog(LOG_INFO, "audio device registry: %d input, %d output devices, "
+                   "enumerated in %.1f ms", (int)inputs.size(),
+         (int)outputs.size(), (double)(os_gettime_ns() - begin) / 1000000.0);
+}
+
+void AudioDeviceRegistry::start()
+{
+    if (started || !backend)
+        return;
+
+    if (!enumerated)
+        enumerate();
+
+    backend->start(this);
+    started = true;
+}
+
+void AudioDeviceRegistry::stop()
+{
+    if (!started)
+        return;
+
+    backend->stop();
+    started    = false;
+    enumerated = false;
+}
+
+void AudioDeviceRegistry::refresh()
+{
+    if (!backend)
+        return;
+
+    for (int i = 0; i < 2; i++) {
+        bool input = i == 1;
+        std::vector<AudioDeviceInfo> current, known;
+        backend->enumerate(input, current);
+        list(input, known);
+
+        for (const AudioDeviceInfo &device : current) {
+            auto it = std::find_if(known.begin(), known.end(),
+                                   [&] (const AudioDeviceInfo &d) {
+                return d.id == device.id;
+            });
+            if (it == known.end() || it->name != device.name)
+                deviceAdded(device);
+        }
+        for (const AudioDeviceInfo &device : known) {
+            auto it = std::find_if(current.begin(), current.end(),
+                                   [&] (const AudioDeviceInfo &d) {
+                return d.id == device.id;
+            });
+            if (it == current.end())
+                deviceRemoved(device.id);
+        }
+    }
+}
+
+void AudioDeviceRegistry::setChangedCallback(const ChangedCallback &callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    changed = callback;
+}
+
+size_t AudioDeviceRegistry::count(bool input) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return index[input ? 1 : 0].ordered.size();
+}
+
+void AudioDeviceRegistry::list(bool input,
+                               std::vector<AudioDeviceInfo> &devices) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    devices = index[input ? 1 : 0].ordered;
+}
+
+bool AudioDeviceRegistry::queryFormat(bool input, const std::string &id,
+                                      AudioDeviceFormat &format) const
+{
+    // 后端查询可能较慢，不持有索引锁
+    return backend && backend->queryFormat(input, id, format);
+}
+
+bool AudioDeviceRegistry::findById(bool input, const std::string &id,
+                                   AudioDeviceInfo &device) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Index &idx = index[input ? 1 : 0];
+    auto it = idx.byId.find(id);
+    if (it == idx.byId.end())
+        return false;
+    device = idx.ordered[it->second];
+    return true;
+}
+
+bool AudioDeviceRegistry::findByDescription(bool input, const std::string &desc,
+                                            AudioDeviceInfo &device) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Index &idx = index[input ? 1 : 0];
+
+    auto exact = idx.byName.find(desc);
+    if (exact != idx.byName.end()) {
+        device = idx.ordered[exact->second];
+        return true;
+    }
+
+    for (const AudioDeviceInfo &d : idx.ordered) {
+        if (d.name.find(desc) != std::string::npos) {
+            device = d;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t AudioDeviceRegistry::generation() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return changes;
+}
+
+void AudioDeviceRegistry::deviceAdded(const AudioDeviceInfo &device)
+{
+    ChangedCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Index &idx = index[device.input ? 1 : 0];
+        auto it = idx.byId.find(device.id);
+        if (it != idx.byId.end()) {
+            if (idx.ordered[it->second].name == device.name)
+                return;
+            idx.ordered[it->second].name = device.name;
+        } else {
+            idx.ordered.push_back(device);
+        }
+        idx.rebuild();
+        changes++;
+        callback = changed;
+    }
+
+    blog(LOG_INFO, "audio device added: %s (%s)", device.name.c_str(),
+         device.input ? "input" : "output");
+    if (callback)
+        callback(device, true);
+}
+
+void AudioDeviceRegistry::deviceRemoved(const std::string &id)
+{
+    ChangedCallback callback;
+    AudioDeviceInfo removed;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < 2 && !found; i++) {
+            Index &idx = index[i];
+            auto it = idx.byId.find(id);
+            if (it == idx.byId.end())
+                continue;
+
+            removed = idx.ordered[it->second];
+            idx.ordered.erase(idx.ordered.begin() + it->second);
+            idx.rebuild();
+            found = true;
+        }
+        if (!found)
+            return;
+        changes++;
+        callback = changed;
+    }
+
+    blog(LOG_INFO, "audio device removed: %s (%s)", removed.name.c_str(),
+         removed.input ? "input" : "output");
+    if (callback)
+        callback(removed, false);
+}
@@ -0,0 +1,193 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * 音频设备注册表：启动时枚举一次设备，按 ID 和描述（名称）建立索引，
+ * 之后根据热插拔通知增量更新，resetAudioInput/resetAudioOutput 不再每次调用
+ * obs_get_source_properties 重新枚举全部设备。
+ */
+struct AudioDeviceInfo
+{
+    std::string id;
+    std::string name;
+    bool        input;    // true 为采集设备（麦克风），false 为播放设备（桌面音频）
+
+    AudioDeviceInfo() : input(true) {}
+    AudioDeviceInfo(const std::string &i, const std::string &n, bool in)
+        : id(i), name(n), input(in) {}
+};
+
+// 设备的原生格式（wasapi 共享模式的混音格式，采集源按此格式送出数据），0 为未知
+struct AudioDeviceFormat
+{
+    uint32_t sampleRate;
+    uint32_t channels;
+
+    AudioDeviceFormat() : sampleRate(0), channels(0) {}
+    AudioDeviceFormat(uint32_t rate, uint32_t ch) : sampleRate(rate), channels(ch) {}
+};
+
+// 热插拔事件的接收者，回调可能在任意线程
+class AudioDeviceListener
+{
+public:
+    virtual ~AudioDeviceListener() {}
+
+    // 新设备出现，或已有设备的名称改变
+    virtual void deviceAdded(const AudioDeviceInfo &device) = 0;
+    // 设备拔出/禁用，此时可能已无法查询设备的方向
+    virtual void deviceRemoved(const std::string &id) = 0;
+};
+
+// 设备枚举和热插拔通知的来源
+class AudioDeviceBackend
+{
+public:
+    virtual ~AudioDeviceBackend() {}
+
+    virtual void enumerate(bool input, std::vector<AudioDeviceInfo> &devices) = 0;
+
+    // 开始/停止发送热插拔通知，不支持通知的后端可以忽略
+    virtual void start(AudioDeviceListener *listener) = 0;
+    virtual void stop() = 0;
+
+    // 查询原生格式，id 为 "default" 时查询默认设备，不支持时返回 false
+    virtual bool queryFormat(bool input, const std::string &id,
+                             AudioDeviceFormat &format)
+    {
+        (void)input;
+        (void)id;
+        (void)format;
+        return false;
+    }
+};
+
+/**
+ * 通过 obs 音频源的 device_id 属性枚举，与 wasapi 采集源使用的 ID 一致；
+ * Windows 下用 IMMNotificationClient 接收热插拔通知。
+ */
+class OBSAudioDeviceBackend : public AudioDeviceBackend
+{
+public:
+    OBSAudioDeviceBackend(const char *inputSourceId, const char *outputSourceId);
+    ~OBSAudioDeviceBackend();
+
+    void enumerate(bool input, std::vector<AudioDeviceInfo> &devices) override;
+    void start(AudioDeviceListener *listener) override;
+    void stop() override;
+    bool queryFormat(bool input, const std::string &id,
+                     AudioDeviceFormat &format) override;
+
+private:
+    std::string inputSourceId;
+    std::string outputSourceId;
+
+    struct Notifier;
+    Notifier *notifier;
+};
+
+/**
+ * 测试用后端：设备列表由调用者维护，addDevice/removeDevice 模拟设备插入和拔出，
+ * simulateHotplug 按固定的伪随机序列反复插拔，用于验证注册表的增量更新。
+ */
+class FakeAudioDeviceBackend : public AudioDeviceBackend
+{
+public:
+    FakeAudioDeviceBackend();
+
+    void enumerate(bool input, std::vector<AudioDeviceInfo> &devices) override;
+    void start(AudioDeviceListener *listener) override;
+    void stop() override;
+    bool queryFormat(bool input, const std::string &id,
+                     AudioDeviceFormat &format) override;
+
+    void addDevice(const AudioDeviceInfo &device);
+    void removeDevice(const std::string &id);
+    // 设置 queryFormat 返回的格式，id 可以是 "default"
+    void setFormat(const std::string &id, const AudioDeviceFormat &format);
+
+    // 执行 steps 次随机插入/拔出，seed 相同时序列相同
+    void simulateHotplug(int steps, uint32_t seed);
+
+private:
+    std::mutex                   mutex;
+    std::vector<AudioDeviceInfo> devices;
+    std::map<std::string, AudioDeviceFormat> formats;
+    AudioDeviceListener          *listener;
+    int                          nextIndex;
+};
+
+class AudioDeviceRegistry : public AudioDeviceListener
+{
+public:
+    typedef std::function<void(const AudioDeviceInfo &device, bool added)>
+            ChangedCallback;
+
+    explicit AudioDeviceRegistry(AudioDeviceBackend *backend);
+    ~AudioDeviceRegistry();
+
+    /**
+     * 完整枚举并重建索引，不注册热插拔通知，可在其它线程中调用（初始化时与
+     * obs 线程的其它步骤并行）。start 之前调用过时 start 不再枚举；start 之后为空操作
+     */
+    void enumerate();
+    // 枚举一次（没有 enumerate 过时）并开始接收热插拔通知
+    void start();
+    void stop();
+
+    // 重新完整枚举，与当前索引比较后按增删事件更新（没有热插拔通知时使用）
+    void refresh();
+
+    // 回调在热插拔通知的线程中执行
+    void setChangedCallback(const ChangedCallback &callback);
+
+    size_t count(bool input) const;
+    void list(bool input, std::vector<AudioDeviceInfo> &devices) const;
+
+    bool findById(bool input, const std::string &id, AudioDeviceInfo &device) const;
+    // 名称完全相同优先，否则按枚举顺序返回第一个名称包含 desc 的设备
+    bool findByDescription(bool input, const std::string &desc,
+                           AudioDeviceInfo &device) const;
+
+    // 每次调用都向后端查询，不缓存（用户可能在系统设置中修改设备格式）
+    bool queryFormat(bool input, const std::string &id,
+                     AudioDeviceFormat &format) const;
+
+    // 每次设备变化加一
+    uint64_t generation() const;
+
+    void deviceAdded(const AudioDeviceInfo &device) override;
+    void deviceRemoved(const std::string &id) override;
+
+private:
+    struct Index {
+        std::vector<AudioDeviceInfo>      ordered;   // 枚举顺序
+        std::map<std::string, size_t>     byId;
+        std::multimap<std::string, size_t> byName;
+
+        void rebuild();
+    };
+
+    void load(bool input, const std::vector<AudioDeviceInfo> &devices);
+
+    std::unique_ptr<AudioDeviceBackend> backend;
+
+    mutable std::mutex mutex;
+    Index              index[2];     // [0] 播放设备 [1] 采集设备
+    uint64_t           changes;
+    ChangedCallback    changed;
+    bool               enumerated;
+    bool               started;
+};
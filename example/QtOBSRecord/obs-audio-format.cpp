@@ -0,0 +1,232 @@
+﻿#include "obs-audio-format.h"
+#include "obs-thread-topology.h"
+
+// obs headers
+#include <media-io/audio-io.h>
+#include <media-io/audio-resampler.h>
+#include <util/platform.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+}
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#define AUDIO_FORMAT_PI       3.14159265358979323846
+#define AUDIO_CHUNK_PER_SEC   100      // wasapi 每 10ms 送出一块
+#define AUDIO_AAC_BITRATE     128000
+
+static const uint32_t candidateRates[] = {48000, 44100};
+
+enum speaker_layout AudioChannelsToSpeakers(uint32_t channels)
+{
+    switch (channels) {
+    case 1:  return SPEAKERS_MONO;
+    case 2:  return SPEAKERS_STEREO;
+    case 3:  return SPEAKERS_2POINT1;
+    case 4:  return SPEAKERS_4POINT0;
+    case 5:  return SPEAKERS_4POINT1;
+    case 6:  return SPEAKERS_5POINT1;
+    case 8:  return SPEAKERS_7POINT1;
+    default: return SPEAKERS_UNKNOWN;
+    }
+}
+
+void CountAudioConversions(const std::vector<AudioDeviceFormat> &devices,
+                           AudioPipelineFormat &format)
+{
+    format.rateConversions = 0;
+    format.remixes         = 0;
+    for (const AudioDeviceFormat &d : devices) {
+        if (!d.sampleRate)
+            continue;
+        if (d.sampleRate != format.sampleRate)
+            format.rateConversions++;
+        else if (AudioChannelsToSpeakers(d.channels) != format.speakers)
+            format.remixes++;
+    }
+}
+
+AudioPipelineFormat ChooseAudioPipelineFormat(
+        const std::vector<AudioDeviceFormat> &devices)
+{
+    // 未知声道数按立体声处理，多于两声道的设备在管线中下混为立体声
+    bool allMono = false;
+    for (const AudioDeviceFormat &d : devices) {
+        if (!d.sampleRate)
+            continue;
+        if (d.channels != 1) {
+            allMono = false;
+            break;
+        }
+        allMono = true;
+    }
+    uint32_t channels = allMono ? 1 : 2;
+
+    AudioPipelineFormat best;
+    uint64_t bestCost = UINT64_MAX;
+    for (uint32_t rate : candidateRates) {
+        AudioPipelineFormat f;
+        f.sampleRate = rate;
+        f.speakers   = AudioChannelsToSpeakers(channels);
+        CountAudioConversions(devices, f);
+
+        // 每个转换采样率的设备按输出采样数计一份，混音和编码再计一份
+        uint64_t cost = (uint64_t)(f.rateConversions + 1) * rate * channels;
+        if (bestCost == UINT64_MAX ||
+                f.rateConversions < best.rateConversions ||
+                (f.rateConversions == best.rateConversions && cost < bestCost)) {
+            best     = f;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 开销测量 */
+
+// 一秒的测试信号（每个声道不同频率的正弦，避免全零输入走捷径），在计时之外生成
+static void RenderTestTone(uint32_t sampleRate, uint32_t channels,
+                           bool interleaved, std::vector<float> &samples)
+{
+    samples.resize((size_t)sampleRate * channels);
+    for (uint32_t i = 0; i < sampleRate; i++) {
+        double t = (double)i / sampleRate;
+        for (uint32_t c = 0; c < channels; c++) {
+            size_t index = interleaved ? (size_t)i * channels + c
+                                       : (size_t)c * sampleRate + i;
+            samples[index] = 0.25f * (float)sin(2.0 * AUDIO_FORMAT_PI *
+                                                (440.0 + 110.0 * c) * t);
+        }
+    }
+}
+
+static double MeasureResample(const AudioDeviceFormat &device,
+                              uint32_t sampleRate,
+                              enum speaker_layout speakers, int seconds)
+{
+    uint32_t channels = std::max(device.channels, 1u);
+    struct resample_info src = {device.sampleRate, AUDIO_FORMAT_FLOAT,
+                                AudioChannelsToSpeakers(channels)};
+    struct resample_info dst = {sampleRate, AUDIO_FORMAT_FLOAT_PLANAR,
+                                speakers};
+    if (src.speakers == SPEAKERS_UNKNOWN)
+        return -1.0;
+
+    audio_resampler_t *resampler = audio_resampler_create(&dst, &src);
+    if (!resampler)
+        return -1.0;
+
+    uint32_t frames = device.sampleRate / AUDIO_CHUNK_PER_SEC;
+    std::vector<float> tone;
+    RenderTestTone(device.sampleRate, channels, true, tone);
+
+    uint64_t cpuStart = 0, cpuEnd = 0;
+    GetCurrentThreadCpuNs(cpuStart);
+    for (int chunk = 0; chunk < seconds * AUDIO_CHUNK_PER_SEC; chunk++) {
+        size_t first = (size_t)(chunk % AUDIO_CHUNK_PER_SEC) * frames;
+        const uint8_t *in[MAX_AV_PLANES] = {
+            reinterpret_cast<const uint8_t *>(&tone[first * channels])
+        };
+        uint8_t *out[MAX_AV_PLANES] = {0};
+        uint32_t outFrames = 0;
+        uint64_t offset = 0;
+        audio_resampler_resample(resampler, out, &outFrames, &offset, in,
+                                 frames);
+    }
+    GetCurrentThreadCpuNs(cpuEnd);
+
+    audio_resampler_destroy(resampler);
+    return (double)(cpuEnd - cpuStart) / 1000000.0 / seconds;
+}
+
+static double MeasureAACEncode(uint32_t sampleRate, uint32_t channels,
+                               int seconds)
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec)
+        return -1.0;
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx)
+        return -1.0;
+    ctx->sample_rate    = (int)sampleRate;
+    ctx->channels       = (int)channels;
+    ctx->channel_layout = av_get_default_channel_layout((int)channels);
+    ctx->sample_fmt     = AV_SAMPLE_FMT_FLTP;
+    ctx->bit_rate       = AUDIO_AAC_BITRATE;
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+        avcodec_free_context(&ctx);
+        return -1.0;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt = av_packet_alloc();
+    frame->format         = ctx->sample_fmt;
+    frame->channel_layout = ctx->channel_layout;
+    frame->nb_samples     = ctx->frame_size;
+    frame->sample_rate    = ctx->sample_rate;
+    double cpuMs = -1.0;
+    if (av_frame_get_buffer(frame, 0) == 0) {
+        std::vector<float> tone;
+        RenderTestTone(sampleRate, channels, false, tone);
+
+        uint32_t size = (uint32_t)ctx->frame_size;
+        int64_t total = (int64_t)sampleRate * seconds;
+        uint64_t cpuStart = 0, cpuEnd = 0;
+        GetCurrentThreadCpuNs(cpuStart);
+        for (int64_t pts = 0; pts < total; pts += size) {
+            // 与 ffmpeg_aac 相同，每帧从音频线程的缓冲拷贝到 AVFrame
+            av_frame_make_writable(frame);
+            uint32_t first = (uint32_t)(pts % sampleRate);
+            uint32_t n = std::min(size, sampleRate - first);
+            for (uint32_t c = 0; c < channels; c++) {
+                float *dst = reinterpret_cast<float *>(frame->data[c]);
+                const float *src = &tone[(size_t)c * sampleRate];
+                memcpy(dst, src + first, n * sizeof(float));
+                memcpy(dst + n, src, (size - n) * sizeof(float));
+            }
+            frame->pts = pts;
+            if (avcodec_send_frame(ctx, frame) < 0)
+                break;
+            while (avcodec_receive_packet(ctx, pkt) == 0)
+                av_packet_unref(pkt);
+        }
+        GetCurrentThreadCpuNs(cpuEnd);
+        cpuMs = (double)(cpuEnd - cpuStart) / 1000000.0 / seconds;
+    }
+
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return cpuMs;
+}
+
+bool MeasureAudioFormatCost(const std::vector<AudioDeviceFormat> &devices,
+                            uint32_t sampleRate, enum speaker_layout speakers,
+                            int seconds, AudioFormatCost &cost)
+{
+    cost = AudioFormatCost();
+    seconds = std::max(seconds, 1);
+
+    for (const AudioDeviceFormat &d : devices) {
+        if (!d.sampleRate)
+            continue;
+        double ms = MeasureResample(d, sampleRate, speakers, seconds);
+        if (ms < 0.0) {
+            blog(LOG_WARNING, "audio format: cannot resample %u Hz %u ch",
+                 d.sampleRate, d.channels);
+            return false;
+        }
+        cost.resampleMs += ms;
+    }
+
+    cost.encodeMs = MeasureAACEncode(sampleRate,
+                                     get_audio_channels(speakers), seconds);
+    return cost.encodeMs >= 0.0;
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+#include "obs-audio-device-registry.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * 音频管线格式选择。
+ *
+ * 采集源的格式（采样率、声道）与管线（obs_reset_audio）不同时，libobs 在源的
+ * 采集线程中用 swresample 转换每一块音频；采样率相同时只做交错到平面的拷贝，
+ * 开销小一个数量级。libobs 不提供选择重采样算法的接口，因此这里通过选择
+ * 管线格式来减少和减轻转换：
+ * - 声道：任一设备为多声道时用立体声，全部为单声道时用单声道；
+ * - 采样率：在 AAC 常用的 48000/44100 中选择需要转换采样率的设备最少的，
+ *   相同时选估算开销（转换的输出采样数 + 混音和 AAC 编码的采样数）较低的。
+ */
+struct AudioPipelineFormat
+{
+    uint32_t            sampleRate;
+    enum speaker_layout speakers;
+    int                 rateConversions;   // 需要转换采样率的设备数
+    int                 remixes;           // 采样率相同但需要转换声道的设备数
+
+    AudioPipelineFormat() : sampleRate(44100), speakers(SPEAKERS_STEREO),
+        rateConversions(0), remixes(0) {}
+};
+
+enum speaker_layout AudioChannelsToSpeakers(uint32_t channels);
+
+// 格式未知的设备（sampleRate 为 0）不参与选择
+AudioPipelineFormat ChooseAudioPipelineFormat(
+        const std::vector<AudioDeviceFormat> &devices);
+
+// 统计 devices 送入 format 管线时需要的转换
+void CountAudioConversions(const std::vector<AudioDeviceFormat> &devices,
+                           AudioPipelineFormat &format);
+
+struct AudioFormatCost
+{
+    double resampleMs;   // 每秒音频的 CPU 时间：各设备转换为管线格式（采集线程）
+    double encodeMs;     // 每秒音频的 CPU 时间：AAC 编码（音频线程）
+
+    AudioFormatCost() : resampleMs(0.0), encodeMs(0.0) {}
+};
+
+/**
+ * 用 libobs 的 audio_resampler（与源内部相同）把各设备格式的合成音频
+ * （wasapi 送出的 float 交错格式）转换为管线格式，并用 libavcodec 的 aac 以 128 kbps 编码，
+ * 处理 seconds 秒音频，返回每秒音频的 CPU 时间
+ */
+bool MeasureAudioFormatCost(const std::vector<AudioDeviceFormat> &devices,
+                            uint32_t sampleRate, enum speaker_layout speakers,
+                            int seconds, AudioFormatCost &cost);
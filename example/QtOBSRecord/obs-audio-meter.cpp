@@ -0,0 +1,107 @@
+﻿#include "obs-audio-meter.h"
+
+// obs headers
+#include <media-io/audio-io.h>
+#include <util/platform.h>
+
+#include <math.h>
+
+#define METER_READ_RETRIES 16
+
+AudioMeter::AudioMeter() : volmeter(nullptr), meterChannels(0), sequence(0),
+    channels(0), timestamp(0)
+{
+    for (int i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+        peak[i].store(-INFINITY, std::memory_order_relaxed);
+        magnitude[i].store(-INFINITY, std::memory_order_relaxed);
+        inputPeak[i].store(-INFINITY, std::memory_order_relaxed);
+    }
+}
+
+AudioMeter::~AudioMeter()
+{
+    detach();
+}
+
+void AudioMeter::attach(obs_source_t *source)
+{
+    if (!source) {
+        detach();
+        return;
+    }
+
+    if (!volmeter) {
+        volmeter = obs_volmeter_create(OBS_FADER_LOG);
+        obs_volmeter_add_callback(volmeter, volmeterUpdated, this);
+    }
+    // 回调中不再调用 obs_volmeter_get_nr_channels（需要加锁）
+    meterChannels = (int)audio_output_get_channels(obs_get_audio());
+    obs_volmeter_attach_source(volmeter, source);
+}
+
+void AudioMeter::detach()
+{
+    if (!volmeter)
+        return;
+
+    obs_volmeter_remove_callback(volmeter, volmeterUpdated, this);
+    obs_volmeter_destroy(volmeter);
+    volmeter = nullptr;
+
+    // 断开后清空快照，UI 显示为静音
+    float silent[MAX_AUDIO_CHANNELS];
+    for (int i = 0; i < MAX_AUDIO_CHANNELS; i++)
+        silent[i] = -INFINITY;
+    write(silent, silent, silent, 0);
+}
+
+void AudioMeter::volmeterUpdated(void *param,
+                                 const float magnitude[MAX_AUDIO_CHANNELS],
+                                 const float peak[MAX_AUDIO_CHANNELS],
+                                 const float inputPeak[MAX_AUDIO_CHANNELS])
+{
+    static_cast<AudioMeter *>(param)->write(magnitude, peak, inputPeak,
+                                            os_gettime_ns());
+}
+
+void AudioMeter::write(const float magnitude_[MAX_AUDIO_CHANNELS],
+                       const float peak_[MAX_AUDIO_CHANNELS],
+                       const float inputPeak_[MAX_AUDIO_CHANNELS],
+                       uint64_t ts)
+{
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    channels.store(ts ? meterChannels : 0, std::memory_order_relaxed);
+    for (int i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+        magnitude[i].store(magnitude_[i], std::memory_order_relaxed);
+        peak[i].store(peak_[i], std::memory_order_relaxed);
+        inputPeak[i].store(inputPeak_[i], std::memory_order_relaxed);
+    }
+    timestamp.store(ts, std::memory_order_relaxed);
+
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool AudioMeter::read(AudioMeterLevels &levels) const
+{
+    for (int retry = 0; retry < METER_READ_RETRIES; retry++) {
+        uint32_t begin = sequence.load(std::memory_order_acquire);
+        if (begin & 1)
+            continue;
+
+        levels.channels = channels.load(std::memory_order_relaxed);
+        for (int i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+            levels.magnitude[i] = magnitude[i].load(std::memory_order_relaxed);
+            levels.peak[i]      = peak[i].load(std::memory_order_relaxed);
+            levels.inputPeak[i] = inputPeak[i].load(std::memory_order_relaxed);
+        }
+        levels.timestamp = timestamp.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == begin)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * 音频电平快照，单位 dBFS（静音为 -inf，与 obs_volmeter 一致）。
+ * magnitude 即 obs_volmeter 计算的 RMS。
+ */
+struct AudioMeterLevels
+{
+    int      channels;
+    float    peak[MAX_AUDIO_CHANNELS];
+    float    magnitude[MAX_AUDIO_CHANNELS];
+    float    inputPeak[MAX_AUDIO_CHANNELS];   // 音量推子之前的峰值
+    uint64_t timestamp;                       // 写入时间 os_gettime_ns，0 表示尚无数据
+};
+
+/**
+ * 基于 obs_volmeter 的电平表。
+ *
+ * volmeter 回调在音频线程中执行，只把结果写入 seqlock 保护的快照，不分配内存、不加锁、
+ * 不向 UI 投递事件；UI 线程按自己的刷新率调用 read 读取。
+ * 只有一个写者（音频线程），读者可以有多个。
+ */
+class AudioMeter
+{
+public:
+    AudioMeter();
+    ~AudioMeter();
+
+    // 在 obs 线程中调用，source 为空时断开
+    void attach(obs_source_t *source);
+    void detach();
+
+    // 任意线程调用，写者正在写入时重试，多次重试失败返回 false（保留上一次的结果即可）
+    bool read(AudioMeterLevels &levels) const;
+
+private:
+    static void volmeterUpdated(void *param,
+                                const float magnitude[MAX_AUDIO_CHANNELS],
+                                const float peak[MAX_AUDIO_CHANNELS],
+                                const float inputPeak[MAX_AUDIO_CHANNELS]);
+
+    void write(const float magnitude[MAX_AUDIO_CHANNELS],
+               const float peak[MAX_AUDIO_CHANNELS],
+               const float inputPeak[MAX_AUDIO_CHANNELS], uint64_t ts);
+
+    obs_volmeter_t *volmeter;
+    int             meterChannels;
+
+    // 序号为奇数表示正在写入
+    std::atomic<uint32_t> sequence;
+    std::atomic<int>      channels;
+    std::atomic<float>    peak[MAX_AUDIO_CHANNELS];
+    std::atomic<float>    magnitude[MAX_AUDIO_CHANNELS];
+    std::atomic<float>    inputPeak[MAX_AUDIO_CHANNELS];
+    std::atomic<uint64_t> timestamp;
+};
@@ -0,0 +1,330 @@
+﻿#include "obs-av-sync.h"
+
+// obs headers
+#include <media-io/audio-io.h>
+#include <util/platform.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+
+#define AV_SYNC_RESET_NS         500000000LL    // 上报时间戳与时间线相差超过此值视为跳变
+#define AV_SYNC_STEP_INTERVAL_NS 100000000ULL   // 两次调整的最小间隔（时间线时间）
+#define AV_SYNC_FORCE_AFTER_NS   10000000000ULL // 超过此时长没有静音时强制调整
+
+struct av_sync_filter {
+    obs_source_t *context;
+
+    // 设置
+    bool         correct;
+    int64_t      thresholdNs;
+    int64_t      stepNs;
+    float        quietLevel;
+    uint64_t     windowFrames;
+
+    uint32_t     sampleRate;
+    size_t       channels;
+
+    // 以下只在音频线程中访问
+    bool         timelineSet;
+    uint64_t     timelineBase;    // 时间线起点 = 重置时的上报时间戳
+    uint64_t     totalFrames;     // 重置以来的采样数
+    uint64_t     frameInWindow;
+    int64_t      windowMinNs;
+    bool         hasReference;
+    int64_t      referenceNs;
+    int64_t      measuredNs;
+    bool         correcting;
+    uint64_t     lastStepNs;
+    uint64_t     lastQuietNs;
+
+    std::atomic<int64_t>  driftNs;
+    std::atomic<int64_t>  maxDriftNs;
+    std::atomic<int64_t>  correctionNs;
+    std::atomic<int64_t>  elapsedNs;
+    std::atomic<uint64_t> windows;
+    std::atomic<uint64_t> steps;
+    std::atomic<uint64_t> forcedSteps;
+    std::atomic<uint64_t> resets;
+};
+
+static inline uint64_t FramesToNs(uint64_t frames, uint32_t rate)
+{
+    return frames / rate * 1000000000ULL +
+           frames % rate * 1000000000ULL / rate;
+}
+
+static const char *av_sync_filter_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS A/V Sync";
+}
+
+static void av_sync_filter_update(void *data, obs_data_t *settings)
+{
+    struct av_sync_filter *f = static_cast<struct av_sync_filter *>(data);
+
+    f->sampleRate   = audio_output_get_sample_rate(obs_get_audio());
+    f->channels     = audio_output_get_channels(obs_get_audio());
+
+    f->correct      = obs_data_get_bool(settings, "correct");
+    f->thresholdNs  = obs_data_get_int(settings, "threshold_ms") * 1000000LL;
+    f->stepNs       = obs_data_get_int(settings, "step_us") * 1000LL;
+    f->quietLevel   = (float)pow(10.0, obs_data_get_double(settings,
+                                                           "quiet_db") / 20.0);
+    f->windowFrames = (uint64_t)obs_data_get_int(settings, "window_ms") *
+                      f->sampleRate / 1000;
+}
+
+// 在 parent 的 sync offset 上叠加 delta，保留用户自己设置的偏移
+static void av_sync_filter_adjust(struct av_sync_filter *f, int64_t delta)
+{
+    obs_source_t *parent = obs_filter_get_parent(f->context);
+    if (!parent || !delta)
+        return;
+
+    obs_source_set_sync_offset(parent,
+                               obs_source_get_sync_offset(parent) + delta);
+    f->correctionNs.fetch_add(delta, std::memory_order_relaxed);
+}
+
+static void av_sync_filter_reset(struct av_sync_filter *f, uint64_t timestamp)
+{
+    if (f->timelineSet)
+        f->resets.fetch_add(1, std::memory_order_relaxed);
+
+    // 跳变后 libobs 也会重新对齐，之前的修正不再适用；一次撤销会造成可听见的跳变，
+    // 重新测量后由修正逻辑逐步撤销（见 av_sync_filter_audio）
+
+    f->timelineSet   = true;
+    f->timelineBase  = timestamp;
+    f->totalFrames   = 0;
+    f->frameInWindow = 0;
+    f->windowMinNs   = INT64_MAX;
+    f->hasReference  = false;
+    f->referenceNs   = 0;
+    f->measuredNs    = 0;
+    f->correcting    = f->correctionNs.load(std::memory_order_relaxed) != 0;
+    f->lastStepNs    = timestamp;
+    f->lastQuietNs   = timestamp;
+
+    f->driftNs.store(0, std::memory_order_relaxed);
+    f->elapsedNs.store(0, std::memory_order_relaxed);
+}
+
+static bool av_sync_filter_quiet(struct av_sync_filter *f,
+                                 const struct obs_audio_data *audio)
+{
+    for (size_t c = 0; c < f->channels; c++) {
+        const float *s = reinterpret_cast<const float *>(audio->data[c]);
+        if (!s)
+            continue;
+        for (uint32_t i = 0; i < audio->frames; i++)
+            if (fabsf(s[i]) > f->quietLevel)
+                return false;
+    }
+    return true;
+}
+
+static void av_sync_filter_measure(struct av_sync_filter *f, int64_t offset,
+                                   uint32_t frames)
+{
+    f->windowMinNs = std::min(f->windowMinNs, offset);
+    f->frameInWindow += frames;
+    if (f->frameInWindow < f->windowFrames)
+        return;
+
+    if (!f->hasReference) {
+        f->referenceNs  = f->windowMinNs;
+        f->hasReference = true;
+    } else {
+        f->measuredNs = f->windowMinNs - f->referenceNs;
+        f->driftNs.store(f->measuredNs, std::memory_order_relaxed);
+
+        int64_t max = f->maxDriftNs.load(std::memory_order_relaxed);
+        if (llabs(f->measuredNs) > llabs(max))
+            f->maxDriftNs.store(f->measuredNs, std::memory_order_relaxed);
+    }
+
+    f->windows.fetch_add(1, std::memory_order_relaxed);
+    f->frameInWindow = 0;
+    f->windowMinNs   = INT64_MAX;
+}
+
+static struct obs_audio_data *av_sync_filter_audio(void *data,
+                                                   struct obs_audio_data *audio)
+{
+    struct av_sync_filter *f = static_cast<struct av_sync_filter *>(data);
+    if (!audio->frames || !f->sampleRate)
+        return audio;
+
+    uint64_t timeline = f->timelineSet
+            ? f->timelineBase + FramesToNs(f->totalFrames, f->sampleRate)
+            : 0;
+    int64_t offset = (int64_t)(audio->timestamp - timeline);
+    if (!f->timelineSet || llabs(offset) > AV_SYNC_RESET_NS) {
+        av_sync_filter_reset(f, audio->timestamp);
+        timeline = audio->timestamp;
+        offset   = 0;
+    }
+
+    av_sync_filter_measure(f, offset, audio->frames);
+
+    // 修正时输出连续的时间线，偏差由 sync offset 修正；只测量时保留设备时间戳
+    if (f->correct)
+        audio->timestamp = timeline;
+    f->totalFrames += audio->frames;
+    f->elapsedNs.store((int64_t)(timeline - f->timelineBase),
+                       std::memory_order_relaxed);
+
+    // 只测量时目标为 0，切换到只测量前留下的修正同样逐步撤销
+    int64_t correction = f->correctionNs.load(std::memory_order_relaxed);
+    if (f->correct ? f->hasReference : correction != 0) {
+        int64_t target   = f->correct ? f->measuredNs : 0;
+        int64_t residual = target - correction;
+        if (!f->correct || llabs(residual) > f->thresholdNs)
+            f->correcting = true;
+        else if (llabs(residual) <= f->stepNs / 2)
+            f->correcting = false;
+
+        bool quiet = av_sync_filter_quiet(f, audio);
+        if (quiet)
+            f->lastQuietNs = timeline;
+
+        if (f->correcting &&
+                timeline - f->lastStepNs >= AV_SYNC_STEP_INTERVAL_NS) {
+            bool forced = !quiet &&
+                          timeline - f->lastQuietNs >= AV_SYNC_FORCE_AFTER_NS;
+            if (quiet || forced) {
+                int64_t limit = forced ? f->stepNs / 4 : f->stepNs;
+                int64_t step = std::max(-limit, std::min(limit, residual));
+                av_sync_filter_adjust(f, step);
+                f->lastStepNs = timeline;
+                f->steps.fetch_add(1, std::memory_order_relaxed);
+                if (forced)
+                    f->forcedSteps.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    return audio;
+}
+
+static void av_sync_filter_proc_get_stats(void *data, calldata_t *cd)
+{
+    struct av_sync_filter *f = static_cast<struct av_sync_filter *>(data);
+    calldata_set_int(cd, "drift_ns", (long long)f->driftNs.load());
+    calldata_set_int(cd, "max_drift_ns", (long long)f->maxDriftNs.load());
+    calldata_set_int(cd, "correction_ns", (long long)f->correctionNs.load());
+    calldata_set_int(cd, "elapsed_ns", (long long)f->elapsedNs.load());
+    calldata_set_int(cd, "windows", (long long)f->windows.load());
+    calldata_set_int(cd, "steps", (long long)f->steps.load());
+    calldata_set_int(cd, "forced_steps", (long long)f->forcedSteps.load());
+    calldata_set_int(cd, "resets", (long long)f->resets.load());
+}
+
+static void *av_sync_filter_create(obs_data_t *settings, obs_source_t *context)
+{
+    struct av_sync_filter *f = new av_sync_filter();
+    f->context      = context;
+    f->timelineSet  = false;
+    f->driftNs      = 0;
+    f->maxDriftNs   = 0;
+    f->correctionNs = 0;
+    f->elapsedNs    = 0;
+    f->windows      = 0;
+    f->steps        = 0;
+    f->forcedSteps  = 0;
+    f->resets       = 0;
+
+    av_sync_filter_update(f, settings);
+
+    proc_handler_t *ph = obs_source_get_proc_handler(context);
+    proc_handler_add(ph, "void get_stats(out int drift_ns, out int max_drift_ns, "
+                         "out int correction_ns, out int elapsed_ns, "
+                         "out int windows, out int steps, "
+                         "out int forced_steps, out int resets)",
+                     av_sync_filter_proc_get_stats, f);
+    return f;
+}
+
+static void av_sync_filter_destroy(void *data)
+{
+    delete static_cast<struct av_sync_filter *>(data);
+}
+
+// 移除滤镜后时间戳恢复为设备上报值，撤销本滤镜的修正
+static void av_sync_filter_remove(void *data, obs_source_t *parent)
+{
+    struct av_sync_filter *f = static_cast<struct av_sync_filter *>(data);
+    int64_t correction = f->correctionNs.exchange(0);
+    if (parent && correction)
+        obs_source_set_sync_offset(parent,
+                                   obs_source_get_sync_offset(parent) -
+                                   correction);
+}
+
+static void av_sync_filter_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_bool(settings, "correct", false);
+    obs_data_set_default_int(settings, "threshold_ms", 20);
+    obs_data_set_default_int(settings, "step_us", 1000);
+    obs_data_set_default_double(settings, "quiet_db", -50.0);
+    obs_data_set_default_int(settings, "window_ms", 1000);
+}
+
+static obs_properties_t *av_sync_filter_properties(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+
+    obs_properties_t *props = obs_properties_create();
+    obs_properties_add_bool(props, "correct", "Correct drift");
+    obs_properties_add_int(props, "threshold_ms", "Threshold (ms)", 1, 500, 1);
+    obs_properties_add_int(props, "step_us", "Max step (us)", 100, 20000, 100);
+    obs_properties_add_float_slider(props, "quiet_db", "Quiet level (dB)",
+                                    -90.0, -20.0, 1.0);
+    obs_properties_add_int(props, "window_ms", "Window (ms)", 200, 10000, 100);
+    return props;
+}
+
+void RegisterAVSyncFilter()
+{
+    struct obs_source_info info = {};
+    info.id             = AV_SYNC_FILTER_ID;
+    info.type           = OBS_SOURCE_TYPE_FILTER;
+    info.output_flags   = OBS_SOURCE_AUDIO;
+    info.get_name       = av_sync_filter_getname;
+    info.create         = av_sync_filter_create;
+    info.destroy        = av_sync_filter_destroy;
+    info.update         = av_sync_filter_update;
+    info.filter_audio   = av_sync_filter_audio;
+    info.filter_remove  = av_sync_filter_remove;
+    info.get_defaults   = av_sync_filter_defaults;
+    info.get_properties = av_sync_filter_properties;
+    obs_register_source(&info);
+}
+
+bool GetAVSyncStats(obs_source_t *syncFilter, AVSyncStats &stats)
+{
+    if (!syncFilter)
+        return false;
+
+    calldata_t cd = {0};
+    bool ok = proc_handler_call(obs_source_get_proc_handler(syncFilter),
+                                "get_stats", &cd);
+    if (ok) {
+        stats.driftNs      = (int64_t)calldata_int(&cd, "drift_ns");
+        stats.maxDriftNs   = (int64_t)calldata_int(&cd, "max_drift_ns");
+        stats.correctionNs = (int64_t)calldata_int(&cd, "correction_ns");
+        stats.elapsedNs    = (int64_t)calldata_int(&cd, "elapsed_ns");
+        stats.windows      = (uint64_t)calldata_int(&cd, "windows");
+        stats.steps        = (uint64_t)calldata_int(&cd, "steps");
+        stats.forcedSteps  = (uint64_t)calldata_int(&cd, "forced_steps");
+        stats.resets       = (uint64_t)calldata_int(&cd, "resets");
+    }
+    calldata_free(&cd);
+    return ok;
+}
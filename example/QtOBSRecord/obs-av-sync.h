@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+
+#include <stdint.h>
+
+/**
+ * 音画同步漂移监测与修正滤镜，加在每个音频设备源上。
+ *
+ * 视频按系统时钟（os_gettime_ns）出帧，音频设备按自己的采样时钟出数据，
+ * 两者的频率差使音频逐渐偏离画面。libobs 在上报时间戳与按采样数推算的时间戳
+ * 相差 70ms 以内时使用后者，超过后跳回上报值，长时间录制中表现为周期性的
+ * 爆音和最多 70ms 的不同步。
+ *
+ * 本滤镜：
+ * - 每个窗口取（上报时间戳 - 按采样数推算的时间线）的最小值作为该窗口的偏差，
+ *   与第一个窗口的差即漂移（最小值可滤掉调度延迟造成的抖动）；
+ * - 修正时输出的时间戳改为连续的时间线，libobs 不再跳变；漂移超过阈值后逐步调整
+ *   音频源的 sync offset（每步不超过 step_us），调整只在静音的音频块上进行，
+ *   时间线的不连续落在静音中，听不到；长时间没有静音时以四分之一步长强制调整；
+ * - 只测量时原样输出设备时间戳，由 libobs 自己对齐，已做的修正按同样的步长撤销；
+ * - 上报时间戳跳变（设备切换、滤镜被禁用后恢复等）时重新测量，之前的修正
+ *   同样逐步撤销，不一次跳回。
+ *
+ * 设置：correct（默认 false，只测量）、threshold_ms、step_us、quiet_db、window_ms
+ */
+#define AV_SYNC_FILTER_ID "qtobs_av_sync_filter"
+
+void RegisterAVSyncFilter();
+
+struct AVSyncStats
+{
+    int64_t  driftNs;         // 当前漂移，正值为音频设备慢于视频时钟（音频超前于画面）
+    int64_t  maxDriftNs;      // 绝对值最大的漂移
+    int64_t  correctionNs;    // 本滤镜叠加在 sync offset 上的修正
+    int64_t  elapsedNs;       // 本次测量的时长
+    uint64_t windows;
+    uint64_t steps;
+    uint64_t forcedSteps;     // 非静音时强制调整的次数
+    uint64_t resets;
+
+    AVSyncStats() : driftNs(0), maxDriftNs(0), correctionNs(0), elapsedNs(0),
+        windows(0), steps(0), forcedSteps(0), resets(0) {}
+
+    // 漂移速率（百万分之一），即设备时钟与视频时钟的频率差
+    double driftPpm() const
+    {
+        return elapsedNs > 0 ? (double)driftNs * 1e6 / (double)elapsedNs : 0.0;
+    }
+};
+
+bool GetAVSyncStats(obs_source_t *syncFilter, AVSyncStats &stats);
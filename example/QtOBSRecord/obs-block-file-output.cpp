@@ -0,0 +1,263 @@
+﻿#include "obs-block-file-output.h"
+#include "obs-block-writer.h"
+#include "obs-fmp4-mux.h"
+
+// obs headers
+#include <util/platform.h>
+
+#include <string.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct block_file_output
+{
+    obs_output_t    *output;
+    BlockFileWriter writer;
+
+    // stop 在调用线程、encoded_packet 在编码线程，mutex 保护以下封装状态和
+    // writer（单生产者）的写入/关闭
+    std::mutex           mutex;
+
+    FMP4Track            video;
+    FMP4Track            audio;
+    std::vector<uint8_t> buf;
+    int64_t              frameDuration;  // video timescale
+    int64_t              fragStartDts;
+    double               fragTarget;     // 秒
+    uint32_t             fragmentSeq;
+    bool                 gotKeyframe;
+    bool                 active;
+};
+
+static bool FlushFragment(block_file_output *out)
+{
+    if (out->video.samples.empty() && out->audio.samples.empty())
+        return true;
+
+    out->buf.clear();
+    BuildFMP4Fragment(++out->fragmentSeq, out->video, out->audio, out->buf);
+    out->video.clear();
+    out->audio.clear();
+    return out->writer.write(out->buf.data(), out->buf.size());
+}
+
+/* ------------------------------------------------------------------------- */
+/* obs_output_info */
+
+static const char *block_file_output_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS Block File Output";
+}
+
+static void block_file_output_get_writer(void *data, calldata_t *cd)
+{
+    block_file_output *out = static_cast<block_file_output *>(data);
+    calldata_set_ptr(cd, "writer", &out->writer);
+}
+
+static void *block_file_output_create(obs_data_t *settings, obs_output_t *output)
+{
+    UNUSED_PARAMETER(settings);
+
+    block_file_output *out = new block_file_output();
+    out->output = output;
+    out->active = false;
+
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    proc_handler_add(ph, "void get_writer(out ptr writer)",
+                     block_file_output_get_writer, out);
+    return out;
+}
+
+static void block_file_output_destroy(void *data)
+{
+    delete static_cast<block_file_output *>(data);
+}
+
+static uint64_t block_file_output_total_bytes(void *data)
+{
+    block_file_output *out = static_cast<block_file_output *>(data);
+    BlockWriterStats s;
+    out->writer.getStats(s);
+    return s.bytes;
+}
+
+static void block_file_output_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_int(settings, "fragment_duration_ms", 1000);
+    obs_data_set_default_int(settings, "block_size_kb", 1024);
+    obs_data_set_default_int(settings, "queue_depth", 8);
+    obs_data_set_default_bool(settings, "direct_io", false);
+    obs_data_set_default_int(settings, "prealloc_mb", 64);
+}
+
+static bool block_file_output_start(void *data)
+{
+    block_file_output *out = static_cast<block_file_output *>(data);
+
+    if (!obs_output_can_begin_data_capture(out->output, 0))
+        return false;
+    if (!obs_output_initialize_encoders(out->output, 0))
+        return false;
+
+    obs_data_t *settings = obs_output_get_settings(out->output);
+    std::string path = obs_data_get_string(settings, "path");
+    out->fragTarget  = obs_data_get_int(settings, "fragment_duration_ms") /
+                       1000.0;
+
+    BlockWriterConfig config;
+    config.blockSize    = (uint32_t)obs_data_get_int(settings, "block_size_kb") *
+                          1024;
+    config.queueDepth   = (uint32_t)obs_data_get_int(settings, "queue_depth");
+    config.directIO     = obs_data_get_bool(settings, "direct_io");
+    config.preallocStep = (uint64_t)obs_data_get_int(settings, "prealloc_mb") *
+                          1024 * 1024;
+    obs_data_release(settings);
+
+    if (path.empty()) {
+        blog(LOG_ERROR, "block file output: empty path");
+        return false;
+    }
+
+    obs_encoder_t *venc = obs_output_get_video_encoder(out->output);
+    obs_encoder_t *aenc = obs_output_get_audio_encoder(out->output, 0);
+    const struct video_output_info *voi =
+            video_output_get_info(obs_encoder_video(venc));
+    out->frameDuration = (int64_t)FMP4_VIDEO_TIMESCALE * voi->fps_den /
+                         voi->fps_num;
+
+    out->video.trackId   = FMP4_VIDEO_TRACK_ID;
+    out->video.timescale = FMP4_VIDEO_TIMESCALE;
+    out->audio.trackId   = FMP4_AUDIO_TRACK_ID;
+    out->audio.timescale = obs_encoder_get_sample_rate(aenc);
+    out->video.clear();
+    out->audio.clear();
+    out->fragmentSeq = 0;
+    out->gotKeyframe = false;
+
+    std::unique_lock<std::mutex> lock(out->mutex);
+    out->buf.clear();
+    if (!BuildFMP4InitSegment(out->output, out->buf))
+        return false;
+    if (!out->writer.open(path, config))
+        return false;
+    if (!out->writer.write(out->buf.data(), out->buf.size())) {
+        out->writer.close();
+        return false;
+    }
+
+    out->active = true;
+    lock.unlock();
+    obs_output_begin_data_capture(out->output, 0);
+    return true;
+}
+
+static void block_file_output_stop(void *data, uint64_t ts)
+{
+    UNUSED_PARAMETER(ts);
+    block_file_output *out = static_cast<block_file_output *>(data);
+
+    std::unique_lock<std::mutex> lock(out->mutex);
+    if (out->active) {
+        FlushFragment(out);
+        out->active = false;
+
+        uint64_t start = os_gettime_ns();
+        bool success = out->writer.close();
+
+        BlockWriterStats s;
+        out->writer.getStats(s);
+        blog(LOG_INFO, "block file output: stopped%s, %llu MB, %llu writes, "
+                       "latency p50 %llu us, p99 %llu us, max %llu us, "
+                       "stalls %llu, close %llu ms",
+             success ? "" : " with errors",
+             (unsigned long long)(s.bytes / (1024 * 1024)),
+             (unsigned long long)s.blocks,
+             (unsigned long long)s.percentileUs(50.0),
+             (unsigned long long)s.percentileUs(99.0),
+             (unsigned long long)s.latencyMaxUs,
+             (unsigned long long)s.stalls,
+             (unsigned long long)((os_gettime_ns() - start) / 1000000));
+    }
+    lock.unlock();
+
+    obs_output_end_data_capture(out->output);
+}
+
+static void block_file_output_packet(void *data, struct encoder_packet *packet)
+{
+    block_file_output *out = static_cast<block_file_output *>(data);
+    std::unique_lock<std::mutex> lock(out->mutex);
+    if (!out->active)
+        return;
+
+    if (packet->type == OBS_ENCODER_AUDIO) {
+        if (out->gotKeyframe)
+            AppendFMP4AudioSample(out->audio, packet);
+        return;
+    }
+
+    int64_t dts = ToTimescale(packet->dts, packet->timebase_num,
+                              packet->timebase_den, FMP4_VIDEO_TIMESCALE);
+
+    if (!out->gotKeyframe) {
+        if (!packet->keyframe)
+            return;
+        out->gotKeyframe  = true;
+        out->fragStartDts = dts;
+    } else if (double(dts + out->frameDuration - out->fragStartDts) /
+               FMP4_VIDEO_TIMESCALE > out->fragTarget) {
+        // 片段不要求从关键帧开始，按时长切分即可
+        if (!FlushFragment(out)) {
+            out->active = false;
+            lock.unlock();
+            obs_output_signal_stop(out->output, OBS_OUTPUT_NO_SPACE);
+            return;
+        }
+        out->fragStartDts = dts;
+    }
+
+    AppendFMP4VideoSample(out->video, packet, dts, out->frameDuration);
+}
+
+void RegisterBlockFileOutput()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+
+    struct obs_output_info info = {};
+    info.id                   = BLOCK_FILE_OUTPUT_ID;
+    info.flags                = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED;
+    info.encoded_video_codecs = "h264";
+    info.encoded_audio_codecs = "aac";
+    info.get_name             = block_file_output_getname;
+    info.create               = block_file_output_create;
+    info.destroy              = block_file_output_destroy;
+    info.start                = block_file_output_start;
+    info.stop                 = block_file_output_stop;
+    info.encoded_packet       = block_file_output_packet;
+    info.get_defaults         = block_file_output_defaults;
+    info.get_total_bytes      = block_file_output_total_bytes;
+    obs_register_output(&info);
+
+    registered = true;
+}
+
+BlockFileWriter *GetBlockFileWriter(obs_output_t *output)
+{
+    const char *id = obs_output_get_id(output);
+    if (!id || strcmp(id, BLOCK_FILE_OUTPUT_ID) != 0)
+        return nullptr;
+
+    calldata_t cd = {0};
+    BlockFileWriter *writer = nullptr;
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    if (proc_handler_call(ph, "get_writer", &cd))
+        writer = static_cast<BlockFileWriter *>(calldata_ptr(&cd, "writer"));
+    calldata_free(&cd);
+    return writer;
+}
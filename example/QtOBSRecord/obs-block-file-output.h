@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <obs.h>
+
+class BlockFileWriter;
+
+/**
+ * 录制输出：h264/aac 数据包封装为 fragmented MP4，通过 BlockFileWriter 按大块
+ * 异步写盘（io_uring 或写线程，可选 O_DIRECT 和预分配）。多路同时录制到一块磁盘时，
+ * 避免 muxer 的小块写入和频繁的元数据更新导致写延迟抖动。
+ *
+ * 设置项：
+ *   path                 输出文件
+ *   fragment_duration_ms 片段时长，一个片段编码完成后整体写入
+ *   block_size_kb        每次提交的块大小
+ *   queue_depth          同时在途的写请求数
+ *   direct_io            绕过页缓存
+ *   prealloc_mb          预分配的增长步长，0 为不预分配
+ */
+#define BLOCK_FILE_OUTPUT_ID "qtobs_block_file_output"
+
+// 需要在 obs_load_all_modules 之后调用，重复调用无副作用
+void RegisterBlockFileOutput();
+
+// 返回输出内部的写入器，生命周期与输出相同；getStats 可在任意线程调用
+BlockFileWriter *GetBlockFileWriter(obs_output_t *output);
@@ -0,0 +1,615 @@
+﻿#include "obs-block-writer.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <string.h>
+#include <errno.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(HAVE_LIBURING)
+#include <liburing.h>
+#endif
+
+#define MAX_QUEUE_DEPTH 256
+
+static uint64_t AlignUp(uint64_t value, uint64_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+static uint8_t *AlignedAlloc(size_t size)
+{
+#if defined(_WIN32)
+    return static_cast<uint8_t *>(_aligned_malloc(size, BLOCK_WRITER_ALIGNMENT));
+#else
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, BLOCK_WRITER_ALIGNMENT, size) != 0)
+        return nullptr;
+    return static_cast<uint8_t *>(ptr);
+#endif
+}
+
+static void AlignedFree(uint8_t *ptr)
+{
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+void BlockWriterStats::merge(const BlockWriterStats &other)
+{
+    bytes        += other.bytes;
+    blocks       += other.blocks;
+    preallocs    += other.preallocs;
+    stalls       += other.stalls;
+    stallTotalNs += other.stallTotalNs;
+    if (other.latencyMaxUs > latencyMaxUs)
+        latencyMaxUs = other.latencyMaxUs;
+    for (int i = 0; i < BLOCK_WRITER_LATENCY_BUCKETS; i++)
+        latency[i] += other.latency[i];
+}
+
+uint64_t BlockWriterStats::percentileUs(double p) const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < BLOCK_WRITER_LATENCY_BUCKETS; i++)
+        total += latency[i];
+    if (!total)
+        return 0;
+
+    uint64_t target = (uint64_t)((double)total * p / 100.0 + 0.5);
+    if (!target)
+        target = 1;
+
+    uint64_t count = 0;
+    for (int i = 0; i < BLOCK_WRITER_LATENCY_BUCKETS; i++) {
+        count += latency[i];
+        if (count >= target) {
+            uint64_t upper = 2ULL << i;
+            return upper < latencyMaxUs ? upper : latencyMaxUs;
+        }
+    }
+    return latencyMaxUs;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 平台相关的文件操作 */
+
+// 短写时已写入的部分向下对齐到 align（directIO 为 BLOCK_WRITER_ALIGNMENT），
+// 剩余部分的地址、偏移和长度仍然对齐，重复写入的数据相同
+static size_t AlignWritten(size_t written, size_t size, size_t align)
+{
+    return written < size ? written / align * align : written;
+}
+
+#if defined(_WIN32)
+
+static bool WriteAt(void *handle, const uint8_t *data, size_t size,
+                    uint64_t offset, size_t align)
+{
+    while (size) {
+        OVERLAPPED ov = {};
+        ov.Offset     = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+        DWORD written = 0;
+        if (!WriteFile((HANDLE)handle, data, chunk, &written, &ov))
+            return false;
+        written = (DWORD)AlignWritten(written, chunk, align);
+        if (!written)
+            return false;
+        data   += written;
+        size   -= written;
+        offset += written;
+    }
+    return true;
+}
+
+#else
+
+static bool WriteAt(int fd, const uint8_t *data, size_t size, uint64_t offset,
+                    size_t align)
+{
+    while (size) {
+        ssize_t written = pwrite(fd, data, size, (off_t)offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written > 0)
+            written = (ssize_t)AlignWritten((size_t)written, size, align);
+        if (written <= 0)
+            return false;
+        data   += written;
+        size   -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return true;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+BlockFileWriter::BlockFileWriter() :
+    opened(false),
+    failed(false),
+    current(0),
+    used(0),
+    offset(0),
+    allocated(0),
+    written(0),
+#if defined(_WIN32)
+    handle(nullptr),
+#else
+    fd(-1),
+#endif
+#if defined(HAVE_LIBURING)
+    ring(nullptr),
+#endif
+    stopping(false)
+{
+}
+
+BlockFileWriter::~BlockFileWriter()
+{
+    close();
+}
+
+const char *BlockFileWriter::backend() const
+{
+#if defined(HAVE_LIBURING)
+    if (ring)
+        return "io_uring";
+#endif
+    return "thread";
+}
+
+uint32_t BlockFileWriter::ioDepth() const
+{
+#if defined(HAVE_LIBURING)
+    if (ring)
+        return config.queueDepth;
+#endif
+    return 1;
+}
+
+bool BlockFileWriter::open(const std::string &path_,
+                           const BlockWriterConfig &config_)
+{
+    close();
+
+    config = config_;
+    if (!config.blockSize)
+        config.blockSize = BLOCK_WRITER_ALIGNMENT;
+    config.blockSize = (uint32_t)AlignUp(config.blockSize, BLOCK_WRITER_ALIGNMENT);
+    if (config.queueDepth < 1)
+        config.queueDepth = 1;
+    if (config.queueDepth > MAX_QUEUE_DEPTH)
+        config.queueDepth = MAX_QUEUE_DEPTH;
+    if (config.preallocStep)
+        config.preallocStep = AlignUp(config.preallocStep, config.blockSize);
+    path = path_;
+
+#if defined(_WIN32)
+    wchar_t *wpath = nullptr;
+    os_utf8_to_wcs_ptr(path.c_str(), 0, &wpath);
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (config.directIO)
+        flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+    HANDLE h = CreateFileW(wpath, GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           CREATE_ALWAYS, flags, nullptr);
+    bfree(wpath);
+    if (h == INVALID_HANDLE_VALUE) {
+        blog(LOG_ERROR, "block writer: open '%s' failed: %lu", path.c_str(),
+             GetLastError());
+        return false;
+    }
+    handle = h;
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#if defined(O_DIRECT)
+    if (config.directIO) {
+        fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        // tmpfs 等文件系统不支持 O_DIRECT，退回页缓存
+        if (fd < 0 && errno == EINVAL) {
+            blog(LOG_WARNING, "block writer: O_DIRECT not supported for '%s'",
+                 path.c_str());
+            config.directIO = false;
+        }
+    }
+#else
+    config.directIO = false;
+#endif
+    if (fd < 0)
+        fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        blog(LOG_ERROR, "block writer: open '%s' failed: %s", path.c_str(),
+             strerror(errno));
+        return false;
+    }
+#endif
+
+    blocks.assign(config.queueDepth, Block());
+    for (Block &block : blocks) {
+        block.data = AlignedAlloc(config.blockSize);
+        if (!block.data) {
+            blog(LOG_ERROR, "block writer: out of memory");
+            closeFile();
+            return false;
+        }
+    }
+
+    current   = 0;
+    used      = 0;
+    offset    = 0;
+    allocated = 0;
+    failed    = false;
+    written   = 0;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats = BlockWriterStats();
+    }
+
+#if defined(HAVE_LIBURING)
+    ring = new struct io_uring;
+    int ret = io_uring_queue_init(config.queueDepth, ring, 0);
+    if (ret < 0) {
+        blog(LOG_WARNING, "block writer: io_uring unavailable (%s), "
+                          "using writer thread", strerror(-ret));
+        delete ring;
+        ring = nullptr;
+    }
+    if (!ring)
+#endif
+    {
+        stopping = false;
+        writer = std::thread(&BlockFileWriter::writerLoop, this);
+    }
+
+    opened = true;
+    blog(LOG_INFO, "block writer: '%s' via %s, block %u KB, queue depth %u "
+                   "(%u buffers), direct io %d, prealloc step %llu MB",
+         path.c_str(), backend(), config.blockSize / 1024, ioDepth(),
+         config.queueDepth, (int)config.directIO,
+         (unsigned long long)(config.preallocStep / (1024 * 1024)));
+    return true;
+}
+
+bool BlockFileWriter::write(const void *data, size_t size)
+{
+    if (!opened || failed)
+        return false;
+
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    while (size) {
+        Block &block = blocks[current];
+        if (!used && !waitBlock(block, true))
+            return false;
+
+        size_t n = config.blockSize - used;
+        if (n > size)
+            n = size;
+        memcpy(block.data + used, src, n);
+        used += n;
+        src  += n;
+        size -= n;
+        written.fetch_add(n, std::memory_order_relaxed);
+
+        if (used == config.blockSize) {
+            if (!submit(block, used))
+                return false;
+            current = (current + 1) % blocks.size();
+            used    = 0;
+        }
+    }
+    return !failed;
+}
+
+bool BlockFileWriter::submit(Block &block, size_t size)
+{
+    if (!preallocate(offset + size))
+        return false;
+
+    block.size     = size;
+    block.offset   = offset;
+    block.submitNs = os_gettime_ns();
+    block.inFlight = true;
+    offset += size;
+
+#if defined(HAVE_LIBURING)
+    if (ring) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+        while (!sqe) {
+            if (!reapOne(true))
+                return false;
+            sqe = io_uring_get_sqe(ring);
+        }
+        io_uring_prep_write(sqe, fd, block.data, (unsigned)size, block.offset);
+        io_uring_sqe_set_data(sqe, &block);
+        int ret = io_uring_submit(ring);
+        if (ret < 0) {
+            blog(LOG_ERROR, "block writer: io_uring_submit failed: %s",
+                 strerror(-ret));
+            block.inFlight = false;
+            failed = true;
+            return false;
+        }
+
+        // 顺便收割已完成的请求，避免完成队列堆积
+        while (reapOne(false)) {}
+        return true;
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(&block);
+    }
+    queueCond.notify_all();
+    return true;
+}
+
+bool BlockFileWriter::waitBlock(Block &block, bool countStall)
+{
+    uint64_t start = os_gettime_ns();
+    bool waited = false;
+
+#if defined(HAVE_LIBURING)
+    if (ring) {
+        while (block.inFlight) {
+            waited = true;
+            if (!reapOne(true)) {
+                failed = true;
+                return false;
+            }
+        }
+    } else
+#endif
+    {
+        // inFlight 由写线程在 queueMutex 下清除
+        std::unique_lock<std::mutex> lock(queueMutex);
+        waited = block.inFlight;
+        queueCond.wait(lock, [&block] () { return !block.inFlight; });
+    }
+
+    if (waited && countStall) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.stalls++;
+        stats.stallTotalNs += os_gettime_ns() - start;
+    }
+    return !failed;
+}
+
+bool BlockFileWriter::reapOne(bool wait)
+{
+#if defined(HAVE_LIBURING)
+    struct io_uring_cqe *cqe = nullptr;
+    int ret;
+    do {
+        ret = wait ? io_uring_wait_cqe(ring, &cqe)
+                   : io_uring_peek_cqe(ring, &cqe);
+    } while (ret == -EINTR);
+    if (ret < 0 || !cqe)
+        return false;
+
+    Block *block = static_cast<Block *>(io_uring_cqe_get_data(cqe));
+    int64_t result = cqe->res;
+    io_uring_cqe_seen(ring, cqe);
+
+    completed(*block, result);
+    block->inFlight = false;
+    return true;
+#else
+    UNUSED_PARAMETER(wait);
+    return false;
+#endif
+}
+
+void BlockFileWriter::completed(Block &block, int64_t result)
+{
+    uint64_t latencyUs = (os_gettime_ns() - block.submitNs) / 1000;
+
+    // 短写：剩余部分从对齐的位置同步补写
+    if (result >= 0 && (size_t)result < block.size) {
+        size_t align = config.directIO ? BLOCK_WRITER_ALIGNMENT : 1;
+        size_t done = (size_t)result / align * align;
+#if defined(_WIN32)
+        bool ok = WriteAt(handle, block.data + done, block.size - done,
+                          block.offset + done, align);
+#else
+        bool ok = WriteAt(fd, block.data + done, block.size - done,
+                          block.offset + done, align);
+#endif
+        result = ok ? (int64_t)block.size : -EIO;
+    }
+    if (result < 0) {
+        blog(LOG_ERROR, "block writer: write '%s' at %llu failed: %s",
+             path.c_str(), (unsigned long long)block.offset,
+             strerror((int)-result));
+        failed = true;
+        return;
+    }
+
+    int bucket = 0;
+    while (bucket < BLOCK_WRITER_LATENCY_BUCKETS - 1 && (latencyUs >> (bucket + 1)))
+        bucket++;
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.blocks++;
+    stats.latency[bucket]++;
+    if (latencyUs > stats.latencyMaxUs)
+        stats.latencyMaxUs = latencyUs;
+}
+
+void BlockFileWriter::writerLoop()
+{
+    os_set_thread_name("block-writer");
+
+    for (;;) {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCond.wait(lock, [this] () {
+                return stopping || !queue.empty();
+            });
+            if (queue.empty())
+                break;
+            block = queue.front();
+            queue.pop_front();
+        }
+
+        size_t align = config.directIO ? BLOCK_WRITER_ALIGNMENT : 1;
+#if defined(_WIN32)
+        bool ok = WriteAt(handle, block->data, block->size, block->offset,
+                          align);
+#else
+        bool ok = WriteAt(fd, block->data, block->size, block->offset, align);
+#endif
+        completed(*block, ok ? (int64_t)block->size : -EIO);
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            block->inFlight = false;
+        }
+        queueCond.notify_all();
+    }
+}
+
+bool BlockFileWriter::preallocate(uint64_t end)
+{
+    if (!config.preallocStep || end <= allocated)
+        return true;
+
+    uint64_t target = AlignUp(end, config.preallocStep);
+
+#if defined(_WIN32)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)target;
+    if (!SetFileInformationByHandle((HANDLE)handle, FileAllocationInfo, &info,
+                                    sizeof(info))) {
+        blog(LOG_WARNING, "block writer: preallocate failed: %lu, disabled",
+             GetLastError());
+        config.preallocStep = 0;
+        return true;
+    }
+#elif defined(__linux__)
+    // 模式 0 会同时扩展文件大小，之后的写入不再更新 i_size，close 时截断
+    if (fallocate(fd, 0, (off_t)allocated, (off_t)(target - allocated)) != 0) {
+        if (errno == ENOSPC) {
+            blog(LOG_ERROR, "block writer: no space left for '%s'", path.c_str());
+            failed = true;
+            return false;
+        }
+        blog(LOG_WARNING, "block writer: fallocate failed: %s, disabled",
+             strerror(errno));
+        config.preallocStep = 0;
+        return true;
+    }
+#else
+    config.preallocStep = 0;
+    return true;
+#endif
+
+    allocated = target;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.preallocs++;
+    return true;
+}
+
+bool BlockFileWriter::truncate(uint64_t size)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)size;
+    return SetFilePointerEx((HANDLE)handle, pos, nullptr, FILE_BEGIN) &&
+           SetEndOfFile((HANDLE)handle);
+#else
+    return ftruncate(fd, (off_t)size) == 0;
+#endif
+}
+
+void BlockFileWriter::closeFile()
+{
+#if defined(_WIN32)
+    if (handle)
+        CloseHandle((HANDLE)handle);
+    handle = nullptr;
+#else
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+#endif
+
+    for (Block &block : blocks)
+        AlignedFree(block.data);
+    blocks.clear();
+}
+
+bool BlockFileWriter::close()
+{
+    if (!opened)
+        return true;
+
+    uint64_t size = offset + used;
+    if (used && !failed) {
+        Block &block = blocks[current];
+        size_t length = used;
+        // directIO 要求长度对齐，补零后写入，下面再截断到实际大小
+        if (config.directIO) {
+            length = (size_t)AlignUp(used, BLOCK_WRITER_ALIGNMENT);
+            memset(block.data + used, 0, length - used);
+        }
+        submit(block, length);
+    }
+
+    for (Block &block : blocks)
+        waitBlock(block, false);
+
+#if defined(HAVE_LIBURING)
+    if (ring) {
+        io_uring_queue_exit(ring);
+        delete ring;
+        ring = nullptr;
+    }
+#endif
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCond.notify_all();
+        writer.join();
+    }
+
+    if (!truncate(size)) {
+        blog(LOG_ERROR, "block writer: truncate '%s' failed", path.c_str());
+        failed = true;
+    }
+    closeFile();
+
+    opened = false;
+    return !failed;
+}
+
+void BlockFileWriter::getStats(BlockWriterStats &out) const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    out = stats;
+    out.bytes = written.load(std::memory_order_relaxed);
+}
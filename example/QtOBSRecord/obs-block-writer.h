@@ -0,0 +1,126 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BLOCK_WRITER_ALIGNMENT       4096
+#define BLOCK_WRITER_LATENCY_BUCKETS 24     // 第 i 个桶为 [2^i, 2^(i+1)) us
+
+struct BlockWriterConfig
+{
+    uint32_t blockSize;     // 每次提交的块大小，BLOCK_WRITER_ALIGNMENT 的整数倍
+    uint32_t queueDepth;    // 块缓冲的数量，io_uring 时也是同时在途的写请求数
+    bool     directIO;      // O_DIRECT / FILE_FLAG_NO_BUFFERING，绕过页缓存
+    uint64_t preallocStep;  // 预分配的增长步长（字节），0 为不预分配
+
+    BlockWriterConfig() : blockSize(1024 * 1024), queueDepth(8),
+        directIO(false), preallocStep(64ULL * 1024 * 1024) {}
+};
+
+struct BlockWriterStats
+{
+    uint64_t bytes;          // 数据量（不含对齐填充）
+    uint64_t blocks;         // 完成的写请求数
+    uint64_t preallocs;      // 预分配次数
+    uint64_t stalls;         // 所有块缓冲都在途，write() 等待的次数
+    uint64_t stallTotalNs;
+    uint64_t latencyMaxUs;   // 提交 -> 完成
+    uint64_t latency[BLOCK_WRITER_LATENCY_BUCKETS];
+
+    BlockWriterStats() : bytes(0), blocks(0), preallocs(0), stalls(0),
+        stallTotalNs(0), latencyMaxUs(0), latency() {}
+
+    void merge(const BlockWriterStats &other);
+    // 按直方图估算的分位数（桶的上界），单位 us
+    uint64_t percentileUs(double p) const;
+};
+
+/**
+ * 顺序写大文件：数据先拷贝进对齐的块缓冲，凑满一块（blockSize）后异步提交，
+ * 最多 queueDepth 个请求在途；调用线程只在所有缓冲都在途时等待。
+ *
+ * Linux 下有 liburing（HAVE_LIBURING）时通过 io_uring 提交，最多 queueDepth 个
+ * 请求同时在途；否则由一个写线程用 pwrite/WriteFile 按偏移逐块同步写入，
+ * 在途的请求只有 1 个，queueDepth 只决定调用线程可以领先写线程的块数。文件按 preallocStep 预分配，写入都在已分配范围内，
+ * 不会每次写都更新文件大小等元数据；close() 时截断到实际大小。
+ * directIO 时最后不足一块的数据补零到对齐后写入，再截断。
+ *
+ * 不是线程安全的，write/close 需要在同一线程调用（getStats 除外）。
+ */
+class BlockFileWriter
+{
+public:
+    BlockFileWriter();
+    ~BlockFileWriter();
+
+    bool open(const std::string &path, const BlockWriterConfig &config);
+    bool write(const void *data, size_t size);
+    // 提交剩余数据，等待所有请求完成，截断并关闭文件
+    bool close();
+    bool isOpen() const { return opened; }
+
+    const char *backend() const;
+    // 同时在途的写请求数，写线程后端为 1
+    uint32_t ioDepth() const;
+    void getStats(BlockWriterStats &stats) const;
+
+private:
+    struct Block
+    {
+        uint8_t  *data;
+        size_t   size;       // 提交的长度（directIO 时已对齐）
+        uint64_t offset;
+        uint64_t submitNs;
+        bool     inFlight;
+    };
+
+    bool submit(Block &block, size_t size);
+    bool waitBlock(Block &block, bool countStall);
+    bool reapOne(bool wait);
+    void completed(Block &block, int64_t result);
+    bool preallocate(uint64_t end);
+    bool truncate(uint64_t size);
+    void closeFile();
+    void writerLoop();
+
+    bool                  opened;
+    std::atomic<bool>     failed;
+    BlockWriterConfig     config;
+    std::string           path;
+    std::vector<Block>    blocks;
+    size_t                current;    // 正在填充的块
+    size_t                used;       // 当前块已填充的字节数
+    uint64_t              offset;     // 下一块的文件偏移
+    uint64_t              allocated;  // 已预分配到的位置
+    std::atomic<uint64_t> written;    // 已接收的数据量，供 getStats 读取
+
+#if defined(_WIN32)
+    void                  *handle;
+#else
+    int                   fd;
+#endif
+#if defined(HAVE_LIBURING)
+    struct io_uring       *ring;
+#endif
+
+    // 写线程后端
+    std::thread             writer;
+    std::mutex              queueMutex;
+    std::condition_variable queueCond;
+    std::deque<Block *>     queue;
+    bool                    stopping;
+
+    mutable std::mutex    statsMutex;
+    BlockWriterStats      stats;
+};
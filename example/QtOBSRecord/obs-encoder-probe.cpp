@@ -0,0 +1,510 @@
+﻿#include "obs-encoder-probe.h"
+#include "obs-packet-sink.h"
+#include "obs-profiler-stats.h"
+#include "obs-roi-encoder.h"
+#include "obs-video-quality.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+
+#include <QSysInfo>
+
+#include <string.h>
+
+#define PROBE_CACHE_FILE    "encoder-probe.json"
+#define PROBE_CACHE_VERSION 1
+#define PROBE_VIDEO_CACHE   8      // 私有 video_t 的帧缓存数量
+#define PROBE_TIMEOUT_NS    10000000000ULL
+#define PROBE_AUDIO_MS      500
+
+static const char *x264Presets[] = {
+    "ultrafast",
+    "superfast",
+    "veryfast",
+    "faster",
+    "fast",
+    "medium",
+    nullptr
+};
+
+static std::string MachineKey(const std::vector<std::string> &encoders)
+{
+    std::string key = QSysInfo::machineUniqueId().toHex().toStdString();
+    key += "|" + std::to_string(os_get_logical_cores());
+    key += "|" + std::string(obs_get_version_string());
+    for (const std::string &id : encoders)
+        key += "|" + id;
+    return key;
+}
+
+void EnumProbeEncoders(std::vector<std::string> &video,
+                       std::vector<std::string> &audio)
+{
+    size_t idx = 0;
+    const char *id;
+    while (obs_enum_encoder_types(idx++, &id)) {
+        uint32_t caps = obs_get_encoder_caps(id);
+        if (caps & OBS_ENCODER_CAP_DEPRECATED)
+            continue;
+
+        const char *codec = obs_get_encoder_codec(id);
+        if (!codec)
+            continue;
+
+        obs_encoder_type type = obs_get_encoder_type(id);
+        if (type == OBS_ENCODER_VIDEO && strcmp(codec, "h264") == 0) {
+            // 纹理编码器直接读取主画布的纹理，无法用合成画面测试，
+            // 它们都有对应的非纹理版本（如 ffmpeg_nvenc）参与探测
+            if (caps & OBS_ENCODER_CAP_PASS_TEXTURE)
+                continue;
+            // ROI 编码器是 obs_x264 的替代实现，由 setROIMode 选用，不参与探测
+            if (strcmp(id, ROI_ENCODER_ID) == 0)
+                continue;
+            video.push_back(id);
+        } else if (type == OBS_ENCODER_AUDIO && astrcmpi(codec, "AAC") == 0) {
+            audio.push_back(id);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* 缓存 */
+
+static bool LoadCache(const std::string &path, const std::string &key,
+                      const EncoderProbeOptions &options,
+                      EncoderProbeResult &result)
+{
+    obs_data_t *data = obs_data_create_from_json_file_safe(path.c_str(),
+                                                           "bak");
+    if (!data)
+        return false;
+
+    bool valid =
+        obs_data_get_int(data, "version") == PROBE_CACHE_VERSION &&
+        key == obs_data_get_string(data, "machine") &&
+        obs_data_get_int(data, "width") == options.width &&
+        obs_data_get_int(data, "height") == options.height &&
+        obs_data_get_int(data, "fps") == options.fps &&
+        obs_data_get_double(data, "min_psnr") == options.minPsnr;
+
+    if (valid) {
+        result.videoEncoder = obs_data_get_string(data, "video_encoder");
+        result.videoPreset  = obs_data_get_string(data, "video_preset");
+        result.audioEncoder = obs_data_get_string(data, "audio_encoder");
+        result.fromCache    = true;
+
+        obs_data_array_t *array = obs_data_get_array(data, "candidates");
+        size_t count = obs_data_array_count(array);
+        for (size_t i = 0; i < count; i++) {
+            obs_data_t *item = obs_data_array_item(array, i);
+            EncoderProbeCandidate c;
+            c.id            = obs_data_get_string(item, "id");
+            c.preset        = obs_data_get_string(item, "preset");
+            c.fps           = obs_data_get_double(item, "fps");
+            c.cpuMsPerFrame = obs_data_get_double(item, "cpu_ms");
+            c.psnr          = obs_data_get_double(item, "psnr");
+            c.ok            = obs_data_get_bool(item, "ok");
+            result.candidates.push_back(c);
+            obs_data_release(item);
+        }
+        obs_data_array_release(array);
+    }
+
+    obs_data_release(data);
+    return valid && !result.videoEncoder.empty();
+}
+
+static void SaveCache(const std::string &path, const std::string &key,
+                      const EncoderProbeOptions &options,
+                      const EncoderProbeResult &result)
+{
+    obs_data_t *data = obs_data_create();
+    obs_data_set_int(data, "version", PROBE_CACHE_VERSION);
+    obs_data_set_string(data, "machine", key.c_str());
+    obs_data_set_int(data, "width", options.width);
+    obs_data_set_int(data, "height", options.height);
+    obs_data_set_int(data, "fps", options.fps);
+    obs_data_set_double(data, "min_psnr", options.minPsnr);
+    obs_data_set_string(data, "video_encoder", result.videoEncoder.c_str());
+    obs_data_set_string(data, "video_preset", result.videoPreset.c_str());
+    obs_data_set_string(data, "audio_encoder", result.audioEncoder.c_str());
+
+    obs_data_array_t *array = obs_data_array_create();
+    for (const EncoderProbeCandidate &c : result.candidates) {
+        obs_data_t *item = obs_data_create();
+        obs_data_set_string(item, "id", c.id.c_str());
+        obs_data_set_string(item, "preset", c.preset.c_str());
+        obs_data_set_double(item, "fps", c.fps);
+        obs_data_set_double(item, "cpu_ms", c.cpuMsPerFrame);
+        obs_data_set_double(item, "psnr", c.psnr);
+        obs_data_set_bool(item, "ok", c.ok);
+        obs_data_array_push_back(array, item);
+        obs_data_release(item);
+    }
+    obs_data_set_array(data, "candidates", array);
+    obs_data_array_release(array);
+
+    if (!obs_data_save_json_safe(data, path.c_str(), "tmp", "bak"))
+        blog(LOG_WARNING, "encoder probe: save cache %s failed", path.c_str());
+    obs_data_release(data);
+}
+
+/* ------------------------------------------------------------------------- */
+/* 视频编码器 */
+
+bool OpenProbeVideo(ProbeVideo &probe, const char *name, int format,
+                    uint32_t width, uint32_t height, uint32_t fpsNum,
+                    uint32_t fpsDen)
+{
+    struct video_output_info voi = {};
+    voi.name       = name;
+    voi.format     = (enum video_format)format;
+    voi.fps_num    = fpsNum;
+    voi.fps_den    = fpsDen ? fpsDen : 1;
+    voi.width      = width;
+    voi.height     = height;
+    voi.cache_size = PROBE_VIDEO_CACHE;
+    voi.colorspace = VIDEO_CS_601;
+    voi.range      = VIDEO_RANGE_PARTIAL;
+
+    probe.video     = nullptr;
+    probe.fed       = 0;
+    probe.timestamp = os_gettime_ns();
+    probe.interval  = 1000000000ULL * voi.fps_den / (fpsNum ? fpsNum : 30);
+    return video_output_open(&probe.video, &voi) == VIDEO_OUTPUT_SUCCESS;
+}
+
+void CloseProbeVideo(ProbeVideo &probe)
+{
+    if (probe.video)
+        video_output_close(probe.video);
+    probe.video = nullptr;
+}
+
+static bool FeedFrame(ProbeVideo &probe, uint32_t index,
+                      const ProbeFrameFiller &fill)
+{
+    // 保证缓存中始终有空位，否则 video_output_lock_frame 会重复上一帧
+    uint64_t deadline = os_gettime_ns() + PROBE_TIMEOUT_NS;
+    while (probe.fed - video_output_get_total_frames(probe.video) >=
+           PROBE_VIDEO_CACHE - 1) {
+        if (os_gettime_ns() > deadline)
+            return false;
+        os_sleep_ms(1);
+    }
+
+    struct video_frame frame;
+    if (!video_output_lock_frame(probe.video, &frame, 1, probe.timestamp))
+        return false;
+    fill(&frame, index);
+    video_output_unlock_frame(probe.video);
+
+    probe.fed++;
+    probe.timestamp += probe.interval;
+    return true;
+}
+
+bool ProbeEncode(ProbeVideo &probe, const char *encoderId, const char *name,
+                 obs_data_t *settings, int frames,
+                 const ProbeFrameFiller &fill, ProbeEncodeResult &result)
+{
+    result = ProbeEncodeResult();
+
+    obs_encoder_t *encoder = obs_video_encoder_create(encoderId, name,
+                                                      settings, nullptr);
+    if (!encoder)
+        return false;
+
+    obs_encoder_set_video(encoder, probe.video);
+
+    std::string sinkName = std::string(name) + "-sink";
+    obs_output_t *output = obs_output_create(PACKET_SINK_VIDEO_OUTPUT_ID,
+                                             sinkName.c_str(), nullptr,
+                                             nullptr);
+    if (!output) {
+        obs_encoder_release(encoder);
+        return false;
+    }
+    obs_output_set_video_encoder(output, encoder);
+
+    PacketSink *sink = GetPacketSink(output);
+    sink->keepData = true;
+
+    os_cpu_usage_info_t *cpu = os_cpu_usage_info_start();
+    uint64_t start = os_gettime_ns();
+    uint64_t count = 0;
+    double cpuPercent = 0.0;
+
+    if (obs_output_start(output)) {
+        // SPS/PPS 在编码器初始化后即可获取
+        uint8_t *extra = nullptr;
+        size_t extraSize = 0;
+        if (obs_encoder_get_extra_data(encoder, &extra, &extraSize))
+            result.header.assign(extra, extra + extraSize);
+
+        bool fed = true;
+        for (int i = 0; i < frames && fed; i++)
+            fed = FeedFrame(probe, (uint32_t)i, fill);
+
+        // 编码器会缓存 lookahead 帧且停止时不 flush，等输出稳定即可
+        uint64_t deadline = os_gettime_ns() + PROBE_TIMEOUT_NS;
+        uint64_t lastChange = os_gettime_ns();
+        while (os_gettime_ns() < deadline) {
+            uint64_t cur;
+            {
+                std::lock_guard<std::mutex> lock(sink->mutex);
+                cur = sink->count;
+            }
+            if (cur >= (uint64_t)frames)
+                break;
+            if (cur != count) {
+                count = cur;
+                lastChange = os_gettime_ns();
+            } else if (os_gettime_ns() - lastChange > 300000000ULL) {
+                break;
+            }
+            os_sleep_ms(5);
+        }
+
+        cpuPercent = os_cpu_usage_info_query(cpu);
+        obs_output_force_stop(output);
+    }
+
+    uint64_t windowNs = os_gettime_ns() - start;
+    uint64_t firstUs, lastUs;
+    {
+        std::lock_guard<std::mutex> lock(sink->mutex);
+        result.packets.swap(sink->packets);
+        result.count = sink->count;
+        result.bytes = sink->bytes;
+        firstUs      = sink->firstUs;
+        lastUs       = sink->lastUs;
+    }
+
+    bool success = result.count > 1 && lastUs > firstUs;
+    if (success) {
+        result.fps = (double)(result.count - 1) * 1000000.0 /
+                     (double)(lastUs - firstUs);
+        result.cpuMsPerFrame = cpuPercent / 100.0 * os_get_logical_cores() *
+                               (double)windowNs / 1000000.0 /
+                               (double)result.count;
+    }
+
+    os_cpu_usage_info_destroy(cpu);
+    obs_output_release(output);
+    obs_encoder_release(encoder);
+    return success;
+}
+
+static void ProbeVideoCandidate(ProbeVideo &probe,
+                                const EncoderProbeOptions &options,
+                                EncoderProbeCandidate &candidate)
+{
+    // 固定码率（约 0.1 bit/像素）下比较各编码器的画质
+    int bitrate = (int)((uint64_t)options.width * options.height *
+                        options.fps / 10000);
+
+    obs_data_t *settings = obs_encoder_defaults(candidate.id.c_str());
+    obs_data_set_string(settings, "rate_control", "CBR");
+    obs_data_set_int(settings, "bitrate", bitrate);
+    obs_data_set_int(settings, "keyint_sec", 2);
+    if (!candidate.preset.empty())
+        obs_data_set_string(settings, "preset", candidate.preset.c_str());
+
+    int width  = (int)options.width;
+    int height = (int)options.height;
+
+    std::string name = "qtobs-probe-" + candidate.id + "-" + candidate.preset;
+    ProbeEncodeResult encoded;
+    bool success = ProbeEncode(probe, candidate.id.c_str(), name.c_str(),
+                               settings, options.frames,
+                               [&] (struct video_frame *frame, uint32_t index) {
+        FillSyntheticFrame(frame, width, height, index);
+    }, encoded);
+    obs_data_release(settings);
+    if (!success)
+        return;
+
+    candidate.fps           = encoded.fps;
+    candidate.cpuMsPerFrame = encoded.cpuMsPerFrame;
+
+    std::vector<uint8_t> ref((size_t)width * height);
+    double mseSum = 0.0;
+    int compared = 0;
+    DecodeH264Packets(encoded.header.data(), encoded.header.size(),
+                      encoded.packets,
+                      [&] (int index, const uint8_t *luma, int linesize,
+                           int w, int h) {
+        if (w != width || h != height || index >= options.frames)
+            return;
+        RenderSyntheticLuma(ref.data(), width, width, height,
+                            (uint32_t)index);
+        mseSum += LumaMse(luma, linesize, ref.data(), width, width, height);
+        compared++;
+    });
+
+    if (compared) {
+        candidate.psnr = MseToPsnr(mseSum / compared);
+        candidate.ok   = true;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* 音频编码器 */
+
+static double ProbeAudioCandidate(const std::string &id)
+{
+    obs_data_t *settings = obs_data_create();
+    obs_data_set_int(settings, "bitrate", 128);
+
+    std::string name = "qtobs-probe-" + id;
+    obs_encoder_t *encoder = obs_audio_encoder_create(id.c_str(), name.c_str(),
+                                                      settings, 0, nullptr);
+    obs_data_release(settings);
+    if (!encoder)
+        return -1.0;
+    obs_encoder_set_audio(encoder, obs_get_audio());
+
+    obs_output_t *output = obs_output_create(PACKET_SINK_AUDIO_OUTPUT_ID,
+                                             (name + "-sink").c_str(),
+                                             nullptr, nullptr);
+    if (!output) {
+        obs_encoder_release(encoder);
+        return -1.0;
+    }
+    obs_output_set_audio_encoder(output, encoder, 0);
+
+    double cost = -1.0;
+    if (obs_output_start(output)) {
+        os_sleep_ms(PROBE_AUDIO_MS);
+        obs_output_force_stop(output);
+
+        PacketSink *sink = GetPacketSink(output);
+        ProfilerStatsMap stats;
+        std::string key = "encode(" + name + ")";
+        stats[key] = ProfilerEntryStats();
+        QueryProfilerStats(stats);
+
+        std::lock_guard<std::mutex> lock(sink->mutex);
+        if (sink->count)
+            cost = stats[key].avgMs();
+    }
+
+    obs_output_release(output);
+    obs_encoder_release(encoder);
+    return cost;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool ProbeEncoders(const EncoderProbeOptions &options,
+                   EncoderProbeResult &result)
+{
+    result = EncoderProbeResult();
+
+    std::vector<std::string> videoIds;
+    std::vector<std::string> audioIds;
+    EnumProbeEncoders(videoIds, audioIds);
+    if (videoIds.empty() || audioIds.empty()) {
+        blog(LOG_ERROR, "encoder probe: no h264/aac encoder available");
+        return false;
+    }
+
+    std::vector<std::string> all = videoIds;
+    all.insert(all.end(), audioIds.begin(), audioIds.end());
+    std::string key = MachineKey(all);
+    std::string path = options.configDir + "/" PROBE_CACHE_FILE;
+
+    if (LoadCache(path, key, options, result)) {
+        blog(LOG_INFO, "encoder probe: cached video=%s preset=%s audio=%s",
+             result.videoEncoder.c_str(), result.videoPreset.c_str(),
+             result.audioEncoder.c_str());
+        return true;
+    }
+
+    RegisterPacketSinkOutputs();
+
+    EncoderProbeOptions opts = options;
+    opts.width  = options.width & ~1u;
+    opts.height = options.height & ~1u;
+
+    ProbeVideo probe;
+    if (!OpenProbeVideo(probe, "qtobs-encoder-probe", VIDEO_FORMAT_I420,
+                        opts.width, opts.height, opts.fps, 1)) {
+        blog(LOG_ERROR, "encoder probe: open probe video failed");
+        return false;
+    }
+
+    blog(LOG_INFO, "encoder probe: %ux%u, target %u fps, psnr >= %.1f dB",
+         opts.width, opts.height, opts.fps, opts.minPsnr);
+
+    for (const std::string &id : videoIds) {
+        std::vector<std::string> presets;
+        if (id == "obs_x264") {
+            for (const char **p = x264Presets; *p; p++)
+                presets.push_back(*p);
+        } else {
+            presets.push_back(std::string());
+        }
+
+        for (const std::string &preset : presets) {
+            EncoderProbeCandidate c;
+            c.id     = id;
+            c.preset = preset;
+            ProbeVideoCandidate(probe, opts, c);
+            blog(LOG_INFO, "encoder probe: %s %s ok=%d fps=%.1f "
+                           "cpu=%.2f ms/frame psnr=%.2f dB",
+                 c.id.c_str(), c.preset.c_str(), c.ok, c.fps,
+                 c.cpuMsPerFrame, c.psnr);
+            result.candidates.push_back(c);
+        }
+    }
+    CloseProbeVideo(probe);
+
+    // 满足帧率和画质要求的候选中选 CPU 开销最低的
+    const EncoderProbeCandidate *best = nullptr;
+    const EncoderProbeCandidate *fastest = nullptr;
+    for (const EncoderProbeCandidate &c : result.candidates) {
+        if (!c.ok)
+            continue;
+        if (!fastest || c.fps > fastest->fps)
+            fastest = &c;
+        if (c.fps < opts.fps || c.psnr < opts.minPsnr)
+            continue;
+        if (!best || c.cpuMsPerFrame < best->cpuMsPerFrame)
+            best = &c;
+    }
+    if (!best) {
+        blog(LOG_WARNING, "encoder probe: no encoder meets the target, "
+                          "use the fastest one");
+        best = fastest;
+    }
+    if (best) {
+        result.videoEncoder = best->id;
+        result.videoPreset  = best->preset;
+    } else {
+        result.videoEncoder = "obs_x264";
+        result.videoPreset  = "veryfast";
+    }
+
+    double bestCost = -1.0;
+    for (const std::string &id : audioIds) {
+        double cost = ProbeAudioCandidate(id);
+        blog(LOG_INFO, "encoder probe: %s %.3f ms/packet", id.c_str(), cost);
+        if (cost >= 0.0 && (bestCost < 0.0 || cost < bestCost)) {
+            bestCost = cost;
+            result.audioEncoder = id;
+        }
+    }
+    if (result.audioEncoder.empty())
+        result.audioEncoder = "ffmpeg_aac";
+
+    blog(LOG_INFO, "encoder probe: selected video=%s preset=%s audio=%s",
+         result.videoEncoder.c_str(), result.videoPreset.c_str(),
+         result.audioEncoder.c_str());
+
+    SaveCache(path, key, options, result);
+    return true;
+}
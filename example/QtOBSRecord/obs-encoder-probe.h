@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct video_output;
+struct video_frame;
+struct obs_data;
+
+/**
+ * 启动时的编码器探测
+ * 用 obs_enum_encoder_types 枚举所有 h264 视频编码器和 AAC 音频编码器，
+ * 对每个候选（x264 还会遍历 preset）编码一段合成的屏幕内容片段，
+ * 选出满足目标帧率和画质（PSNR）的 CPU 开销最低的编码器。
+ * 结果按机器缓存在配置目录的 encoder-probe.json 中，之后启动直接读取。
+ */
+struct EncoderProbeCandidate
+{
+    std::string id;
+    std::string preset;
+    double      fps;            // 最大编码帧率
+    double      cpuMsPerFrame;  // 每帧消耗的 CPU 时间
+    double      psnr;           // 解码后与源画面 Y 平面的 PSNR (dB)
+    bool        ok;
+
+    EncoderProbeCandidate() : fps(0.0), cpuMsPerFrame(0.0), psnr(0.0),
+        ok(false) {}
+};
+
+struct EncoderProbeOptions
+{
+    std::string configDir;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    fps;            // 目标帧率
+    double      minPsnr;        // 最低画质要求
+    int         frames;         // 每个候选编码的帧数
+
+    EncoderProbeOptions() : width(0), height(0), fps(0), minPsnr(38.0),
+        frames(60) {}
+};
+
+struct EncoderProbeResult
+{
+    std::string videoEncoder;
+    std::string videoPreset;
+    std::string audioEncoder;
+    bool        fromCache;
+
+    std::vector<EncoderProbeCandidate> candidates;
+
+    EncoderProbeResult() : fromCache(false) {}
+};
+
+// 需要在 obs_reset_video / obs_reset_audio 之后调用，会阻塞数秒（无缓存时）
+bool ProbeEncoders(const EncoderProbeOptions &options,
+                   EncoderProbeResult &result);
+
+// 可用的 h264 视频编码器（不含纹理编码器）和 AAC 音频编码器
+void EnumProbeEncoders(std::vector<std::string> &video,
+                       std::vector<std::string> &audio);
+
+/* ------------------------------------------------------------------------- */
+/* 在私有 video_t 上编码一段画面，探测和码率-画质测试（obs-rd-bench.h）共用 */
+
+// 帧计数和时间戳跨多次编码单调递增，同一个 ProbeVideo 可以连续测试多个编码器
+struct ProbeVideo
+{
+    struct video_output *video;
+    uint64_t            fed;
+    uint64_t            timestamp;
+    uint64_t            interval;
+
+    ProbeVideo() : video(nullptr), fed(0), timestamp(0), interval(0) {}
+};
+
+// format 为 libobs enum video_format，只支持编码器可直接读取的 I420/NV12
+bool OpenProbeVideo(ProbeVideo &probe, const char *name, int format,
+                    uint32_t width, uint32_t height, uint32_t fpsNum,
+                    uint32_t fpsDen);
+void CloseProbeVideo(ProbeVideo &probe);
+
+// 填充第 index 帧，frame 各平面由 video_output_lock_frame 分配
+typedef std::function<void(struct video_frame *frame,
+                           uint32_t index)> ProbeFrameFiller;
+
+struct ProbeEncodeResult
+{
+    std::vector<uint8_t>              header;     // 编码器 extra data（SPS/PPS）
+    std::vector<std::vector<uint8_t>> packets;
+    uint64_t                          count;
+    uint64_t                          bytes;
+    double                            fps;        // 编码帧率（不按时钟送帧）
+    double                            cpuMsPerFrame;
+
+    ProbeEncodeResult() : count(0), bytes(0), fps(0.0), cpuMsPerFrame(0.0) {}
+};
+
+/**
+ * 用 encoderId 和 settings 编码 frames 帧，收集所有数据包。
+ * 编码器停止时不 flush，末尾 lookahead 中的少量帧可能没有输出。
+ * 至少收到两个包时返回 true。
+ */
+bool ProbeEncode(ProbeVideo &probe, const char *encoderId, const char *name,
+                 struct obs_data *settings, int frames,
+                 const ProbeFrameFiller &fill, ProbeEncodeResult &result);
@@ -0,0 +1,149 @@
+﻿#include "obs-event-bus.h"
+
+// obs headers
+#include <util/platform.h>
+
+#include <QTimer>
+
+#include <string.h>
+
+static void CopyString(char *dst, size_t size, const char *src)
+{
+    if (!src)
+        src = "";
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = 0;
+}
+
+OBSEventBus::OBSEventBus(size_t capacity, int flushIntervalMs, QObject *parent) :
+    QObject(parent),
+    mask(0),
+    enqueuePos(0),
+    dequeuePos(0),
+    scheduled(false),
+    posted(0),
+    dropped(0),
+    batches(0),
+    maxBatch(0),
+    latencyTotalNs(0),
+    latencyMaxNs(0)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    mask = size - 1;
+
+    cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    batch.reserve((int)size);
+
+    // 跨线程发出的 wakeup 只产生一个排队事件，不需要按名称查找方法
+    connect(this, &OBSEventBus::wakeup, this, &OBSEventBus::drain,
+            Qt::QueuedConnection);
+
+    QTimer *timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, &OBSEventBus::drain);
+    timer->start(flushIntervalMs);
+}
+
+OBSEventBus::~OBSEventBus()
+{
+}
+
+bool OBSEventBus::post(const OBSEvent &event, bool wake)
+{
+    // 有界 MPMC 队列（Dmitry Vyukov），这里只有一个消费者
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->event = event;
+    if (!cell->event.timestampNs)
+        cell->event.timestampNs = os_gettime_ns();
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    posted.fetch_add(1, std::memory_order_relaxed);
+
+    if (wake && !scheduled.exchange(true, std::memory_order_acq_rel))
+        emit wakeup();
+    return true;
+}
+
+void OBSEventBus::FromOutputSignal(OBSEvent &event, int type, int channel,
+                                   calldata_t *params)
+{
+    obs_output_t *output = (obs_output_t *)calldata_ptr(params, "output");
+
+    event.type        = type;
+    event.channel     = channel;
+    event.code        = (int)calldata_int(params, "code");
+    event.timestampNs = os_gettime_ns();
+    CopyString(event.outputId, sizeof(event.outputId),
+               output ? obs_output_get_name(output) : nullptr);
+    CopyString(event.lastError, sizeof(event.lastError),
+               calldata_string(params, "last_error"));
+}
+
+void OBSEventBus::drain()
+{
+    // 先清除标记，取出过程中新到的事件会再次唤醒
+    scheduled.store(false, std::memory_order_release);
+
+    uint64_t now = os_gettime_ns();
+    uint64_t latencyMax = latencyMaxNs.load(std::memory_order_relaxed);
+    uint64_t latencyTotal = 0;
+
+    for (;;) {
+        Cell *cell = &cells[dequeuePos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(dequeuePos + 1) < 0)
+            break;
+
+        batch.append(cell->event);
+        cell->sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        dequeuePos++;
+
+        uint64_t ts = batch.last().timestampNs;
+        uint64_t latency = now > ts ? now - ts : 0;
+        latencyTotal += latency;
+        if (latency > latencyMax)
+            latencyMax = latency;
+    }
+
+    if (batch.isEmpty())
+        return;
+
+    uint64_t count = (uint64_t)batch.size();
+    batches.fetch_add(1, std::memory_order_relaxed);
+    latencyTotalNs.fetch_add(latencyTotal, std::memory_order_relaxed);
+    latencyMaxNs.store(latencyMax, std::memory_order_relaxed);
+    if (count > maxBatch.load(std::memory_order_relaxed))
+        maxBatch.store(count, std::memory_order_relaxed);
+
+    emit eventsReady(batch);
+    batch.clear();
+}
+
+void OBSEventBus::getStats(OBSEventBusStats &stats) const
+{
+    stats.posted         = posted.load(std::memory_order_relaxed);
+    stats.dropped        = dropped.load(std::memory_order_relaxed);
+    stats.batches        = batches.load(std::memory_order_relaxed);
+    stats.maxBatch       = maxBatch.load(std::memory_order_relaxed);
+    stats.latencyTotalNs = latencyTotalNs.load(std::memory_order_relaxed);
+    stats.latencyMaxNs   = latencyMaxNs.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <obs.h>
+
+#include <QObject>
+#include <QVector>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#define OBS_EVENT_ID_SIZE    64
+#define OBS_EVENT_ERROR_SIZE 192
+
+/* 定长事件，按值拷贝进预分配的队列 */
+struct OBSEvent
+{
+    enum Type {
+        OutputStarted,
+        OutputStopping,
+        OutputStopped,
+        Stats,           // 周期或逐帧统计，value 的含义由发送方定义
+        User = 100
+    };
+
+    int      type;
+    int      channel;                        // 发送方定义的分类
+    int      code;                           // OBS_OUTPUT_*
+    uint64_t timestampNs;                    // os_gettime_ns()
+    int64_t  value[4];
+    char     outputId[OBS_EVENT_ID_SIZE];    // obs_output_get_name
+    char     lastError[OBS_EVENT_ERROR_SIZE];
+
+    OBSEvent() : type(User), channel(0), code(0), timestampNs(0), value(),
+        outputId(), lastError() {}
+};
+
+struct OBSEventBusStats
+{
+    uint64_t posted;
+    uint64_t dropped;        // 队列满被丢弃
+    uint64_t batches;
+    uint64_t maxBatch;
+    uint64_t latencyTotalNs; // 发送 -> 在 Qt 线程中取出
+    uint64_t latencyMaxNs;
+
+    OBSEventBusStats() : posted(0), dropped(0), batches(0), maxBatch(0),
+        latencyTotalNs(0), latencyMaxNs(0) {}
+};
+
+/**
+ * libobs 线程 -> Qt 线程的事件总线。
+ *
+ * post 可在任意线程调用：事件拷贝进预分配的有界无锁队列（多生产者单消费者），
+ * 不加锁、不分配内存，队列满时丢弃并计数。
+ * 需要立即处理的事件（wake 为 true）在队列从空闲变为非空时发出一次排队信号唤醒
+ * Qt 线程，之后到下次取出前的事件不再重复唤醒；逐帧统计等高频事件使用 wake 为 false，
+ * 由 flushIntervalMs 定时取出。Qt 线程每次取出所有事件，通过 eventsReady 批量交付。
+ */
+class OBSEventBus : public QObject
+{
+    Q_OBJECT
+
+public:
+    // capacity 向上取整为 2 的幂，对象需要属于有事件循环的线程
+    explicit OBSEventBus(size_t capacity = 1024, int flushIntervalMs = 100,
+                         QObject *parent = nullptr);
+    ~OBSEventBus();
+
+    bool post(const OBSEvent &event, bool wake = true);
+
+    // 从 libobs 输出信号（start/stopping/stop）的 calldata 填充事件
+    static void FromOutputSignal(OBSEvent &event, int type, int channel,
+                                 calldata_t *params);
+
+    void getStats(OBSEventBusStats &stats) const;
+
+signals:
+    void eventsReady(const QVector<OBSEvent> &events);
+    void wakeup();
+
+private slots:
+    void drain();
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        OBSEvent            event;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t                  mask;
+    std::atomic<size_t>     enqueuePos;
+    size_t                  dequeuePos;   // 只在 Qt 线程访问
+    std::atomic<bool>       scheduled;
+    QVector<OBSEvent>       batch;
+
+    std::atomic<uint64_t> posted;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> maxBatch;
+    std::atomic<uint64_t> latencyTotalNs;
+    std::atomic<uint64_t> latencyMaxNs;
+};
@@ -0,0 +1,375 @@
+﻿#include "obs-flight-recorder.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+FlightRecorder::FlightRecorder() :
+    base(nullptr),
+    length(0),
+    header(nullptr),
+    records(nullptr),
+    recordCount(0),
+    metricRecords(0),
+    file(nullptr),
+    mapping(nullptr),
+    fd(-1),
+    mapped(false),
+    writers(0),
+    metrics(0),
+    logs(0),
+    events(0),
+    snapshots(0)
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    close();
+}
+
+// 上次没有正常关闭（崩溃）的 ring 改名保留，避免被本次覆盖
+static void PreserveCrashedRing(const std::string &path)
+{
+    FILE *f = os_fopen(path.c_str(), "rb");
+    if (!f)
+        return;
+
+    FlightRecorderHeader header;
+    bool crashed = fread(&header, sizeof(header), 1, f) == 1 &&
+                   header.magic == FLIGHT_RECORDER_MAGIC && !header.closed;
+    fclose(f);
+    if (!crashed)
+        return;
+
+    std::string crashPath = path + ".crash";
+    os_unlink(crashPath.c_str());
+    if (os_rename(path.c_str(), crashPath.c_str()) == 0)
+        blog(LOG_WARNING, "flight recorder: previous session did not exit "
+                          "cleanly, kept as '%s'", crashPath.c_str());
+}
+
+#if defined(_WIN32)
+
+static bool MapFile(const std::string &path, uint64_t size, void *&file,
+                    void *&mapping, uint8_t *&base)
+{
+    wchar_t *wpath = nullptr;
+    os_utf8_to_wcs_ptr(path.c_str(), 0, &wpath);
+    HANDLE f = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    bfree(wpath);
+    if (f == INVALID_HANDLE_VALUE)
+        return false;
+
+    HANDLE m = CreateFileMappingW(f, nullptr, PAGE_READWRITE,
+                                  (DWORD)(size >> 32), (DWORD)size, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        return false;
+    }
+
+    void *view = MapViewOfFile(m, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+    if (!view) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+
+    file    = f;
+    mapping = m;
+    base    = static_cast<uint8_t *>(view);
+    return true;
+}
+
+static void UnmapFile(void *&file, void *&mapping, uint8_t *&base,
+                      uint64_t size)
+{
+    if (base) {
+        FlushViewOfFile(base, (SIZE_T)size);
+        UnmapViewOfFile(base);
+    }
+    if (mapping)
+        CloseHandle(static_cast<HANDLE>(mapping));
+    if (file)
+        CloseHandle(static_cast<HANDLE>(file));
+    file    = nullptr;
+    mapping = nullptr;
+    base    = nullptr;
+}
+
+static uint32_t CurrentPid()
+{
+    return (uint32_t)GetCurrentProcessId();
+}
+
+#else
+
+static bool MapFile(const std::string &path, uint64_t size, int &fd,
+                    uint8_t *&base)
+{
+    int f = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (f < 0)
+        return false;
+    if (ftruncate(f, (off_t)size) != 0) {
+        ::close(f);
+        return false;
+    }
+
+    void *view = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, f, 0);
+    if (view == MAP_FAILED) {
+        ::close(f);
+        return false;
+    }
+
+    fd   = f;
+    base = static_cast<uint8_t *>(view);
+    return true;
+}
+
+static void UnmapFile(int &fd, uint8_t *&base, uint64_t size)
+{
+    if (base) {
+        msync(base, (size_t)size, MS_SYNC);
+        munmap(base, (size_t)size);
+    }
+    if (fd >= 0)
+        ::close(fd);
+    fd   = -1;
+    base = nullptr;
+}
+
+static uint32_t CurrentPid()
+{
+    return (uint32_t)getpid();
+}
+
+#endif
+
+bool FlightRecorder::open(const std::string &path, int minutes,
+                          int recordsPerSecond, int metricIntervalMs)
+{
+    close();
+
+    PreserveCrashedRing(path);
+
+    uint64_t windowMs = (uint64_t)std::max(minutes, 1) * 60 * 1000;
+    uint64_t logCount = windowMs / 1000 * (uint64_t)std::max(recordsPerSecond, 1);
+    uint64_t metricCount = (windowMs + std::max(metricIntervalMs, 1) - 1) /
+                           (uint64_t)std::max(metricIntervalMs, 1);
+    metricCount += metricCount / 8;
+    uint64_t count = metricCount + logCount;
+    uint64_t size = FLIGHT_RECORDER_HEADER_SIZE + count * FLIGHT_RECORD_SIZE;
+
+#if defined(_WIN32)
+    bool success = MapFile(path, size, file, mapping, base);
+#else
+    bool success = MapFile(path, size, fd, base);
+#endif
+    if (!success) {
+        blog(LOG_WARNING, "flight recorder: failed to map '%s'", path.c_str());
+        return false;
+    }
+
+    // 文件新建后内容为 0，所有记录的 seq 都是 0
+    length        = size;
+    recordCount   = (uint32_t)count;
+    metricRecords = (uint32_t)metricCount;
+    header        = reinterpret_cast<FlightRecorderHeader *>(base);
+    records       = reinterpret_cast<FlightRecord *>(
+                    base + FLIGHT_RECORDER_HEADER_SIZE);
+    filePath      = path;
+
+    int64_t wallClockMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+    header->version     = FLIGHT_RECORDER_VERSION;
+    header->recordSize  = FLIGHT_RECORD_SIZE;
+    header->recordCount = recordCount;
+    header->metricRecords = metricRecords;
+    header->generation  = os_gettime_ns();
+    header->wallClockMs = wallClockMs;
+    header->monotonicNs = os_gettime_ns();
+    header->pid         = CurrentPid();
+    header->metricCount = FLIGHT_METRIC_COUNT;
+    header->closed      = 0;
+    header->next.store(0, std::memory_order_relaxed);
+    header->nextMetric.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic       = FLIGHT_RECORDER_MAGIC;
+
+    mapped.store(true, std::memory_order_release);
+
+    blog(LOG_INFO, "flight recorder: '%s', %u records (%u metrics, %u logs; "
+                   "%d min), %llu KB",
+         path.c_str(), recordCount, metricRecords,
+         recordCount - metricRecords, minutes,
+         (unsigned long long)(size / 1024));
+    return true;
+}
+
+void FlightRecorder::close()
+{
+    if (!mapped.exchange(false, std::memory_order_acq_rel))
+        return;
+
+    while (writers.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+
+    header->closed = 1;
+
+#if defined(_WIN32)
+    UnmapFile(file, mapping, base, length);
+#else
+    UnmapFile(fd, base, length);
+#endif
+
+    header        = nullptr;
+    records       = nullptr;
+    recordCount   = 0;
+    metricRecords = 0;
+    length        = 0;
+}
+
+bool FlightRecorder::enter()
+{
+    writers.fetch_add(1, std::memory_order_acq_rel);
+    if (!mapped.load(std::memory_order_acquire)) {
+        writers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+void FlightRecorder::leave()
+{
+    writers.fetch_sub(1, std::memory_order_release);
+}
+
+FlightRecord *FlightRecorder::begin(int type, uint64_t &seq)
+{
+    // 指标写入开头的指标环，日志和事件写入其后的环，两者序号独立
+    FlightRecord *record;
+    if (type == FLIGHT_RECORD_METRICS) {
+        seq = header->nextMetric.fetch_add(1, std::memory_order_relaxed);
+        record = &records[seq % metricRecords];
+    } else {
+        seq = header->next.fetch_add(1, std::memory_order_relaxed);
+        record = &records[metricRecords +
+                          seq % (recordCount - metricRecords)];
+    }
+    record->seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record->timestamp = os_gettime_ns();
+    record->type      = (uint16_t)type;
+    record->count     = 0;
+    record->level     = 0;
+    return record;
+}
+
+void FlightRecorder::commit(FlightRecord *record, uint64_t seq)
+{
+    record->seq.store(seq + 1, std::memory_order_release);
+}
+
+void FlightRecorder::writeMetrics(const int64_t *values, int count)
+{
+    if (!enter())
+        return;
+
+    uint64_t seq;
+    FlightRecord *record = begin(FLIGHT_RECORD_METRICS, seq);
+    count = std::min(std::max(count, 0), FLIGHT_RECORD_MAX_METRICS);
+    memcpy(record->metrics, values, (size_t)count * sizeof(int64_t));
+    record->count = (int16_t)count;
+    commit(record, seq);
+
+    metrics.fetch_add(1, std::memory_order_relaxed);
+    leave();
+}
+
+void FlightRecorder::writeLog(int level, const char *text)
+{
+    if (!enter())
+        return;
+
+    uint64_t seq;
+    FlightRecord *record = begin(FLIGHT_RECORD_LOG, seq);
+    size_t len = std::min(strlen(text), (size_t)FLIGHT_RECORD_PAYLOAD_SIZE);
+    memcpy(record->text, text, len);
+    record->count = (int16_t)len;
+    record->level = level;
+    commit(record, seq);
+
+    logs.fetch_add(1, std::memory_order_relaxed);
+    leave();
+}
+
+void FlightRecorder::writeEvent(int code, const char *output, const char *error)
+{
+    if (!enter())
+        return;
+
+    uint64_t seq;
+    FlightRecord *record = begin(FLIGHT_RECORD_EVENT, seq);
+    int len = snprintf(record->text, FLIGHT_RECORD_PAYLOAD_SIZE, "%s: %s",
+                       output ? output : "", error ? error : "");
+    record->count = (int16_t)std::min(std::max(len, 0),
+                                      FLIGHT_RECORD_PAYLOAD_SIZE - 1);
+    record->level = code;
+    commit(record, seq);
+
+    events.fetch_add(1, std::memory_order_relaxed);
+    leave();
+}
+
+bool FlightRecorder::snapshot(const std::string &path)
+{
+    if (!enter())
+        return false;
+
+    // 拷贝期间仍可能有写入，读取端按 seq 丢弃不完整的记录
+    FILE *f = os_fopen(path.c_str(), "wb");
+    bool success = f && fwrite(base, 1, (size_t)length, f) == (size_t)length;
+    if (f)
+        success = fclose(f) == 0 && success;
+    leave();
+
+    if (!success) {
+        blog(LOG_WARNING, "flight recorder: failed to write snapshot '%s'",
+             path.c_str());
+        os_unlink(path.c_str());
+        return false;
+    }
+
+    snapshots.fetch_add(1, std::memory_order_relaxed);
+    blog(LOG_INFO, "flight recorder: snapshot written to '%s'", path.c_str());
+    return true;
+}
+
+void FlightRecorder::getStats(FlightRecorderStats &stats) const
+{
+    stats.metrics   = metrics.load(std::memory_order_relaxed);
+    stats.logs      = logs.load(std::memory_order_relaxed);
+    stats.events    = events.load(std::memory_order_relaxed);
+    stats.snapshots = snapshots.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "flight-recorder-reader.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+struct FlightRecorderStats
+{
+    uint64_t metrics;
+    uint64_t logs;
+    uint64_t events;
+    uint64_t snapshots;
+
+    FlightRecorderStats() : metrics(0), logs(0), events(0), snapshots(0) {}
+};
+
+/**
+ * 飞行记录器：把最近 minutes 分钟的指标、日志和输出错误写入文件映射的环形缓冲，
+ * 布局参见 flight-recorder-reader.h。
+ *
+ * - 指标单独一个环，按采样间隔留足 minutes 分钟，日志再多也不会覆盖指标；
+ * - 写入不加锁、不分配内存，可在任意线程（包括 libobs 日志回调）调用；
+ * - 进程崩溃后映射的页仍由系统写回文件，下次 open 时如果上次没有正常关闭，
+ *   先把旧文件改名为 <path>.crash 保留；
+ * - snapshot 把当前内容拷贝为独立的文件，用于输出出错后的事后分析。
+ */
+class FlightRecorder
+{
+public:
+    FlightRecorder();
+    ~FlightRecorder();
+
+    // 日志和事件环容量为 minutes * 60 * recordsPerSecond 条，
+    // 指标环按每 metricIntervalMs 一条留足 minutes 分钟（另加 1/8 给快照前的补采）
+    bool open(const std::string &path, int minutes, int recordsPerSecond,
+              int metricIntervalMs);
+    void close();
+    bool isOpen() const { return mapped.load(std::memory_order_acquire); }
+
+    void writeMetrics(const int64_t *values, int count);
+    void writeLog(int level, const char *text);
+    void writeEvent(int code, const char *output, const char *error);
+
+    bool snapshot(const std::string &path);
+
+    void getStats(FlightRecorderStats &stats) const;
+    std::string path() const { return filePath; }
+
+private:
+    FlightRecord *begin(int type, uint64_t &seq);
+    void commit(FlightRecord *record, uint64_t seq);
+    bool enter();
+    void leave();
+
+    std::string           filePath;
+    uint8_t               *base;
+    uint64_t              length;
+    FlightRecorderHeader  *header;
+    FlightRecord          *records;
+    uint32_t              recordCount;
+    uint32_t              metricRecords;  // records 开头的指标环容量
+    void                  *file;      // Windows 的文件和映射句柄
+    void                  *mapping;
+    int                   fd;
+
+    std::atomic<bool>     mapped;
+    std::atomic<int>      writers;    // 正在写入的线程数，close 等待其归零
+
+    std::atomic<uint64_t> metrics;
+    std::atomic<uint64_t> logs;
+    std::atomic<uint64_t> events;
+    std::atomic<uint64_t> snapshots;
+};
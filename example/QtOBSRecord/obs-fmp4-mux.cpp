@@ -0,0 +1,362 @@
+﻿#include "obs-fmp4-mux.h"
+
+// obs headers
+#include <obs-avc.h>
+
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* 初始化段 (ftyp + moov) */
+
+static void WriteTrackHeader(BoxWriter &w, uint32_t trackId, bool audio,
+                             uint32_t width, uint32_t height)
+{
+    w.beginFull("tkhd", 0, 0x000003);
+    w.wb32(0);                       // creation_time
+    w.wb32(0);                       // modification_time
+    w.wb32(trackId);
+    w.wb32(0);                       // reserved
+    w.wb32(0);                       // duration
+    w.zeros(8);
+    w.wb16(0);                       // layer
+    w.wb16(0);                       // alternate_group
+    w.wb16(audio ? 0x0100 : 0);      // volume
+    w.wb16(0);
+    w.matrix();
+    w.wb32(width << 16);
+    w.wb32(height << 16);
+    w.end();
+}
+
+static void WriteMediaHeader(BoxWriter &w, uint32_t timescale,
+                             const char *handler, const char *name)
+{
+    w.beginFull("mdhd", 0, 0);
+    w.wb32(0);
+    w.wb32(0);
+    w.wb32(timescale);
+    w.wb32(0);
+    w.wb16(0x55c4);                  // "und"
+    w.wb16(0);
+    w.end();
+
+    w.beginFull("hdlr", 0, 0);
+    w.wb32(0);
+    w.fourcc(handler);
+    w.zeros(12);
+    w.write(name, strlen(name) + 1);
+    w.end();
+}
+
+static void WriteDataInfo(BoxWriter &w)
+{
+    w.begin("dinf");
+    w.beginFull("dref", 0, 0);
+    w.wb32(1);
+    w.beginFull("url ", 0, 1);
+    w.end();
+    w.end();
+    w.end();
+}
+
+static void WriteEmptySampleTables(BoxWriter &w)
+{
+    w.beginFull("stts", 0, 0);
+    w.wb32(0);
+    w.end();
+    w.beginFull("stsc", 0, 0);
+    w.wb32(0);
+    w.end();
+    w.beginFull("stsz", 0, 0);
+    w.wb32(0);
+    w.wb32(0);
+    w.end();
+    w.beginFull("stco", 0, 0);
+    w.wb32(0);
+    w.end();
+}
+
+static bool WriteVideoTrack(BoxWriter &w, obs_encoder_t *encoder)
+{
+    uint8_t *extra = nullptr;
+    size_t extraSize = 0;
+    if (!obs_encoder_get_extra_data(encoder, &extra, &extraSize))
+        return false;
+
+    uint8_t *avcc = nullptr;
+    size_t avccSize = obs_parse_avc_header(&avcc, extra, extraSize);
+    if (!avccSize)
+        return false;
+
+    uint32_t width  = obs_encoder_get_width(encoder);
+    uint32_t height = obs_encoder_get_height(encoder);
+
+    w.begin("trak");
+    WriteTrackHeader(w, FMP4_VIDEO_TRACK_ID, false, width, height);
+    w.begin("mdia");
+    WriteMediaHeader(w, FMP4_VIDEO_TIMESCALE, "vide", "VideoHandler");
+    w.begin("minf");
+    w.beginFull("vmhd", 0, 1);
+    w.zeros(8);
+    w.end();
+    WriteDataInfo(w);
+    w.begin("stbl");
+    w.beginFull("stsd", 0, 0);
+    w.wb32(1);
+    w.begin("avc1");
+    w.zeros(6);
+    w.wb16(1);                       // data_reference_index
+    w.zeros(16);
+    w.wb16(uint16_t(width));
+    w.wb16(uint16_t(height));
+    w.wb32(0x00480000);              // 72 dpi
+    w.wb32(0x00480000);
+    w.wb32(0);
+    w.wb16(1);                       // frame_count
+    w.zeros(32);                     // compressorname
+    w.wb16(0x0018);
+    w.wb16(0xffff);
+    w.begin("avcC");
+    w.write(avcc, avccSize);
+    w.end();
+    w.end();
+    w.end();
+    WriteEmptySampleTables(w);
+    w.end();
+    w.end();
+    w.end();
+    w.end();
+
+    bfree(avcc);
+    return true;
+}
+
+static bool WriteAudioTrack(BoxWriter &w, obs_encoder_t *encoder)
+{
+    uint8_t *asc = nullptr;
+    size_t ascSize = 0;
+    if (!obs_encoder_get_extra_data(encoder, &asc, &ascSize) || !ascSize)
+        return false;
+
+    uint32_t sampleRate = obs_encoder_get_sample_rate(encoder);
+    size_t channels = audio_output_get_channels(obs_encoder_audio(encoder));
+
+    w.begin("trak");
+    WriteTrackHeader(w, FMP4_AUDIO_TRACK_ID, true, 0, 0);
+    w.begin("mdia");
+    WriteMediaHeader(w, sampleRate, "soun", "SoundHandler");
+    w.begin("minf");
+    w.beginFull("smhd", 0, 0);
+    w.wb32(0);
+    w.end();
+    WriteDataInfo(w);
+    w.begin("stbl");
+    w.beginFull("stsd", 0, 0);
+    w.wb32(1);
+    w.begin("mp4a");
+    w.zeros(6);
+    w.wb16(1);
+    w.zeros(8);
+    w.wb16(uint16_t(channels));
+    w.wb16(16);
+    w.wb32(0);
+    w.wb32(sampleRate << 16);
+
+    // esds，描述符长度都小于 128，单字节长度即可
+    uint8_t dsiSize = uint8_t(2 + ascSize);
+    uint8_t dcdSize = uint8_t(2 + 13 + dsiSize);
+    uint8_t esSize  = uint8_t(3 + dcdSize + 3);
+    w.beginFull("esds", 0, 0);
+    w.w8(0x03);
+    w.w8(esSize);
+    w.wb16(0);                       // ES_ID
+    w.w8(0);
+    w.w8(0x04);
+    w.w8(uint8_t(13 + dsiSize));
+    w.w8(0x40);                      // MPEG-4 audio
+    w.w8(0x15);                      // audio stream
+    w.wb24(0);
+    w.wb32(0);
+    w.wb32(0);
+    w.w8(0x05);
+    w.w8(uint8_t(ascSize));
+    w.write(asc, ascSize);
+    w.w8(0x06);
+    w.w8(1);
+    w.w8(0x02);
+    w.end();
+
+    w.end();
+    w.end();
+    WriteEmptySampleTables(w);
+    w.end();
+    w.end();
+    w.end();
+    w.end();
+    return true;
+}
+
+bool BuildFMP4InitSegment(obs_output_t *output, std::vector<uint8_t> &buf)
+{
+    obs_encoder_t *venc = obs_output_get_video_encoder(output);
+    obs_encoder_t *aenc = obs_output_get_audio_encoder(output, 0);
+
+    BoxWriter w(buf);
+
+    w.begin("ftyp");
+    w.fourcc("iso6");
+    w.wb32(0);
+    w.fourcc("iso6");
+    w.fourcc("isom");
+    w.fourcc("mp41");
+    w.end();
+
+    w.begin("moov");
+    w.beginFull("mvhd", 0, 0);
+    w.wb32(0);
+    w.wb32(0);
+    w.wb32(1000);
+    w.wb32(0);
+    w.wb32(0x00010000);              // rate
+    w.wb16(0x0100);                  // volume
+    w.zeros(10);
+    w.matrix();
+    w.zeros(24);
+    w.wb32(FMP4_AUDIO_TRACK_ID + 1); // next_track_ID
+    w.end();
+
+    if (!WriteVideoTrack(w, venc)) {
+        blog(LOG_ERROR, "fmp4: failed to get h264 header");
+        return false;
+    }
+    if (!WriteAudioTrack(w, aenc)) {
+        blog(LOG_ERROR, "fmp4: failed to get aac header");
+        return false;
+    }
+
+    w.begin("mvex");
+    for (uint32_t id = FMP4_VIDEO_TRACK_ID; id <= FMP4_AUDIO_TRACK_ID; id++) {
+        w.beginFull("trex", 0, 0);
+        w.wb32(id);
+        w.wb32(1);
+        w.wb32(0);
+        w.wb32(0);
+        w.wb32(0);
+        w.end();
+    }
+    w.end();
+    w.end();
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 片段 (moof + mdat) */
+
+static void WriteTrackFragment(BoxWriter &w, const FMP4Track &track,
+                               bool video, std::vector<size_t> &offsetPos)
+{
+    uint32_t flags = 0x000001 | 0x000100 | 0x000200;
+    if (video)
+        flags |= 0x000400 | 0x000800;
+
+    w.begin("traf");
+    w.beginFull("tfhd", 0, 0x020000);   // default-base-is-moof
+    w.wb32(track.trackId);
+    w.end();
+    w.beginFull("tfdt", 1, 0);
+    w.wb64(track.baseTime);
+    w.end();
+    w.beginFull("trun", 0, flags);
+    w.wb32(uint32_t(track.samples.size()));
+    offsetPos.push_back(w.size());
+    w.wb32(0);                          // data_offset，稍后回填
+    for (const FMP4Sample &s : track.samples) {
+        w.wb32(s.duration);
+        w.wb32(s.size);
+        if (video) {
+            w.wb32(s.flags);
+            w.wb32(s.ctsOffset);
+        }
+    }
+    w.end();
+    w.end();
+}
+
+void BuildFMP4Fragment(uint32_t sequence, const FMP4Track &video,
+                       const FMP4Track &audio, std::vector<uint8_t> &buf)
+{
+    size_t start = buf.size();
+    buf.reserve(start + video.data.size() + audio.data.size() + 1024);
+    BoxWriter w(buf);
+    std::vector<size_t> offsetPos;
+    std::vector<size_t> offsetVal;
+
+    size_t dataOffset = 0;
+    w.begin("moof");
+    w.beginFull("mfhd", 0, 0);
+    w.wb32(sequence);
+    w.end();
+    if (!video.samples.empty()) {
+        WriteTrackFragment(w, video, true, offsetPos);
+        offsetVal.push_back(dataOffset);
+        dataOffset += video.data.size();
+    }
+    if (!audio.samples.empty()) {
+        WriteTrackFragment(w, audio, false, offsetPos);
+        offsetVal.push_back(dataOffset);
+    }
+    w.end();
+
+    // data_offset 相对于 moof 的起始位置
+    size_t moofSize = w.size() - start;
+    for (size_t i = 0; i < offsetPos.size(); i++)
+        w.patch32(offsetPos[i], uint32_t(moofSize + 8 + offsetVal[i]));
+
+    w.wb32(uint32_t(8 + video.data.size() + audio.data.size()));
+    w.fourcc("mdat");
+    w.write(video.data.data(), video.data.size());
+    w.write(audio.data.data(), audio.data.size());
+}
+
+/* ------------------------------------------------------------------------- */
+/* 样本 */
+
+void AppendFMP4VideoSample(FMP4Track &track, struct encoder_packet *packet,
+                           int64_t dts, int64_t frameDuration)
+{
+    struct encoder_packet avc = {0};
+    obs_parse_avc_packet(&avc, packet);
+
+    if (track.samples.empty())
+        track.baseTime = (uint64_t)dts;
+
+    int64_t pts = ToTimescale(packet->pts, packet->timebase_num,
+                              packet->timebase_den, FMP4_VIDEO_TIMESCALE);
+    FMP4Sample sample;
+    sample.size      = (uint32_t)avc.size;
+    sample.duration  = (uint32_t)frameDuration;
+    sample.flags     = packet->keyframe ? FMP4_SAMPLE_FLAGS_SYNC
+                                        : FMP4_SAMPLE_FLAGS_NON_SYNC;
+    sample.ctsOffset = (uint32_t)(pts - dts);
+    track.samples.push_back(sample);
+    track.data.insert(track.data.end(), avc.data, avc.data + avc.size);
+
+    obs_encoder_packet_release(&avc);
+}
+
+void AppendFMP4AudioSample(FMP4Track &track, struct encoder_packet *packet)
+{
+    int64_t dts = ToTimescale(packet->dts, packet->timebase_num,
+                              packet->timebase_den, track.timescale);
+    if (track.samples.empty())
+        track.baseTime = (uint64_t)dts;
+
+    FMP4Sample sample;
+    sample.size      = (uint32_t)packet->size;
+    sample.duration  = 1024;     // AAC 每帧采样数
+    sample.flags     = 0;
+    sample.ctsOffset = 0;
+    track.samples.push_back(sample);
+    track.data.insert(track.data.end(), packet->data,
+                      packet->data + packet->size);
+}
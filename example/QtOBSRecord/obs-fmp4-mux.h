@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <obs.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * fragmented MP4（ftyp + moov 初始化段，之后是若干 moof + mdat 片段）的封装，
+ * 供 LL-HLS 输出和块写入录制输出共用。只支持一路 h264 视频 + 一路 aac 音频。
+ */
+#define FMP4_VIDEO_TRACK_ID  1
+#define FMP4_AUDIO_TRACK_ID  2
+#define FMP4_VIDEO_TIMESCALE 90000
+
+#define FMP4_SAMPLE_FLAGS_SYNC     0x02000000 // sample_depends_on = 2
+#define FMP4_SAMPLE_FLAGS_NON_SYNC 0x01010000 // sample_depends_on = 1, non sync
+
+/* ISO BMFF box 写入 */
+class BoxWriter
+{
+public:
+    explicit BoxWriter(std::vector<uint8_t> &buf) : buf(buf) {}
+
+    void w8(uint8_t v) { buf.push_back(v); }
+    void wb16(uint16_t v) { w8(uint8_t(v >> 8)); w8(uint8_t(v)); }
+    void wb24(uint32_t v) { w8(uint8_t(v >> 16)); wb16(uint16_t(v)); }
+    void wb32(uint32_t v) { wb16(uint16_t(v >> 16)); wb16(uint16_t(v)); }
+    void wb64(uint64_t v) { wb32(uint32_t(v >> 32)); wb32(uint32_t(v)); }
+    void zeros(size_t n) { buf.insert(buf.end(), n, 0); }
+    void fourcc(const char *s) { write(s, 4); }
+
+    void write(const void *data, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        buf.insert(buf.end(), p, p + size);
+    }
+
+    void begin(const char *type)
+    {
+        stack.push_back(buf.size());
+        wb32(0);
+        fourcc(type);
+    }
+
+    void beginFull(const char *type, uint8_t version, uint32_t flags)
+    {
+        begin(type);
+        w8(version);
+        wb24(flags);
+    }
+
+    void end()
+    {
+        size_t start = stack.back();
+        stack.pop_back();
+        patch32(start, uint32_t(buf.size() - start));
+    }
+
+    void patch32(size_t pos, uint32_t v)
+    {
+        buf[pos]     = uint8_t(v >> 24);
+        buf[pos + 1] = uint8_t(v >> 16);
+        buf[pos + 2] = uint8_t(v >> 8);
+        buf[pos + 3] = uint8_t(v);
+    }
+
+    size_t size() const { return buf.size(); }
+
+    void matrix()
+    {
+        static const uint32_t unity[9] = {
+            0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000
+        };
+        for (int i = 0; i < 9; i++)
+            wb32(unity[i]);
+    }
+
+private:
+    std::vector<uint8_t> &buf;
+    std::vector<size_t>   stack;
+};
+
+struct FMP4Sample
+{
+    uint32_t size;
+    uint32_t duration;
+    uint32_t flags;
+    uint32_t ctsOffset;
+};
+
+struct FMP4Track
+{
+    uint32_t                trackId;
+    uint32_t                timescale;
+    uint64_t                baseTime;   // 当前片段第一个样本的 dts
+    std::vector<FMP4Sample> samples;
+    std::vector<uint8_t>    data;
+
+    void clear()
+    {
+        samples.clear();
+        data.clear();
+    }
+};
+
+static inline int64_t ToTimescale(int64_t ts, int32_t num, int32_t den,
+                                  uint32_t timescale)
+{
+    return ts * (int64_t)timescale * num / den;
+}
+
+// 输出的视频编码器（h264）和第 0 路音频编码器（aac）的初始化段
+bool BuildFMP4InitSegment(obs_output_t *output, std::vector<uint8_t> &buf);
+
+// 追加一个 moof + mdat 片段，不清空 track 中的样本
+void BuildFMP4Fragment(uint32_t sequence, const FMP4Track &video,
+                       const FMP4Track &audio, std::vector<uint8_t> &buf);
+
+// dts 为 FMP4_VIDEO_TIMESCALE 下的值，数据转换为 AVCC（长度前缀）格式
+void AppendFMP4VideoSample(FMP4Track &track, struct encoder_packet *packet,
+                           int64_t dts, int64_t frameDuration);
+void AppendFMP4AudioSample(FMP4Track &track, struct encoder_packet *packet);
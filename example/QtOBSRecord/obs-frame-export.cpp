@@ -0,0 +1,290 @@
+﻿#include "obs-frame-export.h"
+
+// obs headers
+#include <obs.h>
+#include <media-io/video-io.h>
+#include <media-io/audio-io.h>
+#include <util/platform.h>
+
+#include <string.h>
+#include <new>
+
+#define AUDIO_EXPORT_MIX 0
+
+uint32_t GetPackedPlaneLayout(int format, uint32_t width, uint32_t height,
+                              uint32_t linesize[], uint32_t lines[])
+{
+    switch ((enum video_format)format) {
+    case VIDEO_FORMAT_NV12:
+        linesize[0] = width;     lines[0] = height;
+        linesize[1] = width;     lines[1] = height / 2;
+        return 2;
+    case VIDEO_FORMAT_I420:
+        linesize[0] = width;     lines[0] = height;
+        linesize[1] = width / 2; lines[1] = height / 2;
+        linesize[2] = width / 2; lines[2] = height / 2;
+        return 3;
+    case VIDEO_FORMAT_I444:
+        for (int i = 0; i < 3; i++) {
+            linesize[i] = width;
+            lines[i]    = height;
+        }
+        return 3;
+    case VIDEO_FORMAT_RGBA:
+    case VIDEO_FORMAT_BGRA:
+    case VIDEO_FORMAT_BGRX:
+        linesize[0] = width * 4; lines[0] = height;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static FrameExportHeader *InitHeader(SharedMemoryRegion &region,
+                                     uint32_t kind, uint32_t slots,
+                                     uint64_t slotSize)
+{
+    FrameExportHeader *header =
+            new (region.data()) FrameExportHeader();
+    header->magic      = FRAME_EXPORT_MAGIC;
+    header->version    = FRAME_EXPORT_VERSION;
+    header->kind       = kind;
+    header->slotCount  = slots;
+    header->slotSize   = slotSize;
+    header->totalSize  = region.size();
+    header->generation = os_gettime_ns();
+    header->writeSeq.store(0, std::memory_order_relaxed);
+    header->heartbeatNs.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+
+    FrameExportSlot *slot = reinterpret_cast<FrameExportSlot *>(
+                region.data() + FrameExportSlotsOffset());
+    for (uint32_t i = 0; i < slots; i++)
+        new (&slot[i]) FrameExportSlot();
+    return header;
+}
+
+// 单写者：先把槽位标记为写入中，拷贝完成后发布序号
+static uint8_t *BeginWrite(FrameExportHeader *header, uint64_t &seq)
+{
+    seq = header->writeSeq.load(std::memory_order_relaxed);
+    uint32_t idx = (uint32_t)(seq % header->slotCount);
+
+    uint8_t *base = reinterpret_cast<uint8_t *>(header);
+    FrameExportSlot *slot = reinterpret_cast<FrameExportSlot *>(
+                base + FrameExportSlotsOffset()) + idx;
+    slot->seq.store(seq * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    return base + FrameExportDataOffset(header->slotCount) +
+           idx * header->slotSize;
+}
+
+static void EndWrite(FrameExportHeader *header, uint64_t seq,
+                     uint64_t timestamp, uint32_t size, uint32_t frames)
+{
+    uint8_t *base = reinterpret_cast<uint8_t *>(header);
+    FrameExportSlot *slot = reinterpret_cast<FrameExportSlot *>(
+                base + FrameExportSlotsOffset()) + seq % header->slotCount;
+    slot->timestamp = timestamp;
+    slot->size      = size;
+    slot->frames    = frames;
+    slot->seq.store(seq * 2 + 2, std::memory_order_release);
+
+    header->writeSeq.store(seq + 1, std::memory_order_release);
+    header->heartbeatNs.store(os_gettime_ns(), std::memory_order_relaxed);
+}
+
+FrameExporter::FrameExporter() : videoHeader(nullptr), audioHeader(nullptr),
+    videoFrames(0), audioChunks(0), bytes(0), copyTotalNs(0), copyMaxNs(0)
+{
+    memset(planeHeight, 0, sizeof(planeHeight));
+}
+
+FrameExporter::~FrameExporter()
+{
+    stop();
+}
+
+bool FrameExporter::startVideo(const std::string &name, uint32_t slots)
+{
+    const struct video_output_info *voi = video_output_get_info(obs_get_video());
+    if (!voi)
+        return false;
+
+    uint32_t linesize[FRAME_EXPORT_MAX_PLANES] = {0};
+    uint32_t lines[FRAME_EXPORT_MAX_PLANES] = {0};
+    uint32_t planes = GetPackedPlaneLayout(voi->format, voi->width, voi->height,
+                                           linesize, lines);
+    if (!planes) {
+        blog(LOG_WARNING, "frame export: unsupported video format %s",
+             get_video_format_name(voi->format));
+        return false;
+    }
+
+    uint64_t frameSize = 0;
+    uint32_t offset[FRAME_EXPORT_MAX_PLANES] = {0};
+    for (uint32_t i = 0; i < planes; i++) {
+        offset[i] = (uint32_t)frameSize;
+        frameSize += (uint64_t)linesize[i] * lines[i];
+    }
+
+    uint64_t total = FrameExportDataOffset(slots) + frameSize * slots;
+    if (!videoRegion.create(name, total)) {
+        blog(LOG_WARNING, "frame export: create shared memory '%s' failed",
+             name.c_str());
+        return false;
+    }
+
+    FrameExportHeader *header = InitHeader(videoRegion, FRAME_EXPORT_VIDEO,
+                                           slots, frameSize);
+    header->format = voi->format;
+    header->width  = voi->width;
+    header->height = voi->height;
+    header->fpsNum = voi->fps_num;
+    header->fpsDen = voi->fps_den;
+    header->planes = planes;
+    for (uint32_t i = 0; i < planes; i++) {
+        header->linesize[i]    = linesize[i];
+        header->planeOffset[i] = offset[i];
+        planeHeight[i]         = lines[i];
+    }
+
+    videoHeader = header;
+    obs_add_raw_video_callback(nullptr, rawVideo, this);
+
+    blog(LOG_INFO, "frame export: video '%s' %ux%u %s, %u slots, %llu KB",
+         name.c_str(), voi->width, voi->height,
+         get_video_format_name(voi->format), slots,
+         (unsigned long long)total / 1024);
+    return true;
+}
+
+bool FrameExporter::startAudio(const std::string &name, uint32_t slots)
+{
+    audio_t *audio = obs_get_audio();
+    if (!audio)
+        return false;
+
+    uint32_t channels = (uint32_t)audio_output_get_channels(audio);
+    uint64_t chunkSize = (uint64_t)channels * AUDIO_OUTPUT_FRAMES * sizeof(float);
+    uint64_t total = FrameExportDataOffset(slots) + chunkSize * slots;
+    if (!audioRegion.create(name, total)) {
+        blog(LOG_WARNING, "frame export: create shared memory '%s' failed",
+             name.c_str());
+        return false;
+    }
+
+    FrameExportHeader *header = InitHeader(audioRegion, FRAME_EXPORT_AUDIO,
+                                           slots, chunkSize);
+    header->sampleRate = audio_output_get_sample_rate(audio);
+    header->channels   = channels;
+
+    audioHeader = header;
+    obs_add_raw_audio_callback(AUDIO_EXPORT_MIX, nullptr, rawAudio, this);
+
+    blog(LOG_INFO, "frame export: audio '%s' %u Hz %u ch, %u slots",
+         name.c_str(), header->sampleRate, channels, slots);
+    return true;
+}
+
+bool FrameExporter::start(const std::string &name, bool audio, uint32_t slots)
+{
+    stop();
+
+    if (slots < 2)
+        slots = 2;
+    if (!startVideo(name, slots))
+        return false;
+
+    // 音频的块更小、更频繁，使用更多槽位
+    if (audio && !startAudio(name + "-audio", slots * 8))
+        blog(LOG_WARNING, "frame export: audio disabled");
+
+    videoFrames = 0;
+    audioChunks = 0;
+    bytes       = 0;
+    copyTotalNs = 0;
+    copyMaxNs   = 0;
+    return true;
+}
+
+void FrameExporter::stop()
+{
+    // 移除回调后输出线程不会再访问共享内存
+    if (videoHeader) {
+        obs_remove_raw_video_callback(rawVideo, this);
+        videoHeader->closed.store(1, std::memory_order_release);
+        videoHeader = nullptr;
+        videoRegion.close();
+    }
+    if (audioHeader) {
+        obs_remove_raw_audio_callback(AUDIO_EXPORT_MIX, rawAudio, this);
+        audioHeader->closed.store(1, std::memory_order_release);
+        audioHeader = nullptr;
+        audioRegion.close();
+    }
+}
+
+void FrameExporter::getStats(FrameExportStats &stats) const
+{
+    stats.videoFrames = videoFrames.load(std::memory_order_relaxed);
+    stats.audioChunks = audioChunks.load(std::memory_order_relaxed);
+    stats.bytes       = bytes.load(std::memory_order_relaxed);
+    stats.copyTotalNs = copyTotalNs.load(std::memory_order_relaxed);
+    stats.copyMaxNs   = copyMaxNs.load(std::memory_order_relaxed);
+}
+
+void FrameExporter::rawVideo(void *param, struct video_data *frame)
+{
+    FrameExporter *exporter = static_cast<FrameExporter *>(param);
+    FrameExportHeader *header = exporter->videoHeader;
+    uint64_t start = os_gettime_ns();
+
+    uint64_t seq;
+    uint8_t *dst = BeginWrite(header, seq);
+    for (uint32_t i = 0; i < header->planes; i++) {
+        uint8_t *plane = dst + header->planeOffset[i];
+        uint32_t rowBytes = header->linesize[i];
+        if (frame->linesize[i] == rowBytes) {
+            memcpy(plane, frame->data[i],
+                   (size_t)rowBytes * exporter->planeHeight[i]);
+            continue;
+        }
+        for (uint32_t y = 0; y < exporter->planeHeight[i]; y++)
+            memcpy(plane + (size_t)rowBytes * y,
+                   frame->data[i] + (size_t)frame->linesize[i] * y, rowBytes);
+    }
+    EndWrite(header, seq, frame->timestamp, (uint32_t)header->slotSize, 1);
+
+    uint64_t elapsed = os_gettime_ns() - start;
+    exporter->videoFrames.fetch_add(1, std::memory_order_relaxed);
+    exporter->bytes.fetch_add(header->slotSize, std::memory_order_relaxed);
+    exporter->copyTotalNs.fetch_add(elapsed, std::memory_order_relaxed);
+    // 只有输出线程写入，不需要 CAS
+    if (elapsed > exporter->copyMaxNs.load(std::memory_order_relaxed))
+        exporter->copyMaxNs.store(elapsed, std::memory_order_relaxed);
+}
+
+void FrameExporter::rawAudio(void *param, size_t mix, struct audio_data *data)
+{
+    UNUSED_PARAMETER(mix);
+
+    FrameExporter *exporter = static_cast<FrameExporter *>(param);
+    FrameExportHeader *header = exporter->audioHeader;
+    uint32_t frames = data->frames;
+    if ((uint64_t)frames * header->channels * sizeof(float) > header->slotSize)
+        frames = (uint32_t)(header->slotSize / header->channels / sizeof(float));
+
+    uint64_t seq;
+    uint8_t *dst = BeginWrite(header, seq);
+    size_t planeBytes = (size_t)frames * sizeof(float);
+    for (uint32_t ch = 0; ch < header->channels; ch++)
+        memcpy(dst + ch * planeBytes, data->data[ch], planeBytes);
+    EndWrite(header, seq, data->timestamp,
+             (uint32_t)(planeBytes * header->channels), frames);
+
+    exporter->audioChunks.fetch_add(1, std::memory_order_relaxed);
+    exporter->bytes.fetch_add(planeBytes * header->channels,
+                              std::memory_order_relaxed);
+}
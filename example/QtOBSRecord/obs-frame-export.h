@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "frame-export-reader.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+struct video_data;
+struct audio_data;
+
+/**
+ * 紧密排列（无行对齐）时各平面的每行字节数和行数，返回平面数，不支持的格式返回 0。
+ * format 为 libobs enum video_format 的值
+ */
+uint32_t GetPackedPlaneLayout(int format, uint32_t width, uint32_t height,
+                              uint32_t linesize[], uint32_t lines[]);
+
+struct FrameExportStats
+{
+    uint64_t videoFrames;
+    uint64_t audioChunks;
+    uint64_t bytes;
+    uint64_t copyTotalNs;   // 视频帧拷贝到共享内存的耗时
+    uint64_t copyMaxNs;
+
+    FrameExportStats() : videoFrames(0), audioChunks(0), bytes(0),
+        copyTotalNs(0), copyMaxNs(0) {}
+};
+
+/**
+ * 帧导出写端：通过 obs_add_raw_video_callback / obs_add_raw_audio_callback
+ * 拿到输出画面（输出格式和分辨率）和第一个混音轨，拷贝进共享内存环形缓冲。
+ *
+ * 回调在 video-io/audio-io 的输出线程中执行，只做一次 memcpy 和原子写，
+ * 不加锁、不分配内存、不等待读端。共享内存名称为 name（视频）和 name-audio（音频）。
+ */
+class FrameExporter
+{
+public:
+    FrameExporter();
+    ~FrameExporter();
+
+    // 需要在 obs_reset_video/obs_reset_audio 之后调用
+    bool start(const std::string &name, bool audio, uint32_t slots = 4);
+    void stop();
+    bool active() const { return videoHeader != nullptr; }
+
+    void getStats(FrameExportStats &stats) const;
+
+private:
+    static void rawVideo(void *param, struct video_data *frame);
+    static void rawAudio(void *param, size_t mix, struct audio_data *data);
+
+    bool startVideo(const std::string &name, uint32_t slots);
+    bool startAudio(const std::string &name, uint32_t slots);
+
+    SharedMemoryRegion videoRegion;
+    SharedMemoryRegion audioRegion;
+    FrameExportHeader  *videoHeader;
+    FrameExportHeader  *audioHeader;
+    uint32_t           planeHeight[FRAME_EXPORT_MAX_PLANES];
+
+    std::atomic<uint64_t> videoFrames;
+    std::atomic<uint64_t> audioChunks;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> copyTotalNs;
+    std::atomic<uint64_t> copyMaxNs;
+};
@@ -0,0 +1,341 @@
+﻿#include "obs-init-graph.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+
+#if defined(_WIN32)
+#include <objbase.h>
+#endif
+
+#include <algorithm>
+
+static double ToMs(uint64_t ns)
+{
+    return (double)ns / 1000000.0;
+}
+
+InitGraph::InitGraph(QObject *parent) :
+    QObject(parent),
+    yieldStep(-1),
+    yielding(false),
+    running(false),
+    failed(false),
+    lastMain(-1),
+    startNs(0),
+    endNs(0)
+{
+}
+
+InitGraph::~InitGraph()
+{
+    cancel();
+}
+
+int InitGraph::addStep(const char *name, bool worker, const Step &run,
+                       const std::vector<int> &deps)
+{
+    Node node;
+    node.name     = name;
+    node.worker   = worker;
+    node.run      = run;
+    node.deps     = deps;
+    node.state    = Pending;
+    node.prevMain = -1;
+    node.readyNs  = 0;
+    node.startNs  = 0;
+    node.endNs    = 0;
+    nodes.push_back(std::move(node));
+    results.push_back(false);
+    return (int)nodes.size() - 1;
+}
+
+void InitGraph::start()
+{
+    if (running)
+        return;
+
+    running  = true;
+    failed   = false;
+    lastMain = -1;
+    startNs  = endNs = os_gettime_ns();
+    pump();
+}
+
+void InitGraph::cancel()
+{
+    if (!running)
+        return;
+
+    failed = true;
+    joinWorkers();
+    running = false;
+    endNs = os_gettime_ns();
+    blog(LOG_INFO, "init graph cancelled after %.1f ms", ToMs(endNs - startNs));
+}
+
+void InitGraph::runToEnd()
+{
+    if (!running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        yielding = false;
+    }
+    yieldStep = -1;
+    pump();
+}
+
+void InitGraph::resume()
+{
+    pump();
+}
+
+bool InitGraph::isReady(const Node &node) const
+{
+    if (node.state != Pending)
+        return false;
+    for (int dep : node.deps) {
+        if (nodes[dep].state != Done)
+            return false;
+    }
+    return true;
+}
+
+void InitGraph::markReady(Node &node)
+{
+    node.readyNs = startNs;
+    for (int dep : node.deps)
+        node.readyNs = std::max(node.readyNs, nodes[dep].endNs);
+    node.state   = Running;
+    node.startNs = os_gettime_ns();
+}
+
+void InitGraph::runWorker(int index)
+{
+    os_set_thread_name("qtobs: init worker");
+#if defined(_WIN32)
+    // 设备枚举、格式查询通过 COM
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+
+    bool ok = nodes[index].run();
+    uint64_t end = os_gettime_ns();
+
+#if defined(_WIN32)
+    if (SUCCEEDED(hr))
+        CoUninitialize();
+#endif
+
+    bool post;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nodes[index].endNs = end;
+        results[index] = ok;
+        completed.push_back(index);
+        post = yielding;
+    }
+    cond.notify_all();
+    if (post)
+        QMetaObject::invokeMethod(this, "resume", Qt::QueuedConnection);
+}
+
+void InitGraph::collectWorkers()
+{
+    std::vector<int> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(completed);
+    }
+
+    for (int index : done) {
+        Node &node = nodes[index];
+        node.thread.join();
+
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ok = results[index];
+        }
+        node.state = ok ? Done : Failed;
+        if (!ok)
+            failed = true;
+        emit stepFinished(index, ok);
+    }
+}
+
+void InitGraph::joinWorkers()
+{
+    for (Node &node : nodes) {
+        if (node.thread.joinable())
+            node.thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int index : completed)
+        nodes[index].state = results[index] ? Done : Failed;
+    completed.clear();
+    yielding = false;
+}
+
+void InitGraph::pump()
+{
+    bool ranMain = false;
+    while (running) {
+        collectWorkers();
+        if (failed) {
+            finish(false);
+            return;
+        }
+
+        // 先启动所有就绪的工作线程步骤，再取第一个就绪的主线程步骤
+        bool busy = false;
+        int next = -1;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            Node &node = nodes[i];
+            if (node.state == Running) {
+                busy = true;
+            } else if (isReady(node)) {
+                if (node.worker) {
+                    markReady(node);
+                    node.thread = std::thread(&InitGraph::runWorker, this,
+                                              (int)i);
+                    busy = true;
+                } else if (next < 0) {
+                    next = (int)i;
+                }
+            }
+        }
+
+        if (next >= 0) {
+            if (yielding && ranMain) {
+                QMetaObject::invokeMethod(this, "resume", Qt::QueuedConnection);
+                return;
+            }
+
+            Node &node = nodes[next];
+            markReady(node);
+            node.prevMain = lastMain;
+            bool ok = node.run();
+            node.endNs = os_gettime_ns();
+            node.state = ok ? Done : Failed;
+            lastMain = next;
+            ranMain  = true;
+
+            if (!ok) {
+                failed = true;
+            } else if (next == yieldStep) {
+                std::lock_guard<std::mutex> lock(mutex);
+                yielding = true;
+            }
+            emit stepFinished(next, ok);
+            continue;
+        }
+
+        if (!busy) {
+            finish(true);
+            return;
+        }
+
+        // 只剩工作线程步骤：让出时等待 resume，否则在这里等待
+        if (yielding)
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] () { return !completed.empty(); });
+    }
+}
+
+void InitGraph::finish(bool ok)
+{
+    joinWorkers();
+    running = false;
+    endNs = os_gettime_ns();
+    emit finished(ok);
+}
+
+void InitGraph::getCriticalPath(std::vector<int> &path) const
+{
+    path.clear();
+
+    int last = -1;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node &node = nodes[i];
+        if (node.state != Done && node.state != Failed)
+            continue;
+        if (last < 0 || node.endNs > nodes[last].endNs)
+            last = (int)i;
+    }
+
+    while (last >= 0) {
+        path.push_back(last);
+        const Node &node = nodes[last];
+        int prev = node.worker ? -1 : node.prevMain;
+        for (int dep : node.deps) {
+            if (prev < 0 || nodes[dep].endNs > nodes[prev].endNs)
+                prev = dep;
+        }
+        last = prev;
+    }
+    std::reverse(path.begin(), path.end());
+}
+
+void InitGraph::getTimings(std::vector<InitStepTiming> &timings) const
+{
+    std::vector<int> path;
+    getCriticalPath(path);
+
+    timings.clear();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node &node = nodes[i];
+        InitStepTiming t;
+        t.name   = node.name;
+        t.worker = node.worker;
+        t.ok     = node.state == Done;
+        t.critical = std::find(path.begin(), path.end(), (int)i) != path.end();
+        t.ran    = node.state == Done || node.state == Failed;
+        if (t.ran) {
+            t.readyNs = node.readyNs - startNs;
+            t.startNs = node.startNs - startNs;
+            t.endNs   = node.endNs - startNs;
+        }
+        timings.push_back(t);
+    }
+}
+
+void InitGraph::logTimings() const
+{
+    std::vector<InitStepTiming> timings;
+    getTimings(timings);
+
+    // serial 为各步骤耗时之和，即全部串行运行的耗时
+    uint64_t serialNs = 0;
+    for (const InitStepTiming &t : timings)
+        serialNs += t.endNs - t.startNs;
+    blog(LOG_INFO, "init graph: %.1f ms, serial %.1f ms, %d steps",
+         ToMs(endNs - startNs), ToMs(serialNs), (int)timings.size());
+
+    for (const InitStepTiming &t : timings) {
+        if (!t.ran) {
+            blog(LOG_INFO, "\t  %-18s not run", t.name.c_str());
+            continue;
+        }
+        blog(LOG_INFO, "\t%c %-18s %-6s ready %7.1f, start %7.1f, "
+                       "run %7.1f ms%s",
+             t.critical ? '*' : ' ', t.name.c_str(),
+             t.worker ? "worker" : "main", ToMs(t.readyNs), ToMs(t.startNs),
+             ToMs(t.endNs - t.startNs), t.ok ? "" : " (failed)");
+    }
+
+    std::vector<int> path;
+    getCriticalPath(path);
+    std::string text;
+    for (int index : path) {
+        const InitStepTiming &t = timings[index];
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%s%s %.1f", text.empty() ? "" : " -> ",
+                 t.name.c_str(), ToMs(t.endNs - t.startNs));
+        text += buf;
+    }
+    blog(LOG_INFO, "init critical path (ms): %s", text.c_str());
+}
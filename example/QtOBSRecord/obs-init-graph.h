@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <QObject>
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct InitStepTiming
+{
+    std::string name;
+    bool        worker;
+    bool        ran;        // 失败后未调度的步骤为 false
+    bool        ok;
+    bool        critical;   // 在关键路径上
+    uint64_t    readyNs;    // 依赖全部完成，相对 start
+    uint64_t    startNs;
+    uint64_t    endNs;
+
+    InitStepTiming() : worker(false), ran(false), ok(false), critical(false),
+        readyNs(0), startNs(0), endNs(0) {}
+};
+
+/**
+ * 初始化依赖图。
+ *
+ * 工作线程步骤（设备枚举、配置文件读取等 I/O 为主的探测）在各自的线程中运行，
+ * 不能调用非线程安全的 libobs 接口；其余步骤在调用 start 的线程（obs 线程）中
+ * 按添加顺序串行运行，依赖未完成时先运行后面已就绪的步骤，都未就绪时等待工作线程。
+ *
+ * setYieldAfter 指定的步骤完成之前 start 同步运行；之后主线程步骤改为每个事件
+ * 运行一个，期间 obs 线程可以处理其它排队的调用（如开始录制）。
+ * 任一步骤失败后不再调度新步骤，等待运行中的工作线程结束后发出 finished(false)。
+ */
+class InitGraph : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<bool()> Step;
+
+    explicit InitGraph(QObject *parent = nullptr);
+    ~InitGraph();
+
+    // deps 必须是之前添加的步骤，返回步骤序号
+    int addStep(const char *name, bool worker, const Step &run,
+                const std::vector<int> &deps = std::vector<int>());
+    void setYieldAfter(int step) { yieldStep = step; }
+
+    void start();
+    // 不再调度新步骤，等待运行中的工作线程，不发出 finished
+    void cancel();
+    // 不再让出事件循环，在调用线程中运行完剩余步骤
+    void runToEnd();
+    bool isRunning() const { return running; }
+
+    void getTimings(std::vector<InitStepTiming> &timings) const;
+    // 从最后完成的步骤回溯：每一步取依赖和（主线程步骤）前一个主线程步骤中
+    // 最后完成的一个，按执行顺序返回
+    void getCriticalPath(std::vector<int> &path) const;
+    uint64_t elapsedNs() const { return endNs - startNs; }
+    void logTimings() const;
+
+signals:
+    // 在 obs 线程中发出
+    void stepFinished(int step, bool ok);
+    void finished(bool ok);
+
+private slots:
+    void resume();
+
+private:
+    enum State { Pending, Running, Done, Failed };
+
+    struct Node
+    {
+        std::string      name;
+        bool             worker;
+        Step             run;
+        std::vector<int> deps;
+        int              state;
+        int              prevMain;   // 之前运行的主线程步骤
+        uint64_t         readyNs;
+        uint64_t         startNs;
+        uint64_t         endNs;
+        std::thread      thread;
+    };
+
+    bool isReady(const Node &node) const;
+    void markReady(Node &node);
+    void runWorker(int index);
+    void collectWorkers();
+    void pump();
+    void finish(bool ok);
+    void joinWorkers();
+
+    std::vector<Node>       nodes;
+    mutable std::mutex      mutex;
+    std::condition_variable cond;
+    std::vector<int>        completed;   // 工作线程已结束、尚未处理的步骤
+    std::vector<bool>       results;     // 工作线程步骤的返回值
+
+    int      yieldStep;
+    bool     yielding;    // 工作线程结束时需要投递 resume
+    bool     running;
+    bool     failed;
+    int      lastMain;
+    uint64_t startNs;
+    uint64_t endNs;
+};
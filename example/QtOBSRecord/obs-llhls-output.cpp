@@ -0,0 +1,497 @@
+﻿#include "obs-llhls-output.h"
+#include "obs-fmp4-mux.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PARTS_IN_PLAYLIST_SEGMENTS 2     // 只为最近的 N 个完整 segment 列出 part
+
+/* ------------------------------------------------------------------------- */
+
+struct HLSPart
+{
+    double duration;
+    bool   independent;
+};
+
+struct HLSSegment
+{
+    uint32_t             index;
+    double               duration;
+    std::vector<HLSPart> parts;
+};
+
+struct llhls_output
+{
+    obs_output_t *output;
+
+    // stop 在调用线程、encoded_packet 在编码线程，mutex 保护以下分片、
+    // segment 文件和播放列表的状态
+    std::mutex mutex;
+
+    std::string dir;
+    double      partTarget;      // 秒
+    double      segmentTarget;   // 秒
+    int         windowSegments;
+
+    FMP4Track video;
+    FMP4Track audio;
+    int64_t  frameDuration;      // video timescale
+    uint32_t fragmentSeq;
+    bool     gotKeyframe;
+    bool     active;
+
+    uint32_t               segIndex;
+    FILE                  *segFile;
+    int64_t                segStartDts;
+    int64_t                partStartDts;
+    bool                   partIndependent;
+    uint64_t               partCaptureUs;
+    HLSSegment             current;
+    std::deque<HLSSegment> segments;
+    double                 maxSegDuration;
+
+    // 分片可用延迟：part 中第一帧的采集时刻 -> 写入播放列表
+    std::atomic<uint64_t> latencyCount;
+    std::atomic<uint64_t> latencyTotalUs;
+    std::atomic<uint64_t> latencyMaxUs;
+};
+
+static std::string SegmentName(uint32_t seg)
+{
+    return "seg" + std::to_string(seg) + ".m4s";
+}
+
+static std::string PartName(uint32_t seg, size_t part)
+{
+    return "seg" + std::to_string(seg) + "." + std::to_string(part) + ".m4s";
+}
+
+static bool WriteFileAtomic(const std::string &path, const uint8_t *data,
+                            size_t size)
+{
+    std::string temp = path + ".tmp";
+    FILE *f = os_fopen(temp.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool success = fwrite(data, 1, size, f) == size;
+    fclose(f);
+
+    if (success)
+        success = os_rename(temp.c_str(), path.c_str()) == 0;
+    if (!success)
+        os_unlink(temp.c_str());
+    return success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* init segment (ftyp + moov) */
+
+static bool WriteInitSegment(llhls_output *hls)
+{
+    std::vector<uint8_t> buf;
+    if (!BuildFMP4InitSegment(hls->output, buf))
+        return false;
+    return WriteFileAtomic(hls->dir + "/init.mp4", buf.data(), buf.size());
+}
+
+/* ------------------------------------------------------------------------- */
+/* part (moof + mdat) */
+
+static bool FlushPart(llhls_output *hls, int64_t endDts)
+{
+    if (hls->video.samples.empty() && hls->audio.samples.empty())
+        return true;
+
+    std::vector<uint8_t> buf;
+    BuildFMP4Fragment(++hls->fragmentSeq, hls->video, hls->audio, buf);
+
+    std::string name = PartName(hls->segIndex, hls->current.parts.size());
+    if (!WriteFileAtomic(hls->dir + "/" + name, buf.data(), buf.size())) {
+        blog(LOG_ERROR, "llhls: write part %s failed", name.c_str());
+        return false;
+    }
+    if (hls->segFile && fwrite(buf.data(), 1, buf.size(), hls->segFile) !=
+            buf.size()) {
+        blog(LOG_ERROR, "llhls: write segment %u failed", hls->segIndex);
+        return false;
+    }
+
+    HLSPart part;
+    part.duration    = double(endDts - hls->partStartDts) /
+                       FMP4_VIDEO_TIMESCALE;
+    part.independent = hls->partIndependent;
+    hls->current.parts.push_back(part);
+
+    hls->video.clear();
+    hls->audio.clear();
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 播放列表 */
+
+static void AppendParts(struct dstr *m3u8, const HLSSegment &seg)
+{
+    for (size_t i = 0; i < seg.parts.size(); i++) {
+        const HLSPart &part = seg.parts[i];
+        dstr_catf(m3u8, "#EXT-X-PART:DURATION=%.5f,URI=\"%s\"%s\n",
+                  part.duration, PartName(seg.index, i).c_str(),
+                  part.independent ? ",INDEPENDENT=YES" : "");
+    }
+}
+
+static void WritePlaylist(llhls_output *hls, bool endList)
+{
+    double target = hls->segmentTarget > hls->maxSegDuration ?
+                    hls->segmentTarget : hls->maxSegDuration;
+    uint32_t mediaSeq = hls->segments.empty() ? hls->segIndex
+                                              : hls->segments.front().index;
+
+    struct dstr m3u8 = {0};
+    dstr_cat(&m3u8, "#EXTM3U\n#EXT-X-VERSION:9\n");
+    dstr_catf(&m3u8, "#EXT-X-TARGETDURATION:%d\n", (int)ceil(target));
+    dstr_catf(&m3u8, "#EXT-X-PART-INF:PART-TARGET=%.5f\n", hls->partTarget);
+    dstr_catf(&m3u8, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.5f\n",
+              hls->partTarget * 3.0);
+    dstr_catf(&m3u8, "#EXT-X-MEDIA-SEQUENCE:%u\n", mediaSeq);
+    dstr_cat(&m3u8, "#EXT-X-MAP:URI=\"init.mp4\"\n");
+
+    size_t count = hls->segments.size();
+    for (size_t i = 0; i < count; i++) {
+        const HLSSegment &seg = hls->segments[i];
+        if (i + PARTS_IN_PLAYLIST_SEGMENTS >= count)
+            AppendParts(&m3u8, seg);
+        dstr_catf(&m3u8, "#EXTINF:%.5f,\n%s\n", seg.duration,
+                  SegmentName(seg.index).c_str());
+    }
+
+    if (endList) {
+        dstr_cat(&m3u8, "#EXT-X-ENDLIST\n");
+    } else {
+        AppendParts(&m3u8, hls->current);
+        dstr_catf(&m3u8, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\"\n",
+                  PartName(hls->segIndex, hls->current.parts.size()).c_str());
+    }
+
+    std::string path = hls->dir + "/index.m3u8";
+    if (!os_quick_write_utf8_file_safe(path.c_str(), m3u8.array, m3u8.len,
+                                       false, "tmp", nullptr))
+        blog(LOG_WARNING, "llhls: write playlist failed");
+    dstr_free(&m3u8);
+
+    if (hls->partCaptureUs) {
+        uint64_t latency = os_gettime_ns() / 1000 - hls->partCaptureUs;
+        hls->latencyCount++;
+        hls->latencyTotalUs += latency;
+        if (latency > hls->latencyMaxUs)
+            hls->latencyMaxUs = latency;
+        hls->partCaptureUs = 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* segment */
+
+static bool OpenSegment(llhls_output *hls, int64_t startDts)
+{
+    std::string path = hls->dir + "/" + SegmentName(hls->segIndex) + ".tmp";
+    hls->segFile = os_fopen(path.c_str(), "wb");
+    if (!hls->segFile) {
+        blog(LOG_ERROR, "llhls: open segment %s failed", path.c_str());
+        return false;
+    }
+
+    hls->segStartDts   = startDts;
+    hls->current.index = hls->segIndex;
+    hls->current.duration = 0.0;
+    hls->current.parts.clear();
+    return true;
+}
+
+static void RemoveSegmentFiles(llhls_output *hls, const HLSSegment &seg)
+{
+    os_unlink((hls->dir + "/" + SegmentName(seg.index)).c_str());
+    for (size_t i = 0; i < seg.parts.size(); i++)
+        os_unlink((hls->dir + "/" + PartName(seg.index, i)).c_str());
+}
+
+static void CloseSegment(llhls_output *hls, int64_t endDts)
+{
+    if (!hls->segFile)
+        return;
+
+    fclose(hls->segFile);
+    hls->segFile = nullptr;
+
+    std::string path = hls->dir + "/" + SegmentName(hls->segIndex);
+    os_rename((path + ".tmp").c_str(), path.c_str());
+
+    hls->current.duration = double(endDts - hls->segStartDts) /
+                            FMP4_VIDEO_TIMESCALE;
+    if (hls->current.duration > hls->maxSegDuration)
+        hls->maxSegDuration = hls->current.duration;
+    hls->segments.push_back(hls->current);
+    hls->segIndex++;
+
+    // 滚动窗口，限制磁盘和内存占用
+    while ((int)hls->segments.size() > hls->windowSegments) {
+        RemoveSegmentFiles(hls, hls->segments.front());
+        hls->segments.pop_front();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* obs_output_info */
+
+static const char *llhls_output_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS LL-HLS Output";
+}
+
+static void llhls_output_get_latency(void *data, calldata_t *cd)
+{
+    llhls_output *hls = static_cast<llhls_output *>(data);
+    uint64_t count = hls->latencyCount;
+    calldata_set_int(cd, "count", (long long)count);
+    calldata_set_int(cd, "avg_ms", count ? (long long)(hls->latencyTotalUs /
+                                                       count / 1000) : 0);
+    calldata_set_int(cd, "max_ms", (long long)(hls->latencyMaxUs / 1000));
+}
+
+static void *llhls_output_create(obs_data_t *settings, obs_output_t *output)
+{
+    UNUSED_PARAMETER(settings);
+
+    llhls_output *hls = new llhls_output();
+    hls->output  = output;
+    hls->segFile = nullptr;
+    hls->active  = false;
+
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    proc_handler_add(ph, "void get_latency(out int count, out int avg_ms, "
+                         "out int max_ms)",
+                     llhls_output_get_latency, hls);
+    return hls;
+}
+
+static void llhls_output_destroy(void *data)
+{
+    llhls_output *hls = static_cast<llhls_output *>(data);
+    if (hls->segFile)
+        fclose(hls->segFile);
+    delete hls;
+}
+
+static void llhls_output_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_int(settings, "part_duration_ms", 333);
+    obs_data_set_default_double(settings, "segment_duration", 2.0);
+    obs_data_set_default_int(settings, "window_segments", 6);
+}
+
+static bool llhls_output_start(void *data)
+{
+    llhls_output *hls = static_cast<llhls_output *>(data);
+
+    if (!obs_output_can_begin_data_capture(hls->output, 0))
+        return false;
+    if (!obs_output_initialize_encoders(hls->output, 0))
+        return false;
+
+    obs_data_t *settings = obs_output_get_settings(hls->output);
+    hls->dir            = obs_data_get_string(settings, "path");
+    hls->partTarget     = obs_data_get_int(settings, "part_duration_ms") /
+                          1000.0;
+    hls->segmentTarget  = obs_data_get_double(settings, "segment_duration");
+    hls->windowSegments = (int)obs_data_get_int(settings, "window_segments");
+    obs_data_release(settings);
+
+    if (hls->dir.empty() || os_mkdirs(hls->dir.c_str()) == MKDIR_ERROR) {
+        blog(LOG_ERROR, "llhls: invalid output directory '%s'",
+             hls->dir.c_str());
+        return false;
+    }
+    if (hls->windowSegments < PARTS_IN_PLAYLIST_SEGMENTS + 1)
+        hls->windowSegments = PARTS_IN_PLAYLIST_SEGMENTS + 1;
+
+    obs_encoder_t *venc = obs_output_get_video_encoder(hls->output);
+    obs_encoder_t *aenc = obs_output_get_audio_encoder(hls->output, 0);
+    const struct video_output_info *voi =
+            video_output_get_info(obs_encoder_video(venc));
+    hls->frameDuration = (int64_t)FMP4_VIDEO_TIMESCALE * voi->fps_den /
+                         voi->fps_num;
+
+    // segment 只能在关键帧处切分，目标时长不小于编码器的关键帧间隔
+    obs_data_t *encSettings = obs_encoder_get_settings(venc);
+    double keyint = (double)obs_data_get_int(encSettings, "keyint_sec");
+    obs_data_release(encSettings);
+    if (keyint > hls->segmentTarget)
+        hls->segmentTarget = keyint;
+
+    double frameSec = (double)hls->frameDuration / FMP4_VIDEO_TIMESCALE;
+    if (hls->partTarget < frameSec)
+        hls->partTarget = frameSec;
+
+    hls->video.trackId   = FMP4_VIDEO_TRACK_ID;
+    hls->video.timescale = FMP4_VIDEO_TIMESCALE;
+    hls->audio.trackId   = FMP4_AUDIO_TRACK_ID;
+    hls->audio.timescale = obs_encoder_get_sample_rate(aenc);
+    std::unique_lock<std::mutex> lock(hls->mutex);
+    hls->video.clear();
+    hls->audio.clear();
+
+    hls->fragmentSeq    = 0;
+    hls->gotKeyframe    = false;
+    hls->segIndex       = 0;
+    hls->maxSegDuration = 0.0;
+    hls->partCaptureUs  = 0;
+    hls->segments.clear();
+    hls->latencyCount   = 0;
+    hls->latencyTotalUs = 0;
+    hls->latencyMaxUs   = 0;
+
+    if (!WriteInitSegment(hls))
+        return false;
+
+    hls->active = true;
+    lock.unlock();
+    obs_output_begin_data_capture(hls->output, 0);
+    blog(LOG_INFO, "llhls: output to '%s', part %.3fs, segment %.1fs",
+         hls->dir.c_str(), hls->partTarget, hls->segmentTarget);
+    return true;
+}
+
+static void llhls_output_stop(void *data, uint64_t ts)
+{
+    UNUSED_PARAMETER(ts);
+    llhls_output *hls = static_cast<llhls_output *>(data);
+
+    std::unique_lock<std::mutex> lock(hls->mutex);
+    if (hls->active && hls->gotKeyframe) {
+        int64_t endDts = hls->partStartDts;
+        if (!hls->video.samples.empty())
+            endDts = (int64_t)hls->video.baseTime + hls->frameDuration *
+                     (int64_t)hls->video.samples.size();
+        FlushPart(hls, endDts);
+        CloseSegment(hls, endDts);
+        WritePlaylist(hls, true);
+    }
+    hls->active = false;
+
+    uint64_t count = hls->latencyCount;
+    blog(LOG_INFO, "llhls: stopped, part availability latency avg %llu ms, "
+                   "max %llu ms (%llu parts)",
+         count ? (unsigned long long)(hls->latencyTotalUs / count / 1000) : 0,
+         (unsigned long long)(hls->latencyMaxUs / 1000),
+         (unsigned long long)count);
+    lock.unlock();
+
+    obs_output_end_data_capture(hls->output);
+}
+
+static void llhls_output_packet(void *data, struct encoder_packet *packet)
+{
+    llhls_output *hls = static_cast<llhls_output *>(data);
+    std::unique_lock<std::mutex> lock(hls->mutex);
+    if (!hls->active)
+        return;
+
+    if (packet->type == OBS_ENCODER_AUDIO) {
+        if (!hls->gotKeyframe)
+            return;
+
+        AppendFMP4AudioSample(hls->audio, packet);
+        return;
+    }
+
+    int64_t dts = ToTimescale(packet->dts, packet->timebase_num,
+                              packet->timebase_den, FMP4_VIDEO_TIMESCALE);
+    bool cut = false;
+
+    if (!hls->gotKeyframe) {
+        if (!packet->keyframe)
+            return;
+        hls->gotKeyframe     = true;
+        hls->partStartDts    = dts;
+        hls->partIndependent = true;
+        if (!OpenSegment(hls, dts)) {
+            hls->active = false;
+            lock.unlock();
+            obs_output_signal_stop(hls->output, OBS_OUTPUT_ERROR);
+            return;
+        }
+    } else {
+        double segElapsed  = double(dts - hls->segStartDts) /
+                             FMP4_VIDEO_TIMESCALE;
+        double partElapsed = double(dts + hls->frameDuration -
+                                    hls->partStartDts) / FMP4_VIDEO_TIMESCALE;
+        bool cutSegment = packet->keyframe && segElapsed >= hls->segmentTarget;
+        bool cutPart = cutSegment || partElapsed > hls->partTarget;
+
+        if (cutPart) {
+            if (!FlushPart(hls, dts)) {
+                hls->active = false;
+                lock.unlock();
+                obs_output_signal_stop(hls->output, OBS_OUTPUT_NO_SPACE);
+                return;
+            }
+            hls->partStartDts    = dts;
+            hls->partIndependent = packet->keyframe;
+            cut = true;
+        }
+        if (cutSegment) {
+            CloseSegment(hls, dts);
+            if (!OpenSegment(hls, dts)) {
+                hls->active = false;
+                lock.unlock();
+                obs_output_signal_stop(hls->output, OBS_OUTPUT_ERROR);
+                return;
+            }
+        }
+    }
+
+    if (cut)
+        WritePlaylist(hls, false);
+
+    if (!hls->partCaptureUs)
+        hls->partCaptureUs = (uint64_t)packet->sys_dts_usec;
+    AppendFMP4VideoSample(hls->video, packet, dts, hls->frameDuration);
+}
+
+void RegisterLLHLSOutput()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+
+    struct obs_output_info info = {};
+    info.id                   = LLHLS_OUTPUT_ID;
+    info.flags                = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED;
+    info.encoded_video_codecs = "h264";
+    info.encoded_audio_codecs = "aac";
+    info.get_name             = llhls_output_getname;
+    info.create               = llhls_output_create;
+    info.destroy              = llhls_output_destroy;
+    info.start                = llhls_output_start;
+    info.stop                 = llhls_output_stop;
+    info.encoded_packet       = llhls_output_packet;
+    info.get_defaults         = llhls_output_defaults;
+    obs_register_output(&info);
+
+    registered = true;
+}
@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+/**
+ * 本地 LL-HLS 输出（fMP4 分片 + partial segment + 滚动播放列表）
+ * 直接使用已有的 h264/aac 编码器输出的数据包，不需要录制结束后再转封装。
+ *
+ * 设置项：
+ *   path              输出目录，生成 init.mp4、segN.m4s、segN.P.m4s、index.m3u8
+ *   part_duration_ms  partial segment 目标时长
+ *   segment_duration  segment 最小时长（秒），实际在之后的第一个关键帧处切分
+ *   window_segments   播放列表保留的 segment 数量，更早的文件会被删除
+ *
+ * 通过 proc handler "get_latency" 获取分片可用延迟（采集时刻 -> 写入播放列表）。
+ */
+#define LLHLS_OUTPUT_ID "qtobs_llhls_output"
+
+// 需要在 obs_load_all_modules 之后调用，重复调用无副作用
+void RegisterLLHLSOutput();
@@ -0,0 +1,111 @@
+﻿#include "obs-packet-sink.h"
+
+// obs headers
+#include <util/platform.h>
+
+#include <string.h>
+
+static const char *packet_sink_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS Packet Sink";
+}
+
+static void packet_sink_get(void *data, calldata_t *cd)
+{
+    calldata_set_ptr(cd, "sink", data);
+}
+
+static void *packet_sink_create(obs_data_t *settings, obs_output_t *output)
+{
+    UNUSED_PARAMETER(settings);
+
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    PacketSink *sink = new PacketSink();
+    sink->output = output;
+    proc_handler_add(ph, "void get_sink(out ptr sink)", packet_sink_get, sink);
+    return sink;
+}
+
+static void packet_sink_destroy(void *data)
+{
+    delete static_cast<PacketSink *>(data);
+}
+
+static bool packet_sink_start(void *data)
+{
+    PacketSink *sink = static_cast<PacketSink *>(data);
+
+    if (!obs_output_can_begin_data_capture(sink->output, 0))
+        return false;
+    if (!obs_output_initialize_encoders(sink->output, 0))
+        return false;
+
+    obs_output_begin_data_capture(sink->output, 0);
+    return true;
+}
+
+static void packet_sink_stop(void *data, uint64_t ts)
+{
+    UNUSED_PARAMETER(ts);
+    PacketSink *sink = static_cast<PacketSink *>(data);
+    obs_output_end_data_capture(sink->output);
+}
+
+static void packet_sink_packet(void *data, struct encoder_packet *packet)
+{
+    PacketSink *sink = static_cast<PacketSink *>(data);
+    uint64_t now = os_gettime_ns() / 1000;
+
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    if (!sink->count)
+        sink->firstUs = now;
+    sink->lastUs = now;
+    sink->count++;
+    sink->bytes += packet->size;
+    if (sink->keepData)
+        sink->packets.push_back(std::vector<uint8_t>(packet->data,
+                                                     packet->data +
+                                                     packet->size));
+}
+
+PacketSink *GetPacketSink(obs_output_t *output)
+{
+    const char *id = obs_output_get_id(output);
+    if (!id || (strcmp(id, PACKET_SINK_VIDEO_OUTPUT_ID) != 0 &&
+                strcmp(id, PACKET_SINK_AUDIO_OUTPUT_ID) != 0))
+        return nullptr;
+
+    calldata_t cd = {0};
+    PacketSink *sink = nullptr;
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    if (proc_handler_call(ph, "get_sink", &cd))
+        sink = static_cast<PacketSink *>(calldata_ptr(&cd, "sink"));
+    calldata_free(&cd);
+    return sink;
+}
+
+void RegisterPacketSinkOutputs()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+
+    struct obs_output_info info = {};
+    info.get_name       = packet_sink_getname;
+    info.create         = packet_sink_create;
+    info.destroy        = packet_sink_destroy;
+    info.start          = packet_sink_start;
+    info.stop           = packet_sink_stop;
+    info.encoded_packet = packet_sink_packet;
+
+    info.id    = PACKET_SINK_VIDEO_OUTPUT_ID;
+    info.flags = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED;
+    obs_register_output(&info);
+
+    info.id    = PACKET_SINK_AUDIO_OUTPUT_ID;
+    info.flags = OBS_OUTPUT_AUDIO | OBS_OUTPUT_ENCODED;
+    obs_register_output(&info);
+
+    registered = true;
+}
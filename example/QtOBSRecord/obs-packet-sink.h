@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+/**
+ * 只收集编码数据包的输出，用于编码器探测/基准测试，不写文件也不推流。
+ * 视频和音频各注册一种类型（libobs 的输出 flags 需要和编码器一一对应）。
+ */
+#define PACKET_SINK_VIDEO_OUTPUT_ID "qtobs_packet_sink_video"
+#define PACKET_SINK_AUDIO_OUTPUT_ID "qtobs_packet_sink_audio"
+
+struct PacketSink
+{
+    obs_output_t *output;
+    std::mutex    mutex;
+
+    bool     keepData;   // 为 true 时保存数据包内容（用于解码比较画质）
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t firstUs;    // 收到第一个/最后一个包的时间（os_gettime_ns / 1000）
+    uint64_t lastUs;
+
+    std::vector<std::vector<uint8_t>> packets;
+
+    PacketSink() : output(nullptr), keepData(false), count(0), bytes(0),
+        firstUs(0), lastUs(0) {}
+};
+
+void RegisterPacketSinkOutputs();
+
+// 返回输出内部的 PacketSink，生命周期与输出相同
+PacketSink *GetPacketSink(obs_output_t *output);
@@ -0,0 +1,563 @@
+﻿#include "obs-post-process.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define LAG_POLL_INTERVAL_MS 1000
+#define MAX_FINISHED_JOBS    100     // 队列文件中保留的已完成/失败任务数
+
+static const char *JobTypeNames[]  = {"remux", "proxy", "archive"};
+static const char *JobStateNames[] = {"pending", "running", "done", "failed"};
+
+static int NameToIndex(const QString &name, const char *names[], int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (name == names[i])
+            return i;
+    }
+    return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 子进程优先级和挂起 */
+
+#if defined(_WIN32)
+
+typedef LONG (NTAPI *NtProcessFunc)(HANDLE);
+typedef LONG (NTAPI *NtSetInformationProcessFunc)(HANDLE, ULONG, PVOID, ULONG);
+
+#define PROCESS_IO_PRIORITY 33       // PROCESSINFOCLASS::ProcessIoPriority
+#define IO_PRIORITY_VERY_LOW 0
+
+static FARPROC GetNtFunction(const char *name)
+{
+    HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+    return ntdll ? GetProcAddress(ntdll, name) : nullptr;
+}
+
+static void SetIdleIoPriority(qint64 pid)
+{
+    NtSetInformationProcessFunc setInfo = (NtSetInformationProcessFunc)
+            GetNtFunction("NtSetInformationProcess");
+    HANDLE process = OpenProcess(PROCESS_SET_INFORMATION, FALSE, (DWORD)pid);
+    if (!setInfo || !process) {
+        if (process)
+            CloseHandle(process);
+        return;
+    }
+
+    ULONG priority = IO_PRIORITY_VERY_LOW;
+    setInfo(process, PROCESS_IO_PRIORITY, &priority, sizeof(priority));
+    CloseHandle(process);
+}
+
+static bool SuspendProcess(qint64 pid, bool suspend)
+{
+    if (pid <= 0)
+        return false;
+
+    NtProcessFunc func = (NtProcessFunc)GetNtFunction(
+            suspend ? "NtSuspendProcess" : "NtResumeProcess");
+    HANDLE process = OpenProcess(PROCESS_SUSPEND_RESUME, FALSE, (DWORD)pid);
+    bool success = func && process && func(process) >= 0;
+    if (process)
+        CloseHandle(process);
+    return success;
+}
+
+#else
+
+static bool SuspendProcess(qint64 pid, bool suspend)
+{
+    // pid 为 0 时 kill 会作用于整个进程组
+    if (pid <= 0)
+        return false;
+    return kill((pid_t)pid, suspend ? SIGSTOP : SIGCONT) == 0;
+}
+
+#endif
+
+/**
+ * CPU 优先级在创建进程时设置，避免子进程以正常优先级运行一段时间。
+ * Windows 通过 CreateProcess 的 flags，POSIX 在 fork 之后 exec 之前设置。
+ */
+class PostProcessProcess : public QProcess
+{
+public:
+    explicit PostProcessProcess(QObject *parent) : QProcess(parent)
+    {
+#if defined(_WIN32)
+        setCreateProcessArgumentsModifier(
+                [] (QProcess::CreateProcessArguments *args) {
+            args->flags |= IDLE_PRIORITY_CLASS | CREATE_NO_WINDOW;
+        });
+        connect(this, &QProcess::started, this, [this] () {
+            SetIdleIoPriority(processId());
+        });
+#endif
+    }
+
+protected:
+#if !defined(_WIN32)
+    void setupChildProcess() override
+    {
+        setpriority(PRIO_PROCESS, 0, 19);
+#if defined(__linux__)
+        // ioprio_set(IOPRIO_WHO_PROCESS, 0, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0))
+        syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+    }
+#endif
+};
+
+/* ------------------------------------------------------------------------- */
+
+PostProcessQueue::PostProcessQueue(QObject *parent) : QObject(parent),
+    nextId(1),
+    opened(false),
+    lagTimer(nullptr),
+    lagPaused(false),
+    userPaused(false),
+    lastLagNs(0),
+    pausedTotalNs(0),
+    pauseStartNs(0)
+{
+}
+
+PostProcessQueue::~PostProcessQueue()
+{
+    close();
+}
+
+bool PostProcessQueue::open(const QString &file_,
+                            const PostProcessConfig &config_)
+{
+    close();
+
+    file   = file_;
+    config = config_;
+    if (config.maxWorkers < 1)
+        config.maxWorkers = 1;
+    if (config.maxAttempts < 1)
+        config.maxAttempts = 1;
+
+    if (!load())
+        return false;
+
+    if (!lagTimer) {
+        lagTimer = new QTimer(this);
+        connect(lagTimer, &QTimer::timeout, this, &PostProcessQueue::pollLag);
+    }
+    lagTimer->start(LAG_POLL_INTERVAL_MS);
+
+    opened = true;
+    int pending = 0;
+    for (const PostProcessJob &job : queue)
+        pending += job.state == PostProcessJob::Pending;
+    blog(LOG_INFO, "post process: queue '%s', %d pending, ffmpeg '%s', "
+                   "%d workers",
+         file.toStdString().c_str(), pending,
+         findFFmpeg().toStdString().c_str(), config.maxWorkers);
+
+    schedule();
+    return true;
+}
+
+void PostProcessQueue::close()
+{
+    if (!opened)
+        return;
+
+    if (lagTimer)
+        lagTimer->stop();
+
+    // 中断的任务重新排队，不计入重试次数
+    for (const Worker &worker : workers) {
+        worker.process->disconnect(this);
+        if (paused())
+            SuspendProcess(worker.process->processId(), false);
+        worker.process->kill();
+        worker.process->waitForFinished(3000);
+        worker.process->deleteLater();
+
+        PostProcessJob *job = find(worker.jobId);
+        if (job) {
+            job->state = PostProcessJob::Pending;
+            job->attempts--;
+            QFile::remove(job->output + ".part");
+        }
+    }
+    workers.clear();
+
+    save();
+    opened = false;
+}
+
+QString PostProcessQueue::findFFmpeg() const
+{
+    if (!config.ffmpegPath.isEmpty())
+        return config.ffmpegPath;
+
+#if defined(_WIN32)
+    QString local = QCoreApplication::applicationDirPath() + "/ffmpeg.exe";
+#else
+    QString local = QCoreApplication::applicationDirPath() + "/ffmpeg";
+#endif
+    if (QFileInfo::exists(local))
+        return local;
+
+    QString found = QStandardPaths::findExecutable("ffmpeg");
+    return found.isEmpty() ? QString("ffmpeg") : found;
+}
+
+QStringList PostProcessQueue::arguments(const PostProcessJob &job) const
+{
+    QStringList args;
+    args << "-hide_banner" << "-nostdin" << "-loglevel" << "error" << "-y"
+         << "-i" << job.input;
+
+    QString threads = QString::number(config.threads);
+    switch (job.type) {
+    case PostProcessJob::Remux:
+        args << "-map" << "0" << "-c" << "copy";
+        break;
+    case PostProcessJob::Proxy:
+        args << "-map" << "0:v:0" << "-map" << "0:a?"
+             << "-vf" << QString("scale=-2:%1").arg(config.proxyHeight)
+             << "-c:v" << "libx264" << "-preset" << "veryfast"
+             << "-crf" << "28" << "-threads" << threads
+             << "-c:a" << "aac" << "-b:a" << "96k";
+        break;
+    case PostProcessJob::Archive:
+        args << "-map" << "0" << "-c:v" << "libx265" << "-preset" << "medium"
+             << "-crf" << QString::number(config.archiveCrf)
+             << "-x265-params" << "pools=" + threads
+             << "-tag:v" << "hvc1" << "-c:a" << "copy";
+        break;
+    }
+
+    // 先写 .part，成功后改名
+    args << "-movflags" << "+faststart" << "-f" << "mp4" << job.output + ".part";
+    return args;
+}
+
+int PostProcessQueue::enqueue(const QString &input, int types)
+{
+    if (!QFileInfo::exists(input)) {
+        blog(LOG_WARNING, "post process: input '%s' not found",
+             input.toStdString().c_str());
+        return 0;
+    }
+
+    QFileInfo info(input);
+    QString base = info.absolutePath() + "/" + info.completeBaseName();
+
+    int added = 0;
+    for (int type = PostProcessJob::Remux; type <= PostProcessJob::Archive;
+         type++) {
+        if (!(types & (1 << type)))
+            continue;
+
+        bool exists = false;
+        for (const PostProcessJob &job : queue) {
+            if (job.input == input && job.type == type &&
+                    job.state != PostProcessJob::Failed)
+                exists = true;
+        }
+        if (exists)
+            continue;
+
+        PostProcessJob job;
+        job.id     = nextId++;
+        job.type   = type;
+        job.input  = input;
+        job.output = base + "-" + JobTypeNames[type] + ".mp4";
+        queue.append(job);
+        added++;
+    }
+
+    if (added) {
+        save();
+        schedule();
+    }
+    return added;
+}
+
+PostProcessJob *PostProcessQueue::find(qint64 id)
+{
+    for (PostProcessJob &job : queue) {
+        if (job.id == id)
+            return &job;
+    }
+    return nullptr;
+}
+
+void PostProcessQueue::schedule()
+{
+    if (!opened || paused())
+        return;
+
+    for (PostProcessJob &job : queue) {
+        if (workers.size() >= config.maxWorkers)
+            break;
+        if (job.state == PostProcessJob::Pending)
+            start(job);
+    }
+}
+
+void PostProcessQueue::start(PostProcessJob &job)
+{
+    job.state = PostProcessJob::Running;
+    job.attempts++;
+    save();
+
+    PostProcessProcess *process = new PostProcessProcess(this);
+    process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process->setStandardOutputFile(QProcess::nullDevice());
+
+    connect(process, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                &QProcess::finished),
+            this, [this, process] (int exitCode, QProcess::ExitStatus status) {
+        finish(process, status == QProcess::NormalExit && exitCode == 0);
+    });
+    connect(process, &QProcess::errorOccurred,
+            this, [this, process] (QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart)
+            finish(process, false);
+    });
+
+    Worker worker;
+    worker.jobId   = job.id;
+    worker.process = process;
+    worker.startMs = QDateTime::currentMSecsSinceEpoch();
+    workers.append(worker);
+
+    blog(LOG_INFO, "post process: start job #%lld %s '%s' (attempt %d)",
+         job.id, JobTypeNames[job.type], job.input.toStdString().c_str(),
+         job.attempts);
+    process->start(findFFmpeg(), arguments(job));
+}
+
+void PostProcessQueue::finish(PostProcessProcess *process, bool success)
+{
+    int index = -1;
+    for (int i = 0; i < workers.size(); i++) {
+        if (workers[i].process == process)
+            index = i;
+    }
+    if (index < 0)
+        return;
+
+    Worker worker = workers.takeAt(index);
+    process->deleteLater();
+
+    PostProcessJob *job = find(worker.jobId);
+    if (!job)
+        return;
+
+    job->durationMs = QDateTime::currentMSecsSinceEpoch() - worker.startMs;
+    QString part = job->output + ".part";
+    if (success) {
+        QFile::remove(job->output);
+        success = QFile::rename(part, job->output);
+    } else {
+        QFile::remove(part);
+    }
+
+    if (success)
+        job->state = PostProcessJob::Done;
+    else if (job->attempts < config.maxAttempts)
+        job->state = PostProcessJob::Pending;
+    else
+        job->state = PostProcessJob::Failed;
+
+    blog(success ? LOG_INFO : LOG_WARNING,
+         "post process: job #%lld %s %s in %lld ms (%s)", job->id,
+         JobTypeNames[job->type], success ? "done" : "failed",
+         job->durationMs, JobStateNames[job->state]);
+
+    if (job->state != PostProcessJob::Pending)
+        emit jobFinished(job->id, job->type, success, job->output);
+
+    save();
+    schedule();
+}
+
+void PostProcessQueue::suspendWorkers(bool suspend)
+{
+    for (const Worker &worker : workers) {
+        if (!SuspendProcess(worker.process->processId(), suspend))
+            blog(LOG_WARNING, "post process: %s job #%lld failed",
+                 suspend ? "suspend" : "resume", worker.jobId);
+    }
+
+    uint64_t now = os_gettime_ns();
+    if (suspend) {
+        pauseStartNs = now;
+    } else if (pauseStartNs) {
+        pausedTotalNs += now - pauseStartNs;
+        pauseStartNs = 0;
+    }
+}
+
+void PostProcessQueue::setPaused(bool pause)
+{
+    bool wasPaused = paused();
+    userPaused = pause;
+    if (paused() == wasPaused)
+        return;
+
+    suspendWorkers(paused());
+    schedule();
+}
+
+void PostProcessQueue::pollLag()
+{
+    if (!lagProbe)
+        return;
+
+    uint64_t now = os_gettime_ns();
+    bool wasPaused = paused();
+
+    if (lagProbe()) {
+        lastLagNs = now;
+        if (!lagPaused)
+            blog(LOG_INFO, "post process: live output lagged, pause");
+        lagPaused = true;
+    } else if (lagPaused &&
+               now - lastLagNs >= (uint64_t)config.lagCooldownMs * 1000000) {
+        blog(LOG_INFO, "post process: no lag for %d ms, resume",
+             config.lagCooldownMs);
+        lagPaused = false;
+    }
+
+    if (paused() != wasPaused) {
+        suspendWorkers(paused());
+        schedule();
+    }
+}
+
+bool PostProcessQueue::load()
+{
+    queue.clear();
+    nextId = 1;
+
+    QFile f(file);
+    if (!f.exists())
+        return true;
+    if (!f.open(QIODevice::ReadOnly)) {
+        blog(LOG_ERROR, "post process: open '%s' failed",
+             file.toStdString().c_str());
+        return false;
+    }
+
+    QJsonObject root = QJsonDocument::fromJson(f.readAll()).object();
+    nextId = (qint64)root["next_id"].toDouble(1);
+    for (const QJsonValue &value : root["jobs"].toArray()) {
+        QJsonObject obj = value.toObject();
+        PostProcessJob job;
+        job.id         = (qint64)obj["id"].toDouble();
+        job.type       = NameToIndex(obj["type"].toString(), JobTypeNames, 3);
+        job.state      = NameToIndex(obj["state"].toString(), JobStateNames, 4);
+        job.attempts   = obj["attempts"].toInt();
+        job.input      = obj["input"].toString();
+        job.output     = obj["output"].toString();
+        job.durationMs = (qint64)obj["duration_ms"].toDouble();
+        if (job.type < 0 || job.state < 0 || job.input.isEmpty() ||
+                job.output.isEmpty())
+            continue;
+
+        // 上次退出时正在执行的任务重新排队，残留的 .part 丢弃
+        if (job.state == PostProcessJob::Running) {
+            QFile::remove(job.output + ".part");
+            job.state = job.attempts < config.maxAttempts ?
+                        PostProcessJob::Pending : PostProcessJob::Failed;
+        }
+        if (job.id >= nextId)
+            nextId = job.id + 1;
+        queue.append(job);
+    }
+    return true;
+}
+
+void PostProcessQueue::save()
+{
+    if (file.isEmpty())
+        return;
+
+    // 只保留最近的若干个已结束任务
+    int finished = 0;
+    for (int i = queue.size() - 1; i >= 0; i--) {
+        if (queue[i].state != PostProcessJob::Done &&
+                queue[i].state != PostProcessJob::Failed)
+            continue;
+        if (++finished > MAX_FINISHED_JOBS)
+            queue.removeAt(i);
+    }
+
+    QJsonArray list;
+    for (const PostProcessJob &job : queue) {
+        QJsonObject obj;
+        obj["id"]          = (double)job.id;
+        obj["type"]        = JobTypeNames[job.type];
+        obj["state"]       = JobStateNames[job.state];
+        obj["attempts"]    = job.attempts;
+        obj["input"]       = job.input;
+        obj["output"]      = job.output;
+        obj["duration_ms"] = (double)job.durationMs;
+        list.append(obj);
+    }
+
+    QJsonObject root;
+    root["next_id"] = (double)nextId;
+    root["jobs"]    = list;
+
+    QSaveFile f(file);
+    if (!f.open(QIODevice::WriteOnly) ||
+            f.write(QJsonDocument(root).toJson()) < 0 || !f.commit())
+        blog(LOG_WARNING, "post process: save '%s' failed",
+             file.toStdString().c_str());
+}
+
+void PostProcessQueue::logStats()
+{
+    int count[4] = {0, 0, 0, 0};
+    for (const PostProcessJob &job : queue)
+        count[job.state]++;
+    if (!queue.size())
+        return;
+
+    uint64_t pausedNs = pausedTotalNs;
+    if (pauseStartNs)
+        pausedNs += os_gettime_ns() - pauseStartNs;
+
+    blog(LOG_INFO, "post process stat, pending:%d running:%d done:%d "
+                   "failed:%d, paused:%s (total %.1f s)",
+         count[PostProcessJob::Pending], count[PostProcessJob::Running],
+         count[PostProcessJob::Done], count[PostProcessJob::Failed],
+         lagPaused ? "lag" : (userPaused ? "user" : "no"),
+         (double)pausedNs / 1000000000.0);
+}
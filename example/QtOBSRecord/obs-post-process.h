@@ -0,0 +1,136 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <QObject>
+#include <QList>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+
+#include <stdint.h>
+
+#include <functional>
+
+class QTimer;
+class PostProcessProcess;
+
+/* 录制完成后的处理任务 */
+struct PostProcessJob
+{
+    enum Type {
+        Remux,      // 流拷贝转封装为 faststart mp4
+        Proxy,      // 低分辨率代理文件
+        Archive     // 归档编码（HEVC）
+    };
+    enum State {
+        Pending,
+        Running,
+        Done,
+        Failed
+    };
+
+    qint64  id;
+    int     type;
+    int     state;
+    int     attempts;
+    QString input;
+    QString output;
+    qint64  durationMs;   // 最近一次执行的耗时
+
+    PostProcessJob() : id(0), type(Remux), state(Pending), attempts(0),
+        durationMs(0) {}
+};
+
+struct PostProcessConfig
+{
+    QString ffmpegPath;    // 为空时使用程序目录下的 ffmpeg，其次是 PATH 中的
+    int     maxWorkers;    // 同时执行的任务数
+    int     maxAttempts;   // 失败重试次数（包括进程崩溃、重启时中断的任务）
+    int     threads;       // 每个 ffmpeg 进程的编码线程数
+    int     proxyHeight;
+    int     archiveCrf;
+    int     lagCooldownMs; // 最近一次卡顿后保持暂停的时长
+
+    PostProcessConfig() : maxWorkers(1), maxAttempts(3), threads(2),
+        proxyHeight(360), archiveCrf(26), lagCooldownMs(30000) {}
+};
+
+/**
+ * 录制后处理队列：转封装、代理文件、归档编码，由 ffmpeg 子进程执行。
+ *
+ * - 子进程以最低的 CPU 和 I/O 优先级运行（Windows 为 IDLE_PRIORITY_CLASS +
+ *   IoPriorityVeryLow，Linux 为 nice 19 + IOPRIO_CLASS_IDLE），最多 maxWorkers 个；
+ * - 队列保存在 JSON 文件中，每次状态变化后原子写入；重启后中断的任务重新排队，
+ *   输出先写到 .part 文件，成功后改名，不会留下不完整的结果；
+ * - lagProbe 返回 true（直播/录制出现卡顿）时暂停：不再启动新任务并挂起正在执行的
+ *   子进程，卡顿消失 lagCooldownMs 后恢复。
+ */
+class PostProcessQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<bool()> LagProbe;
+
+    explicit PostProcessQueue(QObject *parent = nullptr);
+    ~PostProcessQueue();
+
+    // 加载队列文件并开始处理
+    bool open(const QString &file, const PostProcessConfig &config);
+    // 终止正在执行的任务（重新排队）并保存
+    void close();
+
+    bool isOpen() const { return opened; }
+    void setLagProbe(const LagProbe &probe) { lagProbe = probe; }
+
+    // types 为 PostProcessJob::Type 的位掩码（1 << Type），返回添加的任务数
+    int enqueue(const QString &input, int types);
+
+    bool paused() const { return lagPaused || userPaused; }
+    void setPaused(bool pause);
+
+    QList<PostProcessJob> jobs() const { return queue; }
+    void logStats();
+
+signals:
+    void jobFinished(qint64 id, int type, bool success, const QString &output);
+
+private slots:
+    void pollLag();
+
+private:
+    struct Worker
+    {
+        qint64             jobId;
+        PostProcessProcess *process;
+        qint64             startMs;
+    };
+
+    QString findFFmpeg() const;
+    QStringList arguments(const PostProcessJob &job) const;
+    PostProcessJob *find(qint64 id);
+    void schedule();
+    void start(PostProcessJob &job);
+    void finish(PostProcessProcess *process, bool success);
+    void suspendWorkers(bool suspend);
+    bool load();
+    void save();
+
+    QString               file;
+    PostProcessConfig     config;
+    QList<PostProcessJob> queue;
+    QList<Worker>         workers;
+    qint64                nextId;
+    bool                  opened;
+
+    LagProbe              lagProbe;
+    QTimer                *lagTimer;
+    bool                  lagPaused;
+    bool                  userPaused;
+    uint64_t              lastLagNs;
+    uint64_t              pausedTotalNs;
+    uint64_t              pauseStartNs;
+};
@@ -0,0 +1,74 @@
+﻿#include "obs-profiler-stats.h"
+
+// obs headers
+#include <util/profiler.h>
+#include <util/darray.h>
+
+#include <string.h>
+
+static bool profilerStarted = false;
+
+void StartProfiler()
+{
+    if (profilerStarted)
+        return;
+
+    profiler_start();
+    profilerStarted = true;
+}
+
+void StopProfiler()
+{
+    if (!profilerStarted)
+        return;
+
+    profiler_stop();
+    profiler_free();
+    profilerStarted = false;
+}
+
+static bool EnumProfilerEntry(void *context, profiler_snapshot_entry_t *entry)
+{
+    ProfilerStatsMap *stats = static_cast<ProfilerStatsMap *>(context);
+    const char *name = profiler_snapshot_entry_name(entry);
+
+    if (name) {
+        for (auto &it : *stats) {
+            const std::string &prefix = it.first;
+            if (strncmp(name, prefix.c_str(), prefix.size()) != 0)
+                continue;
+
+            ProfilerEntryStats &s = it.second;
+            profiler_time_entries_t *times =
+                    profiler_snapshot_entry_times(entry);
+            for (size_t i = 0; i < times->num; i++) {
+                s.totalUs += times->array[i].time_delta *
+                             times->array[i].count;
+                s.calls   += times->array[i].count;
+            }
+
+            uint64_t maxUs = profiler_snapshot_entry_max_time(entry);
+            if (maxUs > s.maxUs)
+                s.maxUs = maxUs;
+        }
+    }
+
+    profiler_snapshot_enumerate_children(entry, EnumProfilerEntry, context);
+    return true;
+}
+
+void QueryProfilerStats(ProfilerStatsMap &stats)
+{
+    for (auto &it : stats)
+        it.second = ProfilerEntryStats();
+
+    if (!profilerStarted)
+        return;
+
+    profiler_snapshot_t *snap = profile_snapshot_create();
+    if (!snap)
+        return;
+
+    profiler_snapshot_enumerate(snap, EnumProfilerEntry, &stats);
+    profile_snapshot_free(snap);
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+/**
+ * libobs 内部的 profile_start/profile_end 会记录各线程的耗时，
+ * 例如 "encode(编码器名)"、"obs_video_thread(...)"、"audio_thread(...)"，
+ * 这里对 profiler 快照做一个简单的查询封装。
+ * 时间单位与 libobs profiler 一致，为微秒。
+ */
+struct ProfilerEntryStats
+{
+    uint64_t calls;
+    uint64_t totalUs;
+    uint64_t maxUs;
+
+    ProfilerEntryStats() : calls(0), totalUs(0), maxUs(0) {}
+
+    double avgMs() const
+    {
+        return calls ? (double)totalUs / 1000.0 / (double)calls : 0.0;
+    }
+};
+
+typedef std::map<std::string, ProfilerEntryStats> ProfilerStatsMap;
+
+// 需要在 obs_startup 之前调用，否则 libobs 线程的耗时不会被记录
+void StartProfiler();
+void StopProfiler();
+
+/**
+ * 生成一次快照，按名称前缀累计 stats 中每个 key 对应的条目（包括子条目）。
+ * 返回的是自 profiler 启动以来的累计值，调用者自行计算区间差值。
+ */
+void QueryProfilerStats(ProfilerStatsMap &stats);
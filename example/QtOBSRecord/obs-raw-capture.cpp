@@ -0,0 +1,660 @@
+﻿#include "obs-raw-capture.h"
+#include "obs-frame-export.h"
+
+// obs headers
+#include <obs.h>
+#include <media-io/video-io.h>
+#include <media-io/audio-io.h>
+#include <util/platform.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define RAW_CAPTURE_VIDEO_SLOTS 8   // 写盘抖动时 tap 环可缓存的帧数
+#define RAW_CAPTURE_AUDIO_SLOTS 64
+
+static_assert(sizeof(RawCaptureRecord) == RAW_CAPTURE_ALIGN,
+              "RawCaptureRecord size mismatch");
+static_assert(sizeof(RawCaptureHeader) <= RAW_CAPTURE_HEADER_SIZE,
+              "RawCaptureHeader too large");
+
+static uint64_t AlignUp(uint64_t value)
+{
+    return (value + RAW_CAPTURE_ALIGN - 1) & ~(uint64_t)(RAW_CAPTURE_ALIGN - 1);
+}
+
+/* ------------------------------------------------------------------------- */
+/* 采集 */
+
+RawCaptureWriter::RawCaptureWriter(RawTapManager &taps_) :
+    taps(taps_),
+    videoTap(0),
+    audioTap(0),
+    header()
+{
+}
+
+RawCaptureWriter::~RawCaptureWriter()
+{
+    stop();
+}
+
+bool RawCaptureWriter::start(const std::string &path, bool audio)
+{
+    stop();
+
+    struct obs_video_info ovi;
+    if (!obs_get_video_info(&ovi))
+        return false;
+
+    header = RawCaptureHeader();
+    header.magic       = RAW_CAPTURE_MAGIC;
+    header.version     = RAW_CAPTURE_VERSION;
+    header.videoFormat = ovi.output_format;
+    header.width       = ovi.output_width;
+    header.height      = ovi.output_height;
+    header.fpsNum      = ovi.fps_num;
+    header.fpsDen      = ovi.fps_den;
+    header.colorspace  = ovi.colorspace;
+    header.range       = ovi.range;
+    header.planes      = GetPackedPlaneLayout(ovi.output_format,
+                                              ovi.output_width,
+                                              ovi.output_height,
+                                              header.linesize, header.lines);
+    header.createdNs   = os_gettime_ns();
+    if (!header.planes) {
+        blog(LOG_WARNING, "raw capture: unsupported video format %d",
+             (int)ovi.output_format);
+        return false;
+    }
+
+    struct obs_audio_info oai;
+    if (audio && obs_get_audio_info(&oai)) {
+        header.sampleRate = oai.samples_per_sec;
+        header.channels   = get_audio_channels(oai.speakers) >= 2 ? 2 : 1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!writer.open(path, BlockWriterConfig())) {
+            blog(LOG_WARNING, "raw capture: failed to open '%s'", path.c_str());
+            return false;
+        }
+
+        std::vector<uint8_t> buf(RAW_CAPTURE_HEADER_SIZE, 0);
+        memcpy(buf.data(), &header, sizeof(header));
+        writer.write(buf.data(), buf.size());
+        stats = RawCaptureStats();
+    }
+
+    RawVideoTapConfig videoConfig;
+    videoConfig.slots = RAW_CAPTURE_VIDEO_SLOTS;
+    videoTap = taps.addVideoTap("raw-capture", videoConfig,
+                                [this] (const RawVideoFrame &frame) {
+        if (frame.width != header.width || frame.height != header.height)
+            return;
+
+        RawCaptureRecord record = {};
+        record.type      = RAW_CAPTURE_VIDEO;
+        record.frames    = 1;
+        record.timestamp = frame.timestamp;
+        record.seq       = frame.seq;
+
+        size_t sizes[RAW_TAP_MAX_PLANES];
+        for (uint32_t i = 0; i < header.planes; i++) {
+            sizes[i] = (size_t)frame.linesize[i] * header.lines[i];
+            record.size += sizes[i];
+        }
+        writeRecord(record, frame.data, sizes, header.planes);
+    });
+
+    if (header.sampleRate) {
+        RawAudioTapConfig audioConfig;
+        audioConfig.channels = header.channels;
+        audioConfig.slots    = RAW_CAPTURE_AUDIO_SLOTS;
+        audioTap = taps.addAudioTap("raw-capture-audio", audioConfig,
+                                    [this] (const RawAudioChunk &chunk) {
+            RawCaptureRecord record = {};
+            record.type      = RAW_CAPTURE_AUDIO;
+            record.frames    = chunk.frames;
+            record.timestamp = chunk.timestamp;
+            record.seq       = chunk.seq;
+
+            const uint8_t *data[RAW_TAP_MAX_CHANNELS];
+            size_t sizes[RAW_TAP_MAX_CHANNELS];
+            for (uint32_t ch = 0; ch < chunk.channels; ch++) {
+                data[ch]  = reinterpret_cast<const uint8_t *>(chunk.data[ch]);
+                sizes[ch] = (size_t)chunk.frames * sizeof(float);
+                record.size += sizes[ch];
+            }
+            writeRecord(record, data, sizes, chunk.channels);
+        });
+    }
+
+    if (!videoTap) {
+        stop();
+        return false;
+    }
+
+    blog(LOG_INFO, "raw capture: '%s', %ux%u format %u, audio %u Hz %u ch",
+         path.c_str(), header.width, header.height, header.videoFormat,
+         header.sampleRate, header.channels);
+    return true;
+}
+
+void RawCaptureWriter::stop()
+{
+    // 先移除 tap（等待回调结束），之后不会再有写入
+    if (videoTap)
+        taps.removeTap(videoTap);
+    if (audioTap)
+        taps.removeTap(audioTap);
+    videoTap = 0;
+    audioTap = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!writer.isOpen())
+        return;
+
+    if (!writer.close())
+        stats.failed++;
+    blog(LOG_INFO, "raw capture stopped, video frames:%llu audio chunks:%llu "
+                   "bytes:%llu",
+         (unsigned long long)stats.videoFrames,
+         (unsigned long long)stats.audioChunks,
+         (unsigned long long)stats.bytes);
+}
+
+void RawCaptureWriter::writeRecord(const RawCaptureRecord &record,
+                                   const uint8_t *const *data,
+                                   const size_t *sizes, uint32_t count)
+{
+    static const uint8_t zeros[RAW_CAPTURE_ALIGN] = {};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!writer.isOpen())
+        return;
+
+    uint64_t start = os_gettime_ns();
+    bool success = writer.write(&record, sizeof(record));
+    for (uint32_t i = 0; i < count && success; i++)
+        success = writer.write(data[i], sizes[i]);
+    size_t pad = (size_t)(AlignUp(record.size) - record.size);
+    if (success && pad)
+        success = writer.write(zeros, pad);
+    uint64_t elapsed = os_gettime_ns() - start;
+
+    if (!success) {
+        stats.failed++;
+        return;
+    }
+
+    if (record.type == RAW_CAPTURE_VIDEO)
+        stats.videoFrames++;
+    else
+        stats.audioChunks++;
+    stats.bytes        += sizeof(record) + record.size + pad;
+    stats.writeTotalNs += elapsed;
+    stats.writeMaxNs    = std::max(stats.writeMaxNs, elapsed);
+}
+
+void RawCaptureWriter::getStats(RawCaptureStats &stats_) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats_ = stats;
+}
+
+void RawCaptureWriter::getWriterStats(BlockWriterStats &stats_) const
+{
+    writer.getStats(stats_);
+}
+
+/* ------------------------------------------------------------------------- */
+/* 读取 */
+
+RawCaptureFile::RawCaptureFile() : base(nullptr), length(0), file(nullptr),
+    mapping(nullptr), fd(-1), hdr(nullptr), videoCount(0)
+{
+}
+
+RawCaptureFile::~RawCaptureFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+static bool MapFileReadOnly(const std::string &path, void *&file,
+                            void *&mapping, const uint8_t *&base,
+                            uint64_t &length)
+{
+    wchar_t *wpath = nullptr;
+    os_utf8_to_wcs_ptr(path.c_str(), 0, &wpath);
+    HANDLE f = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    bfree(wpath);
+    if (f == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+        CloseHandle(f);
+        return false;
+    }
+
+    HANDLE m = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        return false;
+    }
+
+    void *view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+
+    file    = f;
+    mapping = m;
+    base    = static_cast<const uint8_t *>(view);
+    length  = (uint64_t)size.QuadPart;
+    return true;
+}
+
+void RawCaptureFile::close()
+{
+    if (base)
+        UnmapViewOfFile(base);
+    if (mapping)
+        CloseHandle(static_cast<HANDLE>(mapping));
+    if (file)
+        CloseHandle(static_cast<HANDLE>(file));
+    base       = nullptr;
+    mapping    = nullptr;
+    file       = nullptr;
+    length     = 0;
+    hdr        = nullptr;
+    videoCount = 0;
+    list.clear();
+}
+
+#else
+
+static bool MapFileReadOnly(const std::string &path, int &fd,
+                            const uint8_t *&base, uint64_t &length)
+{
+    int f = ::open(path.c_str(), O_RDONLY);
+    if (f < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(f, &st) != 0 || st.st_size == 0) {
+        ::close(f);
+        return false;
+    }
+
+    void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, f, 0);
+    if (view == MAP_FAILED) {
+        ::close(f);
+        return false;
+    }
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    fd     = f;
+    base   = static_cast<const uint8_t *>(view);
+    length = (uint64_t)st.st_size;
+    return true;
+}
+
+void RawCaptureFile::close()
+{
+    if (base)
+        munmap(const_cast<uint8_t *>(base), (size_t)length);
+    if (fd >= 0)
+        ::close(fd);
+    base       = nullptr;
+    fd         = -1;
+    length     = 0;
+    hdr        = nullptr;
+    videoCount = 0;
+    list.clear();
+}
+
+#endif
+
+bool RawCaptureFile::open(const std::string &path)
+{
+    close();
+
+#if defined(_WIN32)
+    bool success = MapFileReadOnly(path, file, mapping, base, length);
+#else
+    bool success = MapFileReadOnly(path, fd, base, length);
+#endif
+    if (!success)
+        return false;
+
+    hdr = reinterpret_cast<const RawCaptureHeader *>(base);
+    if (length < RAW_CAPTURE_HEADER_SIZE || hdr->magic != RAW_CAPTURE_MAGIC ||
+            hdr->version != RAW_CAPTURE_VERSION ||
+            hdr->planes > RAW_TAP_MAX_PLANES ||
+            hdr->channels > RAW_TAP_MAX_CHANNELS) {
+        close();
+        return false;
+    }
+
+    uint64_t videoSize = 0;
+    for (uint32_t i = 0; i < hdr->planes; i++)
+        videoSize += (uint64_t)hdr->linesize[i] * hdr->lines[i];
+
+    // 顺序扫描，遇到不完整或不合法的记录（采集时崩溃）停止
+    uint64_t pos = RAW_CAPTURE_HEADER_SIZE;
+    while (pos + sizeof(RawCaptureRecord) <= length) {
+        const RawCaptureRecord *record =
+                reinterpret_cast<const RawCaptureRecord *>(base + pos);
+        uint64_t end = pos + sizeof(RawCaptureRecord) + AlignUp(record->size);
+        if (end > length)
+            break;
+
+        bool valid = record->type == RAW_CAPTURE_VIDEO ?
+                     record->size == videoSize :
+                     record->type == RAW_CAPTURE_AUDIO &&
+                     record->size == (uint64_t)record->frames *
+                                     hdr->channels * sizeof(float);
+        if (!valid)
+            break;
+
+        Entry entry;
+        entry.type      = record->type;
+        entry.frames    = record->frames;
+        entry.timestamp = record->timestamp;
+        entry.data      = base + pos + sizeof(RawCaptureRecord);
+        entry.size      = record->size;
+        list.push_back(entry);
+
+        if (record->type == RAW_CAPTURE_VIDEO)
+            videoCount++;
+        pos = end;
+    }
+
+    // 画面和音频由不同的 tap 线程写入，按时间戳重新排序
+    std::stable_sort(list.begin(), list.end(),
+                     [] (const Entry &a, const Entry &b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    return !list.empty();
+}
+
+/* ------------------------------------------------------------------------- */
+/* 重放源 */
+
+struct RawReplaySource
+{
+    obs_source_t      *source;
+    std::mutex        mutex;       // update 与 video_tick
+    RawCaptureFile    file;
+    std::string       path;
+    int               rate;
+    bool              loop;
+
+    // RAW_REPLAY_RATE_ORIGINAL：按时间戳送出的线程
+    std::thread       thread;
+    std::atomic<bool> stopping;
+
+    // RAW_REPLAY_RATE_MAX：video_tick 中的游标
+    size_t            cursor;
+    uint64_t          baseNs;
+    uint64_t          loopOffsetNs;
+
+    uint64_t          videoFrames;
+    uint64_t          audioChunks;
+    uint64_t          loops;
+};
+
+// 一轮的时长：首尾时间戳之差再加一帧，循环时时间戳保持连续
+static uint64_t ReplayDuration(const RawCaptureFile &file)
+{
+    const std::vector<RawCaptureFile::Entry> &entries = file.entries();
+    const RawCaptureHeader &header = file.header();
+    uint64_t interval = header.fpsNum ?
+            1000000000ULL * header.fpsDen / header.fpsNum : 0;
+    return entries.back().timestamp - entries.front().timestamp + interval;
+}
+
+static void OutputEntry(RawReplaySource *s, const RawCaptureFile::Entry &entry,
+                        uint64_t timestamp)
+{
+    const RawCaptureHeader &header = s->file.header();
+
+    if (entry.type == RAW_CAPTURE_VIDEO) {
+        struct obs_source_frame frame = {};
+        const uint8_t *plane = entry.data;
+        for (uint32_t i = 0; i < header.planes; i++) {
+            frame.data[i]     = const_cast<uint8_t *>(plane);
+            frame.linesize[i] = header.linesize[i];
+            plane += (size_t)header.linesize[i] * header.lines[i];
+        }
+        frame.width      = header.width;
+        frame.height     = header.height;
+        frame.format     = (enum video_format)header.videoFormat;
+        frame.timestamp  = timestamp;
+        frame.full_range = header.range == VIDEO_RANGE_FULL;
+        video_format_get_parameters((enum video_colorspace)header.colorspace,
+                                    (enum video_range_type)header.range,
+                                    frame.color_matrix, frame.color_range_min,
+                                    frame.color_range_max);
+
+        // libobs 把画面拷贝进自己的缓存，数据直接从映射的文件读取
+        obs_source_output_video(s->source, &frame);
+        s->videoFrames++;
+    } else {
+        struct obs_source_audio audio = {};
+        for (uint32_t ch = 0; ch < header.channels; ch++)
+            audio.data[ch] = entry.data + (size_t)ch * entry.frames * sizeof(float);
+        audio.frames          = entry.frames;
+        audio.speakers        = header.channels >= 2 ? SPEAKERS_STEREO :
+                                                       SPEAKERS_MONO;
+        audio.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+        audio.samples_per_sec = header.sampleRate;
+        audio.timestamp       = timestamp;
+        obs_source_output_audio(s->source, &audio);
+        s->audioChunks++;
+    }
+}
+
+static void ReplayThread(RawReplaySource *s)
+{
+    os_set_thread_name("qtobs: raw replay");
+
+    const std::vector<RawCaptureFile::Entry> &entries = s->file.entries();
+    uint64_t first    = entries.front().timestamp;
+    uint64_t duration = ReplayDuration(s->file);
+    uint64_t start    = os_gettime_ns();
+
+    for (uint64_t offset = 0; !s->stopping; offset += duration) {
+        for (const RawCaptureFile::Entry &entry : entries) {
+            if (s->stopping)
+                return;
+
+            uint64_t timestamp = start + offset + (entry.timestamp - first);
+            os_sleepto_ns(timestamp);
+            OutputEntry(s, entry, timestamp);
+        }
+
+        if (!s->loop)
+            break;
+        s->loops++;
+    }
+}
+
+static void StopReplay(RawReplaySource *s)
+{
+    s->stopping = true;
+    if (s->thread.joinable())
+        s->thread.join();
+    s->stopping = false;
+}
+
+static const char *raw_replay_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS Raw Replay";
+}
+
+static void raw_replay_update(void *data, obs_data_t *settings)
+{
+    RawReplaySource *s = static_cast<RawReplaySource *>(data);
+    std::lock_guard<std::mutex> lock(s->mutex);
+
+    StopReplay(s);
+
+    std::string path = obs_data_get_string(settings, "path");
+    if (path != s->path) {
+        s->path = path;
+        s->file.close();
+        if (!path.empty() && !s->file.open(path))
+            blog(LOG_WARNING, "raw replay: failed to open '%s'", path.c_str());
+    }
+
+    s->rate         = (int)obs_data_get_int(settings, "rate");
+    s->loop         = obs_data_get_bool(settings, "loop");
+    s->cursor       = 0;
+    s->baseNs       = 0;
+    s->loopOffsetNs = 0;
+
+    // 最大速率时每渲染一帧送入一帧，不按时间戳缓冲，立即显示
+    obs_source_set_async_unbuffered(s->source, s->rate == RAW_REPLAY_RATE_MAX);
+
+    if (s->file.entries().empty())
+        return;
+
+    blog(LOG_INFO, "raw replay: '%s', %llu video frames, %s rate",
+         s->path.c_str(), (unsigned long long)s->file.videoFrames(),
+         s->rate == RAW_REPLAY_RATE_MAX ? "max" : "original");
+
+    if (s->rate == RAW_REPLAY_RATE_ORIGINAL)
+        s->thread = std::thread(ReplayThread, s);
+}
+
+static void *raw_replay_create(obs_data_t *settings, obs_source_t *source)
+{
+    RawReplaySource *s = new RawReplaySource();
+    s->source       = source;
+    s->rate         = RAW_REPLAY_RATE_ORIGINAL;
+    s->loop         = true;
+    s->stopping     = false;
+    s->cursor       = 0;
+    s->baseNs       = 0;
+    s->loopOffsetNs = 0;
+    s->videoFrames  = 0;
+    s->audioChunks  = 0;
+    s->loops        = 0;
+    raw_replay_update(s, settings);
+    return s;
+}
+
+static void raw_replay_destroy(void *data)
+{
+    RawReplaySource *s = static_cast<RawReplaySource *>(data);
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        StopReplay(s);
+    }
+
+    blog(LOG_INFO, "raw replay stopped, video frames:%llu audio chunks:%llu "
+                   "loops:%llu",
+         (unsigned long long)s->videoFrames,
+         (unsigned long long)s->audioChunks, (unsigned long long)s->loops);
+    delete s;
+}
+
+// 最大速率：每次 tick 送出下一帧画面和它之前的音频
+static void raw_replay_tick(void *data, float seconds)
+{
+    UNUSED_PARAMETER(seconds);
+
+    RawReplaySource *s = static_cast<RawReplaySource *>(data);
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (s->rate != RAW_REPLAY_RATE_MAX || !s->file.videoFrames())
+        return;
+
+    const std::vector<RawCaptureFile::Entry> &entries = s->file.entries();
+    uint64_t first = entries.front().timestamp;
+    if (!s->baseNs)
+        s->baseNs = os_gettime_ns();
+
+    for (;;) {
+        if (s->cursor >= entries.size()) {
+            if (!s->loop)
+                return;
+            s->cursor        = 0;
+            s->loopOffsetNs += ReplayDuration(s->file);
+            s->loops++;
+        }
+
+        const RawCaptureFile::Entry &entry = entries[s->cursor++];
+        OutputEntry(s, entry,
+                    s->baseNs + s->loopOffsetNs + (entry.timestamp - first));
+        if (entry.type == RAW_CAPTURE_VIDEO)
+            break;
+    }
+}
+
+static void raw_replay_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_int(settings, "rate", RAW_REPLAY_RATE_ORIGINAL);
+    obs_data_set_default_bool(settings, "loop", true);
+}
+
+static obs_properties_t *raw_replay_properties(void *data)
+{
+    UNUSED_PARAMETER(data);
+
+    obs_properties_t *props = obs_properties_create();
+    obs_properties_add_path(props, "path", "Capture file", OBS_PATH_FILE,
+                            "Raw capture (*.qorc)", nullptr);
+    obs_property_t *rate = obs_properties_add_list(props, "rate", "Rate",
+                                                   OBS_COMBO_TYPE_LIST,
+                                                   OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(rate, "Original", RAW_REPLAY_RATE_ORIGINAL);
+    obs_property_list_add_int(rate, "Max (one frame per render)",
+                              RAW_REPLAY_RATE_MAX);
+    obs_properties_add_bool(props, "loop", "Loop");
+    return props;
+}
+
+void RegisterRawReplaySource()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+
+    struct obs_source_info info = {};
+    info.id             = RAW_REPLAY_SOURCE_ID;
+    info.type           = OBS_SOURCE_TYPE_INPUT;
+    info.output_flags   = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO |
+                          OBS_SOURCE_DO_NOT_DUPLICATE;
+    info.get_name       = raw_replay_getname;
+    info.create         = raw_replay_create;
+    info.destroy        = raw_replay_destroy;
+    info.update         = raw_replay_update;
+    info.video_tick     = raw_replay_tick;
+    info.get_defaults   = raw_replay_defaults;
+    info.get_properties = raw_replay_properties;
+    obs_register_source(&info);
+
+    registered = true;
+}
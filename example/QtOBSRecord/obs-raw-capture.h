@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs-raw-tap.h"
+#include "obs-block-writer.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * 原始画面/音频采集文件，用于重放真实会话做可重复的性能测试。
+ *
+ * 文件 = RawCaptureHeader（RAW_CAPTURE_HEADER_SIZE） | 记录...
+ * 记录 = RawCaptureRecord | 数据 | 补零到 RAW_CAPTURE_ALIGN
+ * 视频数据为紧密排列的各个平面（GetPackedPlaneLayout），音频为 32 位浮点平面格式。
+ * 记录按到达顺序追加，没有索引，读取端映射整个文件后顺序扫描，
+ * 采集中途崩溃时丢弃最后不完整的记录即可。
+ */
+#define RAW_CAPTURE_MAGIC       0x43524f51u   // "QORC"
+#define RAW_CAPTURE_VERSION     1
+#define RAW_CAPTURE_HEADER_SIZE 4096
+#define RAW_CAPTURE_ALIGN       64
+
+#define RAW_REPLAY_SOURCE_ID    "qtobs_raw_replay_source"
+
+enum RawCaptureRecordType {
+    RAW_CAPTURE_VIDEO = 1,
+    RAW_CAPTURE_AUDIO = 2
+};
+
+/* 重放速率 */
+enum RawReplayRate {
+    RAW_REPLAY_RATE_ORIGINAL,  // 按采集时的时间戳
+    RAW_REPLAY_RATE_MAX        // 不按时钟等待，每渲染一帧送入下一帧，结果确定
+};
+
+struct RawCaptureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t videoFormat;     // libobs enum video_format，0 为没有视频
+    uint32_t width;
+    uint32_t height;
+    uint32_t fpsNum;
+    uint32_t fpsDen;
+    uint32_t colorspace;      // libobs enum video_colorspace
+    uint32_t range;           // libobs enum video_range_type
+    uint32_t planes;
+    uint32_t linesize[RAW_TAP_MAX_PLANES];
+    uint32_t lines[RAW_TAP_MAX_PLANES];
+    uint32_t sampleRate;      // 0 为没有音频
+    uint32_t channels;
+    uint64_t createdNs;       // 开始采集时的 os_gettime_ns()
+};
+
+struct RawCaptureRecord
+{
+    uint32_t type;            // RawCaptureRecordType
+    uint32_t frames;          // 音频的采样帧数，视频为 1
+    uint64_t size;            // 数据字节数，不含补零
+    uint64_t timestamp;       // libobs 时间戳（纳秒）
+    uint64_t seq;             // tap 序号，不连续说明采集时丢帧
+    uint8_t  reserved[RAW_CAPTURE_ALIGN - 32];
+};
+
+struct RawCaptureStats
+{
+    uint64_t videoFrames;
+    uint64_t audioChunks;
+    uint64_t bytes;
+    uint64_t writeTotalNs;    // tap 线程中写入（拷贝进块缓冲）的耗时
+    uint64_t writeMaxNs;
+    uint64_t failed;
+
+    RawCaptureStats() : videoFrames(0), audioChunks(0), bytes(0),
+        writeTotalNs(0), writeMaxNs(0), failed(0) {}
+};
+
+/**
+ * 采集：通过 RawTapManager 取输出画面和第 0 路混音，由 BlockFileWriter 顺序写入。
+ * 画面和音频 tap 各有一个线程，写文件时加锁串行化；写盘慢时 tap 环满丢帧并计数，
+ * 不会阻塞 libobs 的输出线程。
+ */
+class RawCaptureWriter
+{
+public:
+    explicit RawCaptureWriter(RawTapManager &taps);
+    ~RawCaptureWriter();
+
+    bool start(const std::string &path, bool audio);
+    void stop();
+    bool active() const { return videoTap != 0; }
+
+    void getStats(RawCaptureStats &stats) const;
+    void getWriterStats(BlockWriterStats &stats) const;
+
+private:
+    void writeRecord(const RawCaptureRecord &record, const uint8_t *const *data,
+                     const size_t *sizes, uint32_t count);
+
+    RawTapManager      &taps;
+    int                videoTap;
+    int                audioTap;
+    RawCaptureHeader   header;
+
+    mutable std::mutex mutex;
+    BlockFileWriter    writer;
+    RawCaptureStats    stats;
+};
+
+/* 只读映射采集文件并建立记录索引 */
+class RawCaptureFile
+{
+public:
+    struct Entry
+    {
+        uint32_t       type;
+        uint32_t       frames;
+        uint64_t       timestamp;
+        const uint8_t  *data;
+        uint64_t       size;
+    };
+
+    RawCaptureFile();
+    ~RawCaptureFile();
+
+    bool open(const std::string &path);
+    void close();
+
+    const RawCaptureHeader &header() const { return *hdr; }
+    const std::vector<Entry> &entries() const { return list; }
+    uint64_t videoFrames() const { return videoCount; }
+
+private:
+    const uint8_t          *base;
+    uint64_t               length;
+    void                   *file;
+    void                   *mapping;
+    int                    fd;
+    const RawCaptureHeader *hdr;
+    std::vector<Entry>     list;
+    uint64_t               videoCount;
+};
+
+// 注册 RAW_REPLAY_SOURCE_ID，设置项：path、rate（RawReplayRate）、loop
+void RegisterRawReplaySource();
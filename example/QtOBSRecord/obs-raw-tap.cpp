@@ -0,0 +1,544 @@
+﻿#include "obs-raw-tap.h"
+#include "obs-frame-export.h"
+
+// obs headers
+#include <obs.h>
+#include <media-io/video-io.h>
+#include <media-io/audio-io.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <string.h>
+
+static inline void UpdateMax(std::atomic<uint64_t> &max, uint64_t value)
+{
+    // 每个计数器只有一个写者
+    if (value > max.load(std::memory_order_relaxed))
+        max.store(value, std::memory_order_relaxed);
+}
+
+/* ------------------------------------------------------------------------- */
+/* SPSC 环 + 消费线程 */
+
+class RawTap
+{
+public:
+    RawTap(const std::string &name, bool video, uint32_t slots, size_t slotSize);
+    virtual ~RawTap();
+
+    bool startThread();
+    void stopThread();
+
+    // 由 connect/disconnect 注册到 libobs
+    virtual void connect() = 0;
+    virtual void disconnect() = 0;
+
+    void getStats(RawTapStats &stats) const;
+
+    void setDropHandler(RawTapDropHandler handler, void *param)
+    {
+        dropHandler = handler;
+        dropParam   = param;
+    }
+
+protected:
+    struct Slot {
+        std::vector<uint8_t> data;
+        uint64_t             timestamp;
+        uint64_t             seq;
+        uint32_t             frames;
+    };
+
+    // 生产者（输出线程）：取得可写的槽位，环满时通知 dropHandler 并返回 nullptr
+    Slot *acquire(uint64_t seq);
+    void publish();
+
+    virtual void deliver(const Slot &slot) = 0;
+
+    std::string            name;
+    bool                   video;
+    std::vector<Slot>      slots;
+    uint64_t               produced;    // 只由生产者访问
+
+    std::atomic<uint64_t>  delivered;
+    std::atomic<uint64_t>  dropped;
+    std::atomic<uint64_t>  decimated;
+    std::atomic<uint64_t>  pushTotalNs;
+    std::atomic<uint64_t>  pushMaxNs;
+    std::atomic<uint64_t>  callbackTotalNs;
+    std::atomic<uint64_t>  callbackMaxNs;
+
+    RawTapDropHandler      dropHandler;
+    void                   *dropParam;
+
+private:
+    static void *threadProc(void *param);
+
+    std::atomic<uint64_t>  head;        // 生产者写
+    std::atomic<uint64_t>  tail;        // 消费者写
+    std::atomic<bool>      stopping;
+    os_sem_t               *sem;
+    pthread_t              thread;
+    bool                   threadStarted;
+};
+
+RawTap::RawTap(const std::string &name_, bool video_, uint32_t count,
+               size_t slotSize) :
+    name(name_), video(video_), produced(0), delivered(0), dropped(0),
+    decimated(0), pushTotalNs(0), pushMaxNs(0), callbackTotalNs(0),
+    callbackMaxNs(0), dropHandler(nullptr), dropParam(nullptr), head(0),
+    tail(0), stopping(false), sem(nullptr), threadStarted(false)
+{
+    // 所有缓冲在添加 tap 时一次分配好
+    slots.resize(count < 2 ? 2 : count);
+    for (Slot &slot : slots) {
+        slot.data.resize(slotSize);
+        slot.timestamp = 0;
+        slot.seq       = 0;
+        slot.frames    = 0;
+    }
+}
+
+RawTap::~RawTap()
+{
+    stopThread();
+}
+
+bool RawTap::startThread()
+{
+    if (os_sem_init(&sem, 0) != 0)
+        return false;
+    if (pthread_create(&thread, nullptr, threadProc, this) != 0) {
+        os_sem_destroy(sem);
+        sem = nullptr;
+        return false;
+    }
+    threadStarted = true;
+    return true;
+}
+
+void RawTap::stopThread()
+{
+    if (!threadStarted)
+        return;
+
+    stopping.store(true, std::memory_order_release);
+    os_sem_post(sem);
+    pthread_join(thread, nullptr);
+    os_sem_destroy(sem);
+    sem = nullptr;
+    threadStarted = false;
+}
+
+RawTap::Slot *RawTap::acquire(uint64_t seq)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    if (h - t >= slots.size()) {
+        uint64_t total = dropped.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (dropHandler)
+            dropHandler(dropParam, name.c_str(), video, seq, total);
+        return nullptr;
+    }
+    return &slots[h % slots.size()];
+}
+
+void RawTap::publish()
+{
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+    os_sem_post(sem);
+}
+
+void *RawTap::threadProc(void *param)
+{
+    RawTap *tap = static_cast<RawTap *>(param);
+    std::string threadName = "qtobs: tap " + tap->name;
+    os_set_thread_name(threadName.c_str());
+
+    while (os_sem_wait(tap->sem) == 0) {
+        if (tap->stopping.load(std::memory_order_acquire))
+            break;
+
+        uint64_t t = tap->tail.load(std::memory_order_relaxed);
+        uint64_t h = tap->head.load(std::memory_order_acquire);
+        for (; t < h; t++) {
+            uint64_t start = os_gettime_ns();
+            tap->deliver(tap->slots[t % tap->slots.size()]);
+            uint64_t elapsed = os_gettime_ns() - start;
+
+            tap->delivered.fetch_add(1, std::memory_order_relaxed);
+            tap->callbackTotalNs.fetch_add(elapsed, std::memory_order_relaxed);
+            UpdateMax(tap->callbackMaxNs, elapsed);
+
+            // 回调返回后才释放槽位给生产者
+            tap->tail.store(t + 1, std::memory_order_release);
+        }
+    }
+    return nullptr;
+}
+
+void RawTap::getStats(RawTapStats &stats) const
+{
+    stats.name            = name;
+    stats.video           = video;
+    stats.delivered       = delivered.load(std::memory_order_relaxed);
+    stats.dropped         = dropped.load(std::memory_order_relaxed);
+    stats.decimated       = decimated.load(std::memory_order_relaxed);
+    stats.pushTotalNs     = pushTotalNs.load(std::memory_order_relaxed);
+    stats.pushMaxNs       = pushMaxNs.load(std::memory_order_relaxed);
+    stats.callbackTotalNs = callbackTotalNs.load(std::memory_order_relaxed);
+    stats.callbackMaxNs   = callbackMaxNs.load(std::memory_order_relaxed);
+}
+
+/* ------------------------------------------------------------------------- */
+/* 视频 */
+
+class RawVideoTap : public RawTap
+{
+public:
+    RawVideoTap(const std::string &name, const RawVideoTapConfig &config,
+                const video_scale_info &conversion, bool convert,
+                const uint32_t linesize[], const uint32_t lines[],
+                uint32_t planes, size_t frameSize,
+                const RawTapManager::VideoCallback &callback);
+
+    void connect() override;
+    void disconnect() override;
+
+private:
+    static void rawVideo(void *param, struct video_data *frame);
+    void deliver(const Slot &slot) override;
+
+    RawTapManager::VideoCallback callback;
+    video_scale_info conversion;
+    bool             convert;
+    uint32_t         divisor;
+    uint64_t         frameCount;   // 只由输出线程访问
+    uint32_t         planes;
+    uint32_t         linesize[RAW_TAP_MAX_PLANES];
+    uint32_t         lines[RAW_TAP_MAX_PLANES];
+    size_t           planeOffset[RAW_TAP_MAX_PLANES];
+};
+
+RawVideoTap::RawVideoTap(const std::string &name, const RawVideoTapConfig &config,
+                         const video_scale_info &conversion_, bool convert_,
+                         const uint32_t linesize_[], const uint32_t lines_[],
+                         uint32_t planes_, size_t frameSize,
+                         const RawTapManager::VideoCallback &callback_) :
+    RawTap(name, true, config.slots, frameSize),
+    callback(callback_), conversion(conversion_), convert(convert_),
+    divisor(config.divisor ? config.divisor : 1), frameCount(0),
+    planes(planes_)
+{
+    size_t offset = 0;
+    for (uint32_t i = 0; i < RAW_TAP_MAX_PLANES; i++) {
+        linesize[i]    = i < planes ? linesize_[i] : 0;
+        lines[i]       = i < planes ? lines_[i] : 0;
+        planeOffset[i] = offset;
+        offset += (size_t)linesize[i] * lines[i];
+    }
+}
+
+void RawVideoTap::connect()
+{
+    obs_add_raw_video_callback(convert ? &conversion : nullptr, rawVideo, this);
+}
+
+void RawVideoTap::disconnect()
+{
+    obs_remove_raw_video_callback(rawVideo, this);
+}
+
+void RawVideoTap::rawVideo(void *param, struct video_data *frame)
+{
+    RawVideoTap *tap = static_cast<RawVideoTap *>(param);
+    if (tap->frameCount++ % tap->divisor != 0) {
+        tap->decimated.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t start = os_gettime_ns();
+    uint64_t seq = tap->produced++;
+    Slot *slot = tap->acquire(seq);
+    if (!slot)
+        return;
+
+    uint8_t *dst = slot->data.data();
+    for (uint32_t i = 0; i < tap->planes; i++) {
+        uint8_t *plane = dst + tap->planeOffset[i];
+        uint32_t rowBytes = tap->linesize[i];
+        if (frame->linesize[i] == rowBytes) {
+            memcpy(plane, frame->data[i], (size_t)rowBytes * tap->lines[i]);
+            continue;
+        }
+        for (uint32_t y = 0; y < tap->lines[i]; y++)
+            memcpy(plane + (size_t)rowBytes * y,
+                   frame->data[i] + (size_t)frame->linesize[i] * y, rowBytes);
+    }
+    slot->timestamp = frame->timestamp;
+    slot->seq       = seq;
+    slot->frames    = 1;
+    tap->publish();
+
+    uint64_t elapsed = os_gettime_ns() - start;
+    tap->pushTotalNs.fetch_add(elapsed, std::memory_order_relaxed);
+    UpdateMax(tap->pushMaxNs, elapsed);
+}
+
+void RawVideoTap::deliver(const Slot &slot)
+{
+    RawVideoFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (uint32_t i = 0; i < planes; i++) {
+        frame.data[i]     = slot.data.data() + planeOffset[i];
+        frame.linesize[i] = linesize[i];
+    }
+    frame.planes    = planes;
+    frame.format    = conversion.format;
+    frame.width     = conversion.width;
+    frame.height    = conversion.height;
+    frame.timestamp = slot.timestamp;
+    frame.seq       = slot.seq;
+    callback(frame);
+}
+
+/* ------------------------------------------------------------------------- */
+/* 音频 */
+
+class RawAudioTap : public RawTap
+{
+public:
+    RawAudioTap(const std::string &name, const RawAudioTapConfig &config,
+                const audio_convert_info &conversion, uint32_t channels,
+                uint32_t maxFrames, const RawTapManager::AudioCallback &callback);
+
+    void connect() override;
+    void disconnect() override;
+
+private:
+    static void rawAudio(void *param, size_t mix, struct audio_data *data);
+    void deliver(const Slot &slot) override;
+
+    RawTapManager::AudioCallback callback;
+    audio_convert_info conversion;
+    size_t             mix;
+    uint32_t           channels;
+    uint32_t           maxFrames;
+};
+
+RawAudioTap::RawAudioTap(const std::string &name, const RawAudioTapConfig &config,
+                         const audio_convert_info &conversion_,
+                         uint32_t channels_, uint32_t maxFrames_,
+                         const RawTapManager::AudioCallback &callback_) :
+    RawTap(name, false, config.slots,
+           (size_t)channels_ * maxFrames_ * sizeof(float)),
+    callback(callback_), conversion(conversion_), mix(config.mix),
+    channels(channels_), maxFrames(maxFrames_)
+{
+}
+
+void RawAudioTap::connect()
+{
+    obs_add_raw_audio_callback(mix, &conversion, rawAudio, this);
+}
+
+void RawAudioTap::disconnect()
+{
+    obs_remove_raw_audio_callback(mix, rawAudio, this);
+}
+
+void RawAudioTap::rawAudio(void *param, size_t mix, struct audio_data *data)
+{
+    UNUSED_PARAMETER(mix);
+
+    RawAudioTap *tap = static_cast<RawAudioTap *>(param);
+    uint64_t start = os_gettime_ns();
+    uint64_t seq = tap->produced++;
+    Slot *slot = tap->acquire(seq);
+    if (!slot)
+        return;
+
+    uint32_t frames = data->frames < tap->maxFrames ? data->frames
+                                                    : tap->maxFrames;
+    float *dst = reinterpret_cast<float *>(slot->data.data());
+    for (uint32_t ch = 0; ch < tap->channels; ch++)
+        memcpy(dst + (size_t)ch * tap->maxFrames, data->data[ch],
+               frames * sizeof(float));
+    slot->timestamp = data->timestamp;
+    slot->seq       = seq;
+    slot->frames    = frames;
+    tap->publish();
+
+    uint64_t elapsed = os_gettime_ns() - start;
+    tap->pushTotalNs.fetch_add(elapsed, std::memory_order_relaxed);
+    UpdateMax(tap->pushMaxNs, elapsed);
+}
+
+void RawAudioTap::deliver(const Slot &slot)
+{
+    RawAudioChunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    const float *src = reinterpret_cast<const float *>(slot.data.data());
+    for (uint32_t ch = 0; ch < channels; ch++)
+        chunk.data[ch] = src + (size_t)ch * maxFrames;
+    chunk.channels   = channels;
+    chunk.frames     = slot.frames;
+    chunk.sampleRate = conversion.samples_per_sec;
+    chunk.timestamp  = slot.timestamp;
+    chunk.seq        = slot.seq;
+    callback(chunk);
+}
+
+/* ------------------------------------------------------------------------- */
+
+RawTapManager::RawTapManager() : nextId(1), dropHandler(nullptr),
+    dropParam(nullptr)
+{
+}
+
+RawTapManager::~RawTapManager()
+{
+    removeAll();
+}
+
+int RawTapManager::addVideoTap(const std::string &name,
+                               const RawVideoTapConfig &config,
+                               const VideoCallback &callback)
+{
+    const struct video_output_info *voi = video_output_get_info(obs_get_video());
+    if (!voi || !callback)
+        return 0;
+
+    video_scale_info conversion;
+    conversion.format     = config.format ? (enum video_format)config.format
+                                          : voi->format;
+    conversion.width      = config.width ? config.width : voi->width;
+    conversion.height     = config.height ? config.height : voi->height;
+    conversion.range      = voi->range;
+    conversion.colorspace = voi->colorspace;
+    bool convert = conversion.format != voi->format ||
+                   conversion.width != voi->width ||
+                   conversion.height != voi->height;
+
+    uint32_t linesize[RAW_TAP_MAX_PLANES] = {0};
+    uint32_t lines[RAW_TAP_MAX_PLANES] = {0};
+    uint32_t planes = GetPackedPlaneLayout(conversion.format, conversion.width,
+                                           conversion.height, linesize, lines);
+    if (!planes) {
+        blog(LOG_WARNING, "raw tap '%s': unsupported format %s", name.c_str(),
+             get_video_format_name(conversion.format));
+        return 0;
+    }
+    size_t frameSize = 0;
+    for (uint32_t i = 0; i < planes; i++)
+        frameSize += (size_t)linesize[i] * lines[i];
+
+    std::unique_ptr<RawTap> tap(new RawVideoTap(name, config, conversion,
+                                                convert, linesize, lines,
+                                                planes, frameSize, callback));
+    tap->setDropHandler(dropHandler, dropParam);
+    if (!tap->startThread())
+        return 0;
+    tap->connect();
+
+    blog(LOG_INFO, "raw tap '%s': video %ux%u %s, 1/%u frames, %u slots",
+         name.c_str(), conversion.width, conversion.height,
+         get_video_format_name(conversion.format),
+         config.divisor ? config.divisor : 1, config.slots);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int id = nextId++;
+    taps[id] = std::move(tap);
+    return id;
+}
+
+int RawTapManager::addAudioTap(const std::string &name,
+                               const RawAudioTapConfig &config,
+                               const AudioCallback &callback)
+{
+    audio_t *audio = obs_get_audio();
+    if (!audio || !callback || config.mix >= MAX_AUDIO_MIXES)
+        return 0;
+
+    const struct audio_output_info *aoi = audio_output_get_info(audio);
+    audio_convert_info conversion;
+    conversion.samples_per_sec = config.sampleRate ? config.sampleRate
+                                                   : aoi->samples_per_sec;
+    conversion.format   = AUDIO_FORMAT_FLOAT_PLANAR;
+    conversion.speakers = config.channels == 1 ? SPEAKERS_MONO :
+                          config.channels == 2 ? SPEAKERS_STEREO :
+                          aoi->speakers;
+
+    uint32_t channels = get_audio_channels(conversion.speakers);
+    if (channels > RAW_TAP_MAX_CHANNELS)
+        channels = RAW_TAP_MAX_CHANNELS;
+    // 重采样后每块的帧数会略有波动，按比例留出余量
+    uint32_t maxFrames = (uint32_t)((uint64_t)AUDIO_OUTPUT_FRAMES *
+                                    conversion.samples_per_sec /
+                                    aoi->samples_per_sec) + 64;
+
+    std::unique_ptr<RawTap> tap(new RawAudioTap(name, config, conversion,
+                                                channels, maxFrames, callback));
+    tap->setDropHandler(dropHandler, dropParam);
+    if (!tap->startThread())
+        return 0;
+    tap->connect();
+
+    blog(LOG_INFO, "raw tap '%s': audio mix %d, %u Hz %u ch, %u slots",
+         name.c_str(), (int)config.mix, conversion.samples_per_sec, channels,
+         config.slots);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int id = nextId++;
+    taps[id] = std::move(tap);
+    return id;
+}
+
+void RawTapManager::removeTap(int id)
+{
+    std::unique_ptr<RawTap> tap;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = taps.find(id);
+        if (it == taps.end())
+            return;
+        tap = std::move(it->second);
+        taps.erase(it);
+    }
+
+    // 先断开 libobs 回调（会等待正在执行的回调），再停止消费线程
+    tap->disconnect();
+    tap->stopThread();
+}
+
+void RawTapManager::removeAll()
+{
+    std::map<int, std::unique_ptr<RawTap>> removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        removed.swap(taps);
+    }
+
+    for (auto &it : removed) {
+        it.second->disconnect();
+        it.second->stopThread();
+    }
+}
+
+void RawTapManager::getStats(std::vector<RawTapStats> &stats) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.clear();
+    for (const auto &it : taps) {
+        RawTapStats s;
+        it.second->getStats(s);
+        stats.push_back(s);
+    }
+}
+
+void RawTapManager::setDropHandler(RawTapDropHandler handler, void *param)
+{
+    dropHandler = handler;
+    dropParam   = param;
+}
@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define RAW_TAP_MAX_PLANES 4
+#define RAW_TAP_MAX_CHANNELS 8
+
+/**
+ * 进程内的原始画面/音频旁路（tap）：OCR、缩略图、校验和等消费者直接拿输出画面和混音，
+ * 不需要解码录制文件。
+ *
+ * 每个 tap 通过 obs_add_raw_video_callback / obs_add_raw_audio_callback 单独注册，
+ * 缩放和格式转换由 libobs 的 video-io/audio-io 完成。输出线程中只做：
+ * 抽帧计数 -> 检查 SPSC 环是否已满 -> memcpy 到预分配的槽位 -> 发布 -> os_sem_post，
+ * 不分配内存、不加锁、不等待消费者；环满时丢弃并计数。
+ * 每个 tap 有自己的消费线程调用回调，回调慢只会导致该 tap 丢帧。
+ */
+struct RawVideoFrame
+{
+    const uint8_t *data[RAW_TAP_MAX_PLANES];
+    uint32_t      linesize[RAW_TAP_MAX_PLANES];
+    uint32_t      planes;
+    int           format;     // libobs enum video_format
+    uint32_t      width;
+    uint32_t      height;
+    uint64_t      timestamp;
+    uint64_t      seq;        // 通过抽帧后的帧序号，包括被丢弃的帧
+};
+
+struct RawAudioChunk
+{
+    const float *data[RAW_TAP_MAX_CHANNELS];   // 32 位浮点平面格式
+    uint32_t    channels;
+    uint32_t    frames;
+    uint32_t    sampleRate;
+    uint64_t    timestamp;
+    uint64_t    seq;
+};
+
+struct RawVideoTapConfig
+{
+    uint32_t width;      // 缩放后的分辨率，0 为输出分辨率
+    uint32_t height;
+    int      format;     // 0 (VIDEO_FORMAT_NONE) 为输出格式
+    uint32_t divisor;    // 每 divisor 帧取一帧，1 为不抽帧
+    uint32_t slots;      // 预分配的帧数（环的容量）
+
+    RawVideoTapConfig() : width(0), height(0), format(0), divisor(1), slots(3) {}
+};
+
+struct RawAudioTapConfig
+{
+    size_t   mix;         // 混音轨
+    uint32_t sampleRate;  // 0 为输出采样率
+    uint32_t channels;    // 0 为输出声道数，支持 1/2
+    uint32_t slots;
+
+    RawAudioTapConfig() : mix(0), sampleRate(0), channels(0), slots(16) {}
+};
+
+/**
+ * 环满丢帧时在输出线程中调用，不能阻塞；seq 为被丢弃的帧序号，dropped 为该 tap
+ * 累计的丢弃数
+ */
+typedef void (*RawTapDropHandler)(void *param, const char *name, bool video,
+                                  uint64_t seq, uint64_t dropped);
+
+struct RawTapStats
+{
+    std::string name;
+    bool        video;
+    uint64_t    delivered;      // 已交给回调
+    uint64_t    dropped;        // 环满被丢弃
+    uint64_t    decimated;      // 抽帧跳过
+    uint64_t    pushTotalNs;    // 输出线程中的耗时
+    uint64_t    pushMaxNs;
+    uint64_t    callbackTotalNs;
+    uint64_t    callbackMaxNs;
+};
+
+class RawTap;
+
+class RawTapManager
+{
+public:
+    typedef std::function<void(const RawVideoFrame &)> VideoCallback;
+    typedef std::function<void(const RawAudioChunk &)> AudioCallback;
+
+    RawTapManager();
+    ~RawTapManager();
+
+    /**
+     * 添加 tap，返回 id（失败返回 0）。可在任意线程调用，需要在 obs_reset_video/
+     * obs_reset_audio 之后；回调在 tap 自己的线程中执行
+     */
+    int addVideoTap(const std::string &name, const RawVideoTapConfig &config,
+                    const VideoCallback &callback);
+    int addAudioTap(const std::string &name, const RawAudioTapConfig &config,
+                    const AudioCallback &callback);
+
+    // 等待正在执行的回调结束后返回
+    void removeTap(int id);
+    void removeAll();
+
+    void getStats(std::vector<RawTapStats> &stats) const;
+
+    // 需要在添加 tap 之前调用，只对之后添加的 tap 生效
+    void setDropHandler(RawTapDropHandler handler, void *param);
+
+private:
+    mutable std::mutex                      mutex;
+    std::map<int, std::unique_ptr<RawTap>>  taps;
+    int                                     nextId;
+    RawTapDropHandler                       dropHandler;
+    void                                    *dropParam;
+};
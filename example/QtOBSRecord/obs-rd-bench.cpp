@@ -0,0 +1,772 @@
+﻿#include "obs-rd-bench.h"
+#include "obs-encoder-probe.h"
+#include "obs-packet-sink.h"
+#include "obs-raw-capture.h"
+#include "obs-roi-encoder.h"
+#include "obs-video-quality.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <memory>
+
+#define RD_BENCH_FILE       "rd-bench.csv"
+#define RD_BENCH_CLIPS_FILE "rd-bench-clips.csv"
+#define RD_ROI_FILE         "rd-roi.csv"
+#define RD_REALTIME_MARGIN  1.5    // 推荐配置的编码帧率至少为目标帧率的倍数
+
+static const char *defaultPresets[] = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast", "medium", nullptr
+};
+static const char *defaultTunes[] = {"", "stillimage", nullptr};
+static const int defaultCrfs[]     = {18, 20, 22, 24, 26, 28, 0};
+static const int defaultBitrates[] = {1000, 1500, 2500, 4000, 6000, 0};
+static const int defaultKeyints[]  = {2, 10, 0};
+
+std::string RDBenchConfig::label() const
+{
+    std::string text = encoder;
+    if (!preset.empty())
+        text += "/" + preset;
+    if (!tune.empty())
+        text += "/" + tune;
+    text += "/" + rateControl + "=" + std::to_string(value);
+    text += "/keyint=" + std::to_string(keyintSec);
+    return text;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 片段 */
+
+struct RDClip
+{
+    std::string                    name;
+    std::unique_ptr<RawCaptureFile> file;   // 为空时是合成画面
+    std::vector<const uint8_t *>   frames;
+    int                            format;
+    uint32_t                       width;
+    uint32_t                       height;
+    uint32_t                       fpsNum;
+    uint32_t                       fpsDen;
+    int                            count;
+
+    RDClip() : format(VIDEO_FORMAT_I420), width(0), height(0), fpsNum(0),
+        fpsDen(1), count(0) {}
+};
+
+static bool LoadCaptureClip(const std::string &path, int maxFrames,
+                            RDClip &clip)
+{
+    clip.file.reset(new RawCaptureFile());
+    if (!clip.file->open(path))
+        return false;
+
+    const RawCaptureHeader &header = clip.file->header();
+    if (header.videoFormat != VIDEO_FORMAT_I420 &&
+            header.videoFormat != VIDEO_FORMAT_NV12) {
+        blog(LOG_WARNING, "rd bench: '%s' format %u is not supported",
+             path.c_str(), header.videoFormat);
+        return false;
+    }
+
+    for (const RawCaptureFile::Entry &entry : clip.file->entries()) {
+        if (entry.type != RAW_CAPTURE_VIDEO)
+            continue;
+        clip.frames.push_back(entry.data);
+        if ((int)clip.frames.size() >= maxFrames)
+            break;
+    }
+
+    clip.format = (int)header.videoFormat;
+    clip.width  = header.width;
+    clip.height = header.height;
+    clip.fpsNum = header.fpsNum;
+    clip.fpsDen = header.fpsDen ? header.fpsDen : 1;
+    clip.count  = (int)clip.frames.size();
+    return clip.count > 1;
+}
+
+static void LoadClips(const RDBenchOptions &options,
+                      std::vector<std::unique_ptr<RDClip>> &clips)
+{
+    os_dir_t *dir = options.corpusDir.empty() ? nullptr
+                  : os_opendir(options.corpusDir.c_str());
+    struct os_dirent *ent;
+    while (dir && (ent = os_readdir(dir)) != nullptr) {
+        if (ent->directory)
+            continue;
+        const char *ext = os_get_path_extension(ent->d_name);
+        if (!ext || astrcmpi(ext, ".qorc") != 0)
+            continue;
+
+        std::string path = options.corpusDir + "/" + ent->d_name;
+        std::unique_ptr<RDClip> clip(new RDClip());
+        clip->name = ent->d_name;
+        if (LoadCaptureClip(path, options.maxFrames, *clip))
+            clips.push_back(std::move(clip));
+        else
+            blog(LOG_WARNING, "rd bench: skip '%s'", path.c_str());
+    }
+    if (dir)
+        os_closedir(dir);
+
+    // 按名字排序，保证多次运行的顺序一致
+    std::sort(clips.begin(), clips.end(),
+              [] (const std::unique_ptr<RDClip> &a,
+                  const std::unique_ptr<RDClip> &b) {
+        return a->name < b->name;
+    });
+
+    if (clips.empty()) {
+        std::unique_ptr<RDClip> clip(new RDClip());
+        clip->name   = "synthetic";
+        clip->width  = options.width & ~1u;
+        clip->height = options.height & ~1u;
+        clip->fpsNum = options.fps;
+        clip->count  = options.maxFrames;
+        clips.push_back(std::move(clip));
+    }
+}
+
+static void FillClipFrame(const RDClip &clip, struct video_frame *frame,
+                          uint32_t index)
+{
+    if (!clip.file) {
+        FillSyntheticFrame(frame, (int)clip.width, (int)clip.height, index);
+        return;
+    }
+
+    // 采集文件中各平面紧密排列
+    const RawCaptureHeader &header = clip.file->header();
+    const uint8_t *src = clip.frames[index];
+    for (uint32_t p = 0; p < header.planes && p < MAX_AV_PLANES; p++) {
+        uint32_t bytes = std::min(header.linesize[p], frame->linesize[p]);
+        for (uint32_t y = 0; y < header.lines[p]; y++)
+            memcpy(frame->data[p] + y * frame->linesize[p],
+                   src + y * header.linesize[p], bytes);
+        src += (size_t)header.linesize[p] * header.lines[p];
+    }
+}
+
+static const uint8_t *ClipLuma(const RDClip &clip, uint32_t index,
+                               std::vector<uint8_t> &scratch, int &linesize)
+{
+    if (clip.file) {
+        linesize = (int)clip.file->header().linesize[0];
+        return clip.frames[index];
+    }
+
+    scratch.resize((size_t)clip.width * clip.height);
+    RenderSyntheticLuma(scratch.data(), (int)clip.width, (int)clip.width,
+                        (int)clip.height, index);
+    linesize = (int)clip.width;
+    return scratch.data();
+}
+
+/* ------------------------------------------------------------------------- */
+/* 测试组合 */
+
+template <typename T>
+static std::vector<T> OrDefault(const std::vector<T> &values, const T *list,
+                                T end)
+{
+    if (!values.empty())
+        return values;
+    std::vector<T> result;
+    for (const T *v = list; *v != end; v++)
+        result.push_back(*v);
+    return result;
+}
+
+static std::vector<std::string> OrDefault(
+        const std::vector<std::string> &values, const char **list)
+{
+    if (!values.empty())
+        return values;
+    std::vector<std::string> result;
+    for (const char **v = list; *v; v++)
+        result.push_back(*v);
+    return result;
+}
+
+static void BuildConfigs(const RDBenchOptions &options,
+                         std::vector<RDBenchConfig> &configs)
+{
+    std::vector<std::string> encoders = options.encoders;
+    if (encoders.empty()) {
+        std::vector<std::string> audio;
+        EnumProbeEncoders(encoders, audio);
+    }
+
+    std::vector<std::string> presets = OrDefault(options.presets, defaultPresets);
+    std::vector<std::string> tunes   = OrDefault(options.tunes, defaultTunes);
+    std::vector<int> crfs     = OrDefault(options.crfs, defaultCrfs, 0);
+    std::vector<int> bitrates = OrDefault(options.bitrates, defaultBitrates, 0);
+    std::vector<int> keyints  = OrDefault(options.keyints, defaultKeyints, 0);
+
+    for (const std::string &encoder : encoders) {
+        bool x264 = encoder == "obs_x264";
+        std::vector<std::string> encPresets = x264 ? presets
+                                            : std::vector<std::string>(1);
+        std::vector<std::string> encTunes = x264 ? tunes
+                                          : std::vector<std::string>(1);
+        const std::vector<int> &values = x264 ? crfs : bitrates;
+
+        for (const std::string &preset : encPresets)
+        for (const std::string &tune : encTunes)
+        for (int value : values)
+        for (int keyint : keyints) {
+            RDBenchConfig c;
+            c.encoder     = encoder;
+            c.preset      = preset;
+            c.tune        = tune;
+            c.rateControl = x264 ? "CRF" : "CBR";
+            c.value       = value;
+            c.keyintSec   = keyint;
+            configs.push_back(c);
+        }
+    }
+
+    // 现行配置不在网格中时单独加入
+    if (!options.current.encoder.empty()) {
+        std::string label = options.current.label();
+        bool found = false;
+        for (const RDBenchConfig &c : configs)
+            found = found || c.label() == label;
+        if (!found)
+            configs.push_back(options.current);
+    }
+}
+
+static obs_data_t *CreateSettings(const RDBenchOptions &options,
+                                  const RDBenchConfig &config)
+{
+    obs_data_t *settings = obs_encoder_defaults(config.encoder.c_str());
+    if (!config.preset.empty())
+        obs_data_set_string(settings, "preset", config.preset.c_str());
+    if (!config.tune.empty())
+        obs_data_set_string(settings, "tune", config.tune.c_str());
+    obs_data_set_string(settings, "rate_control", config.rateControl.c_str());
+    if (config.rateControl == "CRF")
+        obs_data_set_int(settings, "crf", config.value);
+    else
+        obs_data_set_int(settings, "bitrate", config.value);
+    obs_data_set_int(settings, "keyint_sec", config.keyintSec);
+    obs_data_set_string(settings, "profile", "main");
+    bool x264 = config.encoder == "obs_x264" ||
+                config.encoder == ROI_ENCODER_ID;
+    if (x264 && !options.x264opts.empty())
+        obs_data_set_string(settings, "x264opts", options.x264opts.c_str());
+    return settings;
+}
+
+struct RDClipResult
+{
+    bool   ok;
+    double kbps;
+    double fps;
+    double cpuMsPerFrame;
+    double psnr;
+    double ssim;
+    double vifp;
+
+    RDClipResult() : ok(false), kbps(0.0), fps(0.0), cpuMsPerFrame(0.0),
+        psnr(0.0), ssim(0.0), vifp(0.0) {}
+};
+
+static RDClipResult RunClip(ProbeVideo &probe, const RDClip &clip,
+                            const RDBenchOptions &options,
+                            const RDBenchConfig &config, size_t index)
+{
+    RDClipResult result;
+
+    obs_data_t *settings = CreateSettings(options, config);
+    std::string name = "qtobs-rd-" + std::to_string(index) + "-" + clip.name;
+    ProbeEncodeResult encoded;
+    bool success = ProbeEncode(probe, config.encoder.c_str(), name.c_str(),
+                               settings, clip.count,
+                               [&] (struct video_frame *frame, uint32_t i) {
+        FillClipFrame(clip, frame, i);
+    }, encoded);
+    obs_data_release(settings);
+    if (!success)
+        return result;
+
+    // 码率按实际输出的帧数计算（lookahead 中的帧没有 flush）
+    double seconds = (double)encoded.count * clip.fpsDen / clip.fpsNum;
+    result.kbps          = (double)encoded.bytes * 8.0 / seconds / 1000.0;
+    result.fps           = encoded.fps;
+    result.cpuMsPerFrame = encoded.cpuMsPerFrame;
+
+    int width  = (int)clip.width;
+    int height = (int)clip.height;
+    int interval = std::max(options.metricInterval, 1);
+    std::vector<uint8_t> scratch;
+    double mseSum = 0.0, ssimSum = 0.0, vifSum = 0.0;
+    int compared = 0;
+    DecodeH264Packets(encoded.header.data(), encoded.header.size(),
+                      encoded.packets,
+                      [&] (int i, const uint8_t *luma, int linesize,
+                           int w, int h) {
+        if (w != width || h != height || i >= clip.count || i % interval)
+            return;
+
+        int refLinesize;
+        const uint8_t *ref = ClipLuma(clip, (uint32_t)i, scratch,
+                                      refLinesize);
+        mseSum  += LumaMse(luma, linesize, ref, refLinesize, width, height);
+        ssimSum += LumaSsim(ref, refLinesize, luma, linesize, width, height);
+        vifSum  += LumaVifp(ref, refLinesize, luma, linesize, width, height);
+        compared++;
+    });
+
+    if (compared) {
+        result.psnr = MseToPsnr(mseSum / compared);
+        result.ssim = ssimSum / compared;
+        result.vifp = vifSum / compared;
+        result.ok   = true;
+    }
+    return result;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Pareto 前沿和推荐 */
+
+static bool Dominates(const RDBenchPoint &a, const RDBenchPoint &b)
+{
+    bool noWorse = a.cpuMsPerFrame <= b.cpuMsPerFrame && a.kbps <= b.kbps &&
+                   a.vifp >= b.vifp;
+    bool better  = a.cpuMsPerFrame < b.cpuMsPerFrame || a.kbps < b.kbps ||
+                   a.vifp > b.vifp;
+    return noWorse && better;
+}
+
+static void MarkPareto(std::vector<RDBenchPoint> &points)
+{
+    for (RDBenchPoint &p : points) {
+        if (!p.ok)
+            continue;
+        p.pareto = true;
+        for (const RDBenchPoint &q : points) {
+            if (q.ok && Dominates(q, p)) {
+                p.pareto = false;
+                break;
+            }
+        }
+    }
+}
+
+static void WriteCsvHeader(FILE *f, const char *first)
+{
+    fprintf(f, "%sencoder,preset,tune,rate_control,value,keyint_sec,kbps,fps,"
+               "cpu_ms_per_frame,psnr,ssim,vifp", first);
+}
+
+static void WriteCsvRow(FILE *f, const RDBenchConfig &c, double kbps,
+                        double fps, double cpu, double psnr, double ssim,
+                        double vifp)
+{
+    fprintf(f, "%s,%s,%s,%s,%d,%d,%.1f,%.1f,%.3f,%.3f,%.5f,%.5f",
+            c.encoder.c_str(), c.preset.c_str(), c.tune.c_str(),
+            c.rateControl.c_str(), c.value, c.keyintSec, kbps, fps, cpu,
+            psnr, ssim, vifp);
+}
+
+static void LogSummary(const RDBenchOptions &options,
+                       const std::vector<RDBenchPoint> &points)
+{
+    std::vector<const RDBenchPoint *> front;
+    const RDBenchPoint *current = nullptr;
+    for (const RDBenchPoint &p : points) {
+        if (p.pareto)
+            front.push_back(&p);
+        if (p.current)
+            current = &p;
+    }
+    std::sort(front.begin(), front.end(),
+              [] (const RDBenchPoint *a, const RDBenchPoint *b) {
+        return a->cpuMsPerFrame < b->cpuMsPerFrame;
+    });
+
+    blog(LOG_INFO, "rd bench: pareto front (cpu, kbps, vifp), %d of %d:",
+         (int)front.size(), (int)points.size());
+    for (const RDBenchPoint *p : front)
+        blog(LOG_INFO, "\t%-48s %7.2f ms %7.0f kbps %6.1f fps "
+                       "psnr=%.2f ssim=%.4f vifp=%.4f",
+             p->config.label().c_str(), p->cpuMsPerFrame, p->kbps, p->fps,
+             p->psnr, p->ssim, p->vifp);
+
+    // 推荐：实时有余量且画质达标的前沿点中码率最低的
+    const RDBenchPoint *best = nullptr;
+    for (const RDBenchPoint *p : front) {
+        if (p->fps < options.fps * RD_REALTIME_MARGIN ||
+                p->ssim < options.minSsim)
+            continue;
+        if (!best || p->kbps < best->kbps)
+            best = p;
+    }
+    if (best)
+        blog(LOG_INFO, "rd bench: recommended %s (%.0f kbps, %.2f ms/frame, "
+                       "ssim %.4f)", best->config.label().c_str(), best->kbps,
+             best->cpuMsPerFrame, best->ssim);
+    else
+        blog(LOG_WARNING, "rd bench: no pareto point reaches %.1fx realtime "
+                          "with ssim >= %.3f", RD_REALTIME_MARGIN,
+             options.minSsim);
+
+    if (!current || !current->ok)
+        return;
+    if (current->pareto) {
+        blog(LOG_INFO, "rd bench: current %s is on the pareto front",
+             current->config.label().c_str());
+        return;
+    }
+    blog(LOG_WARNING, "rd bench: current %s (%.0f kbps, %.2f ms/frame, "
+                      "vifp %.4f) is dominated by:",
+         current->config.label().c_str(), current->kbps,
+         current->cpuMsPerFrame, current->vifp);
+    for (const RDBenchPoint *p : front)
+        if (Dominates(*p, *current))
+            blog(LOG_WARNING, "\t%s (%.0f kbps, %.2f ms/frame, vifp %.4f)",
+                 p->config.label().c_str(), p->kbps, p->cpuMsPerFrame,
+                 p->vifp);
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool RunRDBench(const RDBenchOptions &options,
+                std::vector<RDBenchPoint> &points)
+{
+    points.clear();
+
+    if (os_mkdirs(options.outputDir.c_str()) == MKDIR_ERROR) {
+        blog(LOG_ERROR, "rd bench: invalid output dir '%s'",
+             options.outputDir.c_str());
+        return false;
+    }
+
+    RegisterPacketSinkOutputs();
+
+    std::vector<std::unique_ptr<RDClip>> clips;
+    LoadClips(options, clips);
+
+    std::vector<RDBenchConfig> configs;
+    BuildConfigs(options, configs);
+    if (configs.empty()) {
+        blog(LOG_ERROR, "rd bench: no h264 encoder available");
+        return false;
+    }
+
+    std::string clipsPath = options.outputDir + "/" RD_BENCH_CLIPS_FILE;
+    FILE *clipsCsv = os_fopen(clipsPath.c_str(), "w");
+    if (clipsCsv) {
+        WriteCsvHeader(clipsCsv, "clip,");
+        fputc('\n', clipsCsv);
+    }
+
+    blog(LOG_INFO, "rd bench: %d configs x %d clips, %d frames per clip",
+         (int)configs.size(), (int)clips.size(), options.maxFrames);
+
+    std::string currentLabel = options.current.label();
+    points.resize(configs.size());
+    for (size_t i = 0; i < configs.size(); i++) {
+        points[i].config  = configs[i];
+        points[i].current = !options.current.encoder.empty() &&
+                            configs[i].label() == currentLabel;
+    }
+
+    // 每个片段一个私有 video_t，所有组合共用
+    for (const std::unique_ptr<RDClip> &clip : clips) {
+        ProbeVideo probe;
+        if (!OpenProbeVideo(probe, "qtobs-rd-bench", clip->format,
+                            clip->width, clip->height, clip->fpsNum,
+                            clip->fpsDen)) {
+            blog(LOG_WARNING, "rd bench: open video for '%s' failed",
+                 clip->name.c_str());
+            continue;
+        }
+
+        blog(LOG_INFO, "rd bench: clip '%s' %ux%u, %d frames",
+             clip->name.c_str(), clip->width, clip->height, clip->count);
+
+        for (size_t i = 0; i < configs.size(); i++) {
+            RDClipResult r = RunClip(probe, *clip, options, configs[i], i);
+            if (clipsCsv) {
+                fprintf(clipsCsv, "%s,", clip->name.c_str());
+                WriteCsvRow(clipsCsv, configs[i], r.kbps, r.fps,
+                            r.cpuMsPerFrame, r.psnr, r.ssim, r.vifp);
+                fputc('\n', clipsCsv);
+            }
+            if (!r.ok) {
+                blog(LOG_WARNING, "rd bench: %s failed on '%s'",
+                     configs[i].label().c_str(), clip->name.c_str());
+                continue;
+            }
+
+            RDBenchPoint &p = points[i];
+            p.kbps          += r.kbps;
+            p.fps           += r.fps;
+            p.cpuMsPerFrame += r.cpuMsPerFrame;
+            p.psnr          += r.psnr;
+            p.ssim          += r.ssim;
+            p.vifp          += r.vifp;
+            p.clips++;
+        }
+        CloseProbeVideo(probe);
+    }
+    if (clipsCsv)
+        fclose(clipsCsv);
+
+    for (RDBenchPoint &p : points) {
+        p.ok = p.clips > 0 && p.clips == (int)clips.size();
+        if (!p.clips)
+            continue;
+        p.kbps          /= p.clips;
+        p.fps           /= p.clips;
+        p.cpuMsPerFrame /= p.clips;
+        p.psnr          /= p.clips;
+        p.ssim          /= p.clips;
+        p.vifp          /= p.clips;
+    }
+    MarkPareto(points);
+
+    std::string path = options.outputDir + "/" RD_BENCH_FILE;
+    FILE *csv = os_fopen(path.c_str(), "w");
+    if (csv) {
+        WriteCsvHeader(csv, "");
+        fprintf(csv, ",clips,pareto,current\n");
+        for (const RDBenchPoint &p : points) {
+            WriteCsvRow(csv, p.config, p.kbps, p.fps, p.cpuMsPerFrame,
+                        p.psnr, p.ssim, p.vifp);
+            fprintf(csv, ",%d,%d,%d\n", p.clips, p.pareto, p.current);
+        }
+        fclose(csv);
+        blog(LOG_INFO, "rd bench: results written to '%s'", path.c_str());
+    } else {
+        blog(LOG_WARNING, "rd bench: write '%s' failed", path.c_str());
+    }
+
+    LogSummary(options, points);
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ROI */
+
+static bool RunROIClip(ProbeVideo &probe, const RDClip &clip,
+                       const RDBenchOptions &options, ROIBenchPoint &point,
+                       size_t index)
+{
+    RDBenchConfig config;
+    config.encoder     = ROI_ENCODER_ID;
+    config.preset      = options.current.preset;
+    config.tune        = options.current.tune;
+    config.rateControl = "CRF";
+    config.value       = point.crf;
+    config.keyintSec   = options.current.keyintSec;
+
+    obs_data_t *settings = CreateSettings(options, config);
+    obs_data_set_int(settings, "roi_mode",
+                     point.roi ? ROI_MODE_AUTO : ROI_MODE_OFF);
+    // 文字区域按编码器默认的阈值在参考画面上检测，两组编码使用同一区域
+    float textDensity = (float)obs_data_get_double(settings, "roi_text_density");
+    float flatDensity = (float)obs_data_get_double(settings, "roi_flat_density");
+
+    std::string name = "qtobs-roi-" + std::to_string(index) + "-" + clip.name;
+    ProbeEncodeResult encoded;
+    bool success = ProbeEncode(probe, ROI_ENCODER_ID, name.c_str(), settings,
+                               clip.count,
+                               [&] (struct video_frame *frame, uint32_t i) {
+        FillClipFrame(clip, frame, i);
+    }, encoded);
+    obs_data_release(settings);
+    if (!success)
+        return false;
+
+    double seconds = (double)encoded.count * clip.fpsDen / clip.fpsNum;
+    double kbps = (double)encoded.bytes * 8.0 / seconds / 1000.0;
+
+    int width  = (int)clip.width;
+    int height = (int)clip.height;
+    int interval = std::max(options.metricInterval, 1);
+    std::vector<uint8_t> scratch, mask;
+    ROIBlockMap map;
+    double textSum = 0.0, ssimSum = 0.0;
+    int textWindows = 0, compared = 0;
+    DecodeH264Packets(encoded.header.data(), encoded.header.size(),
+                      encoded.packets,
+                      [&] (int i, const uint8_t *luma, int linesize,
+                           int w, int h) {
+        if (w != width || h != height || i >= clip.count || i % interval)
+            return;
+
+        int refLinesize;
+        const uint8_t *ref = ClipLuma(clip, (uint32_t)i, scratch,
+                                      refLinesize);
+        ComputeROIBlockMap(ref, refLinesize, width, height, textDensity,
+                           flatDensity, map);
+        mask.resize(map.classes.size());
+        for (size_t b = 0; b < map.classes.size(); b++)
+            mask[b] = map.classes[b] == ROI_BLOCK_TEXT;
+
+        int windows = 0;
+        double text = LumaSsimMasked(ref, refLinesize, luma, linesize, width,
+                                     height, mask.data(), map.cols, map.rows,
+                                     map.blockSize, &windows);
+        textSum     += text * windows;
+        textWindows += windows;
+        ssimSum     += LumaSsim(ref, refLinesize, luma, linesize, width,
+                                height);
+        compared++;
+    });
+    if (!compared || !textWindows)
+        return false;
+
+    point.kbps     += kbps;
+    point.textSsim += textSum / textWindows;
+    point.ssim     += ssimSum / compared;
+    point.clips++;
+    return true;
+}
+
+// 在按文字 SSIM 排序的曲线上插值出 textSsim 对应的码率（对数域线性插值）
+static bool InterpolateKbps(const std::vector<const ROIBenchPoint *> &curve,
+                            double textSsim, double &kbps)
+{
+    for (size_t i = 0; i + 1 < curve.size(); i++) {
+        const ROIBenchPoint *a = curve[i];
+        const ROIBenchPoint *b = curve[i + 1];
+        if (textSsim < a->textSsim || textSsim > b->textSsim)
+            continue;
+
+        double span = b->textSsim - a->textSsim;
+        double t = span > 0.0 ? (textSsim - a->textSsim) / span : 0.0;
+        kbps = exp(log(a->kbps) + t * (log(b->kbps) - log(a->kbps)));
+        return true;
+    }
+    return false;
+}
+
+static void ComputeROISaving(ROIBenchResult &result)
+{
+    std::vector<const ROIBenchPoint *> curve;
+    for (const ROIBenchPoint &p : result.points)
+        if (p.ok && p.roi)
+            curve.push_back(&p);
+    std::sort(curve.begin(), curve.end(),
+              [] (const ROIBenchPoint *a, const ROIBenchPoint *b) {
+        return a->textSsim < b->textSsim;
+    });
+
+    double sum = 0.0;
+    result.matched = 0;
+    for (const ROIBenchPoint &p : result.points) {
+        if (!p.ok || p.roi)
+            continue;
+
+        double kbps;
+        if (!InterpolateKbps(curve, p.textSsim, kbps)) {
+            blog(LOG_INFO, "\tcrf %2d: %7.0f kbps text ssim %.4f, "
+                           "outside roi curve", p.crf, p.kbps, p.textSsim);
+            continue;
+        }
+        double saving = 1.0 - kbps / p.kbps;
+        blog(LOG_INFO, "\tcrf %2d: %7.0f kbps -> roi %7.0f kbps at text "
+                       "ssim %.4f, saving %.1f%%", p.crf, p.kbps, kbps,
+             p.textSsim, saving * 100.0);
+        sum += saving;
+        result.matched++;
+    }
+    result.saving = result.matched ? sum / result.matched : 0.0;
+}
+
+bool RunROIBench(const RDBenchOptions &options, ROIBenchResult &result)
+{
+    result = ROIBenchResult();
+
+    if (os_mkdirs(options.outputDir.c_str()) == MKDIR_ERROR) {
+        blog(LOG_ERROR, "roi bench: invalid output dir '%s'",
+             options.outputDir.c_str());
+        return false;
+    }
+
+    RegisterPacketSinkOutputs();
+
+    std::vector<std::unique_ptr<RDClip>> clips;
+    LoadClips(options, clips);
+
+    std::vector<int> crfs = OrDefault(options.crfs, defaultCrfs, 0);
+    for (int roi = 0; roi < 2; roi++) {
+        for (int crf : crfs) {
+            ROIBenchPoint p;
+            p.crf = crf;
+            p.roi = roi != 0;
+            result.points.push_back(p);
+        }
+    }
+
+    blog(LOG_INFO, "roi bench: %d crfs x %d clips, %d frames per clip",
+         (int)crfs.size(), (int)clips.size(), options.maxFrames);
+
+    for (const std::unique_ptr<RDClip> &clip : clips) {
+        ProbeVideo probe;
+        if (!OpenProbeVideo(probe, "qtobs-roi-bench", clip->format,
+                            clip->width, clip->height, clip->fpsNum,
+                            clip->fpsDen)) {
+            blog(LOG_WARNING, "roi bench: open video for '%s' failed",
+                 clip->name.c_str());
+            continue;
+        }
+
+        for (size_t i = 0; i < result.points.size(); i++) {
+            ROIBenchPoint &p = result.points[i];
+            if (!RunROIClip(probe, *clip, options, p, i))
+                blog(LOG_WARNING, "roi bench: crf %d roi %d failed on '%s' "
+                                  "(or no text detected)", p.crf, p.roi,
+                     clip->name.c_str());
+        }
+        CloseProbeVideo(probe);
+    }
+
+    for (ROIBenchPoint &p : result.points) {
+        p.ok = p.clips > 0 && p.clips == (int)clips.size();
+        if (!p.clips)
+            continue;
+        p.kbps     /= p.clips;
+        p.textSsim /= p.clips;
+        p.ssim     /= p.clips;
+    }
+
+    std::string path = options.outputDir + "/" RD_ROI_FILE;
+    FILE *csv = os_fopen(path.c_str(), "w");
+    if (csv) {
+        fprintf(csv, "crf,roi,kbps,text_ssim,ssim,clips\n");
+        for (const ROIBenchPoint &p : result.points)
+            fprintf(csv, "%d,%d,%.1f,%.5f,%.5f,%d\n", p.crf, p.roi, p.kbps,
+                    p.textSsim, p.ssim, p.clips);
+        fclose(csv);
+        blog(LOG_INFO, "roi bench: results written to '%s'", path.c_str());
+    } else {
+        blog(LOG_WARNING, "roi bench: write '%s' failed", path.c_str());
+    }
+
+    blog(LOG_INFO, "roi bench: bitrate at equal text ssim (%s/%s):",
+         options.current.preset.c_str(), options.current.tune.c_str());
+    ComputeROISaving(result);
+    if (result.matched)
+        blog(LOG_INFO, "roi bench: roi saves %.1f%% bitrate at equal text "
+                       "legibility (%d points)", result.saving * 100.0,
+             result.matched);
+    else
+        blog(LOG_WARNING, "roi bench: text ssim ranges do not overlap, "
+                          "widen the crf list");
+    return true;
+}
@@ -0,0 +1,116 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * 编码器码率-画质（RD）测试
+ * 用一组屏幕内容片段（obs-raw-capture.h 的采集文件，没有时使用合成画面）
+ * 遍历编码器 × preset × tune × CRF/码率 × 关键帧间隔，每个组合记录编码速度、
+ * CPU、码率和 PSNR/SSIM/VIFp，输出速度-画质-大小曲线（CSV）和 Pareto 前沿，
+ * 并标出现行配置是否被其他组合支配。
+ *
+ * 画质指标只比较 Y 平面；综合画质按 VIFp 排序（VMAF 的主要基础特征）。
+ */
+struct RDBenchConfig
+{
+    std::string encoder;
+    std::string preset;       // 仅 obs_x264
+    std::string tune;         // 仅 obs_x264，空为不设置
+    std::string rateControl;  // "CRF" 或 "CBR"
+    int         value;        // CRF 值或码率（kbps）
+    int         keyintSec;
+
+    RDBenchConfig() : value(0), keyintSec(0) {}
+
+    std::string label() const;
+};
+
+struct RDBenchPoint
+{
+    RDBenchConfig config;
+    int           clips;          // 成功编码的片段数
+    double        kbps;           // 以下为各片段的平均值
+    double        fps;            // 编码帧率（不按时钟送帧）
+    double        cpuMsPerFrame;
+    double        psnr;
+    double        ssim;
+    double        vifp;
+    bool          ok;             // 所有片段都编码成功
+    bool          pareto;         // 不被任何组合在 CPU、码率、VIFp 上同时支配
+    bool          current;        // 现行配置
+
+    RDBenchPoint() : clips(0), kbps(0.0), fps(0.0), cpuMsPerFrame(0.0),
+        psnr(0.0), ssim(0.0), vifp(0.0), ok(false), pareto(false),
+        current(false) {}
+};
+
+struct RDBenchOptions
+{
+    std::string corpusDir;        // 其中的 *.qorc 文件，空或没有可用文件时用合成画面
+    std::string outputDir;        // rd-bench.csv、rd-bench-clips.csv
+    int         maxFrames;        // 每个片段最多编码的帧数
+    int         metricInterval;   // 每隔几帧计算一次画质（VIFp 开销较大）
+
+    uint32_t    width;            // 合成画面的尺寸和帧率，也是实时性的目标帧率
+    uint32_t    height;
+    uint32_t    fps;
+    double      minSsim;          // 推荐配置的最低画质
+
+    std::vector<std::string> encoders;   // 空为 EnumProbeEncoders 的全部视频编码器
+    std::vector<std::string> presets;
+    std::vector<std::string> tunes;
+    std::vector<int>         crfs;       // obs_x264
+    std::vector<int>         bitrates;   // 其他编码器（CBR）
+    std::vector<int>         keyints;
+    std::string              x264opts;
+
+    RDBenchConfig current;
+
+    RDBenchOptions() : maxFrames(120), metricInterval(4), width(1280),
+        height(720), fps(30), minSsim(0.97) {}
+};
+
+/**
+ * 需要在 obs_reset_video 之后调用，在私有 video_t 上编码，不影响正在进行的输出，
+ * 但会与之争用 CPU。耗时为分钟级，结果写入 outputDir 并输出到日志。
+ */
+bool RunRDBench(const RDBenchOptions &options,
+                std::vector<RDBenchPoint> &points);
+
+/**
+ * ROI 编码测试（obs-roi-encoder.h）：同一个编码器分别关闭/开启自动 ROI，
+ * 用 options.crfs 编码每个片段，比较码率和文字区域的 SSIM（参考画面中
+ * 边缘密度判为文字的块），按文字 SSIM 相同插值出开启 ROI 节省的码率。
+ * preset、tune、keyint 取 options.current，结果写入 outputDir/rd-roi.csv。
+ */
+struct ROIBenchPoint
+{
+    int    crf;
+    bool   roi;
+    int    clips;
+    double kbps;
+    double textSsim;
+    double ssim;
+    bool   ok;
+
+    ROIBenchPoint() : crf(0), roi(false), clips(0), kbps(0.0), textSsim(0.0),
+        ssim(0.0), ok(false) {}
+};
+
+struct ROIBenchResult
+{
+    std::vector<ROIBenchPoint> points;
+    double saving;    // 文字 SSIM 相同时节省的码率比例，各匹配点的平均值
+    int    matched;   // 文字 SSIM 落在 ROI 曲线范围内、参与计算的基准点数
+
+    ROIBenchResult() : saving(0.0), matched(0) {}
+};
+
+bool RunROIBench(const RDBenchOptions &options, ROIBenchResult &result);
@@ -0,0 +1,268 @@
+﻿#include "obs-record-worker.h"
+#include "obs-worker-protocol.h"
+#include "obs-wrapper.h"
+
+// obs headers
+#include <util/platform.h>
+
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <QJsonArray>
+#include <QDir>
+
+#include <QDebug>
+
+#define WORKER_CONNECT_TIMEOUT_MS 5000
+#define WORKER_QUIT_TIMEOUT_MS    10000   // 等待录制正常结束（写完 mp4 索引）的时间
+
+static QRect JsonToRect(const QJsonValue &value)
+{
+    QJsonArray a = value.toArray();
+    if (a.size() != 4)
+        return QRect();
+    return QRect(a[0].toInt(), a[1].toInt(), a[2].toInt(), a[3].toInt());
+}
+
+static QSize JsonToSize(const QJsonValue &value)
+{
+    QJsonArray a = value.toArray();
+    if (a.size() != 2)
+        return QSize();
+    return QSize(a[0].toInt(), a[1].toInt());
+}
+
+RecordWorker::RecordWorker(int index_, const QString &serverName_,
+                           QObject *parent) : QObject(parent),
+    index(index_),
+    serverName(serverName_),
+    socket(nullptr),
+    obsThread(nullptr),
+    obsContext(nullptr),
+    recording(false),
+    quitting(false),
+    cpuInfo(nullptr)
+{
+}
+
+RecordWorker::~RecordWorker()
+{
+    if (obsThread && obsThread->isRunning()) {
+        obsThread->quit();
+        obsThread->wait(3 * 1000);
+    }
+    delete obsContext;
+
+    if (cpuInfo)
+        os_cpu_usage_info_destroy(cpuInfo);
+}
+
+bool RecordWorker::start()
+{
+    socket = new QLocalSocket(this);
+    connect(socket, &QLocalSocket::readyRead,
+            this,   &RecordWorker::onReadyRead);
+    connect(socket, &QLocalSocket::disconnected,
+            this,   &RecordWorker::onDisconnected);
+
+    socket->connectToServer(serverName);
+    if (!socket->waitForConnected(WORKER_CONNECT_TIMEOUT_MS)) {
+        qWarning() << "worker" << index << "connect to" << serverName
+                   << "failed:" << socket->errorString();
+        return false;
+    }
+
+    cpuInfo = os_cpu_usage_info_start();
+
+    QJsonObject hello;
+    hello["event"]  = WORKER_EVENT_HELLO;
+    hello["worker"] = index;
+    hello["pid"]    = (qint64)QCoreApplication::applicationPid();
+    send(hello);
+    return true;
+}
+
+void RecordWorker::setupOBS(const QJsonObject &init)
+{
+    if (obsContext)
+        return;
+
+    obsThread  = new QThread(this);
+    obsContext = new QtOBSContext;
+
+    // 捕获目标在 moveToThread 之前设置，不需要跨线程
+    obsContext->setCaptureTarget((uint)init["pid"].toInt(),
+                                 init["exe"].toString(),
+                                 init["class"].toString());
+    obsContext->moveToThread(obsThread);
+
+    // 视频路径就绪即可录制，supervisor 收到 initialized 后发送 start_record
+    connect(obsContext, &QtOBSContext::videoReady,
+            this,       &RecordWorker::onOBSInitialized);
+    connect(obsContext, &QtOBSContext::recordStarted,
+            this,       &RecordWorker::onOBSRecordStarted);
+    connect(obsContext, &QtOBSContext::recordStopped,
+            this,       &RecordWorker::onOBSRecordStopped);
+    connect(obsContext, &QtOBSContext::errorOccurred,
+            this,       &RecordWorker::onOBSErrorOccurred);
+
+    connect(this,       &RecordWorker::obsInit,
+            obsContext, &QtOBSContext::initialize);
+    connect(this,       &RecordWorker::obsScaleScene,
+            obsContext, &QtOBSContext::scaleScene);
+    connect(this,       &RecordWorker::obsVideoCrop,
+            obsContext, &QtOBSContext::videoCrop);
+    connect(this,       &RecordWorker::obsStartRecord,
+            obsContext, &QtOBSContext::startRecord);
+    connect(this,       &RecordWorker::obsStopRecord,
+            obsContext, &QtOBSContext::stopRecord);
+
+    // 统计在 obs 线程中读取，结果再投递回本线程发送
+    QtOBSContext *context = obsContext;
+    connect(this, &RecordWorker::obsQueryStats, obsContext, [this, context] () {
+        uint64_t bytes;
+        int frames, dropped;
+        context->getRecordStats(bytes, frames, dropped);
+
+        QJsonObject stats;
+        stats["event"]          = WORKER_EVENT_STATS;
+        stats["frames"]         = (qint64)obs_get_total_frames();
+        stats["lagged"]         = (qint64)obs_get_lagged_frames();
+        stats["skipped"]        = obs_get_video() ? (qint64)
+                video_output_get_skipped_frames(obs_get_video()) : 0;
+        stats["record_bytes"]   = (qint64)bytes;
+        stats["record_frames"]  = frames;
+        stats["record_dropped"] = dropped;
+        QMetaObject::invokeMethod(this, "sendStats", Qt::QueuedConnection,
+                                  Q_ARG(QJsonObject, stats));
+    });
+
+    obsThread->start();
+}
+
+void RecordWorker::handleCommand(const QJsonObject &cmd)
+{
+    QString name = cmd["cmd"].toString();
+
+    if (name == WORKER_CMD_INIT) {
+        // 每个工作进程使用自己的配置目录（编码器探测缓存、线程拓扑等）
+        QString configPath = QString("%1/worker-%2")
+                             .arg(cmd["config"].toString()).arg(index);
+        QDir().mkpath(configPath);
+
+        setupOBS(cmd);
+        emit obsInit(configPath, cmd["title"].toString(),
+                     JsonToSize(cmd["screen"]), JsonToRect(cmd["region"]));
+
+    } else if (name == WORKER_CMD_START_RECORD) {
+        emit obsStartRecord(cmd["path"].toString());
+
+    } else if (name == WORKER_CMD_STOP_RECORD) {
+        emit obsStopRecord(cmd["force"].toBool());
+
+    } else if (name == WORKER_CMD_CROP) {
+        emit obsVideoCrop(JsonToRect(cmd["region"]));
+
+    } else if (name == WORKER_CMD_SCALE) {
+        QSize size = JsonToSize(cmd["size"]);
+        emit obsScaleScene(size.width(), size.height());
+
+    } else if (name == WORKER_CMD_STATS) {
+        if (obsContext) {
+            emit obsQueryStats();
+        } else {
+            QJsonObject stats;
+            stats["event"] = WORKER_EVENT_STATS;
+            sendStats(stats);
+        }
+
+    } else if (name == WORKER_CMD_QUIT) {
+        quit();
+
+    } else {
+        qWarning() << "worker" << index << "unknown command" << name;
+    }
+}
+
+void RecordWorker::onReadyRead()
+{
+    QList<QJsonObject> messages;
+    ReadWorkerMessages(socket, messages);
+    for (const QJsonObject &cmd : messages)
+        handleCommand(cmd);
+}
+
+void RecordWorker::onDisconnected()
+{
+    // supervisor 退出后不再有人管理本进程，结束录制后退出
+    qWarning() << "worker" << index << "lost supervisor connection";
+    quit();
+}
+
+void RecordWorker::quit()
+{
+    if (quitting)
+        return;
+    quitting = true;
+
+    if (!recording) {
+        QCoreApplication::quit();
+        return;
+    }
+
+    emit obsStopRecord(false);
+    QTimer::singleShot(WORKER_QUIT_TIMEOUT_MS, this, [this] () {
+        qWarning() << "worker" << index << "stop record timeout";
+        emit obsStopRecord(true);
+        QCoreApplication::quit();
+    });
+}
+
+void RecordWorker::send(const QJsonObject &message)
+{
+    WriteWorkerMessage(socket, message);
+}
+
+void RecordWorker::sendStats(const QJsonObject &stats)
+{
+    QJsonObject message = stats;
+    message["cpu"]    = cpuInfo ? os_cpu_usage_info_query(cpuInfo) : 0.0;
+    message["memory"] = (qint64)os_get_proc_resident_size();
+    send(message);
+}
+
+void RecordWorker::onOBSInitialized()
+{
+    QJsonObject event;
+    event["event"] = WORKER_EVENT_INITIALIZED;
+    send(event);
+}
+
+void RecordWorker::onOBSRecordStarted()
+{
+    recording = true;
+
+    QJsonObject event;
+    event["event"] = WORKER_EVENT_RECORD_STARTED;
+    send(event);
+}
+
+void RecordWorker::onOBSRecordStopped()
+{
+    recording = false;
+
+    QJsonObject event;
+    event["event"] = WORKER_EVENT_RECORD_STOPPED;
+    send(event);
+
+    if (quitting)
+        QCoreApplication::quit();
+}
+
+void RecordWorker::onOBSErrorOccurred(const int type, const QString &msg)
+{
+    QJsonObject event;
+    event["event"]   = WORKER_EVENT_ERROR;
+    event["type"]    = type;
+    event["message"] = msg;
+    send(event);
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <QObject>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+#include <QRect>
+#include <QSize>
+
+class QLocalSocket;
+class QtOBSContext;
+struct os_cpu_usage_info;
+
+/**
+ * 录制工作进程：libobs 是进程内单例，一个进程只能录制一个画布，
+ * 由 WorkerSupervisor 启动多个工作进程（参数 --worker <序号> --server <名称>），
+ * 每个进程有自己的 libobs 实例，通过本地 socket 接收与 Dialog 相同的
+ * 初始化/开始/停止/剪裁命令，参见 obs-worker-protocol.h。
+ *
+ * 与 Dialog 一样，QtOBSContext 运行在单独的 obsThread 中。
+ */
+class RecordWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    RecordWorker(int index, const QString &serverName, QObject *parent = nullptr);
+    ~RecordWorker();
+
+    // 连接 supervisor，失败时返回 false
+    bool start();
+
+signals:
+    void obsInit(const QString &configPath, const QString &windowTitle,
+                 const QSize &screenSize, const QRect &sourceRect);
+    void obsScaleScene(int w, int h);
+    void obsVideoCrop(const QRect &);
+    void obsStartRecord(const QString &output);
+    void obsStopRecord(bool force);
+    void obsQueryStats();
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+
+    void onOBSInitialized();
+    void onOBSRecordStarted();
+    void onOBSRecordStopped();
+    void onOBSErrorOccurred(const int, const QString &);
+    void sendStats(const QJsonObject &stats);
+
+private:
+    void handleCommand(const QJsonObject &cmd);
+    void setupOBS(const QJsonObject &init);
+    void send(const QJsonObject &message);
+    void quit();
+
+    int          index;
+    QString      serverName;
+    QLocalSocket *socket;
+
+    QThread      *obsThread;
+    QtOBSContext *obsContext;
+    bool         recording;
+    bool         quitting;
+
+    os_cpu_usage_info *cpuInfo;
+};
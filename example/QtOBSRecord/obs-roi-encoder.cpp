@@ -0,0 +1,651 @@
+﻿#include "obs-roi-encoder.h"
+
+// obs headers
+#include <obs-avc.h>
+#include <media-io/video-io.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+}
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define ROI_EDGE_STRENGTH 32   // |dx| + |dy| 超过此值的采样算作边缘
+#define ROI_DEFAULT_KEYINT 250  // keyint_sec 为 0 时与 x264 默认值相同
+
+struct roi_encoder {
+    obs_encoder_t        *encoder;
+    AVCodecContext       *context;
+    AVFrame              *frame;
+    AVPacket             *packet;
+    std::vector<uint8_t> buffer;     // 输出数据需保留到下一次 encode
+
+    // 以下设置在 update 中修改（可能在其他线程），编码线程读取
+    std::mutex              mutex;
+    int                     mode;
+    float                   textOffset;
+    float                   flatOffset;
+    float                   textDensity;
+    float                   flatDensity;
+    std::vector<EncoderROI> manual;
+    ROIEncoderStats         stats;       // stats.startFrame 同时是启动门限
+
+    // 只在编码线程中访问
+    ROIBlockMap             map;
+    std::vector<EncoderROI> rois;
+    bool                    gated;       // start_gate，创建时读取
+    int64_t                 startPts;    // startFrame 对应帧的 pts
+    bool                    firstPacket;
+};
+
+/* ------------------------------------------------------------------------- */
+/* 边缘密度 */
+
+void ComputeROIBlockMap(const uint8_t *luma, int linesize, int width,
+                        int height, float textDensity, float flatDensity,
+                        ROIBlockMap &map)
+{
+    const int bs = map.blockSize;
+    map.cols = (width + bs - 1) / bs;
+    map.rows = (height + bs - 1) / bs;
+    map.classes.assign((size_t)map.cols * map.rows, ROI_BLOCK_NONE);
+
+    for (int by = 0; by < map.rows; by++) {
+        int y0 = by * bs;
+        int y1 = std::min(y0 + bs, height - 1);   // 留出 y + 1
+        for (int bx = 0; bx < map.cols; bx++) {
+            int x0 = bx * bs;
+            int x1 = std::min(x0 + bs, width - 1);
+
+            // 偶数位置与右侧/下方相邻像素比较，奇数位置的单像素笔画也能检测到
+            int samples = 0, edges = 0;
+            for (int y = y0; y < y1; y += 2) {
+                const uint8_t *line = luma + (size_t)y * linesize;
+                const uint8_t *next = line + linesize;
+                for (int x = x0; x < x1; x += 2) {
+                    int g = abs((int)line[x + 1] - (int)line[x]) +
+                            abs((int)next[x] - (int)line[x]);
+                    edges += g > ROI_EDGE_STRENGTH;
+                    samples++;
+                }
+            }
+            if (!samples)
+                continue;
+
+            float density = (float)edges / (float)samples;
+            uint8_t &c = map.classes[(size_t)by * map.cols + bx];
+            if (density >= textDensity)
+                c = ROI_BLOCK_TEXT;
+            else if (density < flatDensity)
+                c = ROI_BLOCK_FLAT;
+        }
+    }
+}
+
+static void AppendBlockRuns(const ROIBlockMap &map, uint8_t type,
+                            float offset, std::vector<EncoderROI> &rois)
+{
+    if (offset == 0.0f)
+        return;
+
+    for (int by = 0; by < map.rows; by++) {
+        const uint8_t *row = &map.classes[(size_t)by * map.cols];
+        for (int bx = 0; bx < map.cols; ) {
+            if (row[bx] != type) {
+                bx++;
+                continue;
+            }
+            int start = bx;
+            while (bx < map.cols && row[bx] == type)
+                bx++;
+
+            EncoderROI roi;
+            roi.left          = start * map.blockSize;
+            roi.top           = by * map.blockSize;
+            roi.right         = bx * map.blockSize;
+            roi.bottom        = (by + 1) * map.blockSize;
+            roi.qualityOffset = offset;
+            rois.push_back(roi);
+        }
+    }
+}
+
+void AppendBlockMapROI(const ROIBlockMap &map, float textOffset,
+                       float flatOffset, std::vector<EncoderROI> &rois)
+{
+    AppendBlockRuns(map, ROI_BLOCK_TEXT, textOffset, rois);
+    AppendBlockRuns(map, ROI_BLOCK_FLAT, flatOffset, rois);
+}
+
+/* ------------------------------------------------------------------------- */
+/* 编码器 */
+
+// 运行中的编码器实例，GetROIEncoderStats 通过 obs_encoder_t 查找
+static std::mutex registryMutex;
+static std::map<obs_encoder_t *, struct roi_encoder *> registry;
+
+static const char *roi_encoder_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS x264 (ROI)";
+}
+
+static inline bool roi_encoder_format_supported(enum video_format format)
+{
+    return format == VIDEO_FORMAT_I420 || format == VIDEO_FORMAT_NV12;
+}
+
+static void roi_encoder_update(void *data, obs_data_t *settings)
+{
+    struct roi_encoder *enc = static_cast<struct roi_encoder *>(data);
+
+    // 码率控制参数只在创建时生效，运行中只更新 ROI 设置
+    std::lock_guard<std::mutex> lock(enc->mutex);
+    enc->mode        = (int)obs_data_get_int(settings, "roi_mode");
+    enc->textOffset  = (float)obs_data_get_double(settings, "roi_text_offset");
+    enc->flatOffset  = (float)obs_data_get_double(settings, "roi_flat_offset");
+    enc->textDensity = (float)obs_data_get_double(settings, "roi_text_density");
+    enc->flatDensity = (float)obs_data_get_double(settings, "roi_flat_density");
+
+    enc->manual.clear();
+    obs_data_array_t *rects = obs_data_get_array(settings, "roi_rects");
+    size_t count = rects ? obs_data_array_count(rects) : 0;
+    for (size_t i = 0; i < count; i++) {
+        obs_data_t *item = obs_data_array_item(rects, i);
+        EncoderROI r;
+        r.left          = (int)obs_data_get_int(item, "left");
+        r.top           = (int)obs_data_get_int(item, "top");
+        r.right         = (int)obs_data_get_int(item, "right");
+        r.bottom        = (int)obs_data_get_int(item, "bottom");
+        r.qualityOffset = (float)obs_data_get_double(item, "offset");
+        if (r.right > r.left && r.bottom > r.top)
+            enc->manual.push_back(r);
+        obs_data_release(item);
+    }
+    obs_data_array_release(rects);
+}
+
+static void roi_encoder_destroy(void *data)
+{
+    struct roi_encoder *enc = static_cast<struct roi_encoder *>(data);
+    if (!enc)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.erase(enc->encoder);
+    }
+
+    avcodec_free_context(&enc->context);
+    av_frame_free(&enc->frame);
+    av_packet_free(&enc->packet);
+    delete enc;
+}
+
+// obs_x264 的 x264opts 以空格分隔，libavcodec 的 x264-params 以冒号分隔
+static std::string ToX264Params(const char *opts)
+{
+    std::string params;
+    char **list = strlist_split(opts ? opts : "", ' ', false);
+    for (char **opt = list; opt && *opt; opt++) {
+        if (!params.empty())
+            params += ':';
+        params += *opt;
+    }
+    strlist_free(list);
+    return params;
+}
+
+static bool roi_encoder_open(struct roi_encoder *enc, obs_data_t *settings)
+{
+    const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+    if (!codec) {
+        blog(LOG_WARNING, "roi encoder: libx264 is not available in libavcodec");
+        return false;
+    }
+
+    video_t *video = obs_encoder_video(enc->encoder);
+    const struct video_output_info *voi = video_output_get_info(video);
+    enum video_format format = roi_encoder_format_supported(voi->format)
+                             ? voi->format : VIDEO_FORMAT_I420;
+
+    enc->context = avcodec_alloc_context3(codec);
+    if (!enc->context)
+        return false;
+
+    AVCodecContext *ctx = enc->context;
+    ctx->width     = (int)obs_encoder_get_width(enc->encoder);
+    ctx->height    = (int)obs_encoder_get_height(enc->encoder);
+    ctx->time_base = av_make_q((int)voi->fps_den, (int)voi->fps_num);
+    ctx->framerate = av_make_q((int)voi->fps_num, (int)voi->fps_den);
+    ctx->pix_fmt   = format == VIDEO_FORMAT_NV12 ? AV_PIX_FMT_NV12
+                                                 : AV_PIX_FMT_YUV420P;
+    ctx->color_range = voi->range == VIDEO_RANGE_FULL ? AVCOL_RANGE_JPEG
+                                                      : AVCOL_RANGE_MPEG;
+    if (voi->colorspace == VIDEO_CS_709) {
+        ctx->colorspace      = AVCOL_SPC_BT709;
+        ctx->color_primaries = AVCOL_PRI_BT709;
+        ctx->color_trc       = AVCOL_TRC_BT709;
+    } else {
+        ctx->colorspace      = AVCOL_SPC_SMPTE170M;
+        ctx->color_primaries = AVCOL_PRI_SMPTE170M;
+        ctx->color_trc       = AVCOL_TRC_SMPTE170M;
+    }
+    // SPS/PPS 放在 extra data 中，与 obs_x264 一致
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    int keyintSec = (int)obs_data_get_int(settings, "keyint_sec");
+    ctx->gop_size = keyintSec > 0
+                  ? (int)(keyintSec * voi->fps_num / voi->fps_den)
+                  : ROI_DEFAULT_KEYINT;
+
+    const char *preset  = obs_data_get_string(settings, "preset");
+    const char *tune    = obs_data_get_string(settings, "tune");
+    const char *profile = obs_data_get_string(settings, "profile");
+    const char *rc      = obs_data_get_string(settings, "rate_control");
+    if (preset && *preset)
+        av_opt_set(ctx->priv_data, "preset", preset, 0);
+    if (tune && *tune)
+        av_opt_set(ctx->priv_data, "tune", tune, 0);
+    if (profile && *profile)
+        av_opt_set(ctx->priv_data, "profile", profile, 0);
+
+    if (astrcmpi(rc, "CRF") == 0) {
+        av_opt_set_double(ctx->priv_data, "crf",
+                          (double)obs_data_get_int(settings, "crf"), 0);
+    } else {
+        ctx->bit_rate       = obs_data_get_int(settings, "bitrate") * 1000;
+        ctx->rc_max_rate    = ctx->bit_rate;
+        ctx->rc_buffer_size = (int)ctx->bit_rate;
+    }
+
+    std::string params = ToX264Params(obs_data_get_string(settings, "x264opts"));
+    if (!params.empty())
+        av_opt_set(ctx->priv_data, "x264-params", params.c_str(), 0);
+    // 启动门限按帧序号强制关键帧，pict_type 为 I 时输出 IDR 而不是普通 I 帧
+    if (enc->gated)
+        av_opt_set_int(ctx->priv_data, "forced-idr", 1, 0);
+
+    int ret = avcodec_open2(ctx, codec, nullptr);
+    if (ret < 0) {
+        char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, err, sizeof(err));
+        blog(LOG_WARNING, "roi encoder: open libx264 failed: %s", err);
+        return false;
+    }
+
+    enc->frame  = av_frame_alloc();
+    enc->packet = av_packet_alloc();
+    if (!enc->frame || !enc->packet)
+        return false;
+
+    enc->frame->format = ctx->pix_fmt;
+    enc->frame->width  = ctx->width;
+    enc->frame->height = ctx->height;
+    if (av_frame_get_buffer(enc->frame, 32) < 0)
+        return false;
+
+    blog(LOG_INFO, "roi encoder: %dx%d %s, preset %s, tune %s, %s %d, "
+                   "keyint %d, x264-params '%s'%s",
+         ctx->width, ctx->height, get_video_format_name(format), preset,
+         tune, rc, astrcmpi(rc, "CRF") == 0
+                   ? (int)obs_data_get_int(settings, "crf")
+                   : (int)obs_data_get_int(settings, "bitrate"),
+         ctx->gop_size, params.c_str(), enc->gated ? ", start gated" : "");
+    return true;
+}
+
+static void *roi_encoder_create(obs_data_t *settings, obs_encoder_t *encoder)
+{
+    struct roi_encoder *enc = new roi_encoder();
+    enc->encoder     = encoder;
+    enc->context     = nullptr;
+    enc->frame       = nullptr;
+    enc->packet      = nullptr;
+    enc->gated       = obs_data_get_bool(settings, "start_gate");
+    enc->startPts    = -1;
+    enc->firstPacket = true;
+    roi_encoder_update(enc, settings);
+
+    if (!roi_encoder_open(enc, settings)) {
+        roi_encoder_destroy(enc);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry[encoder] = enc;
+    return enc;
+}
+
+// 把本帧的 ROI 附加到 enc->frame，靠前的矩形优先：手动矩形 > 文字 > 平坦区域
+static void roi_encoder_attach_roi(struct roi_encoder *enc,
+                                   const struct encoder_frame *frame)
+{
+    av_frame_remove_side_data(enc->frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+    int   mode;
+    float textOffset, flatOffset, textDensity, flatDensity;
+    {
+        std::lock_guard<std::mutex> lock(enc->mutex);
+        mode        = enc->mode;
+        textOffset  = enc->textOffset;
+        flatOffset  = enc->flatOffset;
+        textDensity = enc->textDensity;
+        flatDensity = enc->flatDensity;
+        enc->rois.clear();
+        if (mode != ROI_MODE_OFF)
+            enc->rois = enc->manual;
+    }
+
+    int width  = enc->context->width;
+    int height = enc->context->height;
+    uint64_t mapNs = 0;
+    uint64_t textBlocks = 0, flatBlocks = 0, totalBlocks = 0;
+    if (mode == ROI_MODE_AUTO) {
+        uint64_t start = os_gettime_ns();
+        ComputeROIBlockMap(frame->data[0], (int)frame->linesize[0], width,
+                           height, textDensity, flatDensity, enc->map);
+        AppendBlockMapROI(enc->map, textOffset, flatOffset, enc->rois);
+        mapNs = os_gettime_ns() - start;
+
+        for (uint8_t c : enc->map.classes) {
+            textBlocks += c == ROI_BLOCK_TEXT;
+            flatBlocks += c == ROI_BLOCK_FLAT;
+        }
+        totalBlocks = enc->map.classes.size();
+    }
+
+    size_t count = enc->rois.size();
+    if (count) {
+        AVFrameSideData *side = av_frame_new_side_data(
+                enc->frame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+                (int)(count * sizeof(AVRegionOfInterest)));
+        if (side) {
+            AVRegionOfInterest *roi =
+                    reinterpret_cast<AVRegionOfInterest *>(side->data);
+            for (size_t i = 0; i < count; i++) {
+                const EncoderROI &r = enc->rois[i];
+                float offset = std::min(std::max(r.qualityOffset, -1.0f), 1.0f);
+                roi[i].self_size = sizeof(AVRegionOfInterest);
+                roi[i].left      = std::min(std::max(r.left, 0), width);
+                roi[i].right     = std::min(std::max(r.right, 0), width);
+                roi[i].top       = std::min(std::max(r.top, 0), height);
+                roi[i].bottom    = std::min(std::max(r.bottom, 0), height);
+                roi[i].qoffset   = av_make_q((int)lroundf(offset * 1000.0f),
+                                             1000);
+            }
+        } else {
+            count = 0;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(enc->mutex);
+    enc->stats.frames++;
+    enc->stats.roiFrames   += count > 0;
+    enc->stats.regions     += count;
+    enc->stats.textBlocks  += textBlocks;
+    enc->stats.flatBlocks  += flatBlocks;
+    enc->stats.totalBlocks += totalBlocks;
+    enc->stats.mapNs       += mapNs;
+}
+
+// 与 obs_x264 相同，按 slice NAL 的 nal_ref_idc 设置优先级，推流拥塞丢帧时
+// 先丢可丢弃的帧（ref_idc 为 0），关键帧/参考帧最后丢
+static int roi_encoder_packet_priority(const uint8_t *data, size_t size)
+{
+    const uint8_t *end = data + size;
+    const uint8_t *nal = obs_avc_find_startcode(data, end);
+    int priority = OBS_NAL_PRIORITY_DISPOSABLE;
+
+    while (nal < end) {
+        while (nal < end && !*(nal++))
+            ;
+        if (nal == end)
+            break;
+
+        int type = nal[0] & 0x1F;
+        if (type == OBS_NAL_SLICE || type == OBS_NAL_SLICE_DPA ||
+                type == OBS_NAL_SLICE_IDR)
+            priority = std::max(priority, (nal[0] >> 5) & 0x3);
+
+        nal = obs_avc_find_startcode(nal, end);
+    }
+    return priority;
+}
+
+static bool roi_encoder_encode(void *data, struct encoder_frame *frame,
+                               struct encoder_packet *packet,
+                               bool *received_packet)
+{
+    struct roi_encoder *enc = static_cast<struct roi_encoder *>(data);
+    *received_packet = false;
+
+    bool forceIdr = false;
+    if (enc->gated) {
+        int64_t startFrame;
+        {
+            std::lock_guard<std::mutex> lock(enc->mutex);
+            startFrame = enc->stats.startFrame;
+        }
+        int64_t serial = (int64_t)video_output_get_total_frames(
+                obs_encoder_video(enc->encoder));
+        // 门限之前的帧直接丢弃，不送入 x264，第一帧就是 IDR
+        if (startFrame < 0 || serial < startFrame)
+            return true;
+        if (enc->startPts < 0)
+            enc->startPts = frame->pts;
+        forceIdr = (serial - startFrame) % enc->context->gop_size == 0;
+    }
+
+    if (av_frame_make_writable(enc->frame) < 0)
+        return false;
+
+    const uint8_t *src[4] = {0};
+    int srcLinesize[4] = {0};
+    for (int p = 0; p < 4 && p < MAX_AV_PLANES; p++) {
+        src[p]         = frame->data[p];
+        srcLinesize[p] = (int)frame->linesize[p];
+    }
+    av_image_copy(enc->frame->data, enc->frame->linesize, src, srcLinesize,
+                  enc->context->pix_fmt, enc->context->width,
+                  enc->context->height);
+    enc->frame->pts       = frame->pts;
+    enc->frame->pict_type = forceIdr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+    roi_encoder_attach_roi(enc, frame);
+
+    int ret = avcodec_send_frame(enc->context, enc->frame);
+    if (ret < 0) {
+        blog(LOG_WARNING, "roi encoder: send frame failed (%d)", ret);
+        return false;
+    }
+
+    ret = avcodec_receive_packet(enc->context, enc->packet);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        return true;
+    if (ret < 0) {
+        blog(LOG_WARNING, "roi encoder: receive packet failed (%d)", ret);
+        return false;
+    }
+
+    enc->buffer.assign(enc->packet->data,
+                       enc->packet->data + enc->packet->size);
+    packet->data     = enc->buffer.data();
+    packet->size     = enc->buffer.size();
+    packet->pts      = enc->packet->pts;
+    packet->dts      = enc->packet->dts;
+    packet->type     = OBS_ENCODER_VIDEO;
+    packet->keyframe = (enc->packet->flags & AV_PKT_FLAG_KEY) != 0;
+    packet->priority = roi_encoder_packet_priority(packet->data, packet->size);
+    packet->drop_priority = packet->priority;
+    *received_packet = true;
+
+    std::lock_guard<std::mutex> lock(enc->mutex);
+    enc->stats.packets++;
+    if (enc->gated && enc->firstPacket) {
+        enc->firstPacket = false;
+        bool aligned = packet->keyframe && packet->pts == enc->startPts;
+        enc->stats.firstKeyFrame = aligned ? enc->stats.startFrame : -1;
+        if (!aligned)
+            blog(LOG_WARNING, "roi encoder: first packet is not the IDR at "
+                              "start frame %lld",
+                 (long long)enc->stats.startFrame);
+    }
+
+    av_packet_unref(enc->packet);
+    return true;
+}
+
+static bool roi_encoder_extra_data(void *data, uint8_t **extra_data,
+                                   size_t *size)
+{
+    struct roi_encoder *enc = static_cast<struct roi_encoder *>(data);
+    if (!enc->context->extradata_size)
+        return false;
+
+    *extra_data = enc->context->extradata;
+    *size       = (size_t)enc->context->extradata_size;
+    return true;
+}
+
+static void roi_encoder_video_info(void *data, struct video_scale_info *info)
+{
+    UNUSED_PARAMETER(data);
+    if (!roi_encoder_format_supported(info->format))
+        info->format = VIDEO_FORMAT_I420;
+}
+
+static void roi_encoder_defaults(obs_data_t *settings)
+{
+    // 与 obs_x264 的默认值相同
+    obs_data_set_default_int(settings, "bitrate", 2500);
+    obs_data_set_default_string(settings, "rate_control", "CBR");
+    obs_data_set_default_int(settings, "crf", 23);
+    obs_data_set_default_int(settings, "keyint_sec", 0);
+    obs_data_set_default_string(settings, "preset", "veryfast");
+    obs_data_set_default_string(settings, "profile", "");
+    obs_data_set_default_string(settings, "tune", "");
+    obs_data_set_default_string(settings, "x264opts", "");
+
+    // 文字约 -6 QP，平坦背景约 +4 QP
+    obs_data_set_default_int(settings, "roi_mode", ROI_MODE_AUTO);
+    obs_data_set_default_double(settings, "roi_text_offset", -0.12);
+    obs_data_set_default_double(settings, "roi_flat_offset", 0.08);
+    obs_data_set_default_double(settings, "roi_text_density", 0.10);
+    obs_data_set_default_double(settings, "roi_flat_density", 0.01);
+    obs_data_set_default_bool(settings, "start_gate", false);
+}
+
+static obs_properties_t *roi_encoder_properties(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+
+    obs_properties_t *props = obs_properties_create();
+    obs_property_t *list = obs_properties_add_list(props, "rate_control",
+            "Rate Control", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+    obs_property_list_add_string(list, "CBR", "CBR");
+    obs_property_list_add_string(list, "CRF", "CRF");
+    obs_properties_add_int(props, "bitrate", "Bitrate", 50, 10000000, 50);
+    obs_properties_add_int(props, "crf", "CRF", 0, 51, 1);
+    obs_properties_add_int(props, "keyint_sec", "Keyframe Interval (seconds)",
+                           0, 20, 1);
+    obs_properties_add_text(props, "preset", "Preset", OBS_TEXT_DEFAULT);
+    obs_properties_add_text(props, "profile", "Profile", OBS_TEXT_DEFAULT);
+    obs_properties_add_text(props, "tune", "Tune", OBS_TEXT_DEFAULT);
+    obs_properties_add_text(props, "x264opts", "x264 Options", OBS_TEXT_DEFAULT);
+
+    list = obs_properties_add_list(props, "roi_mode", "ROI Mode",
+                                   OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(list, "Off", ROI_MODE_OFF);
+    obs_property_list_add_int(list, "Manual", ROI_MODE_MANUAL);
+    obs_property_list_add_int(list, "Auto", ROI_MODE_AUTO);
+    obs_properties_add_float_slider(props, "roi_text_offset",
+                                    "Text quality offset", -1.0, 1.0, 0.01);
+    obs_properties_add_float_slider(props, "roi_flat_offset",
+                                    "Flat quality offset", -1.0, 1.0, 0.01);
+    obs_properties_add_float_slider(props, "roi_text_density",
+                                    "Text edge density", 0.0, 1.0, 0.01);
+    obs_properties_add_float_slider(props, "roi_flat_density",
+                                    "Flat edge density", 0.0, 1.0, 0.005);
+    return props;
+}
+
+void RegisterROIEncoder()
+{
+    struct obs_encoder_info info = {};
+    info.id             = ROI_ENCODER_ID;
+    info.type           = OBS_ENCODER_VIDEO;
+    info.codec          = "h264";
+    info.get_name       = roi_encoder_getname;
+    info.create         = roi_encoder_create;
+    info.destroy        = roi_encoder_destroy;
+    info.encode         = roi_encoder_encode;
+    info.update         = roi_encoder_update;
+    info.get_defaults   = roi_encoder_defaults;
+    info.get_properties = roi_encoder_properties;
+    info.get_extra_data = roi_encoder_extra_data;
+    info.get_video_info = roi_encoder_video_info;
+    obs_register_encoder(&info);
+}
+
+bool SetEncoderROI(obs_encoder_t *encoder, const std::vector<EncoderROI> &rois)
+{
+    if (!encoder || strcmp(obs_encoder_get_id(encoder), ROI_ENCODER_ID) != 0)
+        return false;
+
+    // 写入设置，编码器未启动时在创建时生效，运行中通过 update 生效
+    obs_data_array_t *rects = obs_data_array_create();
+    for (const EncoderROI &r : rois) {
+        obs_data_t *item = obs_data_create();
+        obs_data_set_int(item, "left", r.left);
+        obs_data_set_int(item, "top", r.top);
+        obs_data_set_int(item, "right", r.right);
+        obs_data_set_int(item, "bottom", r.bottom);
+        obs_data_set_double(item, "offset", r.qualityOffset);
+        obs_data_array_push_back(rects, item);
+        obs_data_release(item);
+    }
+
+    obs_data_t *settings = obs_data_create();
+    obs_data_set_array(settings, "roi_rects", rects);
+    obs_encoder_update(encoder, settings);
+    obs_data_release(settings);
+    obs_data_array_release(rects);
+    return true;
+}
+
+bool SetEncoderStartFrame(obs_encoder_t *encoder, uint32_t frame)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(encoder);
+    if (it == registry.end() || !it->second->gated)
+        return false;
+
+    std::lock_guard<std::mutex> encLock(it->second->mutex);
+    it->second->stats.startFrame = frame;
+    return true;
+}
+
+bool GetROIEncoderStats(obs_encoder_t *encoder, ROIEncoderStats &stats)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(encoder);
+    if (it == registry.end())
+        return false;
+
+    std::lock_guard<std::mutex> encLock(it->second->mutex);
+    stats = it->second->stats;
+    return true;
+}
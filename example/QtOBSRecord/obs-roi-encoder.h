@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * 支持感兴趣区域（ROI）的 h264 编码器。
+ *
+ * obs_x264 不能按区域调整量化，这里通过 libavcodec 的 libx264 编码，
+ * 每帧附加 AV_FRAME_DATA_REGIONS_OF_INTEREST：文字区域降低 QP，
+ * 平坦背景提高 QP，同样码率下文字更清晰。设置项与 obs_x264 相同
+ * （preset、tune、profile、rate_control、crf、bitrate、keyint_sec、x264opts），另有：
+ * - roi_mode：ROI_MODE_*；
+ * - roi_text_offset / roi_flat_offset：质量偏移，-1..1，负值提高质量，
+ *   libx264 按 51 * offset 换算为 QP 偏移；
+ * - roi_text_density / roi_flat_density：边缘密度阈值，参见 ComputeROIBlockMap；
+ * - roi_rects：手动矩形数组（left、top、right、bottom、offset），参见 SetEncoderROI；
+ * - start_gate：创建时为 true 则在 SetEncoderStartFrame 之前丢弃所有帧。
+ *
+ * 需要启用自适应量化（aq-mode 不为 0），否则 libx264 忽略 ROI。
+ */
+#define ROI_ENCODER_ID "qtobs_x264_roi"
+
+enum ROIMode {
+    ROI_MODE_OFF,       // 不附加 ROI，等同于普通的 libx264
+    ROI_MODE_MANUAL,    // 只用 SetEncoderROI 设置的矩形
+    ROI_MODE_AUTO       // 手动矩形 + 每帧按边缘密度检测的文字/平坦区域
+};
+
+struct EncoderROI
+{
+    int   left;           // 输出画面的像素坐标，right/bottom 不含
+    int   top;
+    int   right;
+    int   bottom;
+    float qualityOffset;  // 同 roi_text_offset，重叠时靠前的矩形优先
+};
+
+enum ROIBlockClass {
+    ROI_BLOCK_NONE,       // 图片、视频等，不调整
+    ROI_BLOCK_TEXT,
+    ROI_BLOCK_FLAT
+};
+
+/* 按宏块（16x16）统计的边缘密度分类 */
+struct ROIBlockMap
+{
+    int                  blockSize;
+    int                  cols;
+    int                  rows;
+    std::vector<uint8_t> classes;   // ROIBlockClass，按行排列
+
+    ROIBlockMap() : blockSize(16), cols(0), rows(0) {}
+};
+
+/**
+ * 隔行隔列采样，统计每个块中梯度（|dx| + |dy|）超过固定强度的采样比例：
+ * 不低于 textDensity 为文字，低于 flatDensity 为平坦背景。
+ * 720p 每帧约 0.2M 次采样，远小于编码开销。
+ */
+void ComputeROIBlockMap(const uint8_t *luma, int linesize, int width,
+                        int height, float textDensity, float flatDensity,
+                        ROIBlockMap &map);
+
+// 把同一行相邻的同类块合并为矩形追加到 rois（文字在前，优先级高于平坦区域）
+void AppendBlockMapROI(const ROIBlockMap &map, float textOffset,
+                       float flatOffset, std::vector<EncoderROI> &rois);
+
+struct ROIEncoderStats
+{
+    uint64_t frames;
+    uint64_t roiFrames;       // 附加了 ROI 的帧
+    uint64_t regions;         // 累计的 ROI 矩形数
+    uint64_t textBlocks;      // 自动检测的累计文字/平坦块数
+    uint64_t flatBlocks;
+    uint64_t totalBlocks;
+    uint64_t mapNs;           // 边缘密度检测的累计耗时
+    uint64_t packets;         // 输出的包数
+    int64_t  startFrame;      // SetEncoderStartFrame 的帧序号，未设置为 -1
+    int64_t  firstKeyFrame;   // 第一个输出包是 startFrame 处的 IDR 时等于 startFrame，否则为 -1
+
+    ROIEncoderStats() : frames(0), roiFrames(0), regions(0), textBlocks(0),
+        flatBlocks(0), totalBlocks(0), mapNs(0), packets(0), startFrame(-1),
+        firstKeyFrame(-1) {}
+};
+
+void RegisterROIEncoder();
+
+// encoder 必须是 ROI_ENCODER_ID，矩形写入 roi_rects，运行中在下一帧生效
+bool SetEncoderROI(obs_encoder_t *encoder, const std::vector<EncoderROI> &rois);
+/**
+ * encoder 必须是 ROI_ENCODER_ID 且以 start_gate 创建，并且已经启动。
+ * 帧序号取 video_output_get_total_frames：video-io 线程把同一帧依次交给所有
+ * 编码器，读到的序号相同。序号小于 frame 的帧被丢弃，frame 处强制 IDR，
+ * 此后每 keyint 帧强制一次，设置同一 frame 的编码器关键帧在同一帧上。
+ */
+bool SetEncoderStartFrame(obs_encoder_t *encoder, uint32_t frame);
+// 编码器未启动时返回 false，统计在每次启动时清零
+bool GetROIEncoderStats(obs_encoder_t *encoder, ROIEncoderStats &stats);
@@ -0,0 +1,303 @@
+﻿#include "obs-scene-layout.h"
+
+// obs headers
+#include <util/platform.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#define PIP_COLUMNS 4   // 画中画源的宽/高为画布的 1/4
+#define PIP_MARGIN  16  // 画中画源之间及与画布边缘的间距
+
+static bool SameCrop(const obs_sceneitem_crop &a, const obs_sceneitem_crop &b)
+{
+    return a.left == b.left && a.top == b.top &&
+           a.right == b.right && a.bottom == b.bottom;
+}
+
+static bool SameSettings(obs_data_t *a, obs_data_t *b)
+{
+    if (a == b)
+        return true;
+    if (!a || !b)
+        return false;
+    return strcmp(obs_data_get_json(a), obs_data_get_json(b)) == 0;
+}
+
+SceneLayout::SceneLayout() : scene(nullptr), primary(nullptr), canvasWidth(0),
+    canvasHeight(0), currentMode(Grid), updateCount(0),
+    pendingEntries(nullptr), removedEntries(nullptr), pendingMode(Grid)
+{
+}
+
+SceneLayout::~SceneLayout()
+{
+    clear();
+}
+
+void SceneLayout::setScene(obs_scene_t *scene_, obs_source_t *primary_)
+{
+    clear();
+    scene   = scene_;
+    primary = primary_;
+}
+
+void SceneLayout::setCanvas(uint32_t cx, uint32_t cy)
+{
+    canvasWidth  = cx;
+    canvasHeight = cy;
+}
+
+void SceneLayout::computeCells(Mode mode, size_t extras, Cell &primaryCell,
+                               std::vector<Cell> &cells) const
+{
+    float cx = (float)canvasWidth;
+    float cy = (float)canvasHeight;
+    cells.clear();
+
+    if (mode == PictureInPicture) {
+        primaryCell.x  = primaryCell.y = 0.0f;
+        primaryCell.cx = cx;
+        primaryCell.cy = cy;
+
+        // 从右下角开始向上排列，一列排满后向左换列
+        float w = cx / PIP_COLUMNS;
+        float h = cy / PIP_COLUMNS;
+        int perColumn = std::max(1, (int)((cy - PIP_MARGIN) / (h + PIP_MARGIN)));
+        for (size_t i = 0; i < extras; i++) {
+            int col = (int)i / perColumn;
+            int row = (int)i % perColumn;
+            Cell cell;
+            cell.cx = w;
+            cell.cy = h;
+            cell.x  = cx - (w + PIP_MARGIN) * (col + 1);
+            cell.y  = cy - (h + PIP_MARGIN) * (row + 1);
+            cells.push_back(cell);
+        }
+        return;
+    }
+
+    // 网格：主源占第一个格子
+    size_t n = extras + 1;
+    size_t cols = (size_t)ceil(sqrt((double)n));
+    size_t rows = (n + cols - 1) / cols;
+    float w = cx / cols;
+    float h = cy / rows;
+    for (size_t i = 0; i < n; i++) {
+        Cell cell;
+        cell.cx = w;
+        cell.cy = h;
+        cell.x  = w * (i % cols);
+        cell.y  = h * (i / cols);
+        if (i == 0)
+            primaryCell = cell;
+        else
+            cells.push_back(cell);
+    }
+}
+
+// 用 bounds 等比缩放到格子内居中，不需要知道源当前的尺寸（窗口尚未捕获到时为 0）
+void SceneLayout::placeItem(obs_sceneitem_t *item, const Cell &cell)
+{
+    vec2 pos, bounds;
+    vec2_set(&pos, cell.x, cell.y);
+    vec2_set(&bounds, cell.cx, cell.cy);
+
+    obs_sceneitem_set_alignment(item, OBS_ALIGN_LEFT | OBS_ALIGN_TOP);
+    obs_sceneitem_set_bounds_type(item, OBS_BOUNDS_SCALE_INNER);
+    obs_sceneitem_set_bounds_alignment(item, OBS_ALIGN_CENTER);
+    obs_sceneitem_set_bounds(item, &bounds);
+    obs_sceneitem_set_pos(item, &pos);
+}
+
+void SceneLayout::atomicUpdate(void *param, obs_scene_t *scene)
+{
+    SceneLayout *layout = static_cast<SceneLayout *>(param);
+    std::vector<Entry> &next = *layout->pendingEntries;
+
+    // scene 的锁是递归锁，在回调中增删 item 是安全的
+    for (Entry &entry : *layout->removedEntries) {
+        obs_sceneitem_remove(entry.item);
+        obs_sceneitem_release(entry.item);
+        entry.item = nullptr;
+    }
+
+    for (Entry &entry : next) {
+        if (!entry.item) {
+            entry.item = obs_scene_add(scene, entry.source);
+            obs_sceneitem_addref(entry.item);
+        }
+        obs_sceneitem_set_crop(entry.item, &entry.config.crop);
+    }
+
+    obs_sceneitem_t *primaryItem = layout->primary ?
+            obs_scene_find_source(scene, obs_source_get_name(layout->primary)) :
+            nullptr;
+
+    if (next.empty()) {
+        // 回到单源，由 QtOBSContext 按原来的方式放缩主源
+        if (primaryItem)
+            obs_sceneitem_set_bounds_type(primaryItem, OBS_BOUNDS_NONE);
+        return;
+    }
+
+    Cell primaryCell;
+    std::vector<Cell> cells;
+    layout->computeCells(layout->pendingMode, next.size(), primaryCell, cells);
+
+    if (primaryItem) {
+        vec2 scale;
+        vec2_set(&scale, 1.0f, 1.0f);
+        obs_sceneitem_set_scale(primaryItem, &scale);
+        placeItem(primaryItem, primaryCell);
+        obs_sceneitem_set_order(primaryItem, OBS_ORDER_MOVE_BOTTOM);
+    }
+    for (size_t i = 0; i < next.size(); i++)
+        placeItem(next[i].item, cells[i]);
+}
+
+uint64_t SceneLayout::apply(Mode mode, const std::vector<LayoutSource> &sources)
+{
+    if (!scene || (!sources.empty() && (!canvasWidth || !canvasHeight)))
+        return 0;
+
+    std::vector<Entry> next;
+    std::vector<Entry> removed;
+    std::vector<bool> kept(entries.size(), false);
+    int added = 0;
+
+    // 锁外：创建新源、更新已有源的设置
+    for (const LayoutSource &config : sources) {
+        Entry entry;
+        entry.config = config;
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (kept[i] || entries[i].config.name != config.name ||
+                    entries[i].config.id != config.id)
+                continue;
+            kept[i] = true;
+            entry.source = entries[i].source;
+            entry.item   = entries[i].item;
+            if (!SameSettings(entries[i].config.settings, config.settings))
+                obs_source_update(entry.source, config.settings);
+            break;
+        }
+
+        if (!entry.source) {
+            entry.source = obs_source_create(config.id.c_str(),
+                                             config.name.c_str(),
+                                             config.settings, nullptr);
+            if (!entry.source) {
+                blog(LOG_WARNING, "layout: create source '%s' (%s) failed",
+                     config.name.c_str(), config.id.c_str());
+                continue;
+            }
+            added++;
+        }
+        next.push_back(entry);
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!kept[i])
+            removed.push_back(entries[i]);
+    }
+
+    pendingEntries = &next;
+    removedEntries = &removed;
+    pendingMode    = mode;
+
+    uint64_t start = os_gettime_ns();
+    obs_scene_atomic_update(scene, atomicUpdate, this);
+    uint64_t lockedUs = (os_gettime_ns() - start) / 1000;
+
+    pendingEntries = nullptr;
+    removedEntries = nullptr;
+
+    // 锁外：释放被删除的源
+    for (Entry &entry : removed)
+        obs_source_release(entry.source);
+
+    entries.swap(next);
+    currentMode = mode;
+    updateCount++;
+
+    blog(LOG_INFO, "layout: %s with %d sources (+%d -%d), %llu us in scene lock",
+         mode == Grid ? "grid" : "pip", (int)entries.size(), added,
+         (int)removed.size(), (unsigned long long)lockedUs);
+    return lockedUs;
+}
+
+void SceneLayout::sources(std::vector<LayoutSource> &result) const
+{
+    result.clear();
+    for (const Entry &entry : entries)
+        result.push_back(entry.config);
+}
+
+uint64_t SceneLayout::add(const LayoutSource &source)
+{
+    std::vector<LayoutSource> next;
+    sources(next);
+    for (LayoutSource &config : next) {
+        if (config.name == source.name) {
+            config = source;
+            return apply(currentMode, next);
+        }
+    }
+    next.push_back(source);
+    return apply(currentMode, next);
+}
+
+uint64_t SceneLayout::remove(const std::string &name)
+{
+    std::vector<LayoutSource> next;
+    for (const Entry &entry : entries) {
+        if (entry.config.name != name)
+            next.push_back(entry.config);
+    }
+    if (next.size() == entries.size())
+        return 0;
+    return apply(currentMode, next);
+}
+
+uint64_t SceneLayout::setCrop(const std::string &name,
+                              const obs_sceneitem_crop &crop)
+{
+    std::vector<LayoutSource> next;
+    sources(next);
+    bool changed = false;
+    for (LayoutSource &config : next) {
+        if (config.name == name && !SameCrop(config.crop, crop)) {
+            config.crop = crop;
+            changed = true;
+        }
+    }
+    return changed ? apply(currentMode, next) : 0;
+}
+
+uint64_t SceneLayout::relayout()
+{
+    if (entries.empty())
+        return 0;
+
+    std::vector<LayoutSource> current;
+    sources(current);
+    return apply(currentMode, current);
+}
+
+void SceneLayout::clear()
+{
+    if (entries.empty())
+        return;
+
+    if (scene) {
+        apply(currentMode, std::vector<LayoutSource>());
+        return;
+    }
+
+    for (Entry &entry : entries) {
+        obs_sceneitem_release(entry.item);
+        obs_source_release(entry.source);
+    }
+    entries.clear();
+}
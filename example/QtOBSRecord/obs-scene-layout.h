@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+#include "obs.hpp"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * 多源布局：场景中除主捕获源（captureSource）外，还可以有 N 个额外的捕获源，
+ * 按网格或画中画排列，每个源有自己的剪裁（scene item crop，不需要额外的滤镜渲染）。
+ *
+ * 每次布局变化（增删源、改剪裁、改模式、画布尺寸变化）只调用一次 obs_scene_atomic_update，
+ * 在场景锁内完成全部 scene item 的增删和变换，图形线程不会渲染出中间状态，
+ * 也不会为每个 item 各加一次锁。
+ */
+struct LayoutSource
+{
+    std::string        name;       // 唯一名称，也是 obs 源的名称
+    std::string        id;         // 源类型，如 window_capture、monitor_capture
+    OBSData            settings;   // 源设置，可以为空
+    obs_sceneitem_crop crop;       // 各边剪裁的像素数
+
+    LayoutSource() { crop.left = crop.top = crop.right = crop.bottom = 0; }
+};
+
+class SceneLayout
+{
+public:
+    enum Mode {
+        Grid,              // 主源和额外源按行列平均分布
+        PictureInPicture,  // 主源铺满画布，额外源缩小后排在右下角
+    };
+
+    SceneLayout();
+    ~SceneLayout();
+
+    // primary 为主捕获源，已经添加到 scene 中，没有额外源时不修改它的变换
+    void setScene(obs_scene_t *scene, obs_source_t *primary);
+    void setCanvas(uint32_t cx, uint32_t cy);
+
+    /**
+     * 把场景调整为 sources 描述的布局：按名称比较，新增的源在锁外创建，
+     * 删除/新增/变换在一次 obs_scene_atomic_update 中完成，被删除的源在锁外释放。
+     * 返回场景锁内的耗时（微秒）
+     */
+    uint64_t apply(Mode mode, const std::vector<LayoutSource> &sources);
+
+    // 以下都是基于当前布局的一次 apply
+    uint64_t add(const LayoutSource &source);
+    uint64_t remove(const std::string &name);
+    uint64_t setCrop(const std::string &name, const obs_sceneitem_crop &crop);
+    uint64_t relayout();
+    void clear();
+
+    Mode mode() const { return currentMode; }
+    size_t count() const { return entries.size(); }
+    bool active() const { return !entries.empty(); }
+    void sources(std::vector<LayoutSource> &result) const;
+
+    uint64_t updates() const { return updateCount; }
+
+private:
+    struct Entry {
+        LayoutSource    config;
+        obs_source_t    *source;
+        obs_sceneitem_t *item;
+
+        Entry() : source(nullptr), item(nullptr) {}
+    };
+
+    struct Cell {
+        float x, y, cx, cy;
+    };
+
+    static void atomicUpdate(void *param, obs_scene_t *scene);
+    void computeCells(Mode mode, size_t extras, Cell &primaryCell,
+                      std::vector<Cell> &cells) const;
+    static void placeItem(obs_sceneitem_t *item, const Cell &cell);
+
+    obs_scene_t        *scene;
+    obs_source_t       *primary;
+    uint32_t           canvasWidth;
+    uint32_t           canvasHeight;
+
+    Mode               currentMode;
+    std::vector<Entry> entries;
+    uint64_t           updateCount;
+
+    // 只在 apply 期间有效，供 atomicUpdate 回调使用
+    std::vector<Entry> *pendingEntries;
+    std::vector<Entry> *removedEntries;
+    Mode               pendingMode;
+};
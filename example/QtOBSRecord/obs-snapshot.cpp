@@ -0,0 +1,271 @@
+﻿#include "obs-snapshot.h"
+#include "obs-raw-tap.h"
+#include "obs-thread-topology.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+
+#include <QImage>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QDir>
+
+#include <algorithm>
+#include <memory>
+
+#define SNAPSHOT_THREADS     2
+#define THUMBNAIL_FILE       "thumbnail.jpg"
+#define COST_SMOOTHING       0.2    // 缩略图 CPU 时间滑动平均的权重
+
+class SnapshotGenerator::EncodeTask : public QRunnable
+{
+public:
+    EncodeTask(SnapshotGenerator *generator_, const QImage &image_,
+               const QString &path_, int quality_, bool thumbnail_,
+               qint64 timestamp_) :
+        generator(generator_), image(image_), path(path_),
+        quality(quality_), thumbnail(thumbnail_), timestamp(timestamp_)
+    {
+    }
+
+    void run() override
+    {
+        uint64_t cpuStart = 0, cpuEnd = 0;
+        GetCurrentThreadCpuNs(cpuStart);
+
+        bool success;
+        if (thumbnail) {
+            QByteArray jpeg;
+            QBuffer buffer(&jpeg);
+            buffer.open(QIODevice::WriteOnly);
+            success = image.save(&buffer, "JPG", quality);
+            if (success) {
+                QSaveFile file(path);
+                success = file.open(QIODevice::WriteOnly) &&
+                          file.write(jpeg) == jpeg.size() && file.commit();
+                emit generator->thumbnailReady(jpeg, timestamp);
+            }
+        } else {
+            QImageWriter writer(path);
+            writer.setQuality(quality);
+            success = writer.write(image);
+            if (!success)
+                blog(LOG_WARNING, "snapshot: save '%s' failed: %s",
+                     path.toStdString().c_str(),
+                     writer.errorString().toStdString().c_str());
+            emit generator->stillSaved(path, success);
+        }
+
+        GetCurrentThreadCpuNs(cpuEnd);
+        generator->encodeFinished(thumbnail, success, cpuEnd - cpuStart);
+    }
+
+private:
+    SnapshotGenerator *generator;
+    QImage            image;
+    QString           path;
+    int               quality;
+    bool              thumbnail;
+    qint64            timestamp;
+};
+
+// RGBA 画面在 tap 的槽位中，回调返回后会被复用，需要拷贝
+static QImage CopyFrame(const RawVideoFrame &frame)
+{
+    QImage view(frame.data[0], (int)frame.width, (int)frame.height,
+                (int)frame.linesize[0], QImage::Format_RGBA8888);
+    return view.copy();
+}
+
+SnapshotGenerator::SnapshotGenerator(RawTapManager &taps_, QObject *parent) :
+    QObject(parent),
+    taps(taps_),
+    thumbTap(0),
+    thumbQuality(75),
+    cpuBudget(0.0),
+    baseIntervalNs(0.0),
+    costNs(0.0),
+    lastThumbNs(0),
+    startNs(0),
+    inFlight(0),
+    thumbnails(0),
+    stills(0),
+    skippedBusy(0),
+    skippedBudget(0),
+    failed(0),
+    encodeCpuNs(0),
+    copyNs(0)
+{
+    pool.setMaxThreadCount(SNAPSHOT_THREADS);
+}
+
+SnapshotGenerator::~SnapshotGenerator()
+{
+    stop();
+}
+
+bool SnapshotGenerator::startThumbnails(const QString &dir, int width,
+                                        int intervalMs, int quality,
+                                        double budget)
+{
+    stopThumbnails();
+
+    const struct video_output_info *voi = video_output_get_info(obs_get_video());
+    if (!voi || width <= 0 || intervalMs <= 0)
+        return false;
+
+    QDir().mkpath(dir);
+    thumbDir       = dir;
+    thumbQuality   = quality;
+    cpuBudget      = budget;
+    baseIntervalNs = intervalMs * 1000000.0;
+    costNs         = 0.0;
+    lastThumbNs    = 0;
+    startNs        = os_gettime_ns();
+
+    // 由 libobs 缩放并转换为 RGBA；按帧率先粗略抽帧，再在回调中按时间和预算细调
+    RawVideoTapConfig config;
+    config.width   = (uint32_t)width & ~1u;
+    config.height  = (uint32_t)((uint64_t)config.width * voi->height /
+                                voi->width) & ~1u;
+    config.format  = VIDEO_FORMAT_RGBA;
+    config.divisor = (uint32_t)std::max(1.0, (double)voi->fps_num /
+                                        voi->fps_den * intervalMs / 1000.0 / 2.0);
+    config.slots   = 2;
+
+    thumbTap = taps.addVideoTap("thumbnail", config,
+                                [this] (const RawVideoFrame &frame) {
+        onThumbnailFrame(frame);
+    });
+    return thumbTap != 0;
+}
+
+void SnapshotGenerator::stopThumbnails()
+{
+    if (!thumbTap)
+        return;
+
+    taps.removeTap(thumbTap);
+    thumbTap = 0;
+}
+
+void SnapshotGenerator::onThumbnailFrame(const RawVideoFrame &frame)
+{
+    // 预算约束下的最小间隔：每张的 CPU 时间 / 允许占用的比例
+    double interval = baseIntervalNs;
+    double cost = costNs.load(std::memory_order_relaxed);
+    if (cpuBudget > 0.0 && cost > 0.0)
+        interval = std::max(interval, cost * 100.0 / cpuBudget);
+
+    uint64_t now = os_gettime_ns();
+    if (lastThumbNs && (double)(now - lastThumbNs) < interval) {
+        if ((double)(now - lastThumbNs) >= baseIntervalNs)
+            skippedBudget.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (inFlight.load(std::memory_order_relaxed) >= SNAPSHOT_THREADS) {
+        skippedBusy.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    lastThumbNs = now;
+
+    QImage image = CopyFrame(frame);
+    copyNs.fetch_add(os_gettime_ns() - now, std::memory_order_relaxed);
+
+    inFlight.fetch_add(1, std::memory_order_relaxed);
+    pool.start(new EncodeTask(this, image, thumbDir + "/" THUMBNAIL_FILE,
+                              thumbQuality, true, (qint64)frame.timestamp));
+}
+
+bool SnapshotGenerator::takeStill(const QString &path, int quality)
+{
+    if (path.isEmpty() || !obs_get_video())
+        return false;
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // 原始分辨率的一次性 tap，拿到第一帧后由 obs 线程移除（不能在 tap 线程中移除自己）
+    RawVideoTapConfig config;
+    config.format = VIDEO_FORMAT_RGBA;
+    config.slots  = 2;
+
+    auto taken = std::make_shared<std::atomic<bool>>(false);
+    auto id    = std::make_shared<std::atomic<int>>(0);
+    int tap = taps.addVideoTap("still", config,
+                               [this, taken, id, path, quality]
+                               (const RawVideoFrame &frame) {
+        int tapId = id->load();
+        if (!tapId || taken->exchange(true))
+            return;
+        onStillFrame(tapId, path, quality, frame);
+    });
+    id->store(tap);
+    return tap != 0;
+}
+
+void SnapshotGenerator::onStillFrame(int id, const QString &path, int quality,
+                                     const RawVideoFrame &frame)
+{
+    uint64_t start = os_gettime_ns();
+    QImage image = CopyFrame(frame);
+    copyNs.fetch_add(os_gettime_ns() - start, std::memory_order_relaxed);
+
+    inFlight.fetch_add(1, std::memory_order_relaxed);
+    pool.start(new EncodeTask(this, image, path, quality, false,
+                              (qint64)frame.timestamp));
+    QMetaObject::invokeMethod(this, "removeStillTap", Qt::QueuedConnection,
+                              Q_ARG(int, id));
+}
+
+void SnapshotGenerator::removeStillTap(int id)
+{
+    taps.removeTap(id);
+}
+
+void SnapshotGenerator::encodeFinished(bool thumbnail, bool success,
+                                       uint64_t cpuNs)
+{
+    inFlight.fetch_sub(1, std::memory_order_relaxed);
+    encodeCpuNs.fetch_add(cpuNs, std::memory_order_relaxed);
+
+    if (!success) {
+        failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!thumbnail) {
+        stills.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    thumbnails.fetch_add(1, std::memory_order_relaxed);
+    double cost = costNs.load(std::memory_order_relaxed);
+    costNs.store(cost > 0.0 ? cost + (cpuNs - cost) * COST_SMOOTHING
+                            : (double)cpuNs, std::memory_order_relaxed);
+}
+
+void SnapshotGenerator::stop()
+{
+    stopThumbnails();
+    pool.waitForDone();
+}
+
+void SnapshotGenerator::getStats(SnapshotStats &stats) const
+{
+    stats.thumbnails    = thumbnails.load(std::memory_order_relaxed);
+    stats.stills        = stills.load(std::memory_order_relaxed);
+    stats.skippedBusy   = skippedBusy.load(std::memory_order_relaxed);
+    stats.skippedBudget = skippedBudget.load(std::memory_order_relaxed);
+    stats.failed        = failed.load(std::memory_order_relaxed);
+    stats.encodeCpuNs   = encodeCpuNs.load(std::memory_order_relaxed);
+    stats.copyNs        = copyNs.load(std::memory_order_relaxed);
+    stats.elapsedNs     = startNs ? os_gettime_ns() - startNs : 0;
+
+    double cost = costNs.load(std::memory_order_relaxed);
+    stats.intervalMs = baseIntervalNs / 1000000.0;
+    if (cpuBudget > 0.0 && cost > 0.0)
+        stats.intervalMs = std::max(stats.intervalMs,
+                                    cost * 100.0 / cpuBudget / 1000000.0);
+}
@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QThreadPool>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+class RawTapManager;
+struct RawVideoFrame;
+
+struct SnapshotStats
+{
+    uint64_t thumbnails;
+    uint64_t stills;
+    uint64_t skippedBusy;     // 编码线程全忙，丢弃
+    uint64_t skippedBudget;   // 超出 CPU 预算，丢弃
+    uint64_t failed;
+    uint64_t encodeCpuNs;     // 编码线程的 CPU 时间（包括写文件）
+    uint64_t copyNs;          // tap 线程中拷贝画面的时间
+    uint64_t elapsedNs;       // 缩略图开启的总时长
+    double   intervalMs;      // 当前实际的缩略图间隔（受预算约束）
+
+    SnapshotStats() : thumbnails(0), stills(0), skippedBusy(0),
+        skippedBudget(0), failed(0), encodeCpuNs(0), copyNs(0),
+        elapsedNs(0), intervalMs(0.0) {}
+};
+
+/**
+ * 缩略图和截图：基于 RawTapManager 拿输出画面，由 libobs 缩放并转换为 RGBA，
+ * JPEG/PNG 压缩在单独的线程池中进行，录制线程（图形/编码/输出）不受影响。
+ *
+ * 缩略图按 intervalMs 周期生成，写入 dir/thumbnail.jpg（QSaveFile 原子替换），
+ * 同时发出 thumbnailReady。为了不超过 cpuBudget（占单核的百分比），
+ * 按实测的每张缩略图 CPU 时间自动拉长间隔。
+ *
+ * 截图（takeStill）为原始分辨率，格式由文件后缀决定（png/jpg），
+ * 请求时临时添加一个 tap，拿到一帧后移除。
+ */
+class SnapshotGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    SnapshotGenerator(RawTapManager &taps, QObject *parent = nullptr);
+    ~SnapshotGenerator();
+
+    bool startThumbnails(const QString &dir, int width, int intervalMs,
+                         int quality, double cpuBudget);
+    void stopThumbnails();
+    bool thumbnailsActive() const { return thumbTap != 0; }
+
+    bool takeStill(const QString &path, int quality);
+
+    // 等待所有编码任务结束，移除所有 tap
+    void stop();
+
+    void getStats(SnapshotStats &stats) const;
+
+signals:
+    void thumbnailReady(const QByteArray &jpeg, qint64 timestamp);
+    void stillSaved(const QString &path, bool success);
+
+private slots:
+    void removeStillTap(int id);
+
+private:
+    class EncodeTask;
+    friend class EncodeTask;
+
+    void onThumbnailFrame(const RawVideoFrame &frame);
+    void onStillFrame(int id, const QString &path, int quality,
+                      const RawVideoFrame &frame);
+    void encodeFinished(bool thumbnail, bool success, uint64_t cpuNs);
+
+    RawTapManager       &taps;
+    QThreadPool         pool;
+
+    int                 thumbTap;
+    QString             thumbDir;
+    int                 thumbQuality;
+    double              cpuBudget;
+    double              baseIntervalNs;
+    std::atomic<double> costNs;          // 每张缩略图 CPU 时间的滑动平均
+    uint64_t            lastThumbNs;     // 只在 tap 线程访问
+    uint64_t            startNs;
+    std::atomic<int>    inFlight;
+
+    std::atomic<uint64_t> thumbnails;
+    std::atomic<uint64_t> stills;
+    std::atomic<uint64_t> skippedBusy;
+    std::atomic<uint64_t> skippedBudget;
+    std::atomic<uint64_t> failed;
+    std::atomic<uint64_t> encodeCpuNs;
+    std::atomic<uint64_t> copyNs;
+};
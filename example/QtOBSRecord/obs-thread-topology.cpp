@@ -0,0 +1,532 @@
+﻿#include "obs-thread-topology.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <tlhelp32.h>
+#else
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#define LINUX_THREAD_NAME_MAX 15   // pthread_setname_np 截断长度
+
+static const char *roleNames[THREAD_ROLE_COUNT] = {
+    "graphics",
+    "video",
+    "audio",
+    "encoder",
+    "output",
+    "qtobs",
+    "other",
+};
+
+// libobs 及插件的线程名，参见各模块中的 os_set_thread_name
+static const struct {
+    const char *name;
+    int         role;
+} knownThreads[] = {
+    {"libobs: graphics thread",     THREAD_ROLE_GRAPHICS},
+    {"video-io: video thread",      THREAD_ROLE_VIDEO},
+    {"audio-io: audio thread",      THREAD_ROLE_AUDIO},
+    {"rtmp-stream: send_thread",    THREAD_ROLE_OUTPUT},
+    {"ffmpeg-output: write_thread", THREAD_ROLE_OUTPUT},
+    {"qtobs: obs thread",           THREAD_ROLE_QTOBS},
+    {nullptr,                       THREAD_ROLE_OTHER}
+};
+
+const char *GetThreadRoleName(int role)
+{
+    if (role < 0 || role >= THREAD_ROLE_COUNT)
+        return "unknown";
+    return roleNames[role];
+}
+
+/* ------------------------------------------------------------------------- */
+/* 平台相关 */
+
+#if defined(_WIN32)
+
+typedef HRESULT (WINAPI *GetThreadDescriptionFunc)(HANDLE, PWSTR *);
+
+static void EnumThreadIds(std::vector<uint64_t> &tids)
+{
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot == INVALID_HANDLE_VALUE)
+        return;
+
+    DWORD pid = GetCurrentProcessId();
+    THREADENTRY32 te;
+    te.dwSize = sizeof(te);
+    if (Thread32First(snapshot, &te)) {
+        do {
+            if (te.th32OwnerProcessID == pid)
+                tids.push_back(te.th32ThreadID);
+            te.dwSize = sizeof(te);
+        } while (Thread32Next(snapshot, &te));
+    }
+    CloseHandle(snapshot);
+}
+
+static std::string GetThreadNameById(uint64_t tid)
+{
+    // GetThreadDescription 需要 Windows 10 1607 以上
+    static GetThreadDescriptionFunc getDesc = (GetThreadDescriptionFunc)
+            GetProcAddress(GetModuleHandleW(L"kernel32.dll"),
+                           "GetThreadDescription");
+    if (!getDesc)
+        return std::string();
+
+    HANDLE thread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE,
+                               (DWORD)tid);
+    if (!thread)
+        return std::string();
+
+    std::string name;
+    PWSTR desc = nullptr;
+    if (SUCCEEDED(getDesc(thread, &desc)) && desc) {
+        char *utf8 = nullptr;
+        os_wcs_to_utf8_ptr(desc, 0, &utf8);
+        if (utf8)
+            name = utf8;
+        bfree(utf8);
+        LocalFree(desc);
+    }
+    CloseHandle(thread);
+    return name;
+}
+
+static std::string GetDefaultThreadName()
+{
+    return std::string();
+}
+
+static bool GetThreadCpuNs(uint64_t tid, uint64_t &ns)
+{
+    HANDLE thread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE,
+                               (DWORD)tid);
+    if (!thread)
+        return false;
+
+    FILETIME create, exit, kernel, user;
+    bool ok = !!GetThreadTimes(thread, &create, &exit, &kernel, &user);
+    if (ok) {
+        ULARGE_INTEGER k, u;
+        k.LowPart  = kernel.dwLowDateTime;
+        k.HighPart = kernel.dwHighDateTime;
+        u.LowPart  = user.dwLowDateTime;
+        u.HighPart = user.dwHighDateTime;
+        ns = (k.QuadPart + u.QuadPart) * 100;
+    }
+    CloseHandle(thread);
+    return ok;
+}
+
+static bool SetThreadCpus(uint64_t tid, const std::vector<int> &cpus)
+{
+    // 只处理第一个处理器组（64 核以内）
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < (int)(sizeof(DWORD_PTR) * 8))
+            mask |= (DWORD_PTR)1 << cpu;
+    }
+    if (!mask)
+        return false;
+
+    HANDLE thread = OpenThread(THREAD_SET_INFORMATION |
+                               THREAD_QUERY_INFORMATION, FALSE, (DWORD)tid);
+    if (!thread)
+        return false;
+    bool ok = SetThreadAffinityMask(thread, mask) != 0;
+    CloseHandle(thread);
+    return ok;
+}
+
+static bool SetThreadPriorityLevel(uint64_t tid, int priority)
+{
+    int value;
+    switch (priority) {
+    case TOPOLOGY_PRIORITY_IDLE:     value = THREAD_PRIORITY_IDLE; break;
+    case TOPOLOGY_PRIORITY_LOW:      value = THREAD_PRIORITY_BELOW_NORMAL; break;
+    case TOPOLOGY_PRIORITY_NORMAL:   value = THREAD_PRIORITY_NORMAL; break;
+    case TOPOLOGY_PRIORITY_HIGH:     value = THREAD_PRIORITY_HIGHEST; break;
+    case TOPOLOGY_PRIORITY_CRITICAL: value = THREAD_PRIORITY_TIME_CRITICAL; break;
+    default:
+        return true;
+    }
+
+    HANDLE thread = OpenThread(THREAD_SET_INFORMATION, FALSE, (DWORD)tid);
+    if (!thread)
+        return false;
+    bool ok = !!SetThreadPriority(thread, value);
+    CloseHandle(thread);
+    return ok;
+}
+
+#else
+
+static std::string ReadTaskFile(uint64_t tid, const char *file)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%llu/%s",
+             (unsigned long long)tid, file);
+
+    std::string content;
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return content;
+
+    char buf[512];
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    content.assign(buf, n);
+    return content;
+}
+
+static void EnumThreadIds(std::vector<uint64_t> &tids)
+{
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir)
+        return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+            continue;
+        tids.push_back(strtoull(ent->d_name, nullptr, 10));
+    }
+    closedir(dir);
+}
+
+static std::string GetThreadNameById(uint64_t tid)
+{
+    std::string name = ReadTaskFile(tid, "comm");
+    while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+        name.pop_back();
+    return name;
+}
+
+// 未命名的线程继承主线程（进程）的名字
+static std::string GetDefaultThreadName()
+{
+    return GetThreadNameById((uint64_t)getpid());
+}
+
+static bool GetThreadCpuNs(uint64_t tid, uint64_t &ns)
+{
+    std::string stat = ReadTaskFile(tid, "stat");
+    size_t pos = stat.rfind(')');
+    if (pos == std::string::npos)
+        return false;
+
+    // ')' 之后依次是 state(3) ... utime(14) stime(15)
+    unsigned long long utime = 0, stime = 0;
+    if (sscanf(stat.c_str() + pos + 1,
+               " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+               &utime, &stime) != 2)
+        return false;
+
+    long ticks = sysconf(_SC_CLK_TCK);
+    if (ticks <= 0)
+        return false;
+    ns = (uint64_t)(utime + stime) * (1000000000ULL / (uint64_t)ticks);
+    return true;
+}
+
+static bool SetThreadCpus(uint64_t tid, const std::vector<int> &cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    if (!CPU_COUNT(&set))
+        return false;
+    return sched_setaffinity((pid_t)tid, sizeof(set), &set) == 0;
+}
+
+static bool SetThreadPriorityLevel(uint64_t tid, int priority)
+{
+    int nice;
+    switch (priority) {
+    case TOPOLOGY_PRIORITY_IDLE:     nice = 19; break;
+    case TOPOLOGY_PRIORITY_LOW:      nice = 10; break;
+    case TOPOLOGY_PRIORITY_NORMAL:   nice = 0; break;
+    case TOPOLOGY_PRIORITY_HIGH:     nice = -5; break;   // 需要 CAP_SYS_NICE
+    case TOPOLOGY_PRIORITY_CRITICAL: nice = -10; break;
+    default:
+        return true;
+    }
+    return setpriority(PRIO_PROCESS, (id_t)tid, nice) == 0;
+}
+
+#endif
+
+bool GetCurrentThreadCpuNs(uint64_t &ns)
+{
+#if defined(_WIN32)
+    return GetThreadCpuNs(GetCurrentThreadId(), ns);
+#else
+    return GetThreadCpuNs((uint64_t)syscall(SYS_gettid), ns);
+#endif
+}
+
+bool SetCurrentProcessCpus(const std::vector<int> &cpus)
+{
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < (int)(sizeof(DWORD_PTR) * 8))
+            mask |= (DWORD_PTR)1 << cpu;
+    }
+    if (!mask)
+        return false;
+    return SetProcessAffinityMask(GetCurrentProcess(), mask) != 0;
+#else
+    return SetThreadCpus((uint64_t)syscall(SYS_gettid), cpus);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* 配置 */
+
+void ParseCpuList(const char *str, std::vector<int> &cpus)
+{
+    cpus.clear();
+    while (str && *str) {
+        char *end = nullptr;
+        long first = strtol(str, &end, 10);
+        if (end == str)
+            break;
+
+        long last = first;
+        if (*end == '-') {
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if (end == str)
+                last = first;
+        }
+        for (long cpu = first; cpu <= last && cpu < 1024; cpu++)
+            cpus.push_back((int)cpu);
+
+        str = end;
+        while (*str == ',' || *str == ' ')
+            str++;
+    }
+}
+
+static int ParsePriority(const char *str)
+{
+    if (!str || !*str)
+        return TOPOLOGY_PRIORITY_DEFAULT;
+    if (astrcmpi(str, "idle") == 0)
+        return TOPOLOGY_PRIORITY_IDLE;
+    if (astrcmpi(str, "low") == 0)
+        return TOPOLOGY_PRIORITY_LOW;
+    if (astrcmpi(str, "normal") == 0)
+        return TOPOLOGY_PRIORITY_NORMAL;
+    if (astrcmpi(str, "high") == 0)
+        return TOPOLOGY_PRIORITY_HIGH;
+    if (astrcmpi(str, "critical") == 0)
+        return TOPOLOGY_PRIORITY_CRITICAL;
+
+    blog(LOG_WARNING, "thread topology: unknown priority '%s'", str);
+    return TOPOLOGY_PRIORITY_DEFAULT;
+}
+
+bool ThreadTopologyConfig::load(const std::string &file)
+{
+    obs_data_t *data = obs_data_create_from_json_file_safe(file.c_str(), "bak");
+    if (!data)
+        return false;
+
+    x264Threads = (int)obs_data_get_int(data, "x264_threads");
+
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        ThreadRoleConfig &role = roles[i];
+        role = ThreadRoleConfig();
+
+        obs_data_t *item = obs_data_get_obj(data, roleNames[i]);
+        if (!item)
+            continue;
+
+        ParseCpuList(obs_data_get_string(item, "cpus"), role.cpus);
+        role.priority = ParsePriority(obs_data_get_string(item, "priority"));
+
+        char **names = strlist_split(obs_data_get_string(item, "names"), ',',
+                                     false);
+        for (char **name = names; name && *name; name++) {
+            std::string pattern = *name;
+            while (!pattern.empty() && pattern.front() == ' ')
+                pattern.erase(0, 1);
+            if (!pattern.empty())
+                role.names.push_back(pattern);
+        }
+        strlist_free(names);
+        obs_data_release(item);
+    }
+
+    obs_data_release(data);
+    blog(LOG_INFO, "thread topology loaded from %s, x264 threads:%d",
+         file.c_str(), x264Threads);
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Linux 下线程名被截断为 15 个字符，按前缀比较
+static bool NameMatches(const std::string &name, const char *pattern)
+{
+    size_t len = strlen(pattern);
+    if (name.empty())
+        return false;
+    if (name.size() >= LINUX_THREAD_NAME_MAX && len > name.size())
+        return strncmp(pattern, name.c_str(), name.size()) == 0;
+    return strncmp(name.c_str(), pattern, len) == 0;
+}
+
+ThreadTopology::ThreadTopology() : hasBaseline(false), lastStatsNs(0)
+{
+}
+
+void ThreadTopology::setConfig(const ThreadTopologyConfig &config_)
+{
+    config = config_;
+
+    // 配置变化后所有线程重新应用
+    threads.clear();
+}
+
+int ThreadTopology::classify(uint64_t tid, const std::string &name) const
+{
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        for (const std::string &pattern : config.roles[i].names) {
+            if (NameMatches(name, pattern.c_str()))
+                return i;
+        }
+    }
+    for (size_t i = 0; knownThreads[i].name; i++) {
+        if (NameMatches(name, knownThreads[i].name))
+            return knownThreads[i].role;
+    }
+
+    bool unnamed = name.empty() || name == GetDefaultThreadName();
+    if (unnamed && hasBaseline && baseline.find(tid) == baseline.end())
+        return THREAD_ROLE_ENCODER;
+    return THREAD_ROLE_OTHER;
+}
+
+void ThreadTopology::markBaseline()
+{
+    std::vector<uint64_t> tids;
+    EnumThreadIds(tids);
+
+    baseline.clear();
+    baseline.insert(tids.begin(), tids.end());
+    hasBaseline = true;
+}
+
+int ThreadTopology::apply()
+{
+    std::vector<uint64_t> tids;
+    EnumThreadIds(tids);
+
+    for (auto &it : threads)
+        it.second.alive = false;
+
+    int configured = 0;
+    for (uint64_t tid : tids) {
+        auto it = threads.find(tid);
+        if (it != threads.end()) {
+            it->second.alive = true;
+            continue;
+        }
+
+        ThreadInfo info;
+        info.name      = GetThreadNameById(tid);
+        info.role      = classify(tid, info.name);
+        info.lastCpuNs = 0;
+        info.alive     = true;
+        GetThreadCpuNs(tid, info.lastCpuNs);
+
+        const ThreadRoleConfig &role = config.roles[info.role];
+        if (!role.cpus.empty() && !SetThreadCpus(tid, role.cpus))
+            blog(LOG_WARNING, "thread topology: failed to set affinity of "
+                              "thread %llu (%s)", (unsigned long long)tid,
+                 info.name.c_str());
+        if (!SetThreadPriorityLevel(tid, role.priority))
+            blog(LOG_WARNING, "thread topology: failed to set priority of "
+                              "thread %llu (%s)", (unsigned long long)tid,
+                 info.name.c_str());
+
+        if (!role.cpus.empty() || role.priority != TOPOLOGY_PRIORITY_DEFAULT)
+            configured++;
+
+        threads[tid] = info;
+    }
+
+    // 已退出的线程
+    for (auto it = threads.begin(); it != threads.end();) {
+        if (!it->second.alive)
+            it = threads.erase(it);
+        else
+            ++it;
+    }
+
+    return configured;
+}
+
+void ThreadTopology::logStats()
+{
+    apply();
+
+    uint64_t now = os_gettime_ns();
+    uint64_t elapsed = lastStatsNs ? now - lastStatsNs : 0;
+    lastStatsNs = now;
+
+    double roleUsage[THREAD_ROLE_COUNT] = {0};
+    int roleThreads[THREAD_ROLE_COUNT] = {0};
+
+    for (auto &it : threads) {
+        ThreadInfo &info = it.second;
+        uint64_t cpuNs = 0;
+        if (!GetThreadCpuNs(it.first, cpuNs))
+            continue;
+
+        double usage = 0.0;
+        if (elapsed && cpuNs >= info.lastCpuNs)
+            usage = (double)(cpuNs - info.lastCpuNs) / (double)elapsed * 100.0;
+        info.lastCpuNs = cpuNs;
+
+        roleUsage[info.role] += usage;
+        roleThreads[info.role]++;
+
+        if (elapsed && usage >= 0.1)
+            blog(LOG_INFO, "thread stat, %-8s %6llu %-28s cpu:%.1f%%",
+                 roleNames[info.role], (unsigned long long)it.first,
+                 info.name.empty() ? "-" : info.name.c_str(), usage);
+    }
+
+    if (!elapsed)
+        return;
+
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        if (!roleThreads[i])
+            continue;
+        blog(LOG_INFO, "thread role stat, %-8s threads:%d cpu:%.1f%%",
+             roleNames[i], roleThreads[i], roleUsage[i]);
+    }
+}
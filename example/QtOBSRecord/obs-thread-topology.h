@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * 线程拓扑配置：按角色给管线线程设置 CPU 亲和性和调度优先级，并统计每个线程的 CPU 占用。
+ *
+ * 线程按名字识别（libobs 通过 os_set_thread_name 命名）。x264/libavcodec 的工作线程没有名字，
+ * 初始化完成后（markBaseline）新出现的未命名线程都归为编码线程。
+ */
+enum ThreadRole {
+    THREAD_ROLE_GRAPHICS,   // libobs: graphics thread
+    THREAD_ROLE_VIDEO,      // video-io: video thread，编码器的 encode 在这里调用
+    THREAD_ROLE_AUDIO,      // audio-io: audio thread
+    THREAD_ROLE_ENCODER,    // x264 工作线程
+    THREAD_ROLE_OUTPUT,     // 推流发送/写文件线程
+    THREAD_ROLE_QTOBS,      // Dialog 中的 obsThread
+    THREAD_ROLE_OTHER,
+    THREAD_ROLE_COUNT
+};
+
+enum TopologyPriority {
+    TOPOLOGY_PRIORITY_DEFAULT,  // 不修改
+    TOPOLOGY_PRIORITY_IDLE,
+    TOPOLOGY_PRIORITY_LOW,
+    TOPOLOGY_PRIORITY_NORMAL,
+    TOPOLOGY_PRIORITY_HIGH,
+    TOPOLOGY_PRIORITY_CRITICAL
+};
+
+struct ThreadRoleConfig
+{
+    std::vector<int>         cpus;      // 为空时不修改亲和性
+    int                      priority;  // TopologyPriority
+    std::vector<std::string> names;     // 额外的线程名（逗号分隔，前缀匹配），用于插件线程
+
+    ThreadRoleConfig() : priority(TOPOLOGY_PRIORITY_DEFAULT) {}
+};
+
+/**
+ * 配置文件 thread-topology.json，例如：
+ * {
+ *     "x264_threads": 4,
+ *     "graphics": { "cpus": "0-1", "priority": "high" },
+ *     "encoder":  { "cpus": "2-7" },
+ *     "output":   { "cpus": "8", "names": "ffmpeg-mux, win-wasapi" }
+ * }
+ */
+struct ThreadTopologyConfig
+{
+    ThreadRoleConfig roles[THREAD_ROLE_COUNT];
+    int              x264Threads;   // 0 为 x264 自动
+
+    ThreadTopologyConfig() : x264Threads(0) {}
+
+    bool load(const std::string &file);
+};
+
+const char *GetThreadRoleName(int role);
+
+// 当前线程累计占用的 CPU 时间（用户态 + 内核态）
+bool GetCurrentThreadCpuNs(uint64_t &ns);
+
+// 解析 "0-3,8,10-11" 格式的 CPU 列表
+void ParseCpuList(const char *str, std::vector<int> &cpus);
+
+/**
+ * 把整个进程限制在 cpus 上。Linux 下只对调用线程生效，之后创建的线程继承，
+ * 因此需要在创建其它线程（obs_startup）之前调用
+ */
+bool SetCurrentProcessCpus(const std::vector<int> &cpus);
+
+class ThreadTopology
+{
+public:
+    ThreadTopology();
+
+    void setConfig(const ThreadTopologyConfig &config);
+    const ThreadTopologyConfig &getConfig() const { return config; }
+
+    // 记录当前所有线程，之后出现的未命名线程归为编码线程
+    void markBaseline();
+
+    // 枚举线程并对新线程应用配置，返回本次新配置的线程数
+    int apply();
+
+    // 输出每个线程自上次调用以来的 CPU 占用（占单核的百分比）
+    void logStats();
+
+private:
+    struct ThreadInfo {
+        std::string name;
+        int         role;
+        uint64_t    lastCpuNs;
+        bool        alive;
+    };
+
+    int classify(uint64_t tid, const std::string &name) const;
+
+    ThreadTopologyConfig         config;
+    std::map<uint64_t, ThreadInfo> threads;
+    std::set<uint64_t>           baseline;
+    bool                         hasBaseline;
+    uint64_t                     lastStatsNs;
+};
@@ -0,0 +1,504 @@
+﻿#include "obs-vad-filter.h"
+#include "obs-thread-topology.h"
+
+// obs headers
+#include <media-io/audio-io.h>
+#include <util/platform.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define VAD_BENCH_SOURCE_ID       "qtobs_vad_bench_source"
+
+#define VAD_MIN_SPEECH_DB         -60.0   // 低于此能量一律视为静音
+#define VAD_ZCR_MAX               0.35    // 浊音的过零率上限
+#define VAD_UNVOICED_EXTRA_DB     6.0     // 清音（高过零率）需要额外高出底噪的能量
+#define VAD_ONSET_MS              20.0    // 连续满足条件多久判定为开始说话
+#define VAD_NOISE_FLOOR_RISE_DB_S 3.0     // 底噪估计每秒最多上升
+#define VAD_NOISE_FLOOR_FALL      0.2     // 能量低于底噪时的跟随系数
+
+#define BENCH_SIGNAL_SECONDS      10      // 合成信号长度，循环使用
+
+#define VAD_PI 3.14159265358979323846
+
+struct vad_filter {
+    obs_source_t       *context;
+
+    std::mutex         suppressorMutex;
+    obs_weak_source_t  *suppressor;
+    bool               suppressorOn;
+
+    // 设置
+    double             thresholdDb;
+    double             hangoverMs;
+    float              floorGain;
+    double             attackMs;
+    double             releaseMs;
+
+    // 状态
+    uint32_t           sampleRate;
+    size_t             channels;
+    float              attackStep;
+    float              releaseStep;
+    double             noiseFloorDb;
+    bool               hasNoiseFloor;
+    double             onsetMs;
+    double             silentMs;
+    bool               voiced;
+    float              gain;
+
+    std::atomic<uint64_t> blocks;
+    std::atomic<uint64_t> voicedBlocks;
+    std::atomic<uint64_t> processNs;
+};
+
+static const char *vad_filter_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS VAD Noise Suppression";
+}
+
+static void vad_filter_set_suppressor_state(struct vad_filter *f, bool on)
+{
+    std::lock_guard<std::mutex> lock(f->suppressorMutex);
+    obs_source_t *suppressor = obs_weak_source_get_source(f->suppressor);
+    if (suppressor) {
+        obs_source_set_enabled(suppressor, on);
+        obs_source_release(suppressor);
+    }
+    f->suppressorOn = on;
+}
+
+static void vad_filter_update(void *data, obs_data_t *settings)
+{
+    struct vad_filter *f = static_cast<struct vad_filter *>(data);
+
+    f->thresholdDb = obs_data_get_double(settings, "threshold_db");
+    f->hangoverMs  = (double)obs_data_get_int(settings, "hangover_ms");
+    f->floorGain   = (float)pow(10.0, obs_data_get_double(settings,
+                                                          "gate_floor_db") / 20.0);
+    f->attackMs    = (double)obs_data_get_int(settings, "attack_ms");
+    f->releaseMs   = (double)obs_data_get_int(settings, "release_ms");
+
+    f->sampleRate  = audio_output_get_sample_rate(obs_get_audio());
+    f->channels    = audio_output_get_channels(obs_get_audio());
+
+    // 增益线性渐变，每个采样的步长
+    double attackSamples  = f->attackMs * f->sampleRate / 1000.0;
+    double releaseSamples = f->releaseMs * f->sampleRate / 1000.0;
+    f->attackStep  = attackSamples > 1.0 ? (float)(1.0 / attackSamples) : 1.0f;
+    f->releaseStep = releaseSamples > 1.0 ? (float)(1.0 / releaseSamples) : 1.0f;
+}
+
+static void vad_filter_proc_set_suppressor(void *data, calldata_t *cd)
+{
+    struct vad_filter *f = static_cast<struct vad_filter *>(data);
+    obs_source_t *suppressor =
+            static_cast<obs_source_t *>(calldata_ptr(cd, "filter"));
+
+    {
+        std::lock_guard<std::mutex> lock(f->suppressorMutex);
+        obs_weak_source_release(f->suppressor);
+        f->suppressor = suppressor ? obs_source_get_weak_source(suppressor)
+                                   : nullptr;
+    }
+
+    // 与当前的检测状态保持一致，初始为静音
+    vad_filter_set_suppressor_state(f, f->voiced);
+}
+
+static void vad_filter_proc_get_stats(void *data, calldata_t *cd)
+{
+    struct vad_filter *f = static_cast<struct vad_filter *>(data);
+    calldata_set_int(cd, "blocks", (long long)f->blocks.load());
+    calldata_set_int(cd, "voiced_blocks", (long long)f->voicedBlocks.load());
+    calldata_set_int(cd, "process_ns", (long long)f->processNs.load());
+}
+
+static void *vad_filter_create(obs_data_t *settings, obs_source_t *context)
+{
+    struct vad_filter *f = new vad_filter();
+    f->context       = context;
+    f->suppressor    = nullptr;
+    f->suppressorOn  = true;
+    f->noiseFloorDb  = VAD_MIN_SPEECH_DB;
+    f->hasNoiseFloor = false;
+    f->onsetMs       = 0.0;
+    f->silentMs      = 0.0;
+    f->voiced        = false;
+    f->blocks        = 0;
+    f->voicedBlocks  = 0;
+    f->processNs     = 0;
+
+    vad_filter_update(f, settings);
+    f->gain = f->floorGain;
+
+    proc_handler_t *ph = obs_source_get_proc_handler(context);
+    proc_handler_add(ph, "void set_suppressor(in ptr filter)",
+                     vad_filter_proc_set_suppressor, f);
+    proc_handler_add(ph, "void get_stats(out int blocks, out int voiced_blocks, "
+                         "out int process_ns)",
+                     vad_filter_proc_get_stats, f);
+    return f;
+}
+
+static void vad_filter_destroy(void *data)
+{
+    struct vad_filter *f = static_cast<struct vad_filter *>(data);
+
+    // 本滤镜移除后降噪滤镜恢复为始终启用
+    vad_filter_set_suppressor_state(f, true);
+    obs_weak_source_release(f->suppressor);
+    delete f;
+}
+
+static void vad_filter_detect(struct vad_filter *f, struct obs_audio_data *audio)
+{
+    uint32_t frames = audio->frames;
+    double sum = 0.0;
+    size_t used = 0;
+    for (size_t c = 0; c < f->channels; c++) {
+        const float *s = reinterpret_cast<const float *>(audio->data[c]);
+        if (!s)
+            continue;
+        for (uint32_t i = 0; i < frames; i++)
+            sum += (double)s[i] * s[i];
+        used++;
+    }
+
+    double ms = used && frames ? sum / ((double)frames * used) : 0.0;
+    double db = ms > 1e-12 ? 10.0 * log10(ms) : -120.0;
+
+    // 过零率只看第一个声道
+    double zcr = 0.0;
+    const float *s0 = reinterpret_cast<const float *>(audio->data[0]);
+    if (s0 && frames > 1) {
+        uint32_t crossings = 0;
+        for (uint32_t i = 1; i < frames; i++)
+            crossings += (s0[i - 1] < 0.0f) != (s0[i] < 0.0f);
+        zcr = (double)crossings / (double)(frames - 1);
+    }
+
+    double blockMs = (double)frames * 1000.0 / f->sampleRate;
+
+    // 底噪估计：能量低于底噪时快速跟随，高于时缓慢上升
+    if (!f->hasNoiseFloor) {
+        f->noiseFloorDb  = db;
+        f->hasNoiseFloor = true;
+    } else if (db < f->noiseFloorDb) {
+        f->noiseFloorDb += (db - f->noiseFloorDb) * VAD_NOISE_FLOOR_FALL;
+    } else {
+        double rise = VAD_NOISE_FLOOR_RISE_DB_S * blockMs / 1000.0;
+        f->noiseFloorDb = fmin(db, f->noiseFloorDb + rise);
+    }
+
+    double margin = db - f->noiseFloorDb;
+    bool candidate = db > VAD_MIN_SPEECH_DB && margin > f->thresholdDb &&
+                     (zcr < VAD_ZCR_MAX ||
+                      margin > f->thresholdDb + VAD_UNVOICED_EXTRA_DB);
+
+    if (candidate) {
+        f->onsetMs += blockMs;
+        f->silentMs = 0.0;
+        if (f->onsetMs >= VAD_ONSET_MS)
+            f->voiced = true;
+    } else {
+        f->onsetMs = 0.0;
+        if (f->voiced) {
+            f->silentMs += blockMs;
+            if (f->silentMs >= f->hangoverMs)
+                f->voiced = false;
+        }
+    }
+}
+
+static struct obs_audio_data *vad_filter_audio(void *data,
+                                               struct obs_audio_data *audio)
+{
+    struct vad_filter *f = static_cast<struct vad_filter *>(data);
+    uint64_t start = os_gettime_ns();
+
+    vad_filter_detect(f, audio);
+
+    // 开始说话：先启用降噪，门增益再从底部渐升
+    if (f->voiced && !f->suppressorOn)
+        vad_filter_set_suppressor_state(f, true);
+
+    float target = f->voiced ? 1.0f : f->floorGain;
+    if (f->gain != target || target != 1.0f) {
+        for (uint32_t i = 0; i < audio->frames; i++) {
+            if (f->gain < target)
+                f->gain = fminf(target, f->gain + f->attackStep);
+            else if (f->gain > target)
+                f->gain = fmaxf(target, f->gain - f->releaseStep);
+
+            for (size_t c = 0; c < f->channels; c++) {
+                float *s = reinterpret_cast<float *>(audio->data[c]);
+                if (s)
+                    s[i] *= f->gain;
+            }
+        }
+    }
+
+    // 说话结束：门增益已经降到底才关闭降噪，切换点的信号已被压低
+    if (!f->voiced && f->suppressorOn && f->gain <= f->floorGain)
+        vad_filter_set_suppressor_state(f, false);
+
+    f->blocks++;
+    if (f->suppressorOn)
+        f->voicedBlocks++;
+    f->processNs += os_gettime_ns() - start;
+    return audio;
+}
+
+static void vad_filter_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_double(settings, "threshold_db", 9.0);
+    obs_data_set_default_int(settings, "hangover_ms", 300);
+    obs_data_set_default_double(settings, "gate_floor_db", -30.0);
+    obs_data_set_default_int(settings, "attack_ms", 5);
+    obs_data_set_default_int(settings, "release_ms", 150);
+}
+
+static obs_properties_t *vad_filter_properties(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+
+    obs_properties_t *props = obs_properties_create();
+    obs_properties_add_float_slider(props, "threshold_db",
+                                    "Threshold above noise floor (dB)",
+                                    3.0, 30.0, 0.5);
+    obs_properties_add_int(props, "hangover_ms", "Hangover (ms)", 50, 2000, 10);
+    obs_properties_add_float_slider(props, "gate_floor_db", "Gate floor (dB)",
+                                    -60.0, 0.0, 1.0);
+    obs_properties_add_int(props, "attack_ms", "Attack (ms)", 1, 100, 1);
+    obs_properties_add_int(props, "release_ms", "Release (ms)", 10, 1000, 10);
+    return props;
+}
+
+void SetVADSuppressor(obs_source_t *vadFilter, obs_source_t *suppressor)
+{
+    if (!vadFilter)
+        return;
+
+    calldata_t cd = {0};
+    calldata_set_ptr(&cd, "filter", suppressor);
+    proc_handler_call(obs_source_get_proc_handler(vadFilter),
+                      "set_suppressor", &cd);
+    calldata_free(&cd);
+}
+
+bool GetVADFilterStats(obs_source_t *vadFilter, VADFilterStats &stats)
+{
+    if (!vadFilter)
+        return false;
+
+    calldata_t cd = {0};
+    bool ok = proc_handler_call(obs_source_get_proc_handler(vadFilter),
+                                "get_stats", &cd);
+    if (ok) {
+        stats.blocks       = (uint64_t)calldata_int(&cd, "blocks");
+        stats.voicedBlocks = (uint64_t)calldata_int(&cd, "voiced_blocks");
+        stats.processNs    = (uint64_t)calldata_int(&cd, "process_ns");
+    }
+    calldata_free(&cd);
+    return ok;
+}
+
+/* ------------------------------------------------------------------------- */
+/* 基准测试 */
+
+// 基准测试用的音频源，数据由调用线程直接 obs_source_output_audio
+static const char *bench_source_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return "QtOBS VAD Benchmark Source";
+}
+
+static void *bench_source_create(obs_data_t *settings, obs_source_t *source)
+{
+    UNUSED_PARAMETER(settings);
+    return source;
+}
+
+static void bench_source_destroy(void *data)
+{
+    UNUSED_PARAMETER(data);
+}
+
+static inline float NextNoise(uint32_t &seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (float)((int32_t)seed) / 2147483648.0f;
+}
+
+// 底噪：白噪声 -55 dBFS + 50Hz 交流声 -60 dBFS
+static void GenerateSilence(std::vector<float> &buf, uint32_t sampleRate)
+{
+    uint32_t seed = 1;
+    float noise = (float)pow(10.0, -55.0 / 20.0);
+    float hum   = (float)pow(10.0, -60.0 / 20.0);
+    for (size_t i = 0; i < buf.size(); i++) {
+        double t = (double)i / sampleRate;
+        buf[i] = NextNoise(seed) * noise +
+                 hum * (float)sin(2.0 * VAD_PI * 50.0 * t);
+    }
+}
+
+// 语音：底噪上叠加 2 秒说话 / 1 秒停顿，说话时为 4Hz 音节包络的谐波信号
+static void GenerateSpeech(std::vector<float> &buf, uint32_t sampleRate)
+{
+    GenerateSilence(buf, sampleRate);
+
+    double phase = 0.0;
+    for (size_t i = 0; i < buf.size(); i++) {
+        double t = (double)i / sampleRate;
+        double cycle = fmod(t, 3.0);
+        if (cycle >= 2.0)
+            continue;
+
+        double f0 = 140.0 + 30.0 * sin(2.0 * VAD_PI * 0.5 * t);
+        phase += 2.0 * VAD_PI * f0 / sampleRate;
+
+        double voice = 0.0;
+        for (int k = 1; k <= 10; k++)
+            voice += sin(phase * k) / k;
+
+        double envelope = 0.5 - 0.5 * cos(2.0 * VAD_PI * 4.0 * cycle);
+        buf[i] += (float)(0.08 * envelope * voice);
+    }
+}
+
+static bool RunBenchmarkPass(const std::vector<float> &signal, bool vad,
+                             int seconds, double &cpuMsPerMinute,
+                             double &activeRatio)
+{
+    const struct audio_output_info *aoi = audio_output_get_info(obs_get_audio());
+    uint32_t sampleRate = aoi->samples_per_sec;
+    uint32_t blockFrames = sampleRate / 100;    // 10ms，与 WASAPI 采集的块大小相近
+
+    obs_source_t *source = obs_source_create_private(VAD_BENCH_SOURCE_ID,
+                                                     "qtobs-vad-bench", nullptr);
+    obs_source_t *suppressor = obs_source_create_private(
+            "noise_suppress_filter", "qtobs-vad-bench-suppress", nullptr);
+    obs_source_t *vadFilter = vad ? obs_source_create_private(
+            VAD_NOISE_SUPPRESS_FILTER_ID, "qtobs-vad-bench-vad", nullptr)
+                                  : nullptr;
+
+    bool ok = source && suppressor && (!vad || vadFilter);
+    if (ok) {
+        // 先添加的滤镜先处理，VAD 必须在降噪之前
+        if (vadFilter)
+            obs_source_filter_add(source, vadFilter);
+        obs_source_filter_add(source, suppressor);
+        SetVADSuppressor(vadFilter, suppressor);
+
+        struct obs_source_audio audio = {};
+        audio.speakers        = aoi->speakers;
+        audio.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+        audio.samples_per_sec = sampleRate;
+        audio.frames          = blockFrames;
+
+        uint64_t totalFrames = (uint64_t)seconds * sampleRate;
+        uint64_t ts = os_gettime_ns();
+        size_t pos = 0;
+
+        uint64_t cpuStart = 0, cpuEnd = 0;
+        GetCurrentThreadCpuNs(cpuStart);
+        for (uint64_t done = 0; done < totalFrames; done += blockFrames) {
+            if (pos + blockFrames > signal.size())
+                pos = 0;
+            // process_audio 会把数据拷贝到源内部缓冲，各声道可共用同一份输入
+            for (size_t c = 0; c < get_audio_channels(aoi->speakers); c++)
+                audio.data[c] = reinterpret_cast<const uint8_t *>(&signal[pos]);
+            audio.timestamp = ts;
+
+            obs_source_output_audio(source, &audio);
+
+            pos += blockFrames;
+            ts  += (uint64_t)blockFrames * 1000000000ULL / sampleRate;
+        }
+        GetCurrentThreadCpuNs(cpuEnd);
+
+        cpuMsPerMinute = (double)(cpuEnd - cpuStart) / 1000000.0 * 60.0 /
+                         (double)seconds;
+
+        VADFilterStats stats = {};
+        if (vadFilter && GetVADFilterStats(vadFilter, stats) && stats.blocks)
+            activeRatio = (double)stats.voicedBlocks / (double)stats.blocks;
+        else
+            activeRatio = 1.0;
+
+        if (vadFilter)
+            obs_source_filter_remove(source, vadFilter);
+        obs_source_filter_remove(source, suppressor);
+    }
+
+    obs_source_release(vadFilter);
+    obs_source_release(suppressor);
+    obs_source_release(source);
+    return ok;
+}
+
+bool BenchmarkNoiseSuppression(int seconds, NoiseSuppressionBenchmark &result)
+{
+    if (!obs_get_audio() || seconds <= 0)
+        return false;
+
+    RegisterVADNoiseSuppressFilter();
+
+    uint32_t sampleRate = audio_output_get_sample_rate(obs_get_audio());
+    std::vector<float> silence((size_t)sampleRate * BENCH_SIGNAL_SECONDS);
+    std::vector<float> speech((size_t)sampleRate * BENCH_SIGNAL_SECONDS);
+    GenerateSilence(silence, sampleRate);
+    GenerateSpeech(speech, sampleRate);
+
+    double active = 0.0;
+    bool ok = RunBenchmarkPass(silence, false, seconds, result.alwaysSilenceMs,
+                               active) &&
+              RunBenchmarkPass(speech, false, seconds, result.alwaysSpeechMs,
+                               active) &&
+              RunBenchmarkPass(silence, true, seconds, result.vadSilenceMs,
+                               result.vadSilenceActive) &&
+              RunBenchmarkPass(speech, true, seconds, result.vadSpeechMs,
+                               result.vadSpeechActive);
+    if (!ok)
+        blog(LOG_WARNING, "noise suppression benchmark failed, "
+                          "is obs-filters loaded?");
+    return ok;
+}
+
+void RegisterVADNoiseSuppressFilter()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+
+    struct obs_source_info info = {};
+    info.id             = VAD_NOISE_SUPPRESS_FILTER_ID;
+    info.type           = OBS_SOURCE_TYPE_FILTER;
+    info.output_flags   = OBS_SOURCE_AUDIO;
+    info.get_name       = vad_filter_getname;
+    info.create         = vad_filter_create;
+    info.destroy        = vad_filter_destroy;
+    info.update         = vad_filter_update;
+    info.filter_audio   = vad_filter_audio;
+    info.get_defaults   = vad_filter_defaults;
+    info.get_properties = vad_filter_properties;
+    obs_register_source(&info);
+
+    struct obs_source_info bench = {};
+    bench.id           = VAD_BENCH_SOURCE_ID;
+    bench.type         = OBS_SOURCE_TYPE_INPUT;
+    bench.output_flags = OBS_SOURCE_AUDIO | OBS_SOURCE_CAP_DISABLED;
+    bench.get_name     = bench_source_getname;
+    bench.create       = bench_source_create;
+    bench.destroy      = bench_source_destroy;
+    obs_register_source(&bench);
+
+    registered = true;
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+
+#include <stdint.h>
+
+/**
+ * 语音检测门控的降噪：本滤镜放在 noise_suppress_filter 之前，
+ * 先用能量 + 过零率做语音检测（VAD），只在有人说话时启用降噪滤镜，
+ * 其余时间关闭降噪滤镜，改用轻量的噪声门压低底噪。
+ *
+ * 降噪滤镜只在门增益已经降到底（信号已被压低）时关闭，说话开始时先启用降噪再提升增益，
+ * 切换点不会出现可听的跳变。
+ */
+#define VAD_NOISE_SUPPRESS_FILTER_ID "qtobs_vad_noise_suppress"
+
+void RegisterVADNoiseSuppressFilter();
+
+// 指定由本滤镜控制的降噪滤镜（同一个音频源上的 noise_suppress_filter）
+void SetVADSuppressor(obs_source_t *vadFilter, obs_source_t *suppressor);
+
+struct VADFilterStats
+{
+    uint64_t blocks;         // 处理的音频块数
+    uint64_t voicedBlocks;   // 降噪滤镜启用期间的块数
+    uint64_t processNs;      // 本滤镜自身的处理耗时
+};
+
+bool GetVADFilterStats(obs_source_t *vadFilter, VADFilterStats &stats);
+
+/**
+ * 音频线程 CPU 基准：分别用合成的静音（底噪）和语音信号，
+ * 比较“始终降噪”和“VAD 门控降噪”处理每分钟音频的 CPU 时间。
+ *
+ * 滤镜在音频源的输出线程中执行（obs_source_output_audio），
+ * 这里直接在调用线程中以最快速度送入数据，用线程 CPU 时间计量。
+ */
+struct NoiseSuppressionBenchmark
+{
+    double alwaysSilenceMs;   // 每分钟音频的 CPU 毫秒数
+    double alwaysSpeechMs;
+    double vadSilenceMs;
+    double vadSpeechMs;
+    double vadSilenceActive;  // 降噪滤镜启用的时间比例
+    double vadSpeechActive;
+
+    NoiseSuppressionBenchmark() : alwaysSilenceMs(0.0), alwaysSpeechMs(0.0),
+        vadSilenceMs(0.0), vadSpeechMs(0.0), vadSilenceActive(0.0),
+        vadSpeechActive(0.0) {}
+};
+
+bool BenchmarkNoiseSuppression(int seconds, NoiseSuppressionBenchmark &result);
@@ -0,0 +1,378 @@
+﻿#include "obs-video-quality.h"
+
+// obs headers
+#include <media-io/video-io.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#define TEXT_CELL_WIDTH   8
+#define TEXT_CELL_HEIGHT  16
+#define TEXT_SCROLL_SPEED 2   // 每帧滚动的像素
+
+#define SSIM_WINDOW       8
+#define SSIM_STEP         4
+#define VIF_SCALES        4
+#define VIF_SIGMA_NSQ     2.0   // 视觉噪声方差，与参考实现一致
+
+static inline uint32_t Hash(uint32_t x, uint32_t y)
+{
+    uint32_t h = x * 374761393u + y * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+void RenderSyntheticLuma(uint8_t *dst, int linesize, int width, int height,
+                         uint32_t index)
+{
+    // 移动的色块，模拟窗口拖动/视频区域
+    int boxSize = height / 4;
+    int boxX = (int)((index * 7) % (uint32_t)(width - boxSize));
+    int boxY = height / 2;
+
+    for (int y = 0; y < height; y++) {
+        uint8_t *line = dst + y * linesize;
+        uint32_t row = (uint32_t)y + index * TEXT_SCROLL_SPEED;
+        uint32_t cellY = row / TEXT_CELL_HEIGHT;
+        uint32_t inY = row % TEXT_CELL_HEIGHT;
+
+        for (int x = 0; x < width; x++) {
+            uint32_t cellX = (uint32_t)x / TEXT_CELL_WIDTH;
+            uint32_t inX = (uint32_t)x % TEXT_CELL_WIDTH;
+            uint32_t glyph = Hash(cellX, cellY);
+
+            // 约 70% 的格子有“字符”，每个字符是 6x12 区域内的笔画位图
+            uint8_t value = 235;
+            if ((glyph & 0xff) < 180 && inX < 6 && inY >= 2 && inY < 14) {
+                uint32_t bit = (inY - 2) * 6 + inX;
+                if ((Hash(glyph, bit) & 3) == 0)
+                    value = 16;
+            }
+
+            if (x >= boxX && x < boxX + boxSize && y >= boxY &&
+                    y < boxY + boxSize)
+                value = (uint8_t)(64 + ((x - boxX + y) & 63));
+
+            line[x] = value;
+        }
+    }
+}
+
+void FillSyntheticFrame(struct video_frame *frame, int width, int height,
+                        uint32_t index)
+{
+    RenderSyntheticLuma(frame->data[0], (int)frame->linesize[0], width,
+                        height, index);
+
+    for (int plane = 1; plane < 3; plane++) {
+        for (int y = 0; y < height / 2; y++)
+            memset(frame->data[plane] + y * frame->linesize[plane], 128,
+                   width / 2);
+    }
+}
+
+int DecodeH264Packets(const uint8_t *header, size_t headerSize,
+                      const std::vector<std::vector<uint8_t>> &packets,
+                      const DecodedFrameCallback &callback)
+{
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!codec)
+        return -1;
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx)
+        return -1;
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+        avcodec_free_context(&ctx);
+        return -1;
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    std::vector<uint8_t> first;
+    int decoded = 0;
+
+    auto receive = [&] () {
+        while (avcodec_receive_frame(ctx, frame) == 0) {
+            callback(decoded++, frame->data[0], frame->linesize[0],
+                     frame->width, frame->height);
+            av_frame_unref(frame);
+        }
+    };
+
+    for (size_t i = 0; i < packets.size(); i++) {
+        const std::vector<uint8_t> *data = &packets[i];
+
+        // 编码器的 SPS/PPS 放在 extra data 里，拼到第一个包前面
+        if (i == 0 && header && headerSize) {
+            first.assign(header, header + headerSize);
+            first.insert(first.end(), data->begin(), data->end());
+            data = &first;
+        }
+
+        pkt->data = const_cast<uint8_t *>(data->data());
+        pkt->size = (int)data->size();
+        if (avcodec_send_packet(ctx, pkt) < 0)
+            continue;
+        receive();
+    }
+
+    avcodec_send_packet(ctx, nullptr);
+    receive();
+
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&ctx);
+    return decoded;
+}
+
+double LumaMse(const uint8_t *a, int linesizeA, const uint8_t *b,
+               int linesizeB, int width, int height)
+{
+    uint64_t sum = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t *la = a + y * linesizeA;
+        const uint8_t *lb = b + y * linesizeB;
+        for (int x = 0; x < width; x++) {
+            int d = (int)la[x] - (int)lb[x];
+            sum += (uint64_t)(d * d);
+        }
+    }
+    return (double)sum / ((double)width * height);
+}
+
+double MseToPsnr(double mse)
+{
+    if (mse <= 0.0)
+        return 100.0;
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+static double SsimWindow(const uint8_t *ref, int linesizeRef,
+                         const uint8_t *dist, int linesizeDist)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    const double n  = SSIM_WINDOW * SSIM_WINDOW;
+
+    uint32_t sa = 0, sb = 0;
+    uint64_t saa = 0, sbb = 0, sab = 0;
+    for (int j = 0; j < SSIM_WINDOW; j++) {
+        const uint8_t *la = ref + j * linesizeRef;
+        const uint8_t *lb = dist + j * linesizeDist;
+        for (int i = 0; i < SSIM_WINDOW; i++) {
+            uint32_t a = la[i], b = lb[i];
+            sa  += a;
+            sb  += b;
+            saa += a * a;
+            sbb += b * b;
+            sab += a * b;
+        }
+    }
+
+    double ma  = sa / n;
+    double mb  = sb / n;
+    double va  = saa / n - ma * ma;
+    double vb  = sbb / n - mb * mb;
+    double cov = sab / n - ma * mb;
+    return ((2 * ma * mb + c1) * (2 * cov + c2)) /
+           ((ma * ma + mb * mb + c1) * (va + vb + c2));
+}
+
+double LumaSsim(const uint8_t *ref, int linesizeRef, const uint8_t *dist,
+                int linesizeDist, int width, int height)
+{
+    double sum = 0.0;
+    int windows = 0;
+    for (int y = 0; y + SSIM_WINDOW <= height; y += SSIM_STEP) {
+        for (int x = 0; x + SSIM_WINDOW <= width; x += SSIM_STEP) {
+            sum += SsimWindow(ref + y * linesizeRef + x, linesizeRef,
+                              dist + y * linesizeDist + x, linesizeDist);
+            windows++;
+        }
+    }
+    return windows ? sum / windows : 1.0;
+}
+
+double LumaSsimMasked(const uint8_t *ref, int linesizeRef,
+                      const uint8_t *dist, int linesizeDist, int width,
+                      int height, const uint8_t *mask, int maskCols,
+                      int maskRows, int blockSize, int *windowsOut)
+{
+    double sum = 0.0;
+    int windows = 0;
+    for (int y = 0; y + SSIM_WINDOW <= height; y += SSIM_STEP) {
+        int row = (y + SSIM_WINDOW / 2) / blockSize;
+        if (row >= maskRows)
+            break;
+        for (int x = 0; x + SSIM_WINDOW <= width; x += SSIM_STEP) {
+            int col = (x + SSIM_WINDOW / 2) / blockSize;
+            if (col >= maskCols || !mask[row * maskCols + col])
+                continue;
+            sum += SsimWindow(ref + y * linesizeRef + x, linesizeRef,
+                              dist + y * linesizeDist + x, linesizeDist);
+            windows++;
+        }
+    }
+    if (windowsOut)
+        *windowsOut = windows;
+    return windows ? sum / windows : 1.0;
+}
+
+struct VifPlane
+{
+    std::vector<float> data;
+    int                width;
+    int                height;
+};
+
+// 可分离高斯滤波（valid 模式，输出比输入小 taps - 1）
+static void GaussianFilter(const VifPlane &src, const std::vector<float> &kernel,
+                           VifPlane &dst)
+{
+    int taps = (int)kernel.size();
+    int w = src.width - taps + 1;
+    int h = src.height - taps + 1;
+    if (w <= 0 || h <= 0) {
+        dst.width = dst.height = 0;
+        dst.data.clear();
+        return;
+    }
+
+    std::vector<float> tmp((size_t)w * src.height);
+    for (int y = 0; y < src.height; y++) {
+        const float *in = &src.data[(size_t)y * src.width];
+        float *out = &tmp[(size_t)y * w];
+        for (int x = 0; x < w; x++) {
+            float v = 0.0f;
+            for (int k = 0; k < taps; k++)
+                v += in[x + k] * kernel[k];
+            out[x] = v;
+        }
+    }
+
+    dst.width  = w;
+    dst.height = h;
+    dst.data.assign((size_t)w * h, 0.0f);
+    for (int y = 0; y < h; y++) {
+        float *out = &dst.data[(size_t)y * w];
+        for (int k = 0; k < taps; k++) {
+            const float *in = &tmp[(size_t)(y + k) * w];
+            float weight = kernel[k];
+            for (int x = 0; x < w; x++)
+                out[x] += in[x] * weight;
+        }
+    }
+}
+
+static void Multiply(const VifPlane &a, const VifPlane &b, VifPlane &dst)
+{
+    dst.width  = a.width;
+    dst.height = a.height;
+    dst.data.resize(a.data.size());
+    for (size_t i = 0; i < a.data.size(); i++)
+        dst.data[i] = a.data[i] * b.data[i];
+}
+
+static void Downsample(const VifPlane &src, VifPlane &dst)
+{
+    dst.width  = src.width / 2;
+    dst.height = src.height / 2;
+    dst.data.resize((size_t)dst.width * dst.height);
+    for (int y = 0; y < dst.height; y++)
+        for (int x = 0; x < dst.width; x++)
+            dst.data[(size_t)y * dst.width + x] =
+                src.data[(size_t)(y * 2) * src.width + x * 2];
+}
+
+static std::vector<float> GaussianKernel(int taps)
+{
+    std::vector<float> kernel((size_t)taps);
+    double sigma = taps / 5.0;
+    double sum = 0.0;
+    for (int i = 0; i < taps; i++) {
+        double d = i - (taps - 1) / 2.0;
+        kernel[i] = (float)exp(-d * d / (2.0 * sigma * sigma));
+        sum += kernel[i];
+    }
+    for (float &k : kernel)
+        k = (float)(k / sum);
+    return kernel;
+}
+
+double LumaVifp(const uint8_t *ref, int linesizeRef, const uint8_t *dist,
+                int linesizeDist, int width, int height)
+{
+    VifPlane a, b;
+    a.width = b.width = width;
+    a.height = b.height = height;
+    a.data.resize((size_t)width * height);
+    b.data.resize((size_t)width * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            a.data[(size_t)y * width + x] = ref[y * linesizeRef + x];
+            b.data[(size_t)y * width + x] = dist[y * linesizeDist + x];
+        }
+    }
+
+    double num = 0.0, den = 0.0;
+    VifPlane mu1, mu2, aa, bb, ab, s11, s22, s12, tmp;
+    for (int scale = 0; scale < VIF_SCALES; scale++) {
+        // 窗口从 17 依次减半到 3，sigma = N / 5
+        std::vector<float> kernel =
+                GaussianKernel((1 << (VIF_SCALES - scale)) + 1);
+
+        if (scale > 0) {
+            GaussianFilter(a, kernel, tmp);
+            Downsample(tmp, a);
+            GaussianFilter(b, kernel, tmp);
+            Downsample(tmp, b);
+        }
+
+        GaussianFilter(a, kernel, mu1);
+        GaussianFilter(b, kernel, mu2);
+        if (!mu1.width || !mu1.height)
+            break;
+
+        Multiply(a, a, aa);
+        Multiply(b, b, bb);
+        Multiply(a, b, ab);
+        GaussianFilter(aa, kernel, s11);
+        GaussianFilter(bb, kernel, s22);
+        GaussianFilter(ab, kernel, s12);
+
+        for (size_t i = 0; i < mu1.data.size(); i++) {
+            double m1 = mu1.data[i], m2 = mu2.data[i];
+            double sigma1 = std::max(s11.data[i] - m1 * m1, 0.0);
+            double sigma2 = std::max(s22.data[i] - m2 * m2, 0.0);
+            double sigma12 = s12.data[i] - m1 * m2;
+
+            double g = sigma12 / (sigma1 + 1e-10);
+            double sv = sigma2 - g * sigma12;
+            if (sigma1 < 1e-10) {
+                g = 0.0;
+                sv = sigma2;
+                sigma1 = 0.0;
+            }
+            if (sigma2 < 1e-10) {
+                g = 0.0;
+                sv = 0.0;
+            }
+            if (g < 0.0) {
+                sv = sigma2;
+                g = 0.0;
+            }
+            sv = std::max(sv, 1e-10);
+
+            num += log10(1.0 + g * g * sigma1 / (sv + VIF_SIGMA_NSQ));
+            den += log10(1.0 + sigma1 / VIF_SIGMA_NSQ);
+        }
+    }
+    return den > 0.0 ? num / den : 1.0;
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+struct video_frame;
+
+/**
+ * 画质评估工具：合成测试画面、解码 h264 数据包、计算 Y 平面误差。
+ * 只比较亮度平面，屏幕内容（文字）的可读性主要由亮度决定。
+ */
+
+// 生成确定性的屏幕内容画面（滚动的“文字”块 + 移动的色块），同一 index 结果相同
+void RenderSyntheticLuma(uint8_t *dst, int linesize, int width, int height,
+                         uint32_t index);
+void FillSyntheticFrame(struct video_frame *frame, int width, int height,
+                        uint32_t index);
+
+typedef std::function<void(int index, const uint8_t *luma, int linesize,
+                           int width, int height)> DecodedFrameCallback;
+
+/**
+ * 用 libavcodec 解码 Annex B 格式的 h264 数据包（header 为编码器 extra data），
+ * 按显示顺序回调每一帧，返回解码出的帧数，失败返回 -1
+ */
+int DecodeH264Packets(const uint8_t *header, size_t headerSize,
+                      const std::vector<std::vector<uint8_t>> &packets,
+                      const DecodedFrameCallback &callback);
+
+double LumaMse(const uint8_t *a, int linesizeA, const uint8_t *b,
+               int linesizeB, int width, int height);
+double MseToPsnr(double mse);
+
+// 8x8 窗口、步长 4 的 SSIM 均值，1 为完全相同
+double LumaSsim(const uint8_t *ref, int linesizeRef, const uint8_t *dist,
+                int linesizeDist, int width, int height);
+
+/**
+ * 只统计中心落在 mask 非零块中的窗口（mask 为 maskCols x maskRows 个
+ * blockSize 大小的块，按行排列），用于单独评估文字等区域的画质。
+ * windows 返回参与统计的窗口数，为 0 时结果为 1
+ */
+double LumaSsimMasked(const uint8_t *ref, int linesizeRef,
+                      const uint8_t *dist, int linesizeDist, int width,
+                      int height, const uint8_t *mask, int maskCols,
+                      int maskRows, int blockSize, int *windows = nullptr);
+
+/**
+ * 像素域视觉信息保真度（VIFp，4 个尺度），VMAF 融合的基础特征之一，
+ * 对模糊和振铃比 PSNR 敏感。1 为无损，可能略大于 1（对比度增强）。
+ * 计算量约为 SSIM 的 10 倍，大分辨率时建议抽帧计算。
+ */
+double LumaVifp(const uint8_t *ref, int linesizeRef, const uint8_t *dist,
+                int linesizeDist, int width, int height);
@@ -0,0 +1,300 @@
+﻿#include "obs-window-resolver.h"
+
+// obs headers
+#include <obs.h>
+#include <util/platform.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <ctype.h>
+
+static std::string ToLower(const std::string &str)
+{
+    std::string result = str;
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [] (unsigned char c) { return (char)tolower(c); });
+    return result;
+}
+
+// 与 win-capture window-helpers.c 中的 encode_dstr 一致
+static std::string EncodePart(const std::string &str)
+{
+    std::string result;
+    for (char c : str) {
+        if (c == '#')
+            result += "#22";
+        else if (c == ':')
+            result += "#3A";
+        else
+            result += c;
+    }
+    return result;
+}
+
+#if defined(_WIN32)
+
+static WindowResolver::WindowEventCallback eventCallback;
+
+static std::string WideToUTF8(const wchar_t *str)
+{
+    std::string result;
+    char *utf8 = nullptr;
+    if (str && os_wcs_to_utf8_ptr(str, 0, &utf8))
+        result = utf8;
+    bfree(utf8);
+    return result;
+}
+
+static std::string GetProcessExe(DWORD pid)
+{
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!process)
+        return std::string();
+
+    wchar_t path[MAX_PATH];
+    DWORD size = MAX_PATH;
+    std::string exe;
+    if (QueryFullProcessImageNameW(process, 0, path, &size)) {
+        const wchar_t *slash = wcsrchr(path, L'\\');
+        exe = WideToUTF8(slash ? slash + 1 : path);
+    }
+    CloseHandle(process);
+    return exe;
+}
+
+// 与 window_capture 的窗口列表保持一致：可见、非子窗口、非工具窗口、有客户区
+static bool IsCapturableWindow(HWND hwnd)
+{
+    if (!IsWindowVisible(hwnd))
+        return false;
+
+    LONG style = GetWindowLongW(hwnd, GWL_STYLE);
+    LONG exStyle = GetWindowLongW(hwnd, GWL_EXSTYLE);
+    if ((style & WS_CHILD) || (exStyle & WS_EX_TOOLWINDOW))
+        return false;
+
+    RECT rect;
+    GetClientRect(hwnd, &rect);
+    return rect.right > 0 && rect.bottom > 0;
+}
+
+struct EnumContext
+{
+    std::vector<WindowInfo>    *windows;
+    std::map<DWORD, std::string> exeCache;   // 同一进程只查询一次
+};
+
+static BOOL CALLBACK EnumWindowProc(HWND hwnd, LPARAM param)
+{
+    EnumContext *ctx = reinterpret_cast<EnumContext *>(param);
+    if (!IsCapturableWindow(hwnd))
+        return TRUE;
+
+    WindowInfo window;
+    window.handle = (uint64_t)(uintptr_t)hwnd;
+
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    window.pid = pid;
+
+    auto it = ctx->exeCache.find(pid);
+    if (it == ctx->exeCache.end())
+        it = ctx->exeCache.insert(std::make_pair(pid, GetProcessExe(pid))).first;
+    window.exe = it->second;
+
+    wchar_t buf[512];
+    if (GetClassNameW(hwnd, buf, 512))
+        window.className = WideToUTF8(buf);
+    if (GetWindowTextW(hwnd, buf, 512))
+        window.title = WideToUTF8(buf);
+
+    ctx->windows->push_back(window);
+    return TRUE;
+}
+
+static void CALLBACK WindowEventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                                     LONG idObject, LONG idChild, DWORD thread,
+                                     DWORD time)
+{
+    UNUSED_PARAMETER(hook);
+    UNUSED_PARAMETER(thread);
+    UNUSED_PARAMETER(time);
+
+    if (event != EVENT_OBJECT_CREATE && event != EVENT_OBJECT_DESTROY &&
+            event != EVENT_OBJECT_NAMECHANGE)
+        return;
+    if (!hwnd || idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+        return;
+    if (eventCallback)
+        eventCallback();
+}
+
+#endif
+
+WindowResolver::WindowResolver()
+{
+    eventHooks[0] = eventHooks[1] = nullptr;
+}
+
+WindowResolver::~WindowResolver()
+{
+    stopEvents();
+}
+
+void WindowResolver::add(const WindowInfo &window)
+{
+    size_t idx = windows.size();
+    windows.push_back(window);
+    byPid.insert(std::make_pair(window.pid, idx));
+    byExe.insert(std::make_pair(ToLower(window.exe), idx));
+    byClass.insert(std::make_pair(window.className, idx));
+}
+
+uint64_t WindowResolver::refresh()
+{
+    uint64_t start = os_gettime_ns();
+
+    std::vector<WindowInfo> found;
+#if defined(_WIN32)
+    EnumContext ctx;
+    ctx.windows = &found;
+    EnumWindows(EnumWindowProc, reinterpret_cast<LPARAM>(&ctx));
+#endif
+
+    windows.clear();
+    byPid.clear();
+    byExe.clear();
+    byClass.clear();
+    windows.reserve(found.size());
+    for (const WindowInfo &window : found)
+        add(window);
+
+    return (os_gettime_ns() - start) / 1000;
+}
+
+bool WindowResolver::matchPattern(const std::string &text,
+                                  const std::string &pattern)
+{
+    // 迭代式通配符匹配，* 匹配任意串，? 匹配单个字节
+    size_t t = 0, p = 0, star = std::string::npos, mark = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            t++;
+            p++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = t;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
+
+bool WindowResolver::matches(const WindowInfo &window,
+                             const WindowQuery &query) const
+{
+    if (query.pid && window.pid != query.pid)
+        return false;
+    if (!query.exe.empty() && ToLower(window.exe) != ToLower(query.exe))
+        return false;
+    if (!query.className.empty() && window.className != query.className)
+        return false;
+    if (!query.titlePattern.empty() &&
+            !matchPattern(window.title, query.titlePattern))
+        return false;
+    return true;
+}
+
+bool WindowResolver::resolve(const WindowQuery &query, WindowInfo &window,
+                             uint64_t preferred) const
+{
+    if (query.empty())
+        return false;
+
+    // 用最有区分度的索引缩小候选范围：pid > 类名 > exe
+    std::vector<size_t> candidates;
+    if (query.pid) {
+        auto range = byPid.equal_range(query.pid);
+        for (auto it = range.first; it != range.second; ++it)
+            candidates.push_back(it->second);
+    } else if (!query.className.empty()) {
+        auto range = byClass.equal_range(query.className);
+        for (auto it = range.first; it != range.second; ++it)
+            candidates.push_back(it->second);
+    } else if (!query.exe.empty()) {
+        auto range = byExe.equal_range(ToLower(query.exe));
+        for (auto it = range.first; it != range.second; ++it)
+            candidates.push_back(it->second);
+    } else {
+        for (size_t i = 0; i < windows.size(); i++)
+            candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end());   // 保持 Z 序
+
+    const WindowInfo *first = nullptr;
+    for (size_t idx : candidates) {
+        const WindowInfo &w = windows[idx];
+        if (!matches(w, query))
+            continue;
+        if (preferred && w.handle == preferred) {
+            window = w;
+            return true;
+        }
+        if (!first)
+            first = &w;
+    }
+
+    if (!first)
+        return false;
+    window = *first;
+    return true;
+}
+
+void WindowResolver::startEvents(const WindowEventCallback &callback)
+{
+#if defined(_WIN32)
+    stopEvents();
+    eventCallback = callback;
+    // 两个事件范围分开注册：CREATE..NAMECHANGE 之间还有 SHOW/HIDE/FOCUS/
+    // LOCATIONCHANGE 等，任意进程的鼠标移动、光标闪烁都会触发
+    eventHooks[0] = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_DESTROY,
+                                    nullptr, WindowEventProc, 0, 0,
+                                    WINEVENT_OUTOFCONTEXT);
+    eventHooks[1] = SetWinEventHook(EVENT_OBJECT_NAMECHANGE,
+                                    EVENT_OBJECT_NAMECHANGE,
+                                    nullptr, WindowEventProc, 0, 0,
+                                    WINEVENT_OUTOFCONTEXT);
+    if (!eventHooks[0] || !eventHooks[1])
+        blog(LOG_WARNING, "window resolver: SetWinEventHook failed, "
+                          "fall back to polling");
+#else
+    UNUSED_PARAMETER(callback);
+#endif
+}
+
+void WindowResolver::stopEvents()
+{
+#if defined(_WIN32)
+    for (void *&hook : eventHooks) {
+        if (hook)
+            UnhookWinEvent(static_cast<HWINEVENTHOOK>(hook));
+        hook = nullptr;
+    }
+    eventCallback = nullptr;
+#endif
+}
+
+std::string WindowResolver::captureSetting(const WindowInfo &window)
+{
+    return EncodePart(window.title) + ":" + EncodePart(window.className) +
+           ":" + EncodePart(window.exe);
+}
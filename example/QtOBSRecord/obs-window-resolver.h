@@ -0,0 +1,87 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * 窗口解析：枚举顶层窗口，按进程 ID、可执行文件名、窗口类名建立索引，
+ * 再用标题模式过滤，找到要捕获的窗口。
+ *
+ * window_capture 源只保存 "标题:类名:exe" 字符串，窗口重建或改标题后可能匹配不到而黑屏，
+ * 由 QtOBSContext 定时（以及收到窗口事件时）重新解析并更新源的设置，参见 checkCaptureWindow。
+ */
+struct WindowInfo
+{
+    uint64_t    handle;      // HWND
+    uint32_t    pid;
+    std::string exe;         // 文件名，如 QtOBSRecord.exe
+    std::string className;
+    std::string title;
+
+    WindowInfo() : handle(0), pid(0) {}
+};
+
+// 各条件为空（pid 为 0）时不限制，标题支持 * 和 ? 通配符
+struct WindowQuery
+{
+    uint32_t    pid;
+    std::string exe;
+    std::string className;
+    std::string titlePattern;
+
+    WindowQuery() : pid(0) {}
+    bool empty() const
+    {
+        return !pid && exe.empty() && className.empty() && titlePattern.empty();
+    }
+};
+
+class WindowResolver
+{
+public:
+    typedef std::function<void()> WindowEventCallback;
+
+    WindowResolver();
+    ~WindowResolver();
+
+    // 重新枚举窗口并重建索引，返回耗时（微秒）
+    uint64_t refresh();
+
+    // 在当前索引中查找，preferred 仍然匹配时优先返回它（避免在多个匹配窗口间跳动）
+    bool resolve(const WindowQuery &query, WindowInfo &window,
+                 uint64_t preferred = 0) const;
+
+    size_t count() const { return windows.size(); }
+
+    /**
+     * 监听窗口创建/销毁/改标题事件（Windows 下为 SetWinEventHook，
+     * 回调在调用线程的消息循环中执行），回调只应做标记
+     */
+    void startEvents(const WindowEventCallback &callback);
+    void stopEvents();
+
+    // window_capture 源的 "window" 设置："标题:类名:exe"，各部分的 '#' 和 ':' 需要编码
+    static std::string captureSetting(const WindowInfo &window);
+
+    static bool matchPattern(const std::string &text, const std::string &pattern);
+
+private:
+    void add(const WindowInfo &window);
+    bool matches(const WindowInfo &window, const WindowQuery &query) const;
+
+    std::vector<WindowInfo>               windows;
+    std::multimap<uint32_t, size_t>       byPid;
+    std::multimap<std::string, size_t>    byExe;    // 小写
+    std::multimap<std::string, size_t>    byClass;
+
+    // 创建/销毁、改标题两个事件范围，避免收到 SHOW/FOCUS/LOCATIONCHANGE 等高频事件
+    void *eventHooks[2];
+};
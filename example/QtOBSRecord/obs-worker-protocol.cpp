@@ -0,0 +1,34 @@
+﻿#include "obs-worker-protocol.h"
+
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+#include <QDebug>
+
+void WriteWorkerMessage(QLocalSocket *socket, const QJsonObject &message)
+{
+    if (!socket || socket->state() != QLocalSocket::ConnectedState)
+        return;
+
+    QByteArray line = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    socket->write(line);
+}
+
+void ReadWorkerMessages(QLocalSocket *socket, QList<QJsonObject> &messages)
+{
+    while (socket && socket->canReadLine()) {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+
+        QJsonParseError error;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+        if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+            qWarning() << "invalid worker message:" << error.errorString();
+            continue;
+        }
+        messages.append(doc.object());
+    }
+}
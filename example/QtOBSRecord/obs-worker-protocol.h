@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <QJsonObject>
+#include <QList>
+
+class QLocalSocket;
+
+/**
+ * 录制工作进程与 supervisor 之间的协议：本地 socket（Windows 下为命名管道）上
+ * 每行一个 JSON 对象（QJsonDocument::Compact，以 '\n' 结尾）。
+ *
+ * supervisor -> worker，字段 "cmd"：
+ *     init          { config, title, pid, exe, class, screen: [w, h], region: [x, y, w, h] }
+ *     start_record  { path }
+ *     stop_record   { force }
+ *     crop          { region: [x, y, w, h] }
+ *     scale         { size: [w, h] }
+ *     stats
+ *     quit
+ *
+ * worker -> supervisor，字段 "event"：
+ *     hello          { worker, pid }，连接后的第一条消息
+ *     initialized / record_started / record_stopped，initialized 在视频路径
+ *                    就绪（QtOBSContext::videoReady）时发送
+ *     error          { type, message }，type 为 QtOBSContext::ErrorType
+ *     stats          { frames, lagged, skipped, record_bytes, record_frames,
+ *                      record_dropped, cpu, memory }
+ */
+#define WORKER_CMD_INIT          "init"
+#define WORKER_CMD_START_RECORD  "start_record"
+#define WORKER_CMD_STOP_RECORD   "stop_record"
+#define WORKER_CMD_CROP          "crop"
+#define WORKER_CMD_SCALE         "scale"
+#define WORKER_CMD_STATS         "stats"
+#define WORKER_CMD_QUIT          "quit"
+
+#define WORKER_EVENT_HELLO          "hello"
+#define WORKER_EVENT_INITIALIZED    "initialized"
+#define WORKER_EVENT_RECORD_STARTED "record_started"
+#define WORKER_EVENT_RECORD_STOPPED "record_stopped"
+#define WORKER_EVENT_ERROR          "error"
+#define WORKER_EVENT_STATS          "stats"
+
+// 写入一条消息（不等待发送完成）
+void WriteWorkerMessage(QLocalSocket *socket, const QJsonObject &message);
+
+// 读出 socket 中所有完整的行，不完整的部分留在 socket 缓冲区中
+void ReadWorkerMessages(QLocalSocket *socket, QList<QJsonObject> &messages);
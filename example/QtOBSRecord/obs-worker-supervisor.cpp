@@ -0,0 +1,468 @@
+﻿#include "obs-worker-supervisor.h"
+#include "obs-worker-protocol.h"
+
+// obs headers
+#include <util/base.h>
+#include <util/platform.h>
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QThread>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+
+#include <algorithm>
+
+#define WORKER_STATS_INTERVAL_MS   2000
+#define WORKER_RESTART_MIN_MS      1000
+#define WORKER_RESTART_MAX_MS      30000
+#define WORKER_STABLE_NS           60000000000ULL   // 运行超过 60 秒视为稳定，重置退避
+#define WORKER_QUIT_TIMEOUT_MS     15000
+
+static const char *stateNames[] = {
+    "stopped", "starting", "connected", "ready", "recording"
+};
+
+static QJsonArray RectToJson(const QRect &rect)
+{
+    return QJsonArray { rect.x(), rect.y(), rect.width(), rect.height() };
+}
+
+static QJsonArray SizeToJson(const QSize &size)
+{
+    return QJsonArray { size.width(), size.height() };
+}
+
+WorkerSupervisor::WorkerSupervisor(QObject *parent) : QObject(parent),
+    server(nullptr),
+    statsTimer(nullptr),
+    stopping(false)
+{
+}
+
+WorkerSupervisor::~WorkerSupervisor()
+{
+    stop();
+    qDeleteAll(workers);
+}
+
+bool WorkerSupervisor::loadSessions(const QString &file,
+                                    QList<WorkerSession> &sessions)
+{
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        blog(LOG_ERROR, "open worker sessions '%s' failed",
+             file.toStdString().c_str());
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+    QJsonArray list = doc.object()["workers"].toArray();
+    for (const QJsonValue &value : list) {
+        QJsonObject obj = value.toObject();
+        QJsonArray screen = obj["screen"].toArray();
+        QJsonArray region = obj["region"].toArray();
+
+        WorkerSession session;
+        session.windowTitle = obj["title"].toString();
+        session.pid         = (uint)obj["pid"].toInt();
+        session.exe         = obj["exe"].toString();
+        session.className   = obj["class"].toString();
+        session.outputDir   = obj["output"].toString();
+        session.cpus        = obj["cpus"].toString();
+        if (screen.size() == 2)
+            session.screenSize = QSize(screen[0].toInt(), screen[1].toInt());
+        if (region.size() == 4)
+            session.region = QRect(region[0].toInt(), region[1].toInt(),
+                                   region[2].toInt(), region[3].toInt());
+
+        if (session.windowTitle.isEmpty() || session.screenSize.isEmpty() ||
+                session.region.isEmpty()) {
+            blog(LOG_WARNING, "skip invalid worker session #%d",
+                 sessions.size());
+            continue;
+        }
+        sessions.append(session);
+    }
+    return !sessions.isEmpty();
+}
+
+bool WorkerSupervisor::start(const QString &configPath_,
+                             const QList<WorkerSession> &sessions)
+{
+    if (server || sessions.isEmpty())
+        return false;
+
+    configPath = configPath_;
+    stopping = false;
+
+    // 每个 supervisor 使用独立的 socket 名称，避免与其它实例冲突
+    QString name = QString("qtobs-workers-%1")
+                   .arg(QCoreApplication::applicationPid());
+    server = new QLocalServer(this);
+    QLocalServer::removeServer(name);
+    if (!server->listen(name)) {
+        blog(LOG_ERROR, "worker supervisor listen '%s' failed: %s",
+             name.toStdString().c_str(),
+             server->errorString().toStdString().c_str());
+        delete server;
+        server = nullptr;
+        return false;
+    }
+    connect(server, &QLocalServer::newConnection,
+            this,   &WorkerSupervisor::onNewConnection);
+
+    // 未指定 CPU 的会话平均分配核心
+    int cpuCount = std::max(1, QThread::idealThreadCount());
+    int perWorker = std::max(1, cpuCount / sessions.size());
+
+    for (int i = 0; i < sessions.size(); i++) {
+        Worker *worker = new Worker;
+        worker->index   = i;
+        worker->session = sessions[i];
+        worker->cpus    = sessions[i].cpus;
+        if (worker->cpus.isEmpty()) {
+            int first = (i * perWorker) % cpuCount;
+            int last  = std::min(cpuCount - 1, first + perWorker - 1);
+            worker->cpus = first == last ? QString::number(first) :
+                           QString("%1-%2").arg(first).arg(last);
+        }
+        workers.append(worker);
+        launch(worker);
+    }
+
+    statsTimer = new QTimer(this);
+    connect(statsTimer, &QTimer::timeout, this, &WorkerSupervisor::pollStats);
+    statsTimer->start(WORKER_STATS_INTERVAL_MS);
+
+    blog(LOG_INFO, "worker supervisor started %d workers on '%s'",
+         workers.size(), name.toStdString().c_str());
+    return true;
+}
+
+void WorkerSupervisor::stop()
+{
+    if (!server || stopping)
+        return;
+    stopping = true;
+
+    if (statsTimer)
+        statsTimer->stop();
+
+    // 工作进程收到 quit 后会先正常结束录制
+    for (Worker *worker : workers) {
+        worker->wantRecord = false;
+        QJsonObject cmd;
+        cmd["cmd"] = WORKER_CMD_QUIT;
+        send(worker, cmd);
+        if (worker->socket)
+            worker->socket->flush();
+    }
+    for (Worker *worker : workers) {
+        if (!worker->process)
+            continue;
+        if (!worker->process->waitForFinished(WORKER_QUIT_TIMEOUT_MS)) {
+            blog(LOG_WARNING, "worker %d quit timeout, kill it", worker->index);
+            worker->process->kill();
+            worker->process->waitForFinished(3 * 1000);
+        }
+    }
+
+    server->close();
+    delete server;
+    server = nullptr;
+}
+
+int WorkerSupervisor::state(int index) const
+{
+    if (index < 0 || index >= workers.size())
+        return WorkerStopped;
+    return workers[index]->state;
+}
+
+void WorkerSupervisor::launch(Worker *worker)
+{
+    if (stopping)
+        return;
+
+    if (!worker->process) {
+        worker->process = new QProcess(this);
+        worker->process->setProcessChannelMode(QProcess::ForwardedChannels);
+        connect(worker->process,
+                static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                    &QProcess::finished),
+                this, [this, worker] (int code, QProcess::ExitStatus status) {
+            onProcessFinished(worker, code, status);
+        });
+    }
+
+    QStringList args;
+    args << "--worker" << QString::number(worker->index)
+         << "--server" << server->serverName()
+         << "--cpus" << worker->cpus;
+
+    worker->launchNs = os_gettime_ns();
+    worker->process->start(QCoreApplication::applicationFilePath(), args);
+    setState(worker, WorkerStarting);
+
+    blog(LOG_INFO, "worker %d launched on cpus %s", worker->index,
+         worker->cpus.toStdString().c_str());
+}
+
+void WorkerSupervisor::scheduleRestart(Worker *worker)
+{
+    // 运行了足够长时间后才崩溃的，从最短间隔重新开始退避
+    if (os_gettime_ns() - worker->launchNs > WORKER_STABLE_NS)
+        worker->backoffMs = 0;
+    worker->backoffMs = worker->backoffMs ?
+            std::min(worker->backoffMs * 2, WORKER_RESTART_MAX_MS) :
+            WORKER_RESTART_MIN_MS;
+    worker->restarts++;
+
+    blog(LOG_WARNING, "worker %d restart #%d in %d ms", worker->index,
+         worker->restarts, worker->backoffMs);
+    QTimer::singleShot(worker->backoffMs, this, [this, worker] () {
+        if (!stopping && worker->state == WorkerStopped)
+            launch(worker);
+    });
+}
+
+void WorkerSupervisor::onProcessFinished(Worker *worker, int exitCode,
+                                         QProcess::ExitStatus status)
+{
+    blog(status == QProcess::CrashExit ? LOG_ERROR : LOG_INFO,
+         "worker %d exited (%s, code %d)", worker->index,
+         status == QProcess::CrashExit ? "crash" : "normal", exitCode);
+
+    if (worker->socket) {
+        worker->socket->disconnect(this);
+        worker->socket->deleteLater();
+        worker->socket = nullptr;
+    }
+    setState(worker, WorkerStopped);
+
+    if (!stopping)
+        scheduleRestart(worker);
+}
+
+void WorkerSupervisor::onNewConnection()
+{
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        pending.append(socket);
+
+        // 第一条消息必须是 hello，据此找到对应的工作进程
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket] () {
+            QList<QJsonObject> messages;
+            ReadWorkerMessages(socket, messages);
+            if (messages.isEmpty())
+                return;
+
+            Worker *worker = nullptr;
+            for (Worker *w : workers) {
+                if (w->socket == socket)
+                    worker = w;
+            }
+
+            for (const QJsonObject &msg : messages) {
+                if (!worker && msg["event"].toString() == WORKER_EVENT_HELLO) {
+                    int index = msg["worker"].toInt(-1);
+                    if (index < 0 || index >= workers.size()) {
+                        blog(LOG_WARNING, "unknown worker %d", index);
+                        socket->abort();
+                        return;
+                    }
+                    worker = workers[index];
+                    attach(worker, socket);
+                    continue;
+                }
+                if (worker)
+                    handleEvent(worker, msg);
+            }
+        });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket] () {
+            pending.removeAll(socket);
+            for (Worker *w : workers) {
+                if (w->socket == socket)
+                    w->socket = nullptr;
+            }
+            socket->deleteLater();
+        });
+    }
+}
+
+void WorkerSupervisor::attach(Worker *worker, QLocalSocket *socket)
+{
+    pending.removeAll(socket);
+    if (worker->socket && worker->socket != socket)
+        worker->socket->abort();
+
+    worker->socket = socket;
+    setState(worker, WorkerConnected);
+    sendInit(worker);
+}
+
+void WorkerSupervisor::sendInit(Worker *worker)
+{
+    const WorkerSession &s = worker->session;
+
+    QJsonObject cmd;
+    cmd["cmd"]    = WORKER_CMD_INIT;
+    cmd["config"] = configPath;
+    cmd["title"]  = s.windowTitle;
+    cmd["pid"]    = (qint64)s.pid;
+    cmd["exe"]    = s.exe;
+    cmd["class"]  = s.className;
+    cmd["screen"] = SizeToJson(s.screenSize);
+    cmd["region"] = RectToJson(s.region);
+    send(worker, cmd);
+}
+
+void WorkerSupervisor::sendStartRecord(Worker *worker)
+{
+    // 重启后写入新文件，不覆盖崩溃前的录制
+    QString path = QString("%1/QtOBS-w%2-%3.mp4")
+                   .arg(worker->session.outputDir).arg(worker->index)
+                   .arg(QDateTime::currentDateTime()
+                        .toString("yyyy-MM-dd-hh-mm-ss"));
+    QDir().mkpath(worker->session.outputDir);
+
+    QJsonObject cmd;
+    cmd["cmd"]  = WORKER_CMD_START_RECORD;
+    cmd["path"] = path;
+    send(worker, cmd);
+}
+
+void WorkerSupervisor::handleEvent(Worker *worker, const QJsonObject &event)
+{
+    QString name = event["event"].toString();
+
+    if (name == WORKER_EVENT_INITIALIZED) {
+        setState(worker, WorkerReady);
+        if (worker->wantRecord)
+            sendStartRecord(worker);
+
+    } else if (name == WORKER_EVENT_RECORD_STARTED) {
+        setState(worker, WorkerRecording);
+
+    } else if (name == WORKER_EVENT_RECORD_STOPPED) {
+        setState(worker, WorkerReady);
+
+    } else if (name == WORKER_EVENT_ERROR) {
+        QString msg = event["message"].toString();
+        blog(LOG_WARNING, "worker %d error %d: %s", worker->index,
+             event["type"].toInt(), msg.toStdString().c_str());
+        emit workerError(worker->index, event["type"].toInt(), msg);
+
+    } else if (name == WORKER_EVENT_STATS) {
+        worker->stats   = event;
+        worker->statsNs = os_gettime_ns();
+    }
+}
+
+void WorkerSupervisor::send(Worker *worker, const QJsonObject &cmd)
+{
+    WriteWorkerMessage(worker->socket, cmd);
+}
+
+void WorkerSupervisor::setState(Worker *worker, int state)
+{
+    if (worker->state == state)
+        return;
+    worker->state = state;
+    emit workerStateChanged(worker->index, state);
+}
+
+void WorkerSupervisor::startRecord(int index)
+{
+    for (Worker *worker : workers) {
+        if (index >= 0 && worker->index != index)
+            continue;
+        worker->wantRecord = true;
+        // 尚未初始化完成的，在 initialized 事件中开始录制
+        if (worker->state == WorkerReady)
+            sendStartRecord(worker);
+    }
+}
+
+void WorkerSupervisor::stopRecord(int index, bool force)
+{
+    for (Worker *worker : workers) {
+        if (index >= 0 && worker->index != index)
+            continue;
+        worker->wantRecord = false;
+
+        QJsonObject cmd;
+        cmd["cmd"]   = WORKER_CMD_STOP_RECORD;
+        cmd["force"] = force;
+        send(worker, cmd);
+    }
+}
+
+void WorkerSupervisor::videoCrop(int index, const QRect &region)
+{
+    if (index < 0 || index >= workers.size() || region.isEmpty())
+        return;
+
+    Worker *worker = workers[index];
+    worker->session.region = region;   // 重启后沿用新的区域
+
+    QJsonObject cmd;
+    cmd["cmd"]    = WORKER_CMD_CROP;
+    cmd["region"] = RectToJson(region);
+    send(worker, cmd);
+}
+
+void WorkerSupervisor::pollStats()
+{
+    QJsonObject cmd;
+    cmd["cmd"] = WORKER_CMD_STATS;
+    for (Worker *worker : workers)
+        send(worker, cmd);
+}
+
+void WorkerSupervisor::logStats()
+{
+    double  cpu = 0.0;
+    qint64  memory = 0, bytes = 0, frames = 0, lagged = 0, dropped = 0;
+    int     recording = 0, restarts = 0;
+
+    blog(LOG_INFO, "worker stats:");
+    for (Worker *worker : workers) {
+        const QJsonObject &s = worker->stats;
+        blog(LOG_INFO, "\tworker %d [pid %lld] cpus:%s state:%s restarts:%d "
+                       "cpu:%.1f%% mem:%lld MB frames:%lld lagged:%lld "
+                       "record:%lld MB dropped:%lld",
+             worker->index,
+             worker->process ? (long long)worker->process->processId() : 0LL,
+             worker->cpus.toStdString().c_str(),
+             stateNames[worker->state], worker->restarts,
+             s["cpu"].toDouble(),
+             (long long)s["memory"].toDouble() / (1024 * 1024),
+             (long long)s["frames"].toDouble(),
+             (long long)s["lagged"].toDouble(),
+             (long long)s["record_bytes"].toDouble() / (1024 * 1024),
+             (long long)s["record_dropped"].toDouble());
+
+        cpu      += s["cpu"].toDouble();
+        memory   += (qint64)s["memory"].toDouble();
+        bytes    += (qint64)s["record_bytes"].toDouble();
+        frames   += (qint64)s["frames"].toDouble();
+        lagged   += (qint64)s["lagged"].toDouble();
+        dropped  += (qint64)s["record_dropped"].toDouble();
+        restarts += worker->restarts;
+        if (worker->state == WorkerRecording)
+            recording++;
+    }
+    blog(LOG_INFO, "\ttotal: %d/%d recording, restarts:%d cpu:%.1f%% "
+                   "mem:%lld MB frames:%lld lagged:%lld record:%lld MB "
+                   "dropped:%lld",
+         recording, workers.size(), restarts, cpu,
+         (long long)memory / (1024 * 1024), (long long)frames,
+         (long long)lagged, (long long)bytes / (1024 * 1024),
+         (long long)dropped);
+}
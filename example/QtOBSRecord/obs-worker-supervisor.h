@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include <QObject>
+#include <QJsonObject>
+#include <QProcess>
+#include <QList>
+#include <QRect>
+#include <QSize>
+
+#include <stdint.h>
+
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+
+/* 一个工作进程负责的录制会话 */
+struct WorkerSession
+{
+    QString windowTitle;   // 要捕获的窗口标题，支持 * 和 ? 通配符
+    uint    pid;           // 以下三项为空（0）时不限制
+    QString exe;
+    QString className;
+    QSize   screenSize;    // 用于计算输出分辨率，参见 QtOBSContext::initialize
+    QRect   region;        // 窗口内的录制区域
+    QString outputDir;
+    QString cpus;          // 绑定的 CPU 列表，如 "0-3"，为空时自动平均分配
+
+    WorkerSession() : pid(0) {}
+};
+
+/**
+ * 启动 N 个录制工作进程（见 RecordWorker），每个进程绑定到自己的 CPU 集合，
+ * 通过 QLocalServer 下发命令、定时收集统计。
+ *
+ * 工作进程异常退出时只重启该进程：重新下发 init，退出前在录制的话重新开始录制
+ * （写入新文件），其它进程不受影响。重启间隔从 1 秒开始指数退避，最长 30 秒。
+ *
+ * 会话配置文件格式：
+ * {
+ *     "workers": [
+ *         { "title": "会议*", "exe": "meeting.exe", "screen": [1920, 1080],
+ *           "region": [0, 0, 1280, 720], "output": "D:/records", "cpus": "0-3" }
+ *     ]
+ * }
+ */
+class WorkerSupervisor : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum WorkerState {
+        WorkerStopped,     // 未启动或正在等待重启
+        WorkerStarting,    // 进程已启动，等待连接
+        WorkerConnected,   // 已连接，正在初始化
+        WorkerReady,       // 初始化完成
+        WorkerRecording
+    };
+
+    explicit WorkerSupervisor(QObject *parent = nullptr);
+    ~WorkerSupervisor();
+
+    static bool loadSessions(const QString &file, QList<WorkerSession> &sessions);
+
+    // configPath 为工作进程配置目录的上级目录，每个进程使用 configPath/worker-<序号>
+    bool start(const QString &configPath, const QList<WorkerSession> &sessions);
+    // 停止所有录制并让工作进程退出，不再重启
+    void stop();
+
+    int count() const { return workers.size(); }
+    int state(int worker) const;
+
+signals:
+    void workerStateChanged(int worker, int state);
+    void workerError(int worker, int type, const QString &message);
+
+public slots:
+    // worker 为 -1 时作用于所有工作进程
+    void startRecord(int worker = -1);
+    void stopRecord(int worker = -1, bool force = false);
+    void videoCrop(int worker, const QRect &region);
+    void logStats();
+
+private slots:
+    void onNewConnection();
+    void pollStats();
+
+private:
+    struct Worker {
+        int           index;
+        WorkerSession session;
+        QString       cpus;
+        QProcess      *process;
+        QLocalSocket  *socket;
+        int           state;
+        bool          wantRecord;     // 重启后是否需要重新开始录制
+        int           restarts;
+        int           backoffMs;
+        uint64_t      launchNs;
+        QJsonObject   stats;          // 最近一次 stats 消息
+        uint64_t      statsNs;
+
+        Worker() : index(0), process(nullptr), socket(nullptr),
+            state(WorkerStopped), wantRecord(false), restarts(0),
+            backoffMs(0), launchNs(0), statsNs(0) {}
+    };
+
+    void launch(Worker *worker);
+    void scheduleRestart(Worker *worker);
+    void attach(Worker *worker, QLocalSocket *socket);
+    void handleEvent(Worker *worker, const QJsonObject &event);
+    void sendInit(Worker *worker);
+    void sendStartRecord(Worker *worker);
+    void send(Worker *worker, const QJsonObject &cmd);
+    void setState(Worker *worker, int state);
+    void onProcessFinished(Worker *worker, int exitCode,
+                           QProcess::ExitStatus status);
+
+    QLocalServer    *server;
+    QTimer          *statsTimer;
+    QString         configPath;
+    QList<Worker *> workers;
+    QList<QLocalSocket *> pending;   // 已连接但尚未发送 hello
+    bool            stopping;
+};
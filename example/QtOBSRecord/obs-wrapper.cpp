@@ -1,1404 +1,3993 @@
-﻿#include "obs-wrapper.h"
-
-#ifdef _WIN32
-#define IS_WIN32 1
-#include <windows.h>
-#include <shellapi.h>
-#include <shlobj.h>
-#include <Dwmapi.h>
-#include <psapi.h>
-#include <mmdeviceapi.h>
-#include <audiopolicy.h>
-// obs headers
-#include <util/windows/WinHandle.hpp>
-#include <util/windows/HRError.hpp>
-#include <util/windows/ComPtr.hpp>
-#include <util/windows/win-version.h>
-
-#pragma comment(lib, "ole32.lib")
-
-#else
-#define IS_WIN32 0
-#endif
-
-// obs headers
-#include <util/util.hpp>
-#include <util/platform.h>
-#include <libavcodec/avcodec.h>
-
-#include <QCoreApplication>
-#include <QFileInfo>
-#include <QSysInfo>
-#include <QtWin>
-#include <QSize>
-
-#include <QDebug>
-
-#define DL_OPENGL "libobs-opengl.dll"
-#define DL_D3D11  "libobs-d3d11.dll"
-
-#define TAG "QtOBS"
-
-#define INPUT_AUDIO_SOURCE  "wasapi_input_capture"
-#define OUTPUT_AUDIO_SOURCE "wasapi_output_capture"
-
-enum SourceChannels {
-    SOURCE_CHANNEL_TRANSITION     = 0, // 淡入淡出
-    SOURCE_CHANNEL_AUDIO_OUTPUT      , // 桌面音频设备
-    SOURCE_CHANNEL_AUDIO_OUTPUT_2    , // 桌面音频设备 2
-    SOURCE_CHANNEL_AUDIO_INPUT       , // 麦克风/辅助音频设备
-    SOURCE_CHANNEL_AUDIO_INPUT_2     , // 麦克风/辅助音频设备 2
-    SOURCE_CHANNEL_AUDIO_INPUT_3     , // 麦克风/辅助音频设备 3
-};
-
-#define AUDIO_BITRATE 128 // kb/s
-#define VIDEO_BITRATE 150 // kb/s 用于输出 FLV 格式视频，可自行调整
-
-#define VIDEO_CROP_FILTER_ID "crop_filter"
-#define VIDEO_FPS            15
-
-#if OUTPUT_FLV
-#define VIDEO_ENCODER_ID           AV_CODEC_ID_FLV1
-#define VIDEO_ENCODER_NAME         "flv"
-#define RECORD_OUTPUT_FORMAT       "flv"
-#define RECORD_OUTPUT_FORMAT_MIME  "video/x-flv"
-#else
-#define VIDEO_ENCODER_ID           AV_CODEC_ID_H264
-#define VIDEO_ENCODER_NAME         "libx264"
-#define RECORD_OUTPUT_FORMAT       "mp4"
-#define RECORD_OUTPUT_FORMAT_MIME  "video/mp4"
-#endif
-
-static const double scaled_vals[] =
-{
-    1.0,
-    1.25,
-    (1.0 / 0.75),
-    1.5,
-    (1.0 / 0.6),
-    1.75,
-    2.0,
-    2.25,
-    2.5,
-    2.75,
-    3.0,
-    0.0
-};
-
-static log_handler_t DefLogHandler;
-
-#ifdef _WIN32
-static bool DisableAudioDucking(bool disable)
-{
-    ComPtr<IMMDeviceEnumerator>   devEnum;
-    ComPtr<IMMDevice>             device;
-    ComPtr<IAudioSessionManager2> sessionManager2;
-    ComPtr<IAudioSessionControl>  sessionControl;
-    ComPtr<IAudioSessionControl2> sessionControl2;
-
-    HRESULT result = CoCreateInstance(__uuidof(MMDeviceEnumerator),
-                                      nullptr, CLSCTX_INPROC_SERVER,
-                                      __uuidof(IMMDeviceEnumerator),
-                                      (void **)&devEnum);
-    if (FAILED(result))
-        return false;
-
-    result = devEnum->GetDefaultAudioEndpoint(eRender, eConsole, &device);
-    if (FAILED(result))
-        return false;
-
-    result = device->Activate(__uuidof(IAudioSessionManager2),
-                              CLSCTX_INPROC_SERVER, nullptr,
-                              (void **)&sessionManager2);
-    if (FAILED(result))
-        return false;
-
-    result = sessionManager2->GetAudioSessionControl(nullptr, 0,
-                                                     &sessionControl);
-    if (FAILED(result))
-        return false;
-
-    result = sessionControl->QueryInterface(&sessionControl2);
-    if (FAILED(result))
-        return false;
-
-    result = sessionControl2->SetDuckingPreference(disable);
-    return SUCCEEDED(result);
-}
-
-static void SetAeroEnabled(bool enable)
-{
-    static HRESULT(WINAPI *func)(UINT) = nullptr;
-    static bool failed = false;
-
-    if (!func) {
-        if (failed)
-            return;
-
-        HMODULE dwm = LoadLibraryW(L"dwmapi");
-        if (!dwm) {
-            failed = true;
-            return;
-        }
-
-        func = reinterpret_cast<decltype(func)>(GetProcAddress(dwm,
-                                                               "DwmEnableComposition"));
-        if (!func) {
-            failed = true;
-            return;
-        }
-    }
-
-    func(enable ? DWM_EC_ENABLECOMPOSITION : DWM_EC_DISABLECOMPOSITION);
-}
-
-static uint32_t GetWindowsVersion()
-{
-    static uint32_t ver = 0;
-
-    if (ver == 0) {
-        struct win_version_info ver_info;
-
-        get_win_ver(&ver_info);
-        ver = (ver_info.major << 8) | ver_info.minor;
-    }
-
-    return ver;
-}
-#endif
-
-static void LogHandler(int level, const char *format, va_list args, void *param)
-{
-    Q_UNUSED(level);
-    Q_UNUSED(param);
-
-    char str[4096];
-    vsnprintf(str, sizeof(str), format, args);
-
-    qInfo().noquote() << TAG << str;
-}
-
-static void AddFilterToAudioInput(const char *id)
-{
-    if (id == nullptr || *id == '\0')
-        return;
-
-    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
-    if (!source)
-        return;
-
-    obs_source_t *existing_filter;
-    std::string name = obs_source_get_display_name(id);
-    if (name.empty())
-        name = id;
-    existing_filter = obs_source_get_filter_by_name(source, name.c_str());
-    if (existing_filter) {
-        obs_source_release(existing_filter);
-        obs_source_release(source);
-        return;
-    }
-
-    obs_source_t *filter = obs_source_create(id, name.c_str(), nullptr, nullptr);
-    if (filter) {
-        const char *sourceName = obs_source_get_name(source);
-
-        blog(LOG_INFO, "added filter '%s' (%s) to source '%s'", name.c_str(),
-             id, sourceName);
-
-        obs_source_filter_add(source, filter);
-        obs_source_release(filter);
-    }
-
-    obs_source_release(source);
-}
-
-static inline bool HasAudioDevices(const char *source_id)
-{
-    const char *output_id = source_id;
-    obs_properties_t *props = obs_get_source_properties(output_id);
-    size_t count = 0;
-
-    if (!props)
-        return false;
-
-    obs_property_t *devices = obs_properties_get(props, "device_id");
-    if (devices)
-        count = obs_property_list_item_count(devices);
-
-    obs_properties_destroy(props);
-
-    return count != 0;
-}
-
-static void ResetAudioDevice(const char *sourceId, const char *deviceId,
-                             const char *deviceDesc, int channel)
-{
-    bool disable = deviceId && strcmp(deviceId, "disabled") == 0;
-    obs_source_t *source;
-    obs_data_t *settings;
-
-    source = obs_get_output_source(channel);
-    if (source) {
-        if (disable) {
-            obs_set_output_source(channel, nullptr);
-        } else {
-            settings = obs_source_get_settings(source);
-            const char *oldId = obs_data_get_string(settings,
-                                                    "device_id");
-            if (strcmp(oldId, deviceId) != 0) {
-                obs_data_set_string(settings, "device_id",
-                                    deviceId);
-            }
-            obs_data_set_bool(settings, "use_device_timing", false);
-            obs_source_update(source, settings);
-            obs_data_release(settings);
-        }
-
-    } else if (!disable) {
-        settings = obs_data_create();
-        obs_data_set_string(settings, "device_id", deviceId);
-        obs_data_set_bool(settings, "use_device_timing", false);
-        source = obs_source_create(sourceId, deviceDesc, settings, nullptr);
-        obs_data_release(settings);
-
-        obs_set_output_source(channel, source);
-    }
-
-    obs_source_release(source);
-}
-
-static bool CreateAACEncoder(OBSEncoder &res, std::string &id, const char *name,
-                             size_t idx, obs_data_t *setting)
-{
-    /*
-    static const string encoders[] = {
-        "ffmpeg_aac",
-        "mf_aac",
-        "libfdk_aac",
-        "CoreAudio_AAC",
-    };
-    */
-    const char *id_ = "ffmpeg_aac";
-    id = id_;
-    res = obs_audio_encoder_create(id_, name, setting, idx, nullptr);
-
-    if (res) {
-        obs_encoder_release(res);
-        return true;
-    }
-
-    return false;
-}
-
-static void AddSource(void *_data, obs_scene_t *scene)
-{
-    // 为这个 source 创建一个 scene item
-    obs_source_t *source = (obs_source_t *)_data;
-    obs_scene_add(scene, source);
-    obs_source_release(source);
-}
-
-static bool FindSceneItemAndScale(obs_scene_t *scene, obs_sceneitem_t *item,
-                                  void *param)
-{
-    Q_UNUSED(scene);
-
-    // scene item 只有一个，它对应的 source 为 captureSource
-
-    QtOBSContext *obs = static_cast<QtOBSContext *>(param);
-    QSize baseSize = obs->getBaseSize(), orgSize = obs->getOriginalSize();
-
-    float width = baseSize.width();
-    float height = baseSize.height();
-    float sratio = height / orgSize.height();
-    bool align_width = false;
-    float base_ratio = baseSize.width() * 1.f / baseSize.height();
-    float orginal_ratio = orgSize.width() * 1.f / orgSize.height();
-    if (base_ratio >= orginal_ratio)
-        width = height * orginal_ratio;
-    else {
-        height = width / orginal_ratio;
-        sratio = width / orgSize.width();
-        align_width = true;
-    }
-
-    vec2 scale;
-    scale.x = scale.y = sratio;
-    obs_sceneitem_set_scale(item, &scale);
-
-    vec2 pos;
-    if (align_width)
-        vec2_set(&pos, 0, (baseSize.height() - height) / 2);
-    else
-        vec2_set(&pos, (baseSize.width() - width) / 2, 0);
-    obs_sceneitem_set_pos(item, &pos);
-
-    blog(LOG_INFO, "scene scale %f %f.", scale.x, scale.y);
-    return true;
-}
-
-#define RECORDING_STARTED \
-    "==== Recording Started ==============================================="
-#define RECORDING_STOPPING \
-    "==== Recording Stopping ================================================"
-#define RECORDING_STOPPED \
-    "==== Recording Stopped ================================================"
-#define STREAMING_STARTED \
-    "==== Streaming Started ==============================================="
-#define STREAMING_STOPPING \
-    "==== Streaming Stopping ================================================"
-#define STREAMING_STOPPED \
-    "==== Streaming Stopped ================================================"
-static void RecordingStarted(void *data, calldata_t *params)
-{
-    Q_UNUSED(params);
-    blog(LOG_INFO, RECORDING_STARTED);
-    QtOBSContext *handler = static_cast<QtOBSContext *>(data);
-    QMetaObject::invokeMethod(handler, "recordStarted");
-}
-
-static void RecordingStopping(void *data, calldata_t *params)
-{
-    Q_UNUSED(data);
-    Q_UNUSED(params);
-    blog(LOG_INFO, RECORDING_STOPPING);
-}
-
-static void RecordingStopped(void *data, calldata_t *params)
-{
-    blog(LOG_INFO, RECORDING_STOPPED);
-
-    QString msg;
-    int code = (int)calldata_int(params, "code");
-    switch (code)
-    {
-    case OBS_OUTPUT_SUCCESS:
-        blog(LOG_INFO, "recording finished!");
-        Q_UNUSED(data);
-        break;
-    case OBS_OUTPUT_NO_SPACE:
-        msg = "磁盘存储空间不足！";
-        break;
-    case OBS_OUTPUT_UNSUPPORTED:
-        msg = "格式不支持！";
-        break;
-    default:
-        {
-            const char *last_error = calldata_string(params, "last_error");
-            blog(LOG_ERROR, "record error, code=%d,error=%s", code, last_error);
-        }
-        msg = QString("发生未指定错误 (Code:%1)！").arg(code);
-        break;
-    }
-
-    if (!msg.isEmpty()) {
-        QtOBSContext *handler = static_cast<QtOBSContext *>(data);
-        QMetaObject::invokeMethod(handler, "errorOccurred",
-                                  Q_ARG(int, QtOBSContext::Record),
-                                  Q_ARG(QString, msg));
-    } else {
-        QtOBSContext *handler = static_cast<QtOBSContext *>(data);
-        QMetaObject::invokeMethod(handler, "recordStopped");
-    }
-}
-
-static void StreamingStarted(void *data, calldata_t *params)
-{
-    Q_UNUSED(params);
-    blog(LOG_INFO, STREAMING_STARTED);
-    QtOBSContext *handler = static_cast<QtOBSContext *>(data);
-    QMetaObject::invokeMethod(handler, "streamStarted");
-}
-
-static void StreamingStopping(void *data, calldata_t *params)
-{
-    Q_UNUSED(data);
-    Q_UNUSED(params);
-    blog(LOG_INFO, STREAMING_STOPPING);
-}
-
-static void StreamingStopped(void *data, calldata_t *params)
-{
-    blog(LOG_INFO, STREAMING_STOPPED);
-
-    QString msg;
-    int code = (int)calldata_int(params, "code");
-    switch (code)
-    {
-    case OBS_OUTPUT_SUCCESS:
-        blog(LOG_INFO, "streaming finished!");
-        Q_UNUSED(data);
-        break;
-    case OBS_OUTPUT_BAD_PATH:
-        msg = "无效的地址！";
-        break;
-    case OBS_OUTPUT_CONNECT_FAILED:
-        msg = "无法连接到服务器！";
-        break;
-    case OBS_OUTPUT_INVALID_STREAM:
-        msg = "无法访问流密钥或无法连接服务器！";
-        break;
-    case OBS_OUTPUT_ERROR:
-        msg = "连接服务器时发生意外错误！";
-        break;
-    case OBS_OUTPUT_DISCONNECTED:
-        msg = "已与服务器断开连接！";
-        break;
-    default:
-        {
-            const char *last_error = calldata_string(params, "last_error");
-            blog(LOG_ERROR, "stream error, code=%d,error=%s", code, last_error);
-        }
-        msg = QString("发生未指定错误 (Code:%1)！").arg(code);
-        break;
-    }
-
-    if (!msg.isEmpty()) {
-        QtOBSContext *handler = static_cast<QtOBSContext *>(data);
-        QMetaObject::invokeMethod(handler, "errorOccurred",
-                                  Q_ARG(int, QtOBSContext::Stream),
-                                  Q_ARG(QString, msg));
-    } else {
-        QtOBSContext *handler = static_cast<QtOBSContext *>(data);
-        QMetaObject::invokeMethod(handler, "streamStopped");
-    }
-}
-
-#define OBS_INIT_BEGIN \
-    "==== OBS Init Begin ==============================================="
-#define OBS_INIT_END \
-    "==== OBS Init End ==============================================="
-#define OBS_STARTUP_SEPARATOR \
-    "==== OBS Start Complete ==============================================="
-#define OBS_RELEASE_BEGIN_SEPARATOR \
-    "==== OBS Release Begin ==============================================="
-#define OBS_RELEASE_END_SEPARATOR \
-    "==== OBS Release End ==============================================="
-#define OBS_SEPARATOR "---------------------------------------------"
-
-QtOBSContext::QtOBSContext(QObject *parent) : QObject(parent),
-    filePath(nullptr),
-    liveServer(nullptr),
-    liveKey(nullptr),
-    rtmpService(nullptr),
-    recordOutput(nullptr),
-    streamOutput(nullptr),
-    h264Streaming(nullptr),
-    scene(nullptr),
-    fadeTransition(nullptr),
-    captureSource(nullptr),
-    properties(nullptr),
-    recordWhenStreaming(false)
-{
-#ifdef _WIN32
-    DisableAudioDucking(true);
-#endif
-    for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-        aacTrack[i] = nullptr;
-    base_get_log_handler(&DefLogHandler, nullptr);
-    base_set_log_handler(LogHandler, nullptr);
-}
-
-QtOBSContext::~QtOBSContext()
-{
-#ifdef _WIN32
-    DisableAudioDucking(false);
-#endif
-
-    if (obs_initialized())
-        release();
-
-    obs_shutdown();
-
-    blog(LOG_INFO, "memory leaks: %ld", bnum_allocs());
-    base_set_log_handler(nullptr, nullptr);
-}
-
-void QtOBSContext::release()
-{
-    blog(LOG_INFO, OBS_RELEASE_BEGIN_SEPARATOR);
-
-    recordingStarted.Disconnect();
-    recordingStopping.Disconnect();
-    recordingStopped.Disconnect();
-    streamingStarted.Disconnect();
-    streamingStopping.Disconnect();
-    streamingStopped.Disconnect();
-
-    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, nullptr);
-    obs_set_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT, nullptr);
-    obs_set_output_source(SOURCE_CHANNEL_AUDIO_INPUT, nullptr);
-
-    auto cb = [] (void *unused, obs_source_t *source)
-    {
-        obs_source_remove(source);
-        Q_UNUSED(unused);
-        return true;
-    };
-    obs_enum_sources(cb, nullptr);
-
-    obs_scene_release(scene);
-    obs_properties_destroy(properties);
-
-    scene        = nullptr;
-    properties   = nullptr;
-
-    rtmpService    = nullptr;
-    h264Streaming  = nullptr;
-
-    for (size_t i = 0; i < MAX_AUDIO_MIXES; ++i)
-        aacTrack[i] = nullptr;
-
-    streamOutput = nullptr;
-    recordOutput = nullptr;
-
-    free(filePath);
-    free(liveServer);
-    free(liveKey);
-
-    blog(LOG_INFO, OBS_RELEASE_END_SEPARATOR);
-}
-
-// 整个初始化流程，参见 window-basic-main.cpp -> OBSBasic::OBSInit()
-void QtOBSContext::initialize(const QString &configPath,
-                              const QString &windowTitle,
-                              const QSize &screenSize,
-                              const QRect &sourceRegion)
-{
-    blog(LOG_INFO, OBS_INIT_BEGIN);
-
-    if (configPath.isEmpty() || windowTitle.isEmpty() ||
-            screenSize.isEmpty() || sourceRegion.isEmpty()) {
-        emit errorOccurred(Init, QStringLiteral("参数错误"));
-        return;
-    }
-
-    // 参见 window-basic-main.cpp -> OBSBasic::InitBasicConfigDefaults
-
-    // 计算最终需要输出的分辨率，本例以屏幕分辨率作为标准
-    // 举例（参见 FindSceneItemAndScale 中的处理）：
-    // 屏幕是 1920*1080，那么最终计算出的录制输出为 1280*720，同时 base 也设置为 1280*720，
-    // 如果软件窗口界面大小为 480*360，则把它（窗口捕获源）同比例放大到 960*720，
-    // 并设置它在场景中居中（左右各留黑160）
-    int i = 0;
-    uint32_t out_cx = screenSize.width();
-    uint32_t out_cy = screenSize.height();
-    while (((out_cx * out_cy) > (1280 * 720)) && scaled_vals[i] > 0.0) {
-        double scale = scaled_vals[i++];
-        out_cx = uint32_t(double(screenSize.width()) / scale);
-        out_cy = uint32_t(double(screenSize.height()) / scale);
-    }
-    baseWidth    = out_cx;
-    baseHeight   = out_cy;
-    outputWidth  = out_cx; // 可自行修改
-    outputHeight = out_cy;
-    orgWidth     = sourceRegion.width();
-    orgHeight    = sourceRegion.height();
-    blog(LOG_INFO, "final resolution => org=%dx%d, base=%dx%d, output=%dx%d",
-         orgWidth, orgHeight, baseWidth, baseHeight, outputWidth, outputHeight);
-
-    // 初始化 OBS
-    if (!obs_initialized()) {
-
-        blog(LOG_INFO, "obs version %u", obs_get_version());
-
-        if (!obs_startup("en-US", configPath.toStdString().c_str(), nullptr)) {
-            blog(LOG_ERROR, "startup failed.");
-            emit errorOccurred(Init, QStringLiteral("obs startup failed."));
-            return;
-        }
-
-        // 加载模块，先设置模块加载路径
-        QString appPath = QCoreApplication::applicationDirPath();
-        QString pluginsPath = appPath + "/obs-plugins/32bit";
-        QString modulePath = appPath + "/data/obs-plugins/%module%";
-        obs_add_module_path(pluginsPath.toStdString().c_str(),
-                            modulePath.toStdString().c_str());
-        blog(LOG_INFO, OBS_SEPARATOR);
-        obs_load_all_modules();
-        blog(LOG_INFO, OBS_SEPARATOR);
-        obs_log_loaded_modules();
-
-        blog(LOG_INFO, OBS_STARTUP_SEPARATOR);
-    }
-
-    // 音频基本配置
-    if (!resetAudio()) {
-        blog(LOG_ERROR, "reset audio failed.");
-        emit errorOccurred(Init, QStringLiteral("音频设置失败"));
-        return;
-    }
-
-    // 视频基本配置
-    int ret = resetVideo();
-    if (ret != OBS_VIDEO_SUCCESS) {
-        switch (ret) {
-        case OBS_VIDEO_MODULE_NOT_FOUND:
-            blog(LOG_ERROR, "failed to initialize video: graphics module not found.");
-            break;
-        case OBS_VIDEO_NOT_SUPPORTED:
-            blog(LOG_ERROR, "unsupported.");
-            break;
-        case OBS_VIDEO_INVALID_PARAM:
-            blog(LOG_ERROR, "failed to initialize video: invalid parameters.");
-            break;
-        default:
-            blog(LOG_ERROR, "unknown.");
-            break;
-        }
-        blog(LOG_ERROR, "reset video failed.");
-        emit errorOccurred(Init, QStringLiteral("视频设置失败"));
-        return;
-    }
-
-    // 设置音频检测设备（obs 软件，设置->高级->音频->音频监视设备）
-    //#if defined(_WIN32)
-    //    obs_set_audio_monitoring_device(TAG"-audio-monitor-default", "default");
-    //    blog(LOG_INFO, "audio monitoring device:\tname: %s\tid: %s",
-    //         "obs-audio-monitor-default", "default");
-    //#endif
-
-    // 初始化推流服务
-    if (!initService()) {
-        emit errorOccurred(Init, QStringLiteral("初始化服务失败"));
-        return;
-    }
-
-    // 初始化输出相关(推流/本地录制/编码器)
-    // 参见 window-basic-main.cpp -> OBSBasic::OBSInit()
-    if (!resetOutputs()) {
-        emit errorOccurred(Init, QStringLiteral("初始化编码器失败"));
-        return;
-    }
-
-#ifdef _WIN32
-    // 开启 Aero（Windows 8 及以上版本不起作用）
-    // 方法 1
-    if (1) {
-        uint32_t winVer = GetWindowsVersion();
-        blog(LOG_INFO, "windows version %x", winVer);
-        if (winVer > 0 && winVer < 0x602) {
-            blog(LOG_INFO, "set aero enable");
-            SetAeroEnabled(true);
-        }
-    }
-    // 方法 2
-    else {
-        // if (QSysInfo::windowsVersion() < QSysInfo::WV_WINDOWS8)
-        QtWin::setCompositionEnabled(true);
-    }
-#endif
-
-    // 以下流程
-    // 参见 window-basic-main.cpp -> OBSBasic::Load -> OBSBasic::CreateDefaultScene
-
-    // 参见 obs 软件 设置 -> 音频
-    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, nullptr);
-    obs_set_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT, nullptr);
-    obs_set_output_source(SOURCE_CHANNEL_AUDIO_INPUT, nullptr);
-
-    // 场景过度 - 淡出
-    // 参见 window-basic-main-transitions.cpp -> OBSBasic::InitDefaultTransitions
-    size_t idx = 0;
-    const char *id;
-    while (obs_enum_transition_types(idx++, &id)) {
-        if (!obs_is_source_configurable(id)) {
-            if (strcmp(id, "fade_transition") == 0) {
-                const char *name = obs_source_get_display_name(id);
-                obs_source_t *tr = obs_source_create_private(id, name, NULL);
-                blog(LOG_INFO, "transition saved");
-                fadeTransition = tr;
-                break;
-            }
-        }
-    }
-    if (!fadeTransition) {
-        blog(LOG_ERROR, "cannot find fade transition.");
-        emit errorOccurred(Init, QStringLiteral("创建转换器失败"));
-        return;
-    }
-    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, fadeTransition);
-    obs_source_release(fadeTransition);
-
-    // 创建场景（scene 也是一种 source）
-    scene = obs_scene_create(TAG "-Scene");
-    if (!scene) {
-        blog(LOG_ERROR, "create scene failed.");
-        emit errorOccurred(Init, QStringLiteral("创建场景失败"));
-        return;
-    }
-    obs_source_t *s = obs_get_output_source(SOURCE_CHANNEL_TRANSITION);
-    obs_transition_set(s, obs_scene_get_source(scene));
-    obs_source_release(s);
-
-    if (HasAudioDevices(OUTPUT_AUDIO_SOURCE))
-        ResetAudioDevice(OUTPUT_AUDIO_SOURCE, "default",
-                         TAG " Default Desktop Audio",
-                         SOURCE_CHANNEL_AUDIO_OUTPUT);
-    if (HasAudioDevices(INPUT_AUDIO_SOURCE))
-        ResetAudioDevice(INPUT_AUDIO_SOURCE, "default",
-                         TAG " Default Mic/Aux",
-                         SOURCE_CHANNEL_AUDIO_INPUT);
-    // 设置降噪
-    AddFilterToAudioInput("noise_suppress_filter");
-
-    // 创建窗口捕获源，它是 scene 里唯一的一个 scene item
-    captureSource = obs_source_create("window_capture", TAG "-WindowsCapture",
-                                      NULL, nullptr);
-    if (captureSource) {
-        obs_scene_atomic_update(scene, AddSource, captureSource);
-    } else {
-        blog(LOG_ERROR, "create source failed.");
-        emit errorOccurred(Init, QStringLiteral("创建源失败"));
-        return;
-    }
-
-    // 添加窗口捕获源的剪裁过滤器，可以实现录制窗口特区域
-    addFilterToSource(captureSource, VIDEO_CROP_FILTER_ID);
-    videoCrop(sourceRegion);
-
-    // 设置窗口捕获原的窗口
-    obs_data_t *setting = obs_data_create();
-    obs_data_t *curSetting = obs_source_get_settings(captureSource);
-    obs_data_apply(setting, curSetting);
-    obs_data_release(curSetting);
-
-    blog(LOG_INFO, OBS_SEPARATOR);
-    QFileInfo fi(QCoreApplication::applicationFilePath());
-    QString desc = QString("[%1]: %2").arg(fi.fileName()).arg(windowTitle);
-    blog(LOG_INFO, "exe desc %s", desc.toStdString().c_str());
-    properties = obs_source_properties(captureSource);
-    obs_property_t *property = obs_properties_first(properties);
-    while (property) {
-        const char *name = obs_property_name(property);
-        if (strcmp(name, "window") == 0) {
-            size_t count = obs_property_list_item_count(property);
-            const char *string = nullptr;
-            for (size_t i = 0; i < count; i++) {
-                const char *name = obs_property_list_item_name(property, i);
-                blog(LOG_INFO, "window list item name=%s", name);
-                if (desc == QString::fromUtf8(name)) {
-                    string = obs_property_list_item_string(property, i);
-                    blog(LOG_INFO, "!!!Found item=%s", string);
-                    break;
-                }
-            }
-            if (string) {
-                obs_data_set_string(setting, name, string);
-                obs_source_update(captureSource, setting);
-                break;
-            } else {
-                blog(LOG_INFO, "find application window failed.");
-                obs_data_release(setting);
-                emit errorOccurred(Init, QStringLiteral("查找应用窗口失败"));
-                return;
-            }
-        }
-        obs_property_next(&property);
-    }
-    obs_data_release(setting);
-    blog(LOG_INFO, OBS_SEPARATOR);
-
-    // 场景元素放缩
-    obs_scene_enum_items(scene, FindSceneItemAndScale, (void *)this);
-
-    blog(LOG_INFO, OBS_INIT_END);
-
-    emit initialized();
-}
-
-void QtOBSContext::addFilterToSource(obs_source_t *source, const char *id)
-{
-    if (!id || *id == '\0')
-        return;
-
-    obs_source_t *existing_filter;
-    std::string name = obs_source_get_display_name(id);
-    existing_filter = obs_source_get_filter_by_name(source, name.c_str());
-    if (existing_filter) {
-        blog(LOG_WARNING, "filter %s exists.", id);
-        obs_source_release(existing_filter);
-        return;
-    }
-
-    name = std::string(TAG) + id;
-    obs_source_t *filter = obs_source_create(id, name.c_str(), nullptr, nullptr);
-    if (filter) {
-        const char *sourceName = obs_source_get_name(source);
-        blog(LOG_INFO, "add filter '%s' (%s) to source '%s'",
-             name.c_str(), id, sourceName);
-        obs_source_filter_add(source, filter);
-        obs_source_release(filter);
-    }
-}
-
-void QtOBSContext::videoCrop(const QRect &rect)
-{
-    if (!captureSource) return;
-
-    if (rect.isEmpty()) {
-        blog(LOG_WARNING, "source crop rect(%d %d %d %d) is empty.",
-             rect.left(), rect.top(), rect.right(), rect.bottom());
-        return;
-    }
-
-    scaleScene(rect.width(), rect.height());
-
-    bool relative = false;
-    std::string name = TAG VIDEO_CROP_FILTER_ID;
-    obs_source_t *existing_filter =
-            obs_source_get_filter_by_name(captureSource, name.c_str());
-    if (existing_filter) {
-        obs_data_t *settings = obs_source_get_settings(existing_filter);
-        obs_data_set_bool(settings, "relative", relative);
-        obs_data_set_int(settings, "left", rect.left());
-        obs_data_set_int(settings, "top", rect.top());
-        if (relative) {
-            obs_data_set_int(settings, "right", rect.right());
-            obs_data_set_int(settings, "bottom", rect.bottom());
-            blog(LOG_INFO, "update source crop [Left:%d Top:%d Right:%d Bottom:%d]",
-                 rect.left(), rect.top(), rect.right(), rect.bottom());
-        } else {
-            obs_data_set_int(settings, "cx", rect.width());
-            obs_data_set_int(settings, "cy", rect.height());
-            blog(LOG_INFO, "update source crop [Left:%d Top:%d Width:%d Height:%d]",
-                 rect.left(), rect.top(), rect.width(), rect.height());
-        }
-        obs_source_update(existing_filter, settings);
-        obs_data_release(settings);
-        obs_source_release(existing_filter);
-    }
-}
-
-bool QtOBSContext::initService()
-{
-    if (!rtmpService) {
-        rtmpService = obs_service_create("rtmp_custom", TAG "-RtmpService",
-                                         nullptr, nullptr);
-        if (!rtmpService) {
-            blog(LOG_ERROR, "create service failed.");
-            return false;
-        }
-        obs_service_release(rtmpService);
-    }
-    return true;
-}
-
-/**
- * OBS Output 分为 SimpleOutput 和 AdvancedOutput
- * 我们使用 AdvancedOutput，可以进行更多的配置
- * 参见 window-basic-main-outputs.cpp -> AdvancedOutput::AdvancedOutput(...)
- */
-bool QtOBSContext::resetOutputs()
-{
-    if (!streamOutput) {
-        streamOutput = obs_output_create("rtmp_output",
-                                         TAG "-AdvRtmpOutput",
-                                         nullptr, nullptr);
-        if (!streamOutput) {
-            blog(LOG_ERROR, "create stream output failed.");
-            return false;
-        }
-        obs_output_release(streamOutput);
-    }
-
-    if (!recordOutput) {
-        recordOutput = obs_output_create("ffmpeg_output", TAG "-AdvFFmpegOutput",
-                                         nullptr, nullptr);
-        if (!recordOutput) {
-            blog(LOG_ERROR, "create record output failed.");
-            return false;
-        }
-        obs_output_release(recordOutput);
-    }
-
-    if (!h264Streaming) {
-        OBSData streamEncSettings = getStreamEncSettings();
-        h264Streaming = obs_video_encoder_create("obs_x264",
-                                                 TAG "-StreamingH264",
-                                                 streamEncSettings, nullptr);
-        if (!h264Streaming) {
-            blog(LOG_ERROR, "create streaming encoder fail");
-            return false;
-        }
-        obs_encoder_release(h264Streaming);
-
-        // 禁用放缩
-        obs_encoder_set_scaled_size(h264Streaming, 0, 0);
-        obs_encoder_set_video(h264Streaming, obs_get_video());
-        obs_output_set_video_encoder(streamOutput, h264Streaming);
-        obs_service_apply_encoder_settings(rtmpService, streamEncSettings, nullptr);
-        obs_output_set_service(streamOutput, rtmpService);
-    }
-
-    for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
-        std::string name = TAG "-AdvACCTrack";
-        name += std::to_string(i + 1);
-        obs_data_t *setting = obs_data_create();
-        obs_data_set_int(setting, "bitrate", 128);
-        if (!aacTrack[i]) {
-            if (!CreateAACEncoder(aacTrack[i], aacEncoderID[i], name.c_str(), i,
-                                  setting)) {
-                blog(LOG_ERROR, "create audio encoder %d", i);
-                obs_data_release(setting);
-                return false;
-            }
-        }
-        if (i == 0) {
-            obs_service_apply_encoder_settings(rtmpService, nullptr, setting);
-            obs_output_set_audio_encoder(streamOutput, aacTrack[0], 0);
-        }
-        obs_data_release(setting);
-
-        obs_encoder_set_audio(aacTrack[i], obs_get_audio());
-    }
-
-    recordingStarted.Connect(obs_output_get_signal_handler(recordOutput),
-                             "start", RecordingStarted, this);
-    recordingStopping.Connect(obs_output_get_signal_handler(recordOutput),
-                              "stopping", RecordingStopping, this);
-    recordingStopped.Connect(obs_output_get_signal_handler(recordOutput),
-                             "stop", RecordingStopped, this);
-    streamingStarted.Connect(obs_output_get_signal_handler(streamOutput),
-                             "start", StreamingStarted, this);
-    streamingStopping.Connect(obs_output_get_signal_handler(streamOutput),
-                              "stopping", StreamingStopping, this);
-    streamingStopped.Connect(obs_output_get_signal_handler(streamOutput),
-                             "stop", StreamingStopped, this);
-
-    return true;
-}
-
-bool QtOBSContext::resetAudio()
-{
-    struct obs_audio_info oai;
-    oai.samples_per_sec = 44100;
-    oai.speakers        = SPEAKERS_STEREO;
-    return obs_reset_audio(&oai);
-}
-
-int QtOBSContext::resetVideo()
-{
-    struct obs_video_info ovi;
-    ovi.fps_num         = VIDEO_FPS; // 设置帧率，可自行调整
-    ovi.fps_den         = 1;
-    ovi.graphics_module = DL_D3D11;  // Win32 默认使用 Direct3D 11 参见 obs-app.cpp OBSApp::InitGlobalConfigDefaults()
-    ovi.base_width      = this->baseWidth;
-    ovi.base_height     = this->baseHeight;
-    ovi.output_width    = this->outputWidth;
-    ovi.output_height   = this->outputHeight;
-    ovi.output_format   = VIDEO_FORMAT_I420;
-    ovi.colorspace      = VIDEO_CS_601; // 参见 https://obsproject.com/forum/resources/obs-studio-color-space-color-format-color-range-settings-guide-test-charts.442/
-    ovi.range           = VIDEO_RANGE_PARTIAL;
-    ovi.adapter         = 0;         // 显示适配器索引，可自行调整
-    ovi.gpu_conversion  = true;
-    ovi.scale_type      = OBS_SCALE_BICUBIC;
-
-    int ret = obs_reset_video(&ovi);
-
-    if (IS_WIN32 && ret != OBS_VIDEO_SUCCESS) {
-        if (strcmp(ovi.graphics_module, DL_OPENGL) != 0) {
-            blog(LOG_WARNING, "failed to initialize obs video (%d) "
-                              "with graphics_module='%s', retrying "
-                              "with graphics_module='%s'",
-                 ret, ovi.graphics_module, DL_OPENGL);
-            ovi.graphics_module = DL_OPENGL;
-            ret = obs_reset_video(&ovi);
-        }
-    }
-
-    return ret;
-}
-
-void QtOBSContext::resetRecordFilePath(const QString &path)
-{
-    if (filePath) free(filePath);
-    filePath = _strdup(path.toStdString().c_str());
-    blog(LOG_INFO, "reset output file path %s", filePath);
-}
-
-void QtOBSContext::resetStreamLiveUrl(const QString &server,
-                                      const QString &key)
-{
-    if (liveServer) free(liveServer);
-    if (liveKey) free(liveKey);
-    liveServer = _strdup(server.toStdString().c_str());
-    liveKey = _strdup(key.toStdString().c_str());
-    blog(LOG_INFO, "reset output rtmp url %s%s", liveServer, liveKey);
-}
-
-/**
- * @brief 设置音频输入、输出设备
- *        输出设备序号： 1， 2
- *        输入设备序号： 3， 4， 5
- */
-void QtOBSContext::resetAudioInput(const QString &/*deviceId*/,
-                                   const QString &deviceDesc)
-{
-    obs_properties_t *input_props =
-            obs_get_source_properties(INPUT_AUDIO_SOURCE);
-    bool find = false;
-    const char *currentDeviceId = nullptr;
-
-    obs_source_t *source =
-            obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
-    if (source) {
-        obs_data_t *settings = nullptr;
-        settings = obs_source_get_settings(source);
-        if (settings)
-            currentDeviceId = obs_data_get_string(settings, "device_id");
-        obs_data_release(settings);
-        obs_source_release(source);
-    }
-
-    if (input_props) {
-        obs_property_t *inputs = obs_properties_get(input_props, "device_id");
-        size_t count = obs_property_list_item_count(inputs);
-        for (size_t i = 0; i < count; i++) {
-            const char *name = obs_property_list_item_name(inputs, i);
-            const char *id = obs_property_list_item_string(inputs, i);
-            if (QString(name).contains(deviceDesc)) {
-                blog(LOG_INFO, "reset audio input use %s", name);
-                ResetAudioDevice(INPUT_AUDIO_SOURCE, id, name,
-                                 SOURCE_CHANNEL_AUDIO_INPUT);
-                find = true;
-                break;
-            }
-        }
-        obs_properties_destroy(input_props);
-    }
-
-    if (!find) {
-        if (QString(currentDeviceId) != "default") {
-            blog(LOG_INFO, "reset audio input use \"default\"");
-            ResetAudioDevice(INPUT_AUDIO_SOURCE, "default",
-                             TAG " Default Mic/Aux",
-                             SOURCE_CHANNEL_AUDIO_INPUT);
-        }
-    }
-
-    AddFilterToAudioInput("noise_suppress_filter");
-}
-
-void QtOBSContext::resetAudioOutput(const QString &/*deviceId*/,
-                                    const QString &deviceDesc)
-{
-    obs_properties_t *output_props =
-            obs_get_source_properties(OUTPUT_AUDIO_SOURCE);
-    bool find = false;
-    const char *currentDeviceId = nullptr;
-
-    obs_source_t *source =
-            obs_get_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT);
-    if (source) {
-        obs_data_t *settings = nullptr;
-        settings = obs_source_get_settings(source);
-        if (settings)
-            currentDeviceId = obs_data_get_string(settings, "device_id");
-        obs_data_release(settings);
-        obs_source_release(source);
-    }
-
-    if (output_props) {
-        obs_property_t *outputs = obs_properties_get(output_props, "device_id");
-        size_t count = obs_property_list_item_count(outputs);
-        for (size_t i = 0; i < count; i++) {
-            const char *name = obs_property_list_item_name(outputs, i);
-            const char *id = obs_property_list_item_string(outputs, i);
-            if (QString(name).contains(deviceDesc)) {
-                blog(LOG_INFO, "reset audio output use %s.", name);
-                ResetAudioDevice(OUTPUT_AUDIO_SOURCE, id, name,
-                                 SOURCE_CHANNEL_AUDIO_OUTPUT);
-                find = true;
-                break;
-            }
-        }
-        obs_properties_destroy(output_props);
-    }
-
-    if (!find) {
-        if (QString(currentDeviceId) != "default") {
-            blog(LOG_INFO, "reset audio output use \"default\".");
-            ResetAudioDevice(OUTPUT_AUDIO_SOURCE, "default",
-                             TAG " Default Desktop Audio",
-                             SOURCE_CHANNEL_AUDIO_OUTPUT);
-        }
-    }
-}
-
-static void AudioDownmixMono(obs_source_t *source, bool enable)
-{
-    if (!source) return;
-
-    uint32_t flags = obs_source_get_flags(source);
-    bool forceMonoActive = (flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0;
-    blog(LOG_INFO, "audio force mono %d", forceMonoActive);
-    if (forceMonoActive != enable) {
-        if (enable)
-            flags |= OBS_SOURCE_FLAG_FORCE_MONO;
-        else
-            flags &= ~OBS_SOURCE_FLAG_FORCE_MONO;
-        obs_source_set_flags(source, flags);
-    }
-}
-
-void QtOBSContext::downmixMonoInput(bool enable)
-{
-    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
-    if (source) {
-        AudioDownmixMono(source, enable);
-        obs_source_release(source);
-    }
-}
-
-void QtOBSContext::downmixMonoOutput(bool enable)
-{
-    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT);
-    if (source) {
-        AudioDownmixMono(source, enable);
-        obs_source_release(source);
-    }
-}
-
-void QtOBSContext::muteAudioInput(bool mute)
-{
-    obs_source_t *source =
-            obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
-    if (source) {
-        bool old = obs_source_muted(source);
-        //        if (old != mute) {
-        blog(LOG_INFO, "mute audio input from:%d to:%d", old, mute);
-        obs_source_set_muted(source, mute);
-        //        }
-        obs_source_release(source);
-    }
-}
-
-void QtOBSContext::muteAudioOutput(bool mute)
-{
-    obs_source_t *source =
-            obs_get_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT);
-    if (source) {
-        bool old = obs_source_muted(source);
-        //        if (old != mute) {
-        blog(LOG_INFO, "mute audio output from:%d to:%d.", old, mute);
-        obs_source_set_muted(source, mute);
-        //        }
-        obs_source_release(source);
-    }
-}
-
-OBSData QtOBSContext::getStreamEncSettings()
-{
-    obs_data_t *settings = obs_data_create();
-    obs_data_set_string(settings, "preset", "medium");
-    obs_data_set_string(settings, "tune", "stillimage");
-    obs_data_set_string(settings, "x264opts", "");
-    obs_data_set_bool(settings, "vfr", false);
-    obs_data_set_string(settings, "rate_control", "CRF");
-    obs_data_set_int(settings, "crf", 22);            // 23 标准值，值越小码率越大，文件越大
-    obs_data_set_string(settings, "profile", "main");
-    obs_data_set_int(settings, "keyint_sec", 10);
-
-    OBSData dataRet(settings);
-    obs_data_release(settings);
-    return dataRet;
-}
-
-bool QtOBSContext::setupRecord()
-{
-    obs_data_t *settings = obs_data_create();
-
-    obs_data_set_string(settings, "url", filePath);
-    obs_data_set_string(settings, "format_name", RECORD_OUTPUT_FORMAT);
-    obs_data_set_string(settings, "format_mime_type", RECORD_OUTPUT_FORMAT_MIME);
-    obs_data_set_string(settings, "muxer_settings", "movflags=faststart"); // moov 前置
-    obs_data_set_int(settings, "gop_size", VIDEO_FPS * 10);
-    obs_data_set_string(settings, "video_encoder", VIDEO_ENCODER_NAME);
-    obs_data_set_int(settings, "video_encoder_id", VIDEO_ENCODER_ID);
-    if (VIDEO_ENCODER_ID == AV_CODEC_ID_H264)
-        obs_data_set_string(settings, "video_settings", "profile=main x264-params=crf=22");
-    else if (VIDEO_ENCODER_ID == AV_CODEC_ID_FLV1)
-        obs_data_set_int(settings, "video_bitrate", VIDEO_BITRATE);
-    obs_data_set_int(settings, "audio_bitrate", AUDIO_BITRATE);
-    obs_data_set_string(settings, "audio_encoder", "aac");
-    obs_data_set_int(settings, "audio_encoder_id", AV_CODEC_ID_AAC);
-    obs_data_set_string(settings, "audio_settings", NULL);
-
-    obs_data_set_int(settings, "scale_width", outputWidth);
-    obs_data_set_int(settings, "scale_height", outputHeight);
-
-    //obs_output_set_mixer(fileOutput, 0);
-    obs_output_set_media(recordOutput, obs_get_video(), obs_get_audio());
-    obs_output_update(recordOutput, settings);
-
-    obs_data_release(settings);
-
-    return true;
-}
-
-bool QtOBSContext::setupStream()
-{
-    OBSData settings = obs_data_create();
-    obs_data_release(settings);
-
-    obs_data_set_string(settings, "server", liveServer);
-    obs_data_set_string(settings, "key", liveKey);
-    obs_data_set_bool(settings, "use_auth", false);
-    obs_service_update(rtmpService, settings);
-
-    obs_output_set_reconnect_settings(streamOutput, 0, 0);
-
-    return true;
-}
-
-void QtOBSContext::startRecord(const QString &output)
-{
-    if (output.isEmpty()) {
-        blog(LOG_ERROR, "record parameter invalid, outputPath=%s.",
-             output.toStdString().c_str());
-        emit errorOccurred(Record, QStringLiteral("参数错误"));
-        return;
-    }
-
-    if (QString(filePath).compare(output) != 0) {
-        if (filePath) free(filePath);
-        filePath = _strdup(output.toStdString().c_str());
-        blog(LOG_INFO, "record output file path %s", filePath);
-    }
-
-    setupRecord();
-
-    if (!obs_output_start(recordOutput)) {
-        blog(LOG_ERROR, "record start fail");
-        emit errorOccurred(Record, QStringLiteral("启动失败"));
-        return;
-    }
-}
-
-void QtOBSContext::stopRecord(bool force)
-{
-    if (obs_output_active(recordOutput)) {
-        if (force) {
-            obs_output_force_stop(recordOutput);
-        } else {
-            obs_output_stop(recordOutput);
-        }
-    }
-}
-
-void QtOBSContext::startStream(const QString &server, const QString &key)
-{
-    if (server.isEmpty() || key.isEmpty()) {
-        blog(LOG_ERROR, "stream parameter invalid, server=%s, key=%s",
-             server.toStdString().c_str(), key.toStdString().c_str());
-        emit errorOccurred(Stream, QStringLiteral("参数错误"));
-        return;
-    }
-
-    if (QString(liveServer).compare(server) != 0 ||
-            QString(liveKey).compare(key) != 0) {
-        if (liveServer) free(liveServer);
-        if (liveKey) free(liveKey);
-        liveServer = _strdup(server.toStdString().c_str());
-        liveKey = _strdup(key.toStdString().c_str());
-        blog(LOG_INFO, "stream url server:%s key:%s", liveServer, liveKey);
-    }
-
-    setupStream();
-
-    if (!obs_output_start(streamOutput)) {
-        blog(LOG_ERROR, "stream start fail");
-        emit errorOccurred(Stream, QStringLiteral("启动失败"));
-        return;
-    }
-
-    if (recordWhenStreaming)
-        startRecord(QString(filePath));
-
-    firstTotal = obs_output_get_total_frames(streamOutput);
-    firstDropped = obs_output_get_frames_dropped(streamOutput);
-    blog(LOG_INFO, "first total:%d, dropped:%d", firstTotal, firstDropped);
-}
-
-void QtOBSContext::stopStream(bool force)
-{
-    if (obs_output_active(streamOutput)) {
-        if (force) {
-            obs_output_force_stop(streamOutput);
-        } else {
-            obs_output_stop(streamOutput);
-        }
-    }
-
-    if (recordWhenStreaming)
-        stopRecord(force);
-}
-
-void QtOBSContext::updateVideoSettings(bool cursor, bool compatibility,
-                                       bool useWildcards)
-{
-    if (!captureSource) return;
-
-    blog(LOG_INFO, "update source cursor=%d, compatibility=%d, "
-                   "use_wildcards=%d", cursor, compatibility, useWildcards);
-    obs_data_t *settings = obs_source_get_settings(captureSource);
-    obs_data_set_bool(settings, "cursor", cursor);
-    obs_data_set_bool(settings, "compatibility", compatibility);
-    obs_data_set_bool(settings, "use_wildcards", useWildcards);
-    obs_source_update(captureSource, settings);
-    obs_data_release(settings);
-}
-
-void QtOBSContext::scaleScene(int w, int h)
-{
-    if (orgWidth == w && orgHeight == h)
-        return;
-
-    orgWidth = w;
-    orgHeight = h;
-    if (scene) {
-        obs_scene_enum_items(scene, FindSceneItemAndScale, (void *)this);
-        blog(LOG_INFO, "scale scene to %dx%d.", w, h);
-    }
-}
-
-void QtOBSContext::logStreamStats()
-{
-    if (!streamOutput) return;
-
-    uint64_t totalBytes = obs_output_get_total_bytes(streamOutput);
-    uint64_t curTime = os_gettime_ns();
-    uint64_t bytesSent = totalBytes;
-
-    if (bytesSent < lastBytesSent)
-        bytesSent = 0;
-    if (bytesSent == 0)
-        lastBytesSent = 0;
-
-    uint64_t bitsBetween = (bytesSent - lastBytesSent) * 8;
-    long double timePassed = (long double)(curTime - lastBytesSentTime) /
-                             1000000000.0l;
-    long double kbps = (long double)bitsBetween /
-                       timePassed / 1000.0l;
-
-    if (timePassed < 0.01l)
-        kbps = 0.0l;
-
-    long double num = 0;
-    int total = obs_output_get_total_frames(streamOutput);
-    int dropped = obs_output_get_frames_dropped(streamOutput);
-    if (total < firstTotal || dropped < firstDropped) {
-        firstTotal   = 0;
-        firstDropped = 0;
-    }
-    total   -= firstTotal;
-    dropped -= firstDropped;
-    num = total ? (long double)dropped / (long double)total * 100.0l : 0.0l;
-
-    blog(LOG_INFO, "obs stream stat, bitrate:%.2lf kb/s, frames:%d / %d (%.2lf%%)",
-         kbps, dropped, total, num);
-
-    lastBytesSent     = bytesSent;
-    lastBytesSentTime = curTime;
-}
+﻿#include "obs-wrapper.h"
+
+#ifdef _WIN32
+#define IS_WIN32 1
+#include <windows.h>
+#include <shellapi.h>
+#include <shlobj.h>
+#include <Dwmapi.h>
+#include <psapi.h>
+#include <mmdeviceapi.h>
+#include <audiopolicy.h>
+// obs headers
+#include <util/windows/WinHandle.hpp>
+#include <util/windows/HRError.hpp>
+#include <util/windows/ComPtr.hpp>
+#include <util/windows/win-version.h>
+
+#pragma comment(lib, "ole32.lib")
+
+#else
+#define IS_WIN32 0
+#endif
+
+// obs headers
+#include <util/util.hpp>
+#include <util/platform.h>
+#include <libavcodec/avcodec.h>
+
+#include "obs-profiler-stats.h"
+#include "obs-llhls-output.h"
+#include "obs-block-file-output.h"
+#include "obs-block-writer.h"
+#include "obs-encoder-probe.h"
+#include "obs-packet-sink.h"
+#include "obs-vad-filter.h"
+#include "obs-event-bus.h"
+#include "obs-flight-recorder.h"
+#include "obs-raw-capture.h"
+#include "obs-rd-bench.h"
+#include "obs-av-sync.h"
+#include "obs-roi-encoder.h"
+#include "obs-init-graph.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QFileInfo>
+#include <QSysInfo>
+#include <QtWin>
+#include <QSize>
+#include <QDir>
+#include <QDateTime>
+
+#include <QDebug>
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <thread>
+
+#define DL_OPENGL "libobs-opengl.dll"
+#define DL_D3D11  "libobs-d3d11.dll"
+
+#define TAG "QtOBS"
+
+#define INPUT_AUDIO_SOURCE  "wasapi_input_capture"
+#define OUTPUT_AUDIO_SOURCE "wasapi_output_capture"
+
+enum SourceChannels {
+    SOURCE_CHANNEL_TRANSITION     = 0, // 淡入淡出
+    SOURCE_CHANNEL_AUDIO_OUTPUT      , // 桌面音频设备
+    SOURCE_CHANNEL_AUDIO_OUTPUT_2    , // 桌面音频设备 2
+    SOURCE_CHANNEL_AUDIO_INPUT       , // 麦克风/辅助音频设备
+    SOURCE_CHANNEL_AUDIO_INPUT_2     , // 麦克风/辅助音频设备 2
+    SOURCE_CHANNEL_AUDIO_INPUT_3     , // 麦克风/辅助音频设备 3
+};
+
+#define AUDIO_BITRATE 128 // kb/s
+#define VIDEO_BITRATE 150 // kb/s 用于输出 FLV 格式视频，可自行调整
+
+#define VIDEO_CROP_FILTER_ID "crop_filter"
+
+#define CAPTURE_WINDOW_PRIORITY_EXE 2     // win-capture window-helpers.h -> WINDOW_PRIORITY_EXE
+#define WINDOW_CHECK_INTERVAL_MS    100   // 窗口事件的合并间隔
+#define WINDOW_POLL_INTERVAL_MS     1000  // 没有窗口事件时的兜底检查间隔
+#define FLIGHT_RECORDER_MINUTES     10    // 飞行记录器保留的时长
+#define FLIGHT_RECORDER_RATE        32    // 预计每秒的日志和事件数，指标另有自己的环
+#define FLIGHT_SAMPLE_INTERVAL_MS   1000
+#define IDLE_CHECK_INTERVAL_MS      1000
+#define TAP_DROP_LOG_INTERVAL_NS    5000000000ULL
+#define RESET_BENCH_TIMEOUT_MS      10000 // benchmarkReset 等待录制开始/停止
+#define VIDEO_FPS            15
+
+#if OUTPUT_FLV
+#define VIDEO_ENCODER_ID           AV_CODEC_ID_FLV1
+#define VIDEO_ENCODER_NAME         "flv"
+#define RECORD_OUTPUT_FORMAT       "flv"
+#define RECORD_OUTPUT_FORMAT_MIME  "video/x-flv"
+#else
+#define VIDEO_ENCODER_ID           AV_CODEC_ID_H264
+#define VIDEO_ENCODER_NAME         "libx264"
+#define RECORD_OUTPUT_FORMAT       "mp4"
+#define RECORD_OUTPUT_FORMAT_MIME  "video/mp4"
+#endif
+
+static const double scaled_vals[] =
+{
+    1.0,
+    1.25,
+    (1.0 / 0.75),
+    1.5,
+    (1.0 / 0.6),
+    1.75,
+    2.0,
+    2.25,
+    2.5,
+    2.75,
+    3.0,
+    0.0
+};
+
+static log_handler_t DefLogHandler;
+
+// 日志回调在任意线程执行，同时写入飞行记录器
+static std::atomic<FlightRecorder *> activeFlightRecorder(nullptr);
+
+#ifdef _WIN32
+static bool DisableAudioDucking(bool disable)
+{
+    ComPtr<IMMDeviceEnumerator>   devEnum;
+    ComPtr<IMMDevice>             device;
+    ComPtr<IAudioSessionManager2> sessionManager2;
+    ComPtr<IAudioSessionControl>  sessionControl;
+    ComPtr<IAudioSessionControl2> sessionControl2;
+
+    HRESULT result = CoCreateInstance(__uuidof(MMDeviceEnumerator),
+                                      nullptr, CLSCTX_INPROC_SERVER,
+                                      __uuidof(IMMDeviceEnumerator),
+                                      (void **)&devEnum);
+    if (FAILED(result))
+        return false;
+
+    result = devEnum->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+    if (FAILED(result))
+        return false;
+
+    result = device->Activate(__uuidof(IAudioSessionManager2),
+                              CLSCTX_INPROC_SERVER, nullptr,
+                              (void **)&sessionManager2);
+    if (FAILED(result))
+        return false;
+
+    result = sessionManager2->GetAudioSessionControl(nullptr, 0,
+                                                     &sessionControl);
+    if (FAILED(result))
+        return false;
+
+    result = sessionControl->QueryInterface(&sessionControl2);
+    if (FAILED(result))
+        return false;
+
+    result = sessionControl2->SetDuckingPreference(disable);
+    return SUCCEEDED(result);
+}
+
+static void SetAeroEnabled(bool enable)
+{
+    static HRESULT(WINAPI *func)(UINT) = nullptr;
+    static bool failed = false;
+
+    if (!func) {
+        if (failed)
+            return;
+
+        HMODULE dwm = LoadLibraryW(L"dwmapi");
+        if (!dwm) {
+            failed = true;
+            return;
+        }
+
+        func = reinterpret_cast<decltype(func)>(GetProcAddress(dwm,
+                                                               "DwmEnableComposition"));
+        if (!func) {
+            failed = true;
+            return;
+        }
+    }
+
+    func(enable ? DWM_EC_ENABLECOMPOSITION : DWM_EC_DISABLECOMPOSITION);
+}
+
+static uint32_t GetWindowsVersion()
+{
+    static uint32_t ver = 0;
+
+    if (ver == 0) {
+        struct win_version_info ver_info;
+
+        get_win_ver(&ver_info);
+        ver = (ver_info.major << 8) | ver_info.minor;
+    }
+
+    return ver;
+}
+#endif
+
+static void LogHandler(int level, const char *format, va_list args, void *param)
+{
+    Q_UNUSED(level);
+    Q_UNUSED(param);
+
+    char str[4096];
+    vsnprintf(str, sizeof(str), format, args);
+
+    FlightRecorder *recorder = activeFlightRecorder.load();
+    if (recorder)
+        recorder->writeLog(level, str);
+
+    qInfo().noquote() << TAG << str;
+}
+
+static void AddFilterToAudioInput(const char *id)
+{
+    if (id == nullptr || *id == '\0')
+        return;
+
+    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
+    if (!source)
+        return;
+
+    obs_source_t *existing_filter;
+    std::string name = obs_source_get_display_name(id);
+    if (name.empty())
+        name = id;
+    existing_filter = obs_source_get_filter_by_name(source, name.c_str());
+    if (existing_filter) {
+        obs_source_release(existing_filter);
+        obs_source_release(source);
+        return;
+    }
+
+    obs_source_t *filter = obs_source_create(id, name.c_str(), nullptr, nullptr);
+    if (filter) {
+        const char *sourceName = obs_source_get_name(source);
+
+        blog(LOG_INFO, "added filter '%s' (%s) to source '%s'", name.c_str(),
+             id, sourceName);
+
+        obs_source_filter_add(source, filter);
+        obs_source_release(filter);
+    }
+
+    obs_source_release(source);
+}
+
+// 按 AddFilterToAudioInput 的命名规则查找滤镜，返回值需要 release
+static obs_source_t *GetAudioInputFilter(obs_source_t *source, const char *id)
+{
+    std::string name = obs_source_get_display_name(id);
+    if (name.empty())
+        name = id;
+    return obs_source_get_filter_by_name(source, name.c_str());
+}
+
+static std::string GetAudioDeviceId(int channel)
+{
+    std::string id;
+    obs_source_t *source = obs_get_output_source(channel);
+    if (source) {
+        obs_data_t *settings = obs_source_get_settings(source);
+        if (settings)
+            id = obs_data_get_string(settings, "device_id");
+        obs_data_release(settings);
+        obs_source_release(source);
+    }
+    return id;
+}
+
+static void ResetAudioDevice(const char *sourceId, const char *deviceId,
+                             const char *deviceDesc, int channel)
+{
+    bool disable = deviceId && strcmp(deviceId, "disabled") == 0;
+    obs_source_t *source;
+    obs_data_t *settings;
+
+    source = obs_get_output_source(channel);
+    if (source) {
+        if (disable) {
+            obs_set_output_source(channel, nullptr);
+        } else {
+            settings = obs_source_get_settings(source);
+            const char *oldId = obs_data_get_string(settings,
+                                                    "device_id");
+            if (strcmp(oldId, deviceId) != 0) {
+                obs_data_set_string(settings, "device_id",
+                                    deviceId);
+            }
+            obs_data_set_bool(settings, "use_device_timing", false);
+            obs_source_update(source, settings);
+            obs_data_release(settings);
+        }
+
+    } else if (!disable) {
+        settings = obs_data_create();
+        obs_data_set_string(settings, "device_id", deviceId);
+        obs_data_set_bool(settings, "use_device_timing", false);
+        source = obs_source_create(sourceId, deviceDesc, settings, nullptr);
+        obs_data_release(settings);
+
+        obs_set_output_source(channel, source);
+    }
+
+    obs_source_release(source);
+}
+
+static bool CreateAACEncoder(OBSEncoder &res, std::string &id,
+                             const char *encoderId, const char *name,
+                             size_t idx, obs_data_t *setting)
+{
+    /*
+    static const string encoders[] = {
+        "ffmpeg_aac",
+        "mf_aac",
+        "libfdk_aac",
+        "CoreAudio_AAC",
+    };
+    */
+    const char *id_ = encoderId && *encoderId ? encoderId : "ffmpeg_aac";
+    id = id_;
+    res = obs_audio_encoder_create(id_, name, setting, idx, nullptr);
+
+    if (res) {
+        obs_encoder_release(res);
+        return true;
+    }
+
+    return false;
+}
+
+static void AddSource(void *_data, obs_scene_t *scene)
+{
+    // 为这个 source 创建一个 scene item
+    obs_source_t *source = (obs_source_t *)_data;
+    obs_scene_add(scene, source);
+    obs_source_release(source);
+}
+
+static bool FindSceneItemAndScale(obs_scene_t *scene, obs_sceneitem_t *item,
+                                  void *param)
+{
+    Q_UNUSED(scene);
+
+    // 只处理 captureSource 对应的 scene item，多源布局的 item 由 SceneLayout 摆放
+    QtOBSContext *obs = static_cast<QtOBSContext *>(param);
+    if (obs_sceneitem_get_source(item) != obs->getCaptureSource())
+        return true;
+    QSize baseSize = obs->getBaseSize(), orgSize = obs->getOriginalSize();
+
+    float width = baseSize.width();
+    float height = baseSize.height();
+    float sratio = height / orgSize.height();
+    bool align_width = false;
+    float base_ratio = baseSize.width() * 1.f / baseSize.height();
+    float orginal_ratio = orgSize.width() * 1.f / orgSize.height();
+    if (base_ratio >= orginal_ratio)
+        width = height * orginal_ratio;
+    else {
+        height = width / orginal_ratio;
+        sratio = width / orgSize.width();
+        align_width = true;
+    }
+
+    vec2 scale;
+    scale.x = scale.y = sratio;
+    obs_sceneitem_set_scale(item, &scale);
+
+    vec2 pos;
+    if (align_width)
+        vec2_set(&pos, 0, (baseSize.height() - height) / 2);
+    else
+        vec2_set(&pos, (baseSize.width() - width) / 2, 0);
+    obs_sceneitem_set_pos(item, &pos);
+
+    blog(LOG_INFO, "scene scale %f %f.", scale.x, scale.y);
+    return true;
+}
+
+// 所有输出和 raw 回调的启动最终都连接到 libobs 的视频/音频输出，在这里统一恢复空闲暂停
+static void IdleTick(void *param, float seconds)
+{
+    Q_UNUSED(seconds);
+    QtOBSContext *obs = static_cast<QtOBSContext *>(param);
+    obs->idleTick();
+}
+
+#define RECORDING_STARTED \
+    "==== Recording Started ==============================================="
+#define RECORDING_STOPPING \
+    "==== Recording Stopping ================================================"
+#define RECORDING_STOPPED \
+    "==== Recording Stopped ================================================"
+#define STREAMING_STARTED \
+    "==== Streaming Started ==============================================="
+#define STREAMING_STOPPING \
+    "==== Streaming Stopping ================================================"
+#define STREAMING_STOPPED \
+    "==== Streaming Stopped ================================================"
+/* 事件总线上的事件分类，见 handleEvents */
+enum OutputEventChannel {
+    RecordChannel,
+    StreamChannel,
+    HLSChannel,
+    BlockChannel,
+    TapChannel      // OBSEvent::Stats，raw tap 丢帧
+};
+
+static void PostOutputEvent(void *data, calldata_t *params, int type,
+                            int channel)
+{
+    QtOBSContext *handler = static_cast<QtOBSContext *>(data);
+    OBSEvent event;
+    OBSEventBus::FromOutputSignal(event, type, channel, params);
+
+    // 错误先在输出线程写入飞行记录器，即使之后进程崩溃也能保留
+    FlightRecorder *recorder = activeFlightRecorder.load();
+    if (recorder && type == OBSEvent::OutputStopped &&
+            event.code != OBS_OUTPUT_SUCCESS)
+        recorder->writeEvent(event.code, event.outputId, event.lastError);
+
+    handler->eventBus()->post(event);
+}
+
+static void RecordingStarted(void *data, calldata_t *params)
+{
+    blog(LOG_INFO, RECORDING_STARTED);
+    PostOutputEvent(data, params, OBSEvent::OutputStarted, RecordChannel);
+}
+
+static void RecordingStopping(void *data, calldata_t *params)
+{
+    blog(LOG_INFO, RECORDING_STOPPING);
+    PostOutputEvent(data, params, OBSEvent::OutputStopping, RecordChannel);
+}
+
+static void RecordingStopped(void *data, calldata_t *params)
+{
+    blog(LOG_INFO, RECORDING_STOPPED);
+
+    int code = (int)calldata_int(params, "code");
+    if (code == OBS_OUTPUT_SUCCESS)
+        blog(LOG_INFO, "recording finished!");
+    else
+        blog(LOG_ERROR, "record error, code=%d,error=%s", code,
+             calldata_string(params, "last_error"));
+
+    PostOutputEvent(data, params, OBSEvent::OutputStopped, RecordChannel);
+}
+
+static void StreamingStarted(void *data, calldata_t *params)
+{
+    blog(LOG_INFO, STREAMING_STARTED);
+    PostOutputEvent(data, params, OBSEvent::OutputStarted, StreamChannel);
+}
+
+static void StreamingStopping(void *data, calldata_t *params)
+{
+    blog(LOG_INFO, STREAMING_STOPPING);
+    PostOutputEvent(data, params, OBSEvent::OutputStopping, StreamChannel);
+}
+
+static void StreamingStopped(void *data, calldata_t *params)
+{
+    blog(LOG_INFO, STREAMING_STOPPED);
+
+    int code = (int)calldata_int(params, "code");
+    if (code == OBS_OUTPUT_SUCCESS)
+        blog(LOG_INFO, "streaming finished!");
+    else
+        blog(LOG_ERROR, "stream error, code=%d,error=%s", code,
+             calldata_string(params, "last_error"));
+
+    PostOutputEvent(data, params, OBSEvent::OutputStopped, StreamChannel);
+}
+
+static void HLSStopped(void *data, calldata_t *params)
+{
+    int code = (int)calldata_int(params, "code");
+    if (code == OBS_OUTPUT_SUCCESS) {
+        blog(LOG_INFO, "hls finished!");
+        return;
+    }
+
+    blog(LOG_ERROR, "hls error, code=%d,error=%s", code,
+         calldata_string(params, "last_error"));
+    PostOutputEvent(data, params, OBSEvent::OutputStopped, HLSChannel);
+}
+
+static void BlockStopped(void *data, calldata_t *params)
+{
+    int code = (int)calldata_int(params, "code");
+    if (code == OBS_OUTPUT_SUCCESS) {
+        blog(LOG_INFO, "block record finished!");
+        return;
+    }
+
+    // 块写入器的 NO_SPACE / I/O 错误只能通过 stop 信号得知
+    blog(LOG_ERROR, "block record error, code=%d,error=%s", code,
+         calldata_string(params, "last_error"));
+    PostOutputEvent(data, params, OBSEvent::OutputStopped, BlockChannel);
+}
+
+// 输出线程中逐帧调用，不唤醒 Qt 线程，由事件总线定时取出
+static void RawTapDropped(void *data, const char *name, bool video,
+                          uint64_t seq, uint64_t dropped)
+{
+    QtOBSContext *handler = static_cast<QtOBSContext *>(data);
+    OBSEvent event;
+    event.type     = OBSEvent::Stats;
+    event.channel  = TapChannel;
+    event.value[0] = video ? 1 : 0;
+    event.value[1] = (int64_t)seq;
+    event.value[2] = (int64_t)dropped;
+    snprintf(event.outputId, sizeof(event.outputId), "%s", name);
+    handler->eventBus()->post(event, false);
+}
+
+static QString RecordErrorMessage(int code)
+{
+    switch (code)
+    {
+    case OBS_OUTPUT_SUCCESS:
+        return QString();
+    case OBS_OUTPUT_NO_SPACE:
+        return "磁盘存储空间不足！";
+    case OBS_OUTPUT_UNSUPPORTED:
+        return "格式不支持！";
+    default:
+        return QString("发生未指定错误 (Code:%1)！").arg(code);
+    }
+}
+
+static QString StreamErrorMessage(int code)
+{
+    switch (code)
+    {
+    case OBS_OUTPUT_SUCCESS:
+        return QString();
+    case OBS_OUTPUT_BAD_PATH:
+        return "无效的地址！";
+    case OBS_OUTPUT_CONNECT_FAILED:
+        return "无法连接到服务器！";
+    case OBS_OUTPUT_INVALID_STREAM:
+        return "无法访问流密钥或无法连接服务器！";
+    case OBS_OUTPUT_ERROR:
+        return "连接服务器时发生意外错误！";
+    case OBS_OUTPUT_DISCONNECTED:
+        return "已与服务器断开连接！";
+    default:
+        return QString("发生未指定错误 (Code:%1)！").arg(code);
+    }
+}
+
+#define OBS_INIT_BEGIN \
+    "==== OBS Init Begin ==============================================="
+#define OBS_INIT_END \
+    "==== OBS Init End ==============================================="
+#define OBS_STARTUP_SEPARATOR \
+    "==== OBS Start Complete ==============================================="
+#define OBS_RELEASE_BEGIN_SEPARATOR \
+    "==== OBS Release Begin ==============================================="
+#define OBS_RELEASE_END_SEPARATOR \
+    "==== OBS Release End ==============================================="
+#define OBS_SEPARATOR "---------------------------------------------"
+
+QtOBSContext::QtOBSContext(QObject *parent) : QObject(parent),
+    filePath(nullptr),
+    liveServer(nullptr),
+    liveKey(nullptr),
+    rtmpService(nullptr),
+    recordOutput(nullptr),
+    streamOutput(nullptr),
+    hlsOutput(nullptr),
+    blockOutput(nullptr),
+    h264Streaming(nullptr),
+    videoEncoderId("obs_x264"),
+    videoEncoderPreset("medium"),
+    audioEncoderId("ffmpeg_aac"),
+    noiseSuppressionMode(NoiseSuppressionAlways),
+    audioFormatMode(AudioFormatFixed),
+    avSyncCorrect(false),
+    avSyncThresholdMs(20),
+    roiMode(ROI_MODE_OFF),
+    initGraph(nullptr),
+    coldStartupNs(0),
+    videoPathReady(false),
+    scene(nullptr),
+    fadeTransition(nullptr),
+    captureSource(nullptr),
+    properties(nullptr),
+    layoutBenchTimer(nullptr),
+    layoutBench(),
+    rawCapture(rawTaps),
+    snapshots(nullptr),
+    events(nullptr),
+    lastTapDropLogNs(0),
+    idleTimer(nullptr),
+    idleEnabled(false),
+    idleGraceMs(5000),
+    idleSuspended(false),
+    idleSinceNs(0),
+    lastIdleCheckNs(0),
+    idleCpu(nullptr),
+    idleStats(),
+    flightTimer(nullptr),
+    cpuUsage(nullptr),
+    postProcess(nullptr),
+    postProcessTypes(0),
+    lastLaggedFrames(0),
+    lastSkippedFrames(0),
+    windowTimer(nullptr),
+    windowDirty(false),
+    windowDirtyNs(0),
+    lastWindowCheckNs(0),
+    windowEnumUs(0),
+    recordWhenStreaming(false)
+{
+#ifdef _WIN32
+    DisableAudioDucking(true);
+#endif
+    qRegisterMetaType<RenditionConfig>("RenditionConfig");
+    qRegisterMetaType<QList<RenditionConfig>>("QList<RenditionConfig>");
+    qRegisterMetaType<LayoutSourceConfig>("LayoutSourceConfig");
+    qRegisterMetaType<QList<LayoutSourceConfig>>("QList<LayoutSourceConfig>");
+    qRegisterMetaType<QList<QRect>>("QList<QRect>");
+
+    snapshots = new SnapshotGenerator(rawTaps, this);
+    connect(snapshots, &SnapshotGenerator::thumbnailReady,
+            this,      &QtOBSContext::thumbnailReady);
+
+    events = new OBSEventBus(1024, 100, this);
+    connect(events, &OBSEventBus::eventsReady,
+            this,   &QtOBSContext::handleEvents);
+    rawTaps.setDropHandler(RawTapDropped, this);
+
+    postProcess = new PostProcessQueue(this);
+    connect(this, &QtOBSContext::recordStopped, this, [this] () {
+        if (postProcessTypes && filePath)
+            postProcess->enqueue(QString::fromUtf8(filePath), postProcessTypes);
+    });
+
+    // 编码耗时等统计依赖 libobs profiler，必须在 obs_startup 之前启动
+    StartProfiler();
+    for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+        aacTrack[i] = nullptr;
+    base_get_log_handler(&DefLogHandler, nullptr);
+    base_set_log_handler(LogHandler, nullptr);
+}
+
+QtOBSContext::~QtOBSContext()
+{
+#ifdef _WIN32
+    DisableAudioDucking(false);
+#endif
+
+    if (obs_initialized())
+        release();
+
+    // 依赖 rawTaps，需要在成员析构前删除
+    delete snapshots;
+    snapshots = nullptr;
+
+    audioDevices.reset();
+
+    obs_shutdown();
+    StopProfiler();
+
+    if (cpuUsage)
+        os_cpu_usage_info_destroy(cpuUsage);
+    cpuUsage = nullptr;
+    if (idleCpu)
+        os_cpu_usage_info_destroy(idleCpu);
+    idleCpu = nullptr;
+
+    blog(LOG_INFO, "memory leaks: %ld", bnum_allocs());
+    activeFlightRecorder.store(nullptr);
+    flight.close();
+    base_set_log_handler(nullptr, nullptr);
+}
+
+void QtOBSContext::release()
+{
+    blog(LOG_INFO, OBS_RELEASE_BEGIN_SEPARATOR);
+
+    // 让出事件循环后尚未运行的初始化步骤不再运行
+    if (initGraph)
+        initGraph->cancel();
+
+    disconnectOutputSignals();
+
+    inputMeter.detach();
+    outputMeter.detach();
+
+    windowResolver.stopEvents();
+    if (windowTimer && windowTimer->thread() == QThread::currentThread())
+        windowTimer->stop();
+    if (flightTimer && flightTimer->thread() == QThread::currentThread())
+        flightTimer->stop();
+    if (idleTimer && idleTimer->thread() == QThread::currentThread())
+        idleTimer->stop();
+    if (layoutBenchTimer && layoutBenchTimer->isActive()) {
+        layoutBenchTimer->stop();
+        blog(LOG_INFO, "scene layout benchmark aborted");
+    }
+    layoutBench = LayoutBench();
+    logIdleStats();
+    obs_remove_tick_callback(IdleTick, this);
+    resumeIdle();
+
+    for (Rendition &r : renditions) {
+        r.output  = nullptr;
+        r.encoder = nullptr;
+    }
+
+    stopFrameExport();
+    logSnapshotStats();
+    snapshots->stop();
+    stopRawCapture();
+    rawTaps.removeAll();
+    stopReplay();
+
+    // 在场景和源释放前移除布局中的 scene item
+    sceneLayout.setScene(nullptr, nullptr);
+
+    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, nullptr);
+    obs_set_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT, nullptr);
+    obs_set_output_source(SOURCE_CHANNEL_AUDIO_INPUT, nullptr);
+
+    auto cb = [] (void *unused, obs_source_t *source)
+    {
+        obs_source_remove(source);
+        Q_UNUSED(unused);
+        return true;
+    };
+    obs_enum_sources(cb, nullptr);
+
+    obs_scene_release(scene);
+    obs_properties_destroy(properties);
+
+    scene        = nullptr;
+    properties   = nullptr;
+
+    rtmpService    = nullptr;
+    h264Streaming  = nullptr;
+
+    for (size_t i = 0; i < MAX_AUDIO_MIXES; ++i)
+        aacTrack[i] = nullptr;
+
+    streamOutput = nullptr;
+    recordOutput = nullptr;
+    hlsOutput    = nullptr;
+    blockOutput  = nullptr;
+
+    free(filePath);
+    free(liveServer);
+    free(liveKey);
+    filePath   = nullptr;
+    liveServer = nullptr;
+    liveKey    = nullptr;
+    videoPathReady = false;
+
+    blog(LOG_INFO, OBS_RELEASE_END_SEPARATOR);
+}
+
+// 整个初始化流程，参见 window-basic-main.cpp -> OBSBasic::OBSInit()
+void QtOBSContext::initialize(const QString &configPath,
+                              const QString &windowTitle,
+                              const QSize &screenSize,
+                              const QRect &sourceRegion)
+{
+    blog(LOG_INFO, OBS_INIT_BEGIN);
+
+    if (configPath.isEmpty() || windowTitle.isEmpty() ||
+            screenSize.isEmpty() || sourceRegion.isEmpty()) {
+        emit errorOccurred(Init, QStringLiteral("参数错误"));
+        return;
+    }
+
+    if (initGraph && initGraph->isRunning()) {
+        blog(LOG_WARNING, "initialize ignored, previous initialization "
+                          "still running.");
+        return;
+    }
+
+    // softReset/benchmarkReset 使用
+    initConfigPath = configPath;
+    initScreenSize = screenSize;
+    captureTitle   = windowTitle;
+    captureRegion  = sourceRegion;
+
+    // 当前线程即 Dialog 中的 obsThread，命名后可被线程拓扑识别
+    os_set_thread_name("qtobs: obs thread");
+
+    // 飞行记录器跨 initialize/release 保留，尽早打开以记录初始化日志
+    if (!flight.isOpen()) {
+        flightDir = configPath + "/flight";
+        QDir().mkpath(flightDir);
+        if (flight.open((flightDir + "/flight-recorder.bin").toStdString(),
+                        FLIGHT_RECORDER_MINUTES, FLIGHT_RECORDER_RATE,
+                        FLIGHT_SAMPLE_INTERVAL_MS))
+            activeFlightRecorder.store(&flight);
+    }
+
+    // 参见 window-basic-main.cpp -> OBSBasic::InitBasicConfigDefaults
+
+    // 计算最终需要输出的分辨率，本例以屏幕分辨率作为标准
+    // 举例（参见 FindSceneItemAndScale 中的处理）：
+    // 屏幕是 1920*1080，那么最终计算出的录制输出为 1280*720，同时 base 也设置为 1280*720，
+    // 如果软件窗口界面大小为 480*360，则把它（窗口捕获源）同比例放大到 960*720，
+    // 并设置它在场景中居中（左右各留黑160）
+    int i = 0;
+    uint32_t out_cx = screenSize.width();
+    uint32_t out_cy = screenSize.height();
+    while (((out_cx * out_cy) > (1280 * 720)) && scaled_vals[i] > 0.0) {
+        double scale = scaled_vals[i++];
+        out_cx = uint32_t(double(screenSize.width()) / scale);
+        out_cy = uint32_t(double(screenSize.height()) / scale);
+    }
+    baseWidth    = out_cx;
+    baseHeight   = out_cy;
+    outputWidth  = out_cx; // 可自行修改
+    outputHeight = out_cy;
+    orgWidth     = sourceRegion.width();
+    orgHeight    = sourceRegion.height();
+    blog(LOG_INFO, "final resolution => org=%dx%d, base=%dx%d, output=%dx%d",
+         orgWidth, orgHeight, baseWidth, baseHeight, outputWidth, outputHeight);
+
+    // 各步骤组成依赖图：startup、resetAudio/resetVideo、创建输出和源等 libobs 调用
+    // 在 obs 线程中串行运行；配置文件读取、设备格式查询、设备枚举、窗口枚举在工作线程中
+    // 与之并行。录制需要的输出和捕获源就绪后发出 videoReady，之后的步骤让出事件循环
+    delete initGraph;
+    initGraph = new InitGraph(this);
+    connect(initGraph, &InitGraph::finished,
+            this,      &QtOBSContext::onInitFinished);
+
+    // 音频设备注册表，只在第一次初始化时枚举，之后按热插拔通知更新
+    if (!audioDevices)
+        audioDevices.reset(new AudioDeviceRegistry(
+                new OBSAudioDeviceBackend(INPUT_AUDIO_SOURCE,
+                                          OUTPUT_AUDIO_SOURCE)));
+
+    // 工作线程步骤的结果，步骤在 initialize 返回后仍可能运行
+    auto audioFormats = std::make_shared<std::vector<AudioDeviceFormat>>();
+
+    InitGraph *g = initGraph;
+
+    // 初始化 OBS
+    int startup = g->addStep("startup", false, [this, configPath] () {
+        if (obs_initialized())
+            return true;
+
+        blog(LOG_INFO, "obs version %u", obs_get_version());
+        uint64_t startupBeginNs = os_gettime_ns();
+
+        if (!obs_startup("en-US", configPath.toStdString().c_str(), nullptr)) {
+            blog(LOG_ERROR, "startup failed.");
+            emit errorOccurred(Init, QStringLiteral("obs startup failed."));
+            return false;
+        }
+
+        // 加载模块，先设置模块加载路径
+        QString appPath = QCoreApplication::applicationDirPath();
+        QString pluginsPath = appPath + "/obs-plugins/32bit";
+        QString modulePath = appPath + "/data/obs-plugins/%module%";
+        obs_add_module_path(pluginsPath.toStdString().c_str(),
+                            modulePath.toStdString().c_str());
+        blog(LOG_INFO, OBS_SEPARATOR);
+        obs_load_all_modules();
+        blog(LOG_INFO, OBS_SEPARATOR);
+        obs_log_loaded_modules();
+
+        RegisterLLHLSOutput();
+        RegisterBlockFileOutput();
+        RegisterPacketSinkOutputs();
+        RegisterVADNoiseSuppressFilter();
+        RegisterAVSyncFilter();
+        RegisterROIEncoder();
+        RegisterRawReplaySource();
+
+        coldStartupNs = os_gettime_ns() - startupBeginNs;
+        blog(LOG_INFO, OBS_STARTUP_SEPARATOR);
+        return true;
+    });
+
+    // 线程拓扑配置，文件不存在时保持系统默认调度；resetOutputs 读取其中的 x264 线程数
+    int topology = g->addStep("thread config", true, [this, configPath] () {
+        ThreadTopologyConfig config;
+        if (config.load((configPath + "/thread-topology.json").toStdString()))
+            threadTopology.setConfig(config);
+        return true;
+    });
+
+    // 默认设备的原生格式，只查询 WASAPI，不依赖 libobs
+    int formats = g->addStep("audio formats", true, [this, audioFormats] () {
+        if (audioFormatMode == AudioFormatAuto)
+            probeAudioFormats(*audioFormats, false);
+        return true;
+    });
+
+    // 通过音频源的属性（obs_get_source_properties）枚举设备，需要先加载模块；
+    // 与 resetAudio/resetVideo 同样在 obs 线程执行，工作线程的步骤不调用 libobs
+    int devices = g->addStep("audio devices", false, [this] () {
+        audioDevices->enumerate();
+        return true;
+    }, {startup});
+
+    int windows = g->addStep("windows", true, [this] () {
+        windowEnumUs = windowResolver.refresh();
+        return true;
+    });
+
+    // 音频基本配置
+    int audio = g->addStep("audio", false, [this, audioFormats] () {
+        if (!resetAudio(*audioFormats)) {
+            blog(LOG_ERROR, "reset audio failed.");
+            emit errorOccurred(Init, QStringLiteral("音频设置失败"));
+            return false;
+        }
+        return true;
+    }, {startup, formats});
+
+    // 视频基本配置
+    int video = g->addStep("video", false, [this] () {
+        int ret = resetVideo();
+        if (ret != OBS_VIDEO_SUCCESS) {
+            switch (ret) {
+            case OBS_VIDEO_MODULE_NOT_FOUND:
+                blog(LOG_ERROR, "failed to initialize video: graphics module not found.");
+                break;
+            case OBS_VIDEO_NOT_SUPPORTED:
+                blog(LOG_ERROR, "unsupported.");
+                break;
+            case OBS_VIDEO_INVALID_PARAM:
+                blog(LOG_ERROR, "failed to initialize video: invalid parameters.");
+                break;
+            default:
+                blog(LOG_ERROR, "unknown.");
+                break;
+            }
+            blog(LOG_ERROR, "reset video failed.");
+            emit errorOccurred(Init, QStringLiteral("视频设置失败"));
+            return false;
+        }
+        return true;
+    }, {startup});
+
+    // 探测最适合本机的编码器，结果缓存在配置目录。没有缓存时要测量进程 CPU，
+    // 场景和捕获源在探测之后创建以免干扰
+    int encoders = g->addStep("encoders", false, [this, configPath] () {
+        probeEncoders(configPath);
+        return true;
+    }, {audio, video});
+
+    // 初始化推流服务
+    int service = g->addStep("service", false, [this] () {
+        if (!initService()) {
+            emit errorOccurred(Init, QStringLiteral("初始化服务失败"));
+            return false;
+        }
+        return true;
+    }, {startup});
+
+    // 以下流程
+    // 参见 window-basic-main.cpp -> OBSBasic::Load -> OBSBasic::CreateDefaultScene
+    int sceneStep = g->addStep("scene", false, [this] () {
+#ifdef _WIN32
+        // 开启 Aero（Windows 8 及以上版本不起作用）
+        // 方法 1
+        if (1) {
+            uint32_t winVer = GetWindowsVersion();
+            blog(LOG_INFO, "windows version %x", winVer);
+            if (winVer > 0 && winVer < 0x602) {
+                blog(LOG_INFO, "set aero enable");
+                SetAeroEnabled(true);
+            }
+        }
+        // 方法 2
+        else {
+            // if (QSysInfo::windowsVersion() < QSysInfo::WV_WINDOWS8)
+            QtWin::setCompositionEnabled(true);
+        }
+#endif
+
+        // 参见 obs 软件 设置 -> 音频
+        obs_set_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT, nullptr);
+        obs_set_output_source(SOURCE_CHANNEL_AUDIO_INPUT, nullptr);
+        return createScene();
+    }, {video, encoders});
+
+    int capture = g->addStep("capture", false, [this, windowTitle,
+                                                sourceRegion] () {
+        // 窗口列表已在 windows 步骤中枚举
+        return createCaptureSource(windowTitle, sourceRegion, false);
+    }, {sceneStep, windows});
+
+    // 初始化输出相关(推流/本地录制/编码器)
+    // 参见 window-basic-main.cpp -> OBSBasic::OBSInit()
+    int outputs = g->addStep("outputs", false, [this] () {
+        if (!resetOutputs()) {
+            emit errorOccurred(Init, QStringLiteral("初始化编码器失败"));
+            return false;
+        }
+        return true;
+    }, {service, encoders, topology});
+
+    // 输出和捕获源就绪即可开始录制，麦克风/桌面音频在之后加入混音
+    int videoReadyStep = g->addStep("video ready", false, [this] () {
+        blog(LOG_INFO, "video path ready");
+        videoPathReady = true;
+
+        // 图形/视频线程都已创建，之后新出现的未命名线程视为编码线程。收到 videoReady
+        // 的一方会立即开始录制，基线必须在它创建 x264/ffmpeg 线程之前记录
+        threadTopology.markBaseline();
+        emit videoReady();
+        return true;
+    }, {outputs, capture});
+    g->setYieldAfter(videoReadyStep);
+
+    int audioSources = g->addStep("audio sources", false, [this] () {
+        audioDevices->start();
+
+        if (audioDevices->count(false))
+            ResetAudioDevice(OUTPUT_AUDIO_SOURCE, "default",
+                             TAG " Default Desktop Audio",
+                             SOURCE_CHANNEL_AUDIO_OUTPUT);
+        if (audioDevices->count(true))
+            ResetAudioDevice(INPUT_AUDIO_SOURCE, "default",
+                             TAG " Default Mic/Aux",
+                             SOURCE_CHANNEL_AUDIO_INPUT);
+        // 设置降噪
+        setupNoiseSuppression();
+        attachAudioMeters();
+        setupAVSync();
+
+        emit audioReady();
+        return true;
+    }, {sceneStep, audio, devices});
+
+    int timers = g->addStep("timers", false, [this] () {
+        if (!flightTimer) {
+            flightTimer = new QTimer(this);
+            connect(flightTimer, &QTimer::timeout,
+                    this, &QtOBSContext::sampleFlightMetrics);
+            cpuUsage = os_cpu_usage_info_start();
+        }
+        flightTimer->start(FLIGHT_SAMPLE_INTERVAL_MS);
+
+        if (!idleTimer) {
+            idleTimer = new QTimer(this);
+            connect(idleTimer, &QTimer::timeout, this, &QtOBSContext::checkIdle);
+            idleCpu = os_cpu_usage_info_start();
+        }
+        idleSinceNs     = 0;
+        lastIdleCheckNs = os_gettime_ns();
+        idleTimer->start(IDLE_CHECK_INTERVAL_MS);
+        obs_add_tick_callback(IdleTick, this);
+        return true;
+    }, {video});
+
+    // 后处理队列跨 initialize/release 保留，只在第一次初始化时加载
+    g->addStep("post process", false, [this, configPath] () {
+        if (postProcess->isOpen())
+            return true;
+
+        postProcess->setLagProbe([this] () {
+            video_t *video = obs_get_video();
+            if (!video)
+                return false;
+
+            uint32_t lagged  = obs_get_lagged_frames();
+            uint32_t skipped = video_output_get_skipped_frames(video);
+            bool lag = (lagged > lastLaggedFrames ||
+                        skipped > lastSkippedFrames) && liveOutputActive();
+            lastLaggedFrames  = lagged;
+            lastSkippedFrames = skipped;
+            return lag;
+        });
+        lastLaggedFrames = obs_get_lagged_frames();
+        postProcess->open(configPath + "/post-process-queue.json",
+                          PostProcessConfig());
+        return true;
+    }, {video});
+
+    // 设置音频检测设备（obs 软件，设置->高级->音频->音频监视设备）
+    //#if defined(_WIN32)
+    //    obs_set_audio_monitoring_device(TAG"-audio-monitor-default", "default");
+    //    blog(LOG_INFO, "audio monitoring device:\tname: %s\tid: %s",
+    //         "obs-audio-monitor-default", "default");
+    //#endif
+
+    // 基线已在 video ready 中记录，这里在音频源和定时器就绪后应用拓扑
+    g->addStep("thread topology", false, [this] () {
+        threadTopology.apply();
+        return true;
+    }, {videoReadyStep, audioSources, timers});
+
+    initGraph->start();
+}
+
+void QtOBSContext::onInitFinished(bool ok)
+{
+    initGraph->logTimings();
+    if (!ok) {
+        blog(LOG_ERROR, "initialize failed.");
+        return;
+    }
+
+    blog(LOG_INFO, OBS_INIT_END);
+
+    emit initialized();
+}
+
+// 转场和场景（scene 也是一种 source）
+// 参见 window-basic-main.cpp -> OBSBasic::Load -> OBSBasic::CreateDefaultScene
+bool QtOBSContext::createScene()
+{
+    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, nullptr);
+
+    // 场景过度 - 淡出
+    // 参见 window-basic-main-transitions.cpp -> OBSBasic::InitDefaultTransitions
+    size_t idx = 0;
+    const char *id;
+    while (obs_enum_transition_types(idx++, &id)) {
+        if (!obs_is_source_configurable(id)) {
+            if (strcmp(id, "fade_transition") == 0) {
+                const char *name = obs_source_get_display_name(id);
+                obs_source_t *tr = obs_source_create_private(id, name, NULL);
+                blog(LOG_INFO, "transition saved");
+                fadeTransition = tr;
+                break;
+            }
+        }
+    }
+    if (!fadeTransition) {
+        blog(LOG_ERROR, "cannot find fade transition.");
+        emit errorOccurred(Init, QStringLiteral("创建转换器失败"));
+        return false;
+    }
+    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, fadeTransition);
+    obs_source_release(fadeTransition);
+
+    scene = obs_scene_create(TAG "-Scene");
+    if (!scene) {
+        blog(LOG_ERROR, "create scene failed.");
+        emit errorOccurred(Init, QStringLiteral("创建场景失败"));
+        return false;
+    }
+    obs_source_t *s = obs_get_output_source(SOURCE_CHANNEL_TRANSITION);
+    obs_transition_set(s, obs_scene_get_source(scene));
+    obs_source_release(s);
+    return true;
+}
+
+// refresh 同 bindCaptureWindow
+bool QtOBSContext::createCaptureSource(const QString &windowTitle,
+                                       const QRect &sourceRegion, bool refresh)
+{
+    // 创建窗口捕获源，它是 scene 里唯一的一个 scene item
+    captureSource = obs_source_create("window_capture", TAG "-WindowsCapture",
+                                      NULL, nullptr);
+    if (captureSource) {
+        obs_scene_atomic_update(scene, AddSource, captureSource);
+    } else {
+        blog(LOG_ERROR, "create source failed.");
+        emit errorOccurred(Init, QStringLiteral("创建源失败"));
+        return false;
+    }
+
+    sceneLayout.setScene(scene, captureSource);
+    sceneLayout.setCanvas(baseWidth, baseHeight);
+
+    // 添加窗口捕获源的剪裁过滤器，可以实现录制窗口特区域
+    addFilterToSource(captureSource, VIDEO_CROP_FILTER_ID);
+    videoCrop(sourceRegion);
+
+    // 设置窗口捕获源的窗口：按本进程 ID + 窗口标题查找，
+    // 之后窗口重建时由 checkCaptureWindow 自动重新绑定
+    blog(LOG_INFO, OBS_SEPARATOR);
+    if (captureTarget.empty()) {
+        QFileInfo fi(QCoreApplication::applicationFilePath());
+        windowQuery = WindowQuery();
+        windowQuery.pid = (uint32_t)QCoreApplication::applicationPid();
+        windowQuery.exe = fi.fileName().toStdString();
+    } else {
+        windowQuery = captureTarget;
+    }
+    windowQuery.titlePattern = windowTitle.toStdString();
+    boundWindow = WindowInfo();
+    if (!bindCaptureWindow(refresh)) {
+        blog(LOG_INFO, "find application window failed.");
+        emit errorOccurred(Init, QStringLiteral("查找应用窗口失败"));
+        return false;
+    }
+    startWindowMonitor();
+    blog(LOG_INFO, OBS_SEPARATOR);
+
+    // 场景元素放缩
+    obs_scene_enum_items(scene, FindSceneItemAndScale, (void *)this);
+    return true;
+}
+
+/**
+ * 软重置只拆除场景（转场、场景、捕获源和布局中的额外源）并重新绑定输出，
+ * obs_startup、模块、obs_reset_video/obs_reset_audio、音频源和编码器对象都保留。
+ * 编码器在输出停止时已经关闭编码上下文，对象和设置可以直接复用
+ */
+bool QtOBSContext::rebuildScene(const QString &windowTitle,
+                                const QRect &sourceRegion)
+{
+    if (windowTitle.isEmpty() || sourceRegion.isEmpty()) {
+        emit errorOccurred(Init, QStringLiteral("参数错误"));
+        return false;
+    }
+
+    if (!obs_initialized() || !scene || !h264Streaming ||
+            (initGraph && initGraph->isRunning())) {
+        blog(LOG_WARNING, "soft reset ignored, not initialized.");
+        return false;
+    }
+
+    if (liveOutputActive()) {
+        blog(LOG_WARNING, "soft reset ignored, outputs still active.");
+        return false;
+    }
+
+    uint64_t beginNs = os_gettime_ns();
+
+    windowResolver.stopEvents();
+    if (windowTimer)
+        windowTimer->stop();
+    resumeIdle();
+    stopReplay();
+    disconnectOutputSignals();
+
+    // 与 release 相同，在场景和源释放前移除布局中的 scene item
+    sceneLayout.setScene(nullptr, nullptr);
+    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, nullptr);
+    obs_source_remove(captureSource);
+    obs_source_remove(obs_scene_get_source(scene));
+    obs_scene_release(scene);
+    scene          = nullptr;
+    captureSource  = nullptr;
+    fadeTransition = nullptr;
+    uint64_t teardownNs = os_gettime_ns();
+
+    captureTitle  = windowTitle;
+    captureRegion = sourceRegion;
+    orgWidth      = sourceRegion.width();
+    orgHeight     = sourceRegion.height();
+    bool ok = createScene() &&
+              createCaptureSource(windowTitle, sourceRegion, true);
+    uint64_t sceneNs = os_gettime_ns();
+
+    if (ok && !bindOutputs()) {
+        emit errorOccurred(Init, QStringLiteral("初始化编码器失败"));
+        ok = false;
+    }
+    if (!ok) {
+        // 原场景已拆除，输出信号和窗口监视已停止，无法回到重置前的状态：
+        // 与初始化失败相同，全部释放，调用方收到 Init 错误后重新 initialize
+        blog(LOG_ERROR, "soft reset failed, released.");
+        release();
+        return false;
+    }
+    uint64_t endNs = os_gettime_ns();
+
+    blog(LOG_INFO, "soft reset: %.1f ms (teardown %.1f, scene %.1f, "
+                   "outputs %.1f), org=%dx%d",
+         (double)(endNs - beginNs) / 1000000.0,
+         (double)(teardownNs - beginNs) / 1000000.0,
+         (double)(sceneNs - teardownNs) / 1000000.0,
+         (double)(endNs - sceneNs) / 1000000.0, orgWidth, orgHeight);
+    return true;
+}
+
+void QtOBSContext::softReset(const QString &windowTitle,
+                             const QRect &sourceRect)
+{
+    if (!rebuildScene(windowTitle, sourceRect))
+        return;
+
+    emit videoReady();
+    emit initialized();
+}
+
+// 轮询输出的 active 状态，ffmpeg_output 在连接线程中开始采集（即 "start" 信号）
+static bool WaitOutputActive(obs_output_t *output, bool active, int timeoutMs)
+{
+    uint64_t deadline = os_gettime_ns() + (uint64_t)timeoutMs * 1000000ULL;
+    while (obs_output_active(output) != active) {
+        if (os_gettime_ns() > deadline)
+            return false;
+        os_sleep_ms(1);
+    }
+    return true;
+}
+
+/**
+ * 进程内无法重复 obs_shutdown + obs_startup（自定义输出/源/滤镜只注册一次），
+ * 这里对比软重置与 release + initialize（libobs 核心保留，重建音视频子系统、
+ * 音频源、编码器和输出），完整重启的估计值再加上第一次初始化时测得的
+ * obs_startup 和加载模块的耗时
+ */
+void QtOBSContext::benchmarkReset(const QString &dir, int runs)
+{
+    if (dir.isEmpty() || runs <= 0)
+        return;
+
+    if (!scene || initConfigPath.isEmpty() ||
+            (initGraph && initGraph->isRunning())) {
+        blog(LOG_WARNING, "reset benchmark: not initialized.");
+        return;
+    }
+
+    if (liveOutputActive()) {
+        blog(LOG_WARNING, "reset benchmark: outputs still active.");
+        return;
+    }
+
+    std::string base = dir.toStdString();
+    if (os_mkdirs(base.c_str()) == MKDIR_ERROR) {
+        blog(LOG_ERROR, "reset benchmark: invalid dir '%s'", base.c_str());
+        return;
+    }
+
+    // 期间不发出 videoReady/initialized，录制信号也不经过事件总线，
+    // 否则 Dialog 会自行开始录制，录制完成后还会加入后处理队列
+    bool blocked = blockSignals(true);
+
+    static const char *kinds[] = {"soft reset", "re-initialize"};
+    std::vector<double> resetMs[2];
+    std::vector<double> recordMs[2];
+    bool ok = true;
+    for (int run = 0; run < runs && ok; run++) {
+        for (int kind = 0; kind < 2 && ok; kind++) {
+            QString path = QString("%1/reset-bench-%2-%3.mp4").arg(dir)
+                           .arg(kind == 0 ? "soft" : "reinit").arg(run);
+            QString title  = captureTitle;
+            QRect   region = captureRegion;
+
+            uint64_t beginNs = os_gettime_ns();
+            if (kind == 0) {
+                ok = rebuildScene(title, region);
+            } else {
+                release();
+                initialize(initConfigPath, title, initScreenSize, region);
+                ok = videoPathReady;
+            }
+            uint64_t readyNs = os_gettime_ns();
+            if (!ok) {
+                blog(LOG_ERROR, "reset benchmark: %s failed.", kinds[kind]);
+                break;
+            }
+
+            disconnectOutputSignals();
+            startRecord(path);
+            ok = WaitOutputActive(recordOutput, true, RESET_BENCH_TIMEOUT_MS);
+            uint64_t startedNs = os_gettime_ns();
+
+            stopRecord(false);
+            if (!WaitOutputActive(recordOutput, false, RESET_BENCH_TIMEOUT_MS))
+                stopRecord(true);
+
+            // 重新初始化让出事件循环后的步骤（音频源等）在这里运行完
+            if (initGraph && initGraph->isRunning())
+                initGraph->runToEnd();
+
+            if (!ok) {
+                blog(LOG_ERROR, "reset benchmark: record start timed out.");
+                break;
+            }
+            resetMs[kind].push_back((double)(readyNs - beginNs) / 1000000.0);
+            recordMs[kind].push_back((double)(startedNs - beginNs) / 1000000.0);
+        }
+    }
+
+    if (scene && recordOutput)
+        connectOutputSignals();
+    blockSignals(blocked);
+
+    blog(LOG_INFO, "reset benchmark, %d runs, dir '%s':", runs, base.c_str());
+    blog(LOG_INFO, "\tkind             n  reset avg(ms)  max(ms)  "
+                   "to recording avg(ms)  max(ms)");
+    double recordAvg[2] = {0.0, 0.0};
+    for (int kind = 0; kind < 2; kind++) {
+        size_t n = recordMs[kind].size();
+        if (!n)
+            continue;
+        double resetTotal = 0.0, resetMax = 0.0;
+        double recordTotal = 0.0, recordMax = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            resetTotal += resetMs[kind][i];
+            resetMax    = std::max(resetMax, resetMs[kind][i]);
+            recordTotal += recordMs[kind][i];
+            recordMax    = std::max(recordMax, recordMs[kind][i]);
+        }
+        recordAvg[kind] = recordTotal / (double)n;
+        blog(LOG_INFO, "\t%-14s %3d  %13.1f  %7.1f  %20.1f  %7.1f",
+             kinds[kind], (int)n, resetTotal / (double)n, resetMax,
+             recordAvg[kind], recordMax);
+    }
+
+    // coldStartupNs 为 0 时本进程的第一次初始化时 libobs 已经启动
+    if (!recordMs[0].empty() && !recordMs[1].empty()) {
+        double full = recordAvg[1] + (double)coldStartupNs / 1000000.0;
+        blog(LOG_INFO, "\tfull restart (re-initialize + startup %.1f ms): "
+                       "%.1f ms, soft reset %.1fx faster",
+             (double)coldStartupNs / 1000000.0, full,
+             recordAvg[0] > 0.0 ? full / recordAvg[0] : 0.0);
+    }
+}
+
+// 解析 windowQuery 对应的窗口，窗口句柄变化时更新 captureSource，输出不需要重启
+bool QtOBSContext::bindCaptureWindow(bool refresh)
+{
+    if (!captureSource)
+        return false;
+
+    uint64_t lookupUs = refresh ? windowResolver.refresh() : windowEnumUs;
+    uint64_t start = os_gettime_ns();
+    WindowInfo window;
+    bool found = windowResolver.resolve(windowQuery, window, boundWindow.handle);
+    lookupUs += (os_gettime_ns() - start) / 1000;
+
+    windowStats.lookups++;
+    windowStats.lookupTotalUs += lookupUs;
+    windowStats.lookupMaxUs = std::max(windowStats.lookupMaxUs, lookupUs);
+
+    if (!found) {
+        if (boundWindow.handle)
+            blog(LOG_WARNING, "capture window '%s' not found in %d windows",
+                 windowQuery.titlePattern.c_str(), (int)windowResolver.count());
+        return false;
+    }
+
+    // 只改标题时 window_capture 仍持有原窗口，不必重建捕获
+    if (window.handle == boundWindow.handle) {
+        boundWindow = window;
+        return true;
+    }
+
+    std::string setting = WindowResolver::captureSetting(window);
+    obs_data_t *settings = obs_source_get_settings(captureSource);
+    obs_data_set_string(settings, "window", setting.c_str());
+    obs_data_set_int(settings, "priority", CAPTURE_WINDOW_PRIORITY_EXE);
+    obs_source_update(captureSource, settings);
+    obs_data_release(settings);
+
+    blog(LOG_INFO, "capture window %s: %s (pid %u, lookup %llu us)",
+         boundWindow.handle ? "rebound" : "bound", setting.c_str(),
+         window.pid, (unsigned long long)lookupUs);
+
+    if (boundWindow.handle)
+        windowStats.rebinds++;
+    boundWindow = window;
+    return true;
+}
+
+void QtOBSContext::startWindowMonitor()
+{
+    if (!windowTimer) {
+        windowTimer = new QTimer(this);
+        connect(windowTimer, &QTimer::timeout,
+                this, &QtOBSContext::checkCaptureWindow);
+    }
+
+    // 钩子回调在本线程的消息循环中执行，只做标记，由定时器合并处理
+    windowResolver.startEvents([this] () {
+        if (!windowDirty) {
+            windowDirty   = true;
+            windowDirtyNs = os_gettime_ns();
+        }
+    });
+
+    lastWindowCheckNs = os_gettime_ns();
+    windowTimer->start(WINDOW_CHECK_INTERVAL_MS);
+}
+
+void QtOBSContext::checkCaptureWindow()
+{
+    uint64_t now = os_gettime_ns();
+    bool poll = now - lastWindowCheckNs >=
+                WINDOW_POLL_INTERVAL_MS * 1000000ULL;
+    if (!windowDirty && !poll)
+        return;
+
+    uint64_t eventNs = windowDirty ? windowDirtyNs : 0;
+    uint64_t handle = boundWindow.handle;
+    windowDirty = false;
+    lastWindowCheckNs = now;
+
+    bindCaptureWindow();
+
+    // 重新绑定的延迟：从第一个窗口事件到 obs_source_update 完成
+    if (boundWindow.handle != handle && handle) {
+        uint64_t latencyUs = (os_gettime_ns() - (eventNs ? eventNs : now)) / 1000;
+        windowStats.rebindTotalUs += latencyUs;
+        windowStats.rebindMaxUs = std::max(windowStats.rebindMaxUs, latencyUs);
+        if (!eventNs)
+            windowStats.pollRebinds++;
+        blog(LOG_INFO, "capture window rebind latency %.2f ms (%s)",
+             (double)latencyUs / 1000.0, eventNs ? "event" : "poll");
+    }
+}
+
+void QtOBSContext::setCaptureTarget(uint pid, const QString &exe,
+                                    const QString &className)
+{
+    captureTarget = WindowQuery();
+    captureTarget.pid       = pid;
+    captureTarget.exe       = exe.toStdString();
+    captureTarget.className = className.toStdString();
+}
+
+void QtOBSContext::getRecordStats(uint64_t &bytes, int &frames, int &dropped)
+{
+    bytes   = 0;
+    frames  = 0;
+    dropped = 0;
+    if (!recordOutput || !obs_output_active(recordOutput))
+        return;
+
+    bytes   = obs_output_get_total_bytes(recordOutput);
+    frames  = obs_output_get_total_frames(recordOutput);
+    dropped = obs_output_get_frames_dropped(recordOutput);
+}
+
+void QtOBSContext::setCaptureWindow(uint pid, const QString &exe,
+                                    const QString &className,
+                                    const QString &titlePattern)
+{
+    windowQuery.pid          = pid;
+    windowQuery.exe          = exe.toStdString();
+    windowQuery.className    = className.toStdString();
+    windowQuery.titlePattern = titlePattern.toStdString();
+
+    boundWindow = WindowInfo();
+    if (!bindCaptureWindow())
+        emit errorOccurred(Init, QStringLiteral("查找应用窗口失败"));
+}
+
+void QtOBSContext::logWindowResolverStats()
+{
+    const WindowResolverStats &s = windowStats;
+    blog(LOG_INFO, "window resolver stat, lookups:%llu avg:%.1f us max:%llu us, "
+                   "rebinds:%llu (poll:%llu) avg:%.2f ms max:%.2f ms",
+         (unsigned long long)s.lookups,
+         s.lookups ? (double)s.lookupTotalUs / (double)s.lookups : 0.0,
+         (unsigned long long)s.lookupMaxUs,
+         (unsigned long long)s.rebinds, (unsigned long long)s.pollRebinds,
+         s.rebinds ? (double)s.rebindTotalUs / 1000.0 / (double)s.rebinds : 0.0,
+         (double)s.rebindMaxUs / 1000.0);
+}
+
+void QtOBSContext::addFilterToSource(obs_source_t *source, const char *id)
+{
+    if (!id || *id == '\0')
+        return;
+
+    obs_source_t *existing_filter;
+    std::string name = obs_source_get_display_name(id);
+    existing_filter = obs_source_get_filter_by_name(source, name.c_str());
+    if (existing_filter) {
+        blog(LOG_WARNING, "filter %s exists.", id);
+        obs_source_release(existing_filter);
+        return;
+    }
+
+    name = std::string(TAG) + id;
+    obs_source_t *filter = obs_source_create(id, name.c_str(), nullptr, nullptr);
+    if (filter) {
+        const char *sourceName = obs_source_get_name(source);
+        blog(LOG_INFO, "add filter '%s' (%s) to source '%s'",
+             name.c_str(), id, sourceName);
+        obs_source_filter_add(source, filter);
+        obs_source_release(filter);
+    }
+}
+
+void QtOBSContext::videoCrop(const QRect &rect)
+{
+    if (!captureSource) return;
+
+    if (rect.isEmpty()) {
+        blog(LOG_WARNING, "source crop rect(%d %d %d %d) is empty.",
+             rect.left(), rect.top(), rect.right(), rect.bottom());
+        return;
+    }
+
+    scaleScene(rect.width(), rect.height());
+
+    bool relative = false;
+    std::string name = TAG VIDEO_CROP_FILTER_ID;
+    obs_source_t *existing_filter =
+            obs_source_get_filter_by_name(captureSource, name.c_str());
+    if (existing_filter) {
+        obs_data_t *settings = obs_source_get_settings(existing_filter);
+        obs_data_set_bool(settings, "relative", relative);
+        obs_data_set_int(settings, "left", rect.left());
+        obs_data_set_int(settings, "top", rect.top());
+        if (relative) {
+            obs_data_set_int(settings, "right", rect.right());
+            obs_data_set_int(settings, "bottom", rect.bottom());
+            blog(LOG_INFO, "update source crop [Left:%d Top:%d Right:%d Bottom:%d]",
+                 rect.left(), rect.top(), rect.right(), rect.bottom());
+        } else {
+            obs_data_set_int(settings, "cx", rect.width());
+            obs_data_set_int(settings, "cy", rect.height());
+            blog(LOG_INFO, "update source crop [Left:%d Top:%d Width:%d Height:%d]",
+                 rect.left(), rect.top(), rect.width(), rect.height());
+        }
+        obs_source_update(existing_filter, settings);
+        obs_data_release(settings);
+        obs_source_release(existing_filter);
+    }
+}
+
+void QtOBSContext::probeEncoders(const QString &configPath)
+{
+    EncoderProbeOptions options;
+    options.configDir = configPath.toStdString();
+    options.width     = outputWidth;
+    options.height    = outputHeight;
+    options.fps       = VIDEO_FPS;
+
+    EncoderProbeResult result;
+    if (!ProbeEncoders(options, result)) {
+        blog(LOG_WARNING, "encoder probe failed, use %s/%s",
+             videoEncoderId.c_str(), audioEncoderId.c_str());
+        return;
+    }
+
+    videoEncoderId     = result.videoEncoder;
+    videoEncoderPreset = result.videoPreset;
+    audioEncoderId     = result.audioEncoder;
+}
+
+bool QtOBSContext::initService()
+{
+    if (!rtmpService) {
+        rtmpService = obs_service_create("rtmp_custom", TAG "-RtmpService",
+                                         nullptr, nullptr);
+        if (!rtmpService) {
+            blog(LOG_ERROR, "create service failed.");
+            return false;
+        }
+        obs_service_release(rtmpService);
+    }
+    return true;
+}
+
+/**
+ * OBS Output 分为 SimpleOutput 和 AdvancedOutput
+ * 我们使用 AdvancedOutput，可以进行更多的配置
+ * 参见 window-basic-main-outputs.cpp -> AdvancedOutput::AdvancedOutput(...)
+ */
+bool QtOBSContext::resetOutputs()
+{
+    if (!streamOutput) {
+        streamOutput = obs_output_create("rtmp_output",
+                                         TAG "-AdvRtmpOutput",
+                                         nullptr, nullptr);
+        if (!streamOutput) {
+            blog(LOG_ERROR, "create stream output failed.");
+            return false;
+        }
+        obs_output_release(streamOutput);
+    }
+
+    if (!recordOutput) {
+        recordOutput = obs_output_create("ffmpeg_output", TAG "-AdvFFmpegOutput",
+                                         nullptr, nullptr);
+        if (!recordOutput) {
+            blog(LOG_ERROR, "create record output failed.");
+            return false;
+        }
+        obs_output_release(recordOutput);
+    }
+
+    if (!hlsOutput) {
+        hlsOutput = obs_output_create(LLHLS_OUTPUT_ID, TAG "-LLHLSOutput",
+                                      nullptr, nullptr);
+        if (!hlsOutput) {
+            blog(LOG_ERROR, "create hls output failed.");
+            return false;
+        }
+        obs_output_release(hlsOutput);
+    }
+
+    if (!blockOutput) {
+        blockOutput = obs_output_create(BLOCK_FILE_OUTPUT_ID,
+                                        TAG "-BlockFileOutput",
+                                        nullptr, nullptr);
+        if (!blockOutput) {
+            blog(LOG_ERROR, "create block file output failed.");
+            return false;
+        }
+        obs_output_release(blockOutput);
+    }
+
+    if (!h264Streaming) {
+        OBSData streamEncSettings = getStreamEncSettings();
+        std::string encoderId = getStreamEncoderId();
+        h264Streaming = obs_video_encoder_create(encoderId.c_str(),
+                                                 TAG "-StreamingH264",
+                                                 streamEncSettings, nullptr);
+        if (!h264Streaming) {
+            blog(LOG_ERROR, "create streaming encoder fail");
+            return false;
+        }
+        obs_encoder_release(h264Streaming);
+    }
+
+    for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
+        if (aacTrack[i])
+            continue;
+
+        std::string name = TAG "-AdvACCTrack";
+        name += std::to_string(i + 1);
+        obs_data_t *setting = obs_data_create();
+        obs_data_set_int(setting, "bitrate", 128);
+        bool ok = CreateAACEncoder(aacTrack[i], aacEncoderID[i],
+                                   audioEncoderId.c_str(), name.c_str(), i,
+                                   setting);
+        obs_data_release(setting);
+        if (!ok) {
+            blog(LOG_ERROR, "create audio encoder %d", i);
+            return false;
+        }
+    }
+
+    return bindOutputs();
+}
+
+// 编码器与视频/音频、输出、推流服务的绑定，编码器和输出都需要处于停止状态
+bool QtOBSContext::bindOutputs()
+{
+    OBSData streamEncSettings = obs_encoder_get_settings(h264Streaming);
+    obs_data_release(streamEncSettings);
+
+    // 禁用放缩
+    obs_encoder_set_scaled_size(h264Streaming, 0, 0);
+    obs_encoder_set_video(h264Streaming, obs_get_video());
+    obs_output_set_video_encoder(streamOutput, h264Streaming);
+    obs_service_apply_encoder_settings(rtmpService, streamEncSettings, nullptr);
+    obs_output_set_service(streamOutput, rtmpService);
+
+    // LL-HLS 和块写入录制复用推流编码器，不额外编码
+    obs_output_set_video_encoder(hlsOutput, h264Streaming);
+    obs_output_set_video_encoder(blockOutput, h264Streaming);
+    applyTextROI();
+
+    OBSData audioSettings = obs_encoder_get_settings(aacTrack[0]);
+    obs_data_release(audioSettings);
+    obs_service_apply_encoder_settings(rtmpService, nullptr, audioSettings);
+    obs_output_set_audio_encoder(streamOutput, aacTrack[0], 0);
+    obs_output_set_audio_encoder(hlsOutput, aacTrack[0], 0);
+    obs_output_set_audio_encoder(blockOutput, aacTrack[0], 0);
+
+    for (int i = 0; i < MAX_AUDIO_MIXES; i++)
+        obs_encoder_set_audio(aacTrack[i], obs_get_audio());
+
+    connectOutputSignals();
+    return resetRenditions();
+}
+
+void QtOBSContext::connectOutputSignals()
+{
+    recordingStarted.Connect(obs_output_get_signal_handler(recordOutput),
+                             "start", RecordingStarted, this);
+    recordingStopping.Connect(obs_output_get_signal_handler(recordOutput),
+                              "stopping", RecordingStopping, this);
+    recordingStopped.Connect(obs_output_get_signal_handler(recordOutput),
+                             "stop", RecordingStopped, this);
+    streamingStarted.Connect(obs_output_get_signal_handler(streamOutput),
+                             "start", StreamingStarted, this);
+    streamingStopping.Connect(obs_output_get_signal_handler(streamOutput),
+                              "stopping", StreamingStopping, this);
+    streamingStopped.Connect(obs_output_get_signal_handler(streamOutput),
+                             "stop", StreamingStopped, this);
+    hlsStopped.Connect(obs_output_get_signal_handler(hlsOutput),
+                       "stop", HLSStopped, this);
+    blockStopped.Connect(obs_output_get_signal_handler(blockOutput),
+                         "stop", BlockStopped, this);
+}
+
+void QtOBSContext::disconnectOutputSignals()
+{
+    recordingStarted.Disconnect();
+    recordingStopping.Disconnect();
+    recordingStopped.Disconnect();
+    streamingStarted.Disconnect();
+    streamingStopping.Disconnect();
+    streamingStopped.Disconnect();
+    hlsStopped.Disconnect();
+    blockStopped.Disconnect();
+}
+
+/**
+ * 多码率档位：每个档位创建一个独立的编码器（探测出的编码器，参见
+ * getRenditionEncoderId），通过 obs_encoder_set_scaled_size 从同一路
+ * obs_get_video() 画面缩放，不会重复采集和合成。
+ * 探测结果为 obs_x264 时档位使用 ROI_ENCODER_ID（关闭 ROI）并打开启动门限，
+ * 所有输出启动后设置同一个帧序号，各编码器从这一帧开始编码并强制 IDR，
+ * 此后每 keyint 帧强制一次，关键帧在同一帧上，参见 SetEncoderStartFrame。
+ * 硬件编码器无法按帧强制关键帧，只能依赖相同的 keyint 和连续启动。
+ */
+bool QtOBSContext::resetRenditions()
+{
+    std::string encoderId = getRenditionEncoderId();
+    if (!renditions.empty() && encoderId != ROI_ENCODER_ID)
+        blog(LOG_WARNING, "rendition encoder %s can not force keyframes, "
+                          "keyframes may not be aligned.", encoderId.c_str());
+
+    for (Rendition &r : renditions) {
+        if (r.encoder)
+            continue;
+
+        int width  = r.config.width;
+        int height = r.config.height;
+        if (width > outputWidth || height > outputHeight) {
+            // 不放大画布，超出的档位按比例缩小到输出分辨率以内，宽高取偶数
+            double scale = std::min((double)outputWidth / width,
+                                    (double)outputHeight / height);
+            int scaledWidth  = std::max((int)(width * scale) & ~1, 2);
+            int scaledHeight = std::max((int)(height * scale) & ~1, 2);
+            blog(LOG_WARNING, "rendition %s %dx%d exceeds output %dx%d, "
+                              "scaled to %dx%d.",
+                 r.config.name.toStdString().c_str(), width, height,
+                 outputWidth, outputHeight, scaledWidth, scaledHeight);
+            width  = scaledWidth;
+            height = scaledHeight;
+        }
+
+        std::string name = TAG "-Rendition-" + r.config.name.toStdString();
+        OBSData settings = getRenditionEncSettings(r.config);
+        r.encoder = obs_video_encoder_create(encoderId.c_str(), name.c_str(),
+                                             settings, nullptr);
+        if (!r.encoder) {
+            blog(LOG_ERROR, "create rendition encoder %s fail", name.c_str());
+            return false;
+        }
+        obs_encoder_release(r.encoder);
+        obs_encoder_set_scaled_size(r.encoder, width, height);
+        obs_encoder_set_video(r.encoder, obs_get_video());
+
+        name += "-Output";
+        r.output = obs_output_create("ffmpeg_muxer", name.c_str(),
+                                     nullptr, nullptr);
+        if (!r.output) {
+            blog(LOG_ERROR, "create rendition output %s fail", name.c_str());
+            return false;
+        }
+        obs_output_release(r.output);
+        obs_output_set_video_encoder(r.output, r.encoder);
+        obs_output_set_audio_encoder(r.output, aacTrack[0], 0);
+
+        r.lastEncodeCalls  = 0;
+        r.lastEncodeTimeUs = 0;
+
+        blog(LOG_INFO, "rendition %s: %s %dx%d %dkb/s preset=%s",
+             r.config.name.toStdString().c_str(), encoderId.c_str(), width,
+             height, r.config.bitrate, obs_data_get_string(settings, "preset"));
+    }
+
+    return true;
+}
+
+void QtOBSContext::setRenditionLadder(const QList<RenditionConfig> &ladder)
+{
+    for (const Rendition &r : renditions) {
+        if (r.output && obs_output_active(r.output)) {
+            blog(LOG_WARNING, "rendition ladder is busy, ignore.");
+            return;
+        }
+    }
+
+    renditions.clear();
+
+    for (const RenditionConfig &config : ladder) {
+        if (config.name.isEmpty() || config.width <= 0 ||
+                config.height <= 0 || config.bitrate <= 0) {
+            blog(LOG_WARNING, "invalid rendition %s, ignore.",
+                 config.name.toStdString().c_str());
+            continue;
+        }
+        Rendition r;
+        r.config           = config;
+        r.lastEncodeCalls  = 0;
+        r.lastEncodeTimeUs = 0;
+        renditions.push_back(r);
+    }
+
+    // 初始化完成前只保存配置，resetOutputs 中再创建编码器
+    if (h264Streaming && !resetRenditions())
+        emit errorOccurred(Record, QStringLiteral("创建多码率编码器失败"));
+}
+
+void QtOBSContext::startRenditions()
+{
+    if (renditions.empty() || !filePath)
+        return;
+
+    QFileInfo fi(QString::fromUtf8(filePath));
+    for (Rendition &r : renditions) {
+        if (!r.output)
+            continue;
+
+        QString path = QString("%1/%2-%3.mp4").arg(fi.absolutePath())
+                       .arg(fi.completeBaseName()).arg(r.config.name);
+        obs_data_t *settings = obs_data_create();
+        obs_data_set_string(settings, "path",
+                            QDir::toNativeSeparators(path).toStdString().c_str());
+        obs_data_set_string(settings, "muxer_settings", "movflags=faststart");
+        obs_output_update(r.output, settings);
+        obs_data_release(settings);
+
+        if (!obs_output_start(r.output))
+            blog(LOG_ERROR, "rendition %s start fail: %s",
+                 r.config.name.toStdString().c_str(),
+                 obs_output_get_last_error(r.output));
+    }
+
+    // 输出启动时编码器已经连接到 video 输出，此后的每一帧都会送到所有档位。
+    // 加 1 跳过连接期间可能正在分发的帧，门限打开前的帧由编码器丢弃
+    uint32_t startFrame = video_output_get_total_frames(obs_get_video()) + 1;
+    for (Rendition &r : renditions) {
+        if (!r.output || !obs_output_active(r.output) ||
+                !SetEncoderStartFrame(r.encoder, startFrame))
+            continue;
+        blog(LOG_INFO, "rendition %s starts at frame %u",
+             r.config.name.toStdString().c_str(), startFrame);
+    }
+}
+
+void QtOBSContext::stopRenditions(bool force)
+{
+    for (Rendition &r : renditions) {
+        if (!r.output || !obs_output_active(r.output))
+            continue;
+        if (force)
+            obs_output_force_stop(r.output);
+        else
+            obs_output_stop(r.output);
+    }
+}
+
+static const char *SpeakersName(enum speaker_layout speakers)
+{
+    switch (speakers) {
+    case SPEAKERS_MONO:    return "mono";
+    case SPEAKERS_STEREO:  return "stereo";
+    case SPEAKERS_5POINT1: return "5.1";
+    case SPEAKERS_7POINT1: return "7.1";
+    default:               return "other";
+    }
+}
+
+/**
+ * @brief 探测麦克风、桌面音频设备的原生格式，格式未知的设备为 0 Hz
+ *        current 为 false 时（初始化，音频源还未创建）按 "default" 设备查询，
+ *        不调用 libobs，可在工作线程中运行
+ */
+void QtOBSContext::probeAudioFormats(std::vector<AudioDeviceFormat> &formats,
+                                     bool current)
+{
+    static const int channels[] = {SOURCE_CHANNEL_AUDIO_INPUT,
+                                   SOURCE_CHANNEL_AUDIO_OUTPUT};
+
+    formats.clear();
+    for (int channel : channels) {
+        bool input = channel == SOURCE_CHANNEL_AUDIO_INPUT;
+        std::string id = current ? GetAudioDeviceId(channel) : std::string();
+        if (id == "disabled")
+            continue;
+        if (id.empty())
+            id = "default";
+
+        AudioDeviceFormat format;
+        if (!audioDevices || !audioDevices->queryFormat(input, id, format))
+            format = AudioDeviceFormat();
+        blog(LOG_INFO, "audio %s device %s: %u Hz, %u ch",
+             input ? "input" : "output", id.c_str(), format.sampleRate,
+             format.channels);
+        formats.push_back(format);
+    }
+}
+
+bool QtOBSContext::resetAudio(const std::vector<AudioDeviceFormat> &formats)
+{
+    audioFormat = AudioPipelineFormat();
+    if (audioFormatMode == AudioFormatAuto)
+        audioFormat = ChooseAudioPipelineFormat(formats);
+
+    blog(LOG_INFO, "audio pipeline %u Hz %s (%s), rate conversions:%d, "
+                   "remixes:%d",
+         audioFormat.sampleRate, SpeakersName(audioFormat.speakers),
+         audioFormatMode == AudioFormatAuto ? "auto" : "fixed",
+         audioFormat.rateConversions, audioFormat.remixes);
+
+    struct obs_audio_info oai;
+    oai.samples_per_sec = audioFormat.sampleRate;
+    oai.speakers        = audioFormat.speakers;
+    return obs_reset_audio(&oai);
+}
+
+/**
+ * @brief 运行中切换的设备与管线采样率不同时只能由 libobs 重采样，提示重新初始化
+ */
+void QtOBSContext::checkAudioDeviceFormat(bool input, const std::string &id)
+{
+    AudioDeviceFormat format;
+    if (!audioDevices || !audioDevices->queryFormat(input, id, format) ||
+            format.sampleRate == audioFormat.sampleRate)
+        return;
+
+    blog(LOG_WARNING, "audio %s device %s runs at %u Hz, pipeline is %u Hz; "
+                      "samples will be resampled, re-initialize to re-match",
+         input ? "input" : "output", id.c_str(), format.sampleRate,
+         audioFormat.sampleRate);
+}
+
+int QtOBSContext::resetVideo()
+{
+    struct obs_video_info ovi;
+    ovi.fps_num         = VIDEO_FPS; // 设置帧率，可自行调整
+    ovi.fps_den         = 1;
+    ovi.graphics_module = DL_D3D11;  // Win32 默认使用 Direct3D 11 参见 obs-app.cpp OBSApp::InitGlobalConfigDefaults()
+    ovi.base_width      = this->baseWidth;
+    ovi.base_height     = this->baseHeight;
+    ovi.output_width    = this->outputWidth;
+    ovi.output_height   = this->outputHeight;
+    ovi.output_format   = VIDEO_FORMAT_I420;
+    ovi.colorspace      = VIDEO_CS_601; // 参见 https://obsproject.com/forum/resources/obs-studio-color-space-color-format-color-range-settings-guide-test-charts.442/
+    ovi.range           = VIDEO_RANGE_PARTIAL;
+    ovi.adapter         = 0;         // 显示适配器索引，可自行调整
+    ovi.gpu_conversion  = true;
+    ovi.scale_type      = OBS_SCALE_BICUBIC;
+
+    int ret = obs_reset_video(&ovi);
+
+    if (IS_WIN32 && ret != OBS_VIDEO_SUCCESS) {
+        if (strcmp(ovi.graphics_module, DL_OPENGL) != 0) {
+            blog(LOG_WARNING, "failed to initialize obs video (%d) "
+                              "with graphics_module='%s', retrying "
+                              "with graphics_module='%s'",
+                 ret, ovi.graphics_module, DL_OPENGL);
+            ovi.graphics_module = DL_OPENGL;
+            ret = obs_reset_video(&ovi);
+        }
+    }
+
+    return ret;
+}
+
+void QtOBSContext::resetRecordFilePath(const QString &path)
+{
+    if (filePath) free(filePath);
+    filePath = _strdup(path.toStdString().c_str());
+    blog(LOG_INFO, "reset output file path %s", filePath);
+}
+
+void QtOBSContext::resetStreamLiveUrl(const QString &server,
+                                      const QString &key)
+{
+    if (liveServer) free(liveServer);
+    if (liveKey) free(liveKey);
+    liveServer = _strdup(server.toStdString().c_str());
+    liveKey = _strdup(key.toStdString().c_str());
+    blog(LOG_INFO, "reset output rtmp url %s%s", liveServer, liveKey);
+}
+
+/**
+ * @brief 设置音频输入、输出设备
+ *        输出设备序号： 1， 2
+ *        输入设备序号： 3， 4， 5
+ */
+void QtOBSContext::resetAudioInput(const QString &deviceId,
+                                   const QString &deviceDesc)
+{
+    std::string currentDeviceId = GetAudioDeviceId(SOURCE_CHANNEL_AUDIO_INPUT);
+
+    // 先按 ID 再按描述查找，不再每次重新枚举设备
+    AudioDeviceInfo device;
+    bool find = audioDevices &&
+            ((!deviceId.isEmpty() &&
+              audioDevices->findById(true, deviceId.toStdString(), device)) ||
+             audioDevices->findByDescription(true, deviceDesc.toStdString(),
+                                             device));
+    if (find) {
+        blog(LOG_INFO, "reset audio input use %s", device.name.c_str());
+        ResetAudioDevice(INPUT_AUDIO_SOURCE, device.id.c_str(),
+                         device.name.c_str(), SOURCE_CHANNEL_AUDIO_INPUT);
+        checkAudioDeviceFormat(true, device.id);
+    } else if (currentDeviceId != "default") {
+        blog(LOG_INFO, "reset audio input use \"default\"");
+        ResetAudioDevice(INPUT_AUDIO_SOURCE, "default",
+                         TAG " Default Mic/Aux",
+                         SOURCE_CHANNEL_AUDIO_INPUT);
+    }
+
+    setupNoiseSuppression();
+    attachAudioMeters();
+    setupAVSync();
+}
+
+void QtOBSContext::resetAudioOutput(const QString &deviceId,
+                                    const QString &deviceDesc)
+{
+    std::string currentDeviceId = GetAudioDeviceId(SOURCE_CHANNEL_AUDIO_OUTPUT);
+
+    AudioDeviceInfo device;
+    bool find = audioDevices &&
+            ((!deviceId.isEmpty() &&
+              audioDevices->findById(false, deviceId.toStdString(), device)) ||
+             audioDevices->findByDescription(false, deviceDesc.toStdString(),
+                                             device));
+    if (find) {
+        blog(LOG_INFO, "reset audio output use %s.", device.name.c_str());
+        ResetAudioDevice(OUTPUT_AUDIO_SOURCE, device.id.c_str(),
+                         device.name.c_str(), SOURCE_CHANNEL_AUDIO_OUTPUT);
+        checkAudioDeviceFormat(false, device.id);
+    } else if (currentDeviceId != "default") {
+        blog(LOG_INFO, "reset audio output use \"default\".");
+        ResetAudioDevice(OUTPUT_AUDIO_SOURCE, "default",
+                         TAG " Default Desktop Audio",
+                         SOURCE_CHANNEL_AUDIO_OUTPUT);
+    }
+
+    attachAudioMeters();
+    setupAVSync();
+}
+
+void QtOBSContext::attachAudioMeters()
+{
+    obs_source_t *input = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
+    obs_source_t *output = obs_get_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT);
+    inputMeter.attach(input);
+    outputMeter.attach(output);
+    obs_source_release(input);
+    obs_source_release(output);
+}
+
+static obs_source_t *GetAVSyncFilter(int channel)
+{
+    obs_source_t *source = obs_get_output_source(channel);
+    if (!source)
+        return nullptr;
+
+    std::string name = std::string(obs_source_get_name(source)) + "-AVSync";
+    obs_source_t *filter = obs_source_get_filter_by_name(source, name.c_str());
+    obs_source_release(source);
+    return filter;
+}
+
+static void SetupAVSyncFilter(int channel, obs_data_t *settings)
+{
+    obs_source_t *source = obs_get_output_source(channel);
+    if (!source)
+        return;
+
+    // 设备切换时源保持不变（只更新 device_id），滤镜已存在时只更新设置
+    std::string name = std::string(obs_source_get_name(source)) + "-AVSync";
+    obs_source_t *filter = obs_source_get_filter_by_name(source, name.c_str());
+    if (filter) {
+        obs_source_update(filter, settings);
+    } else {
+        filter = obs_source_create(AV_SYNC_FILTER_ID, name.c_str(), settings,
+                                   nullptr);
+        if (filter)
+            obs_source_filter_add(source, filter);
+    }
+
+    obs_source_release(filter);
+    obs_source_release(source);
+}
+
+// 设备源重建后重新添加；放在降噪等滤镜之后，修正的是最终送入混音的时间戳
+void QtOBSContext::setupAVSync()
+{
+    obs_data_t *settings = obs_data_create();
+    obs_data_set_bool(settings, "correct", avSyncCorrect);
+    obs_data_set_int(settings, "threshold_ms", avSyncThresholdMs);
+    SetupAVSyncFilter(SOURCE_CHANNEL_AUDIO_INPUT, settings);
+    SetupAVSyncFilter(SOURCE_CHANNEL_AUDIO_OUTPUT, settings);
+    obs_data_release(settings);
+}
+
+bool QtOBSContext::getAVSyncStats(int channel, AVSyncStats &stats) const
+{
+    int sourceChannel;
+    switch (channel) {
+    case MeterAudioInput:
+        sourceChannel = SOURCE_CHANNEL_AUDIO_INPUT;
+        break;
+    case MeterAudioOutput:
+        sourceChannel = SOURCE_CHANNEL_AUDIO_OUTPUT;
+        break;
+    default:
+        return false;
+    }
+
+    obs_source_t *filter = GetAVSyncFilter(sourceChannel);
+    bool ok = GetAVSyncStats(filter, stats);
+    obs_source_release(filter);
+    return ok;
+}
+
+void QtOBSContext::setAVSyncCorrection(bool enable, int thresholdMs)
+{
+    avSyncCorrect     = enable;
+    avSyncThresholdMs = std::max(thresholdMs, 1);
+    setupAVSync();
+}
+
+void QtOBSContext::logAVSyncStats()
+{
+    static const struct {
+        int        channel;
+        int        sourceChannel;
+        const char *name;
+    } sources[] = {
+        {MeterAudioInput, SOURCE_CHANNEL_AUDIO_INPUT, "input"},
+        {MeterAudioOutput, SOURCE_CHANNEL_AUDIO_OUTPUT, "output"},
+    };
+
+    for (const auto &s : sources) {
+        AVSyncStats stats;
+        if (!getAVSyncStats(s.channel, stats) || !stats.windows)
+            continue;
+
+        // ResetAudioDevice 关闭了 use_device_timing，一并输出以便对照
+        bool deviceTiming = false;
+        obs_source_t *source = obs_get_output_source(s.sourceChannel);
+        if (source) {
+            obs_data_t *settings = obs_source_get_settings(source);
+            deviceTiming = obs_data_get_bool(settings, "use_device_timing");
+            obs_data_release(settings);
+            obs_source_release(source);
+        }
+
+        blog(LOG_INFO, "a/v sync %s, device timing:%d, drift:%.2f ms "
+                       "(%.1f ppm over %.0f s), max:%.2f ms, correction:%.2f ms, "
+                       "steps:%llu (forced %llu), resets:%llu",
+             s.name, deviceTiming, (double)stats.driftNs / 1000000.0,
+             stats.driftPpm(), (double)stats.elapsedNs / 1000000000.0,
+             (double)stats.maxDriftNs / 1000000.0,
+             (double)stats.correctionNs / 1000000.0,
+             (unsigned long long)stats.steps,
+             (unsigned long long)stats.forcedSteps,
+             (unsigned long long)stats.resets);
+    }
+}
+
+void QtOBSContext::setAudioDeviceBackend(AudioDeviceBackend *backend)
+{
+    if (audioDevices) {
+        blog(LOG_WARNING, "audio device registry already created.");
+        delete backend;
+        return;
+    }
+    audioDevices.reset(new AudioDeviceRegistry(backend));
+}
+
+bool QtOBSContext::getAudioLevels(int channel, AudioMeterLevels &levels) const
+{
+    switch (channel) {
+    case MeterAudioInput:
+        return inputMeter.read(levels);
+    case MeterAudioOutput:
+        return outputMeter.read(levels);
+    default:
+        return false;
+    }
+}
+
+static void AudioDownmixMono(obs_source_t *source, bool enable)
+{
+    if (!source) return;
+
+    uint32_t flags = obs_source_get_flags(source);
+    bool forceMonoActive = (flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0;
+    blog(LOG_INFO, "audio force mono %d", forceMonoActive);
+    if (forceMonoActive != enable) {
+        if (enable)
+            flags |= OBS_SOURCE_FLAG_FORCE_MONO;
+        else
+            flags &= ~OBS_SOURCE_FLAG_FORCE_MONO;
+        obs_source_set_flags(source, flags);
+    }
+}
+
+// VAD 模式下 VAD 滤镜必须先于 noise_suppress_filter 添加（先添加的滤镜先处理）
+void QtOBSContext::setupNoiseSuppression()
+{
+    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
+    if (!source)
+        return;
+
+    bool useVAD = noiseSuppressionMode == NoiseSuppressionVAD;
+    obs_source_t *vad = GetAudioInputFilter(source, VAD_NOISE_SUPPRESS_FILTER_ID);
+    obs_source_t *suppressor = GetAudioInputFilter(source, "noise_suppress_filter");
+
+    if (useVAD && !vad) {
+        if (suppressor) {
+            obs_source_filter_remove(source, suppressor);
+            obs_source_release(suppressor);
+            suppressor = nullptr;
+        }
+        AddFilterToAudioInput(VAD_NOISE_SUPPRESS_FILTER_ID);
+        vad = GetAudioInputFilter(source, VAD_NOISE_SUPPRESS_FILTER_ID);
+    } else if (!useVAD && vad) {
+        SetVADSuppressor(vad, nullptr);
+        obs_source_filter_remove(source, vad);
+        obs_source_release(vad);
+        vad = nullptr;
+    }
+
+    if (!suppressor) {
+        AddFilterToAudioInput("noise_suppress_filter");
+        suppressor = GetAudioInputFilter(source, "noise_suppress_filter");
+    }
+
+    if (vad)
+        SetVADSuppressor(vad, suppressor);
+    else if (suppressor)
+        obs_source_set_enabled(suppressor, true);
+
+    blog(LOG_INFO, "noise suppression mode: %s", useVAD ? "vad" : "always");
+
+    obs_source_release(suppressor);
+    obs_source_release(vad);
+    obs_source_release(source);
+}
+
+void QtOBSContext::setNoiseSuppressionMode(int mode)
+{
+    if (noiseSuppressionMode == mode)
+        return;
+
+    noiseSuppressionMode = mode;
+    setupNoiseSuppression();
+}
+
+void QtOBSContext::logNoiseSuppressionStats()
+{
+    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
+    if (!source)
+        return;
+
+    obs_source_t *vad = GetAudioInputFilter(source, VAD_NOISE_SUPPRESS_FILTER_ID);
+    VADFilterStats stats = {};
+    if (vad && GetVADFilterStats(vad, stats) && stats.blocks) {
+        blog(LOG_INFO, "noise suppression stat, blocks:%llu, suppressor "
+                       "active:%.1f%%, vad:%.2f us/block",
+             (unsigned long long)stats.blocks,
+             (double)stats.voicedBlocks / (double)stats.blocks * 100.0,
+             (double)stats.processNs / 1000.0 / (double)stats.blocks);
+    }
+
+    obs_source_release(vad);
+    obs_source_release(source);
+}
+
+void QtOBSContext::benchmarkNoiseSuppression(int seconds)
+{
+    NoiseSuppressionBenchmark result;
+    if (!BenchmarkNoiseSuppression(seconds, result))
+        return;
+
+    blog(LOG_INFO, "noise suppression benchmark, cpu ms per minute of audio "
+                   "(%d s per pass):", seconds);
+    blog(LOG_INFO, "\talways: silence %.1f ms, speech %.1f ms",
+         result.alwaysSilenceMs, result.alwaysSpeechMs);
+    blog(LOG_INFO, "\tvad:    silence %.1f ms (suppressor %.0f%%), "
+                   "speech %.1f ms (suppressor %.0f%%)",
+         result.vadSilenceMs, result.vadSilenceActive * 100.0,
+         result.vadSpeechMs, result.vadSpeechActive * 100.0);
+}
+
+void QtOBSContext::setAudioFormatMode(int mode)
+{
+    if (audioFormatMode == mode)
+        return;
+
+    audioFormatMode = mode;
+    blog(LOG_INFO, "audio format mode %s, applies on next initialize",
+         mode == AudioFormatAuto ? "auto" : "fixed");
+}
+
+void QtOBSContext::benchmarkAudioFormat(int seconds)
+{
+    std::vector<AudioDeviceFormat> formats;
+    probeAudioFormats(formats);
+
+    AudioPipelineFormat before;
+    AudioPipelineFormat after = ChooseAudioPipelineFormat(formats);
+    CountAudioConversions(formats, before);
+
+    AudioFormatCost beforeCost, afterCost;
+    if (!MeasureAudioFormatCost(formats, before.sampleRate, before.speakers,
+                                seconds, beforeCost) ||
+            !MeasureAudioFormatCost(formats, after.sampleRate, after.speakers,
+                                    seconds, afterCost))
+        return;
+
+    // 每秒音频的 CPU 毫秒数，除以 10 即占单核的百分比
+    blog(LOG_INFO, "audio format benchmark, cpu ms per second of audio "
+                   "(%d s per pass):", seconds);
+    blog(LOG_INFO, "\tbefore %u Hz %s: resample %.2f ms, aac %.2f ms, "
+                   "total %.2f%% of a core (%d rate conversions)",
+         before.sampleRate, SpeakersName(before.speakers),
+         beforeCost.resampleMs, beforeCost.encodeMs,
+         (beforeCost.resampleMs + beforeCost.encodeMs) / 10.0,
+         before.rateConversions);
+    blog(LOG_INFO, "\tafter  %u Hz %s: resample %.2f ms, aac %.2f ms, "
+                   "total %.2f%% of a core (%d rate conversions)",
+         after.sampleRate, SpeakersName(after.speakers),
+         afterCost.resampleMs, afterCost.encodeMs,
+         (afterCost.resampleMs + afterCost.encodeMs) / 10.0,
+         after.rateConversions);
+}
+
+void QtOBSContext::downmixMonoInput(bool enable)
+{
+    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
+    if (source) {
+        AudioDownmixMono(source, enable);
+        obs_source_release(source);
+    }
+}
+
+void QtOBSContext::downmixMonoOutput(bool enable)
+{
+    obs_source_t *source = obs_get_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT);
+    if (source) {
+        AudioDownmixMono(source, enable);
+        obs_source_release(source);
+    }
+}
+
+void QtOBSContext::muteAudioInput(bool mute)
+{
+    obs_source_t *source =
+            obs_get_output_source(SOURCE_CHANNEL_AUDIO_INPUT);
+    if (source) {
+        bool old = obs_source_muted(source);
+        //        if (old != mute) {
+        blog(LOG_INFO, "mute audio input from:%d to:%d", old, mute);
+        obs_source_set_muted(source, mute);
+        //        }
+        obs_source_release(source);
+    }
+}
+
+void QtOBSContext::muteAudioOutput(bool mute)
+{
+    obs_source_t *source =
+            obs_get_output_source(SOURCE_CHANNEL_AUDIO_OUTPUT);
+    if (source) {
+        bool old = obs_source_muted(source);
+        //        if (old != mute) {
+        blog(LOG_INFO, "mute audio output from:%d to:%d.", old, mute);
+        obs_source_set_muted(source, mute);
+        //        }
+        obs_source_release(source);
+    }
+}
+
+OBSData QtOBSContext::getStreamEncSettings()
+{
+    obs_data_t *settings = obs_data_create();
+    if (!videoEncoderPreset.empty())
+        obs_data_set_string(settings, "preset", videoEncoderPreset.c_str());
+    obs_data_set_string(settings, "tune", "stillimage");
+    obs_data_set_string(settings, "x264opts",
+                        getX264ThreadOpts(" ").c_str());
+    obs_data_set_bool(settings, "vfr", false);
+    if (videoEncoderId == "obs_x264") {
+        obs_data_set_string(settings, "rate_control", "CRF");
+        obs_data_set_int(settings, "crf", 22);        // 23 标准值，值越小码率越大，文件越大
+    } else {
+        // 硬件编码器不支持 CRF，使用固定码率
+        obs_data_set_string(settings, "rate_control", "CBR");
+        obs_data_set_int(settings, "bitrate", 2500);
+    }
+    obs_data_set_string(settings, "profile", "main");
+    obs_data_set_int(settings, "keyint_sec", 10);
+    if (getStreamEncoderId() == ROI_ENCODER_ID)
+        obs_data_set_int(settings, "roi_mode", roiMode);
+
+    OBSData dataRet(settings);
+    obs_data_release(settings);
+    return dataRet;
+}
+
+OBSData QtOBSContext::getRenditionEncSettings(const RenditionConfig &config)
+{
+    OBSData settings = getStreamEncSettings();
+    QString preset = config.preset.isEmpty() ? QString("veryfast")
+                                             : config.preset;
+    obs_data_set_string(settings, "rate_control", "CBR");
+    obs_data_set_int(settings, "bitrate", config.bitrate);
+    if (getRenditionEncoderId() != ROI_ENCODER_ID)
+        return settings;
+
+    // preset 和 x264opts 只对 x264 有效，硬件编码器使用默认值
+    obs_data_set_string(settings, "preset", preset.toStdString().c_str());
+    // 关闭场景切换关键帧，关键帧只由启动门限按 keyint 强制产生
+    std::string opts = "scenecut=0" + getX264ThreadOpts(" ");
+    obs_data_set_string(settings, "x264opts", opts.c_str());
+    obs_data_set_int(settings, "roi_mode", ROI_MODE_OFF);
+    obs_data_set_bool(settings, "start_gate", true);
+    return settings;
+}
+
+// 探测结果为 obs_x264 时改用同样基于 x264 的 ROI_ENCODER_ID，以便按帧强制 IDR
+std::string QtOBSContext::getRenditionEncoderId() const
+{
+    if (videoEncoderId == "obs_x264")
+        return ROI_ENCODER_ID;
+    return videoEncoderId;
+}
+
+// ROI 编码器与 obs_x264 使用相同的设置，只替换 x264
+std::string QtOBSContext::getStreamEncoderId() const
+{
+    if (roiMode != ROI_MODE_OFF && videoEncoderId == "obs_x264")
+        return ROI_ENCODER_ID;
+    return videoEncoderId;
+}
+
+// x264 线程数，由线程拓扑配置指定，返回以 separator 开头的参数，未指定时返回空
+std::string QtOBSContext::getX264ThreadOpts(const char *separator)
+{
+    int threads = threadTopology.getConfig().x264Threads;
+    if (threads <= 0)
+        return std::string();
+    return std::string(separator) + "threads=" + std::to_string(threads);
+}
+
+bool QtOBSContext::setupRecord()
+{
+    obs_data_t *settings = obs_data_create();
+
+    obs_data_set_string(settings, "url", filePath);
+    obs_data_set_string(settings, "format_name", RECORD_OUTPUT_FORMAT);
+    obs_data_set_string(settings, "format_mime_type", RECORD_OUTPUT_FORMAT_MIME);
+    obs_data_set_string(settings, "muxer_settings", "movflags=faststart"); // moov 前置
+    obs_data_set_int(settings, "gop_size", VIDEO_FPS * 10);
+    obs_data_set_string(settings, "video_encoder", VIDEO_ENCODER_NAME);
+    obs_data_set_int(settings, "video_encoder_id", VIDEO_ENCODER_ID);
+    if (VIDEO_ENCODER_ID == AV_CODEC_ID_H264) {
+        // 探测结果为 x264 时，录制也使用探测出的 preset
+        std::string videoSettings = "profile=main x264-params=crf=22";
+        if (videoEncoderId == "obs_x264" && !videoEncoderPreset.empty())
+            videoSettings = "preset=" + videoEncoderPreset + " " + videoSettings;
+        videoSettings += getX264ThreadOpts(" ");
+        obs_data_set_string(settings, "video_settings", videoSettings.c_str());
+    }
+    else if (VIDEO_ENCODER_ID == AV_CODEC_ID_FLV1)
+        obs_data_set_int(settings, "video_bitrate", VIDEO_BITRATE);
+    obs_data_set_int(settings, "audio_bitrate", AUDIO_BITRATE);
+    obs_data_set_string(settings, "audio_encoder", "aac");
+    obs_data_set_int(settings, "audio_encoder_id", AV_CODEC_ID_AAC);
+    obs_data_set_string(settings, "audio_settings", NULL);
+
+    obs_data_set_int(settings, "scale_width", outputWidth);
+    obs_data_set_int(settings, "scale_height", outputHeight);
+
+    //obs_output_set_mixer(fileOutput, 0);
+    obs_output_set_media(recordOutput, obs_get_video(), obs_get_audio());
+    obs_output_update(recordOutput, settings);
+
+    obs_data_release(settings);
+
+    return true;
+}
+
+bool QtOBSContext::setupStream()
+{
+    OBSData settings = obs_data_create();
+    obs_data_release(settings);
+
+    obs_data_set_string(settings, "server", liveServer);
+    obs_data_set_string(settings, "key", liveKey);
+    obs_data_set_bool(settings, "use_auth", false);
+    obs_service_update(rtmpService, settings);
+
+    obs_output_set_reconnect_settings(streamOutput, 0, 0);
+
+    return true;
+}
+
+bool QtOBSContext::liveOutputActive()
+{
+    if ((recordOutput && obs_output_active(recordOutput)) ||
+            (streamOutput && obs_output_active(streamOutput)) ||
+            (hlsOutput && obs_output_active(hlsOutput)) ||
+            (blockOutput && obs_output_active(blockOutput)))
+        return true;
+
+    for (const Rendition &r : renditions) {
+        if (r.output && obs_output_active(r.output))
+            return true;
+    }
+    return false;
+}
+
+void QtOBSContext::startRecord(const QString &output)
+{
+    if (output.isEmpty()) {
+        blog(LOG_ERROR, "record parameter invalid, outputPath=%s.",
+             output.toStdString().c_str());
+        emit errorOccurred(Record, QStringLiteral("参数错误"));
+        return;
+    }
+
+    if (QString(filePath).compare(output) != 0) {
+        if (filePath) free(filePath);
+        filePath = _strdup(output.toStdString().c_str());
+        blog(LOG_INFO, "record output file path %s", filePath);
+    }
+
+    // 空闲时先恢复捕获和渲染，输出的第一帧就有画面
+    setupRecord();
+
+    if (!obs_output_start(recordOutput)) {
+        blog(LOG_ERROR, "record start fail");
+        emit errorOccurred(Record, QStringLiteral("启动失败"));
+        return;
+    }
+
+    startRenditions();
+
+    // ffmpeg_output 异步启动，编码线程可能稍后才创建，logThreadStats 时会再次应用
+    threadTopology.apply();
+}
+
+void QtOBSContext::stopRecord(bool force)
+{
+    if (obs_output_active(recordOutput)) {
+        if (force) {
+            obs_output_force_stop(recordOutput);
+        } else {
+            obs_output_stop(recordOutput);
+        }
+    }
+
+    stopRenditions(force);
+}
+
+void QtOBSContext::startStream(const QString &server, const QString &key)
+{
+    if (server.isEmpty() || key.isEmpty()) {
+        blog(LOG_ERROR, "stream parameter invalid, server=%s, key=%s",
+             server.toStdString().c_str(), key.toStdString().c_str());
+        emit errorOccurred(Stream, QStringLiteral("参数错误"));
+        return;
+    }
+
+    if (QString(liveServer).compare(server) != 0 ||
+            QString(liveKey).compare(key) != 0) {
+        if (liveServer) free(liveServer);
+        if (liveKey) free(liveKey);
+        liveServer = _strdup(server.toStdString().c_str());
+        liveKey = _strdup(key.toStdString().c_str());
+        blog(LOG_INFO, "stream url server:%s key:%s", liveServer, liveKey);
+    }
+
+    setupStream();
+
+    if (!obs_output_start(streamOutput)) {
+        blog(LOG_ERROR, "stream start fail");
+        emit errorOccurred(Stream, QStringLiteral("启动失败"));
+        return;
+    }
+
+    if (recordWhenStreaming)
+        startRecord(QString(filePath));
+    else
+        threadTopology.apply();
+
+    firstTotal = obs_output_get_total_frames(streamOutput);
+    firstDropped = obs_output_get_frames_dropped(streamOutput);
+    blog(LOG_INFO, "first total:%d, dropped:%d", firstTotal, firstDropped);
+}
+
+void QtOBSContext::stopStream(bool force)
+{
+    if (obs_output_active(streamOutput)) {
+        if (force) {
+            obs_output_force_stop(streamOutput);
+        } else {
+            obs_output_stop(streamOutput);
+        }
+    }
+
+    if (recordWhenStreaming)
+        stopRecord(force);
+}
+
+void QtOBSContext::updateVideoSettings(bool cursor, bool compatibility,
+                                       bool useWildcards)
+{
+    if (!captureSource) return;
+
+    blog(LOG_INFO, "update source cursor=%d, compatibility=%d, "
+                   "use_wildcards=%d", cursor, compatibility, useWildcards);
+    obs_data_t *settings = obs_source_get_settings(captureSource);
+    obs_data_set_bool(settings, "cursor", cursor);
+    obs_data_set_bool(settings, "compatibility", compatibility);
+    obs_data_set_bool(settings, "use_wildcards", useWildcards);
+    obs_source_update(captureSource, settings);
+    obs_data_release(settings);
+}
+
+void QtOBSContext::scaleScene(int w, int h)
+{
+    if (orgWidth == w && orgHeight == h)
+        return;
+
+    orgWidth = w;
+    orgHeight = h;
+    // 多源布局用 bounds 自动适应源尺寸的变化，不需要重新放缩
+    if (scene && !sceneLayout.active()) {
+        obs_scene_enum_items(scene, FindSceneItemAndScale, (void *)this);
+        blog(LOG_INFO, "scale scene to %dx%d.", w, h);
+    }
+}
+
+static LayoutSource ToLayoutSource(const LayoutSourceConfig &config)
+{
+    LayoutSource source;
+    source.name = config.name.toStdString();
+    source.id   = config.id.toStdString();
+    if (!config.settings.isEmpty()) {
+        source.settings = obs_data_create_from_json(
+                    config.settings.toStdString().c_str());
+        obs_data_release(source.settings);
+    }
+    source.crop.left   = config.crop.left();
+    source.crop.top    = config.crop.top();
+    source.crop.right  = config.crop.right();
+    source.crop.bottom = config.crop.bottom();
+    return source;
+}
+
+void QtOBSContext::applySceneLayout(SceneLayout::Mode mode,
+                                    const std::vector<LayoutSource> &sources)
+{
+    if (!scene) return;
+
+    bool wasActive = sceneLayout.active();
+    sceneLayout.apply(mode, sources);
+
+    // 回到单源时恢复主源原来的放缩方式
+    if (wasActive && !sceneLayout.active())
+        obs_scene_enum_items(scene, FindSceneItemAndScale, (void *)this);
+}
+
+void QtOBSContext::setSceneLayout(int mode,
+                                  const QList<LayoutSourceConfig> &sources)
+{
+    std::vector<LayoutSource> next;
+    for (const LayoutSourceConfig &config : sources)
+        next.push_back(ToLayoutSource(config));
+
+    applySceneLayout(mode == LayoutPictureInPicture ?
+                     SceneLayout::PictureInPicture : SceneLayout::Grid, next);
+}
+
+void QtOBSContext::addLayoutSource(const LayoutSourceConfig &source)
+{
+    if (!scene) return;
+
+    sceneLayout.add(ToLayoutSource(source));
+}
+
+void QtOBSContext::removeLayoutSource(const QString &name)
+{
+    if (!scene) return;
+
+    bool wasActive = sceneLayout.active();
+    sceneLayout.remove(name.toStdString());
+    if (wasActive && !sceneLayout.active())
+        obs_scene_enum_items(scene, FindSceneItemAndScale, (void *)this);
+}
+
+void QtOBSContext::cropLayoutSource(const QString &name, const QMargins &crop)
+{
+    obs_sceneitem_crop c;
+    c.left   = crop.left();
+    c.top    = crop.top();
+    c.right  = crop.right();
+    c.bottom = crop.bottom();
+    sceneLayout.setCrop(name.toStdString(), c);
+}
+
+void QtOBSContext::benchmarkSceneLayout(int maxSources, int seconds)
+{
+    if (!scene || !captureSource || maxSources < 0 || seconds <= 0)
+        return;
+    if (layoutBenchTimer && layoutBenchTimer->isActive()) {
+        blog(LOG_WARNING, "scene layout benchmark already running");
+        return;
+    }
+
+    LayoutBench &b = layoutBench;
+    b = LayoutBench();
+    sceneLayout.sources(b.saved);
+    b.savedMode  = sceneLayout.mode();
+    b.maxSources = maxSources;
+    b.seconds    = seconds;
+
+    // 每个额外源都捕获主源的窗口，测到的是捕获 + 合成的总开销
+    b.settings = obs_source_get_settings(captureSource);
+    obs_data_release(b.settings);
+
+    b.stats["render_main_texture"] = ProfilerEntryStats();
+    b.stats["tick_sources"]        = ProfilerEntryStats();
+
+    blog(LOG_INFO, "scene layout benchmark, %d s per step:", seconds);
+    blog(LOG_INFO, "\tsources  lock(us)  render(ms)  tick(ms)  frame(ms)  lagged");
+
+    if (!layoutBenchTimer) {
+        layoutBenchTimer = new QTimer(this);
+        layoutBenchTimer->setSingleShot(true);
+        connect(layoutBenchTimer, &QTimer::timeout,
+                this, &QtOBSContext::stepSceneLayoutBenchmark);
+    }
+    applyLayoutBenchStep();
+
+    // 基准测试只渲染、不连接输出，立即重新检查以恢复空闲暂停
+    checkIdle();
+}
+
+void QtOBSContext::applyLayoutBenchStep()
+{
+    LayoutBench &b = layoutBench;
+
+    std::vector<LayoutSource> sources;
+    for (int i = 0; i < b.sources; i++) {
+        LayoutSource source;
+        source.name     = TAG "-LayoutBench-" + std::to_string(i);
+        source.id       = "window_capture";
+        source.settings = b.settings;
+        sources.push_back(source);
+    }
+    b.lockUs   = sceneLayout.apply(SceneLayout::Grid, sources);
+    b.sampling = false;
+
+    // 等新源捕获到画面后再开始采样
+    layoutBenchTimer->start(1000);
+}
+
+void QtOBSContext::stepSceneLayoutBenchmark()
+{
+    LayoutBench &b = layoutBench;
+    if (!scene)
+        return;
+
+    QueryProfilerStats(b.stats);
+    if (!b.sampling) {
+        b.render   = b.stats["render_main_texture"];
+        b.tick     = b.stats["tick_sources"];
+        b.lagged   = obs_get_lagged_frames();
+        b.sampling = true;
+        layoutBenchTimer->start(b.seconds * 1000);
+        return;
+    }
+
+    const ProfilerEntryStats &r = b.stats["render_main_texture"];
+    const ProfilerEntryStats &t = b.stats["tick_sources"];
+    uint64_t renderCalls = r.calls - b.render.calls;
+    uint64_t tickCalls   = t.calls - b.tick.calls;
+
+    blog(LOG_INFO, "\t%7d  %8llu  %10.3f  %8.3f  %9.3f  %6u",
+         b.sources + 1, (unsigned long long)b.lockUs,
+         renderCalls ? (double)(r.totalUs - b.render.totalUs) / 1000.0 /
+                       (double)renderCalls : 0.0,
+         tickCalls ? (double)(t.totalUs - b.tick.totalUs) / 1000.0 /
+                     (double)tickCalls : 0.0,
+         (double)obs_get_average_frame_time_ns() / 1000000.0,
+         obs_get_lagged_frames() - b.lagged);
+
+    b.sources = b.sources ? b.sources * 2 : 1;
+    if (b.sources <= b.maxSources) {
+        applyLayoutBenchStep();
+        return;
+    }
+
+    applySceneLayout(b.savedMode, b.saved);
+    layoutBench = LayoutBench();
+}
+
+void QtOBSContext::logStreamStats()
+{
+    if (!streamOutput) return;
+
+    uint64_t totalBytes = obs_output_get_total_bytes(streamOutput);
+    uint64_t curTime = os_gettime_ns();
+    uint64_t bytesSent = totalBytes;
+
+    if (bytesSent < lastBytesSent)
+        bytesSent = 0;
+    if (bytesSent == 0)
+        lastBytesSent = 0;
+
+    uint64_t bitsBetween = (bytesSent - lastBytesSent) * 8;
+    long double timePassed = (long double)(curTime - lastBytesSentTime) /
+                             1000000000.0l;
+    long double kbps = (long double)bitsBetween /
+                       timePassed / 1000.0l;
+
+    if (timePassed < 0.01l)
+        kbps = 0.0l;
+
+    long double num = 0;
+    int total = obs_output_get_total_frames(streamOutput);
+    int dropped = obs_output_get_frames_dropped(streamOutput);
+    if (total < firstTotal || dropped < firstDropped) {
+        firstTotal   = 0;
+        firstDropped = 0;
+    }
+    total   -= firstTotal;
+    dropped -= firstDropped;
+    num = total ? (long double)dropped / (long double)total * 100.0l : 0.0l;
+
+    blog(LOG_INFO, "obs stream stat, bitrate:%.2lf kb/s, frames:%d / %d (%.2lf%%)",
+         kbps, dropped, total, num);
+
+    lastBytesSent     = bytesSent;
+    lastBytesSentTime = curTime;
+
+    logThreadStats();
+    logWindowResolverStats();
+    logFrameExportStats();
+    logRawTapStats();
+    logRawCaptureStats();
+    logSnapshotStats();
+    logBlockRecordStats();
+    logPostProcessStats();
+    logEventBusStats();
+    logFlightRecorderStats();
+    logIdleStats();
+    logAVSyncStats();
+    logROIStats();
+}
+
+void QtOBSContext::logThreadStats()
+{
+    // 先对新出现的线程应用配置，再输出每个线程的 CPU 占用
+    threadTopology.logStats();
+}
+
+void QtOBSContext::logRenditionStats()
+{
+    if (renditions.empty()) return;
+
+    ProfilerStatsMap stats;
+    for (const Rendition &r : renditions) {
+        std::string key = "encode(" TAG "-Rendition-" +
+                          r.config.name.toStdString() + ")";
+        stats[key] = ProfilerEntryStats();
+    }
+    QueryProfilerStats(stats);
+
+    double frameBudgetMs = 1000.0 / VIDEO_FPS;
+    int64_t firstKeyFrame = -1;
+    bool aligned = true;
+    for (Rendition &r : renditions) {
+        std::string key = "encode(" TAG "-Rendition-" +
+                          r.config.name.toStdString() + ")";
+        const ProfilerEntryStats &s = stats[key];
+        uint64_t calls  = s.calls - r.lastEncodeCalls;
+        uint64_t timeUs = s.totalUs - r.lastEncodeTimeUs;
+        double avgMs = calls ? (double)timeUs / 1000.0 / (double)calls : 0.0;
+
+        int total = r.output ? obs_output_get_total_frames(r.output) : 0;
+        int dropped = r.output ? obs_output_get_frames_dropped(r.output) : 0;
+
+        blog(LOG_INFO, "rendition %s stat, encode:%.2f ms/frame (max %.2f ms, "
+                       "%.1f%% of frame budget), frames:%d / %d",
+             r.config.name.toStdString().c_str(), avgMs,
+             (double)s.maxUs / 1000.0, avgMs / frameBudgetMs * 100.0,
+             dropped, total);
+
+        r.lastEncodeCalls  = s.calls;
+        r.lastEncodeTimeUs = s.totalUs;
+
+        // 启动门限的编码器：第一个关键帧都应在同一个帧序号上
+        ROIEncoderStats roiStats;
+        if (!r.output || !obs_output_active(r.output) ||
+                !GetROIEncoderStats(r.encoder, roiStats) ||
+                roiStats.startFrame < 0 || !roiStats.packets)
+            continue;
+        blog(LOG_INFO, "rendition %s start frame %lld, first keyframe %lld",
+             r.config.name.toStdString().c_str(),
+             (long long)roiStats.startFrame,
+             (long long)roiStats.firstKeyFrame);
+        if (roiStats.firstKeyFrame < 0 ||
+                (firstKeyFrame >= 0 && roiStats.firstKeyFrame != firstKeyFrame))
+            aligned = false;
+        firstKeyFrame = roiStats.firstKeyFrame;
+    }
+
+    if (!aligned)
+        blog(LOG_WARNING, "rendition keyframes are not aligned");
+}
+
+void QtOBSContext::startHLS(const QString &dir)
+{
+    if (dir.isEmpty() || !hlsOutput) {
+        blog(LOG_ERROR, "hls parameter invalid, dir=%s.",
+             dir.toStdString().c_str());
+        emit errorOccurred(Record, QStringLiteral("参数错误"));
+        return;
+    }
+
+    if (obs_output_active(hlsOutput)) {
+        blog(LOG_WARNING, "hls output is active, ignore.");
+        return;
+    }
+
+    obs_data_t *settings = obs_data_create();
+    obs_data_set_string(settings, "path", dir.toStdString().c_str());
+    obs_output_update(hlsOutput, settings);
+    obs_data_release(settings);
+
+    if (!obs_output_start(hlsOutput)) {
+        blog(LOG_ERROR, "hls start fail: %s",
+             obs_output_get_last_error(hlsOutput));
+        emit errorOccurred(Record, QStringLiteral("启动失败"));
+    }
+}
+
+void QtOBSContext::stopHLS(bool force)
+{
+    if (obs_output_active(hlsOutput)) {
+        if (force) {
+            obs_output_force_stop(hlsOutput);
+        } else {
+            obs_output_stop(hlsOutput);
+        }
+    }
+}
+
+void QtOBSContext::startBlockRecord(const QString &path, int queueDepth,
+                                    bool directIO, int preallocMB)
+{
+    if (path.isEmpty() || !blockOutput) {
+        blog(LOG_ERROR, "block record parameter invalid, path=%s.",
+             path.toStdString().c_str());
+        emit errorOccurred(Record, QStringLiteral("参数错误"));
+        return;
+    }
+
+    if (obs_output_active(blockOutput)) {
+        blog(LOG_WARNING, "block record output is active, ignore.");
+        return;
+    }
+
+    obs_data_t *settings = obs_data_create();
+    obs_data_set_string(settings, "path", path.toStdString().c_str());
+    obs_data_set_int(settings, "queue_depth", queueDepth);
+    obs_data_set_bool(settings, "direct_io", directIO);
+    obs_data_set_int(settings, "prealloc_mb", preallocMB);
+    obs_output_update(blockOutput, settings);
+    obs_data_release(settings);
+
+    if (!obs_output_start(blockOutput)) {
+        blog(LOG_ERROR, "block record start fail: %s",
+             obs_output_get_last_error(blockOutput));
+        emit errorOccurred(Record, QStringLiteral("启动失败"));
+    }
+}
+
+void QtOBSContext::stopBlockRecord(bool force)
+{
+    if (obs_output_active(blockOutput)) {
+        if (force) {
+            obs_output_force_stop(blockOutput);
+        } else {
+            obs_output_stop(blockOutput);
+        }
+    }
+}
+
+static void LogWriteLatency(const BlockWriterStats &s)
+{
+    std::string hist;
+    for (int i = 0; i < BLOCK_WRITER_LATENCY_BUCKETS; i++) {
+        if (!s.latency[i])
+            continue;
+        hist += " <" + std::to_string(2ULL << i) + "us:" +
+                std::to_string(s.latency[i]);
+    }
+    blog(LOG_INFO, "\twrite latency histogram:%s", hist.c_str());
+}
+
+void QtOBSContext::logBlockRecordStats()
+{
+    if (!blockOutput || !obs_output_active(blockOutput)) return;
+
+    BlockFileWriter *writer = GetBlockFileWriter(blockOutput);
+    if (!writer) return;
+
+    BlockWriterStats s;
+    writer->getStats(s);
+    blog(LOG_INFO, "block record stat, %s depth %u, %llu MB, writes:%llu, "
+                   "latency p50:%llu us p99:%llu us max:%llu us, "
+                   "stalls:%llu (%.2f ms), preallocs:%llu",
+         writer->backend(), writer->ioDepth(),
+         (unsigned long long)(s.bytes / (1024 * 1024)),
+         (unsigned long long)s.blocks,
+         (unsigned long long)s.percentileUs(50.0),
+         (unsigned long long)s.percentileUs(99.0),
+         (unsigned long long)s.latencyMaxUs, (unsigned long long)s.stalls,
+         (double)s.stallTotalNs / 1000000.0, (unsigned long long)s.preallocs);
+    LogWriteLatency(s);
+}
+
+void QtOBSContext::benchmarkRecordWriters(const QString &dir, int seconds)
+{
+    if (dir.isEmpty() || seconds <= 0 || !h264Streaming || !aacTrack[0])
+        return;
+
+    std::string base = dir.toStdString();
+    if (os_mkdirs(base.c_str()) == MKDIR_ERROR) {
+        blog(LOG_ERROR, "record writer benchmark: invalid dir '%s'",
+             base.c_str());
+        return;
+    }
+
+    // 所有输出共用推流编码器，只比较封装和写盘；ffmpeg_muxer 在编码线程中写管道，
+    // 磁盘慢时会阻塞编码线程，表现为 video-io 跳帧
+    static const int counts[] = {1, 8, 32};
+    static const char *writers[] = {"ffmpeg_muxer", BLOCK_FILE_OUTPUT_ID};
+
+    blog(LOG_INFO, "record writer benchmark, %d s per step, dir '%s':",
+         seconds, base.c_str());
+    blog(LOG_INFO, "\twriter                    n    MB/s  skipped  lagged  "
+                   "p50(us)  p99(us)  max(us)  stop(ms)");
+
+    video_t *video = obs_get_video();
+    for (int count : counts) {
+        for (const char *writer : writers) {
+            std::vector<OBSOutput>   outputs;
+            std::vector<std::string> paths;
+            for (int i = 0; i < count; i++) {
+                std::string name = TAG "-WriterBench-" + std::to_string(i);
+                std::string path = base + "/writer-bench-" +
+                                   std::to_string(i) + ".mp4";
+                OBSData settings = obs_data_create();
+                obs_data_release(settings);
+                obs_data_set_string(settings, "path", path.c_str());
+
+                OBSOutput output = obs_output_create(writer, name.c_str(),
+                                                     settings, nullptr);
+                if (!output)
+                    continue;
+                obs_output_release(output);
+                obs_output_set_video_encoder(output, h264Streaming);
+                obs_output_set_audio_encoder(output, aacTrack[0], 0);
+                outputs.push_back(output);
+                paths.push_back(path);
+            }
+
+            uint32_t skipped = video_output_get_skipped_frames(video);
+            uint32_t lagged  = obs_get_lagged_frames();
+            for (OBSOutput &output : outputs) {
+                if (!obs_output_start(output))
+                    blog(LOG_WARNING, "record writer benchmark: start %s "
+                                      "failed", writer);
+            }
+
+            os_sleep_ms(seconds * 1000);
+
+            uint64_t bytes = 0;
+            for (OBSOutput &output : outputs)
+                bytes += obs_output_get_total_bytes(output);
+            skipped = video_output_get_skipped_frames(video) - skipped;
+            lagged  = obs_get_lagged_frames() - lagged;
+
+            // 停止时间包括把缓冲的数据写完
+            uint64_t stopStart = os_gettime_ns();
+            for (OBSOutput &output : outputs)
+                obs_output_stop(output);
+            for (OBSOutput &output : outputs) {
+                while (obs_output_active(output) &&
+                       os_gettime_ns() - stopStart < 30000000000ULL)
+                    os_sleep_ms(10);
+            }
+            uint64_t stopMs = (os_gettime_ns() - stopStart) / 1000000;
+
+            BlockWriterStats s;
+            for (OBSOutput &output : outputs) {
+                BlockFileWriter *w = GetBlockFileWriter(output);
+                if (w) {
+                    BlockWriterStats one;
+                    w->getStats(one);
+                    s.merge(one);
+                }
+            }
+
+            double mbps = (double)bytes / (1024.0 * 1024.0) / seconds;
+            blog(LOG_INFO, "\t%-24s  %2d  %6.2f  %7u  %6u  %7llu  %7llu  "
+                           "%7llu  %8llu",
+                 writer, (int)outputs.size(), mbps, skipped, lagged,
+                 (unsigned long long)s.percentileUs(50.0),
+                 (unsigned long long)s.percentileUs(99.0),
+                 (unsigned long long)s.latencyMaxUs,
+                 (unsigned long long)stopMs);
+            if (s.blocks)
+                LogWriteLatency(s);
+
+            outputs.clear();
+            for (const std::string &path : paths)
+                os_unlink(path.c_str());
+        }
+    }
+}
+
+void QtOBSContext::startFrameExport(const QString &name, bool audio)
+{
+    if (!obs_get_video() || name.isEmpty()) return;
+
+    frameExportName = name.toStdString();
+    if (!frameExporter.start(frameExportName, audio)) {
+        frameExportName.clear();
+        emit errorOccurred(Init, QStringLiteral("启动画面导出失败"));
+    }
+}
+
+void QtOBSContext::stopFrameExport()
+{
+    if (!frameExporter.active()) return;
+
+    logFrameExportStats();
+    frameExporter.stop();
+    frameExportName.clear();
+}
+
+void QtOBSContext::logFrameExportStats()
+{
+    if (!frameExporter.active()) return;
+
+    FrameExportStats s;
+    frameExporter.getStats(s);
+    blog(LOG_INFO, "frame export stat '%s', video frames:%llu audio chunks:%llu "
+                   "bytes:%llu MB, copy avg:%.1f us max:%.1f us",
+         frameExportName.c_str(), (unsigned long long)s.videoFrames,
+         (unsigned long long)s.audioChunks,
+         (unsigned long long)s.bytes / (1024 * 1024),
+         s.videoFrames ? (double)s.copyTotalNs / 1000.0 / (double)s.videoFrames
+                       : 0.0,
+         (double)s.copyMaxNs / 1000.0);
+}
+
+// 一个读取端读取 seconds 秒，slowMs 为读到每一帧后的处理时间
+static void RunFrameExportReader(const std::string &name, int seconds,
+                                 int slowMs, uint64_t &received,
+                                 uint64_t &dropped, uint64_t &readBytes)
+{
+    received = dropped = readBytes = 0;
+
+    FrameExportReader reader;
+    if (!reader.attach(name))
+        return;
+
+    std::vector<uint8_t> buffer;
+    FrameExportFrame frame;
+    uint64_t end = os_gettime_ns() + (uint64_t)seconds * 1000000000ULL;
+    while (os_gettime_ns() < end) {
+        FrameExportReader::ReadResult res = reader.readNext(buffer, frame);
+        if (res == FrameExportReader::ReadRestarted)
+            break;
+        if (res == FrameExportReader::ReadNoData) {
+            os_sleep_ms(1);
+            continue;
+        }
+        readBytes += frame.size;
+        if (slowMs)
+            os_sleep_ms(slowMs);
+    }
+    received = reader.received();
+    dropped  = reader.dropped();
+}
+
+void QtOBSContext::benchmarkFrameExport(int seconds)
+{
+    if (!obs_get_video() || seconds <= 0) return;
+
+    bool temporary = !frameExporter.active();
+    if (temporary) {
+        QString name = QString("qtobs-bench-%1")
+                       .arg(QCoreApplication::applicationPid());
+        startFrameExport(name, false);
+        if (!frameExporter.active())
+            return;
+    }
+
+    blog(LOG_INFO, "frame export benchmark '%s', %d s per pass:",
+         frameExportName.c_str(), seconds);
+
+    const int passes[] = {0, 100};   // 读取端每帧的处理时间（毫秒）
+    for (int slowMs : passes) {
+        FrameExportStats before, after;
+        frameExporter.getStats(before);
+
+        uint64_t received, dropped, readBytes;
+        std::thread reader(RunFrameExportReader, frameExportName, seconds,
+                           slowMs, std::ref(received), std::ref(dropped),
+                           std::ref(readBytes));
+        reader.join();
+
+        frameExporter.getStats(after);
+        uint64_t frames = after.videoFrames - before.videoFrames;
+        blog(LOG_INFO, "\t%s reader: writer %.1f fps %.1f MB/s copy avg %.1f us "
+                       "max %.1f us, reader received %llu dropped %llu "
+                       "%.1f MB/s",
+             slowMs ? "slow" : "fast",
+             (double)frames / seconds,
+             (double)(after.bytes - before.bytes) / (1024.0 * 1024.0) / seconds,
+             frames ? (double)(after.copyTotalNs - before.copyTotalNs) /
+                      1000.0 / (double)frames : 0.0,
+             (double)after.copyMaxNs / 1000.0,
+             (unsigned long long)received, (unsigned long long)dropped,
+             (double)readBytes / (1024.0 * 1024.0) / seconds);
+    }
+
+    if (temporary)
+        stopFrameExport();
+}
+
+void QtOBSContext::logRawTapStats()
+{
+    std::vector<RawTapStats> stats;
+    rawTaps.getStats(stats);
+    for (const RawTapStats &s : stats) {
+        blog(LOG_INFO, "raw tap stat '%s' (%s), delivered:%llu dropped:%llu "
+                       "decimated:%llu, push avg:%.1f us max:%.1f us, "
+                       "callback avg:%.2f ms max:%.2f ms",
+             s.name.c_str(), s.video ? "video" : "audio",
+             (unsigned long long)s.delivered, (unsigned long long)s.dropped,
+             (unsigned long long)s.decimated,
+             s.delivered ? (double)s.pushTotalNs / 1000.0 /
+                           (double)s.delivered : 0.0,
+             (double)s.pushMaxNs / 1000.0,
+             s.delivered ? (double)s.callbackTotalNs / 1000000.0 /
+                           (double)s.delivered : 0.0,
+             (double)s.callbackMaxNs / 1000000.0);
+    }
+}
+
+void QtOBSContext::startRawCapture(const QString &path, bool audio)
+{
+    if (!rawCapture.start(path.toUtf8().constData(), audio))
+        blog(LOG_WARNING, "start raw capture '%s' failed",
+             path.toStdString().c_str());
+}
+
+void QtOBSContext::stopRawCapture()
+{
+    logRawCaptureStats();
+    rawCapture.stop();
+}
+
+void QtOBSContext::logRawCaptureStats()
+{
+    if (!rawCapture.active())
+        return;
+
+    RawCaptureStats s;
+    BlockWriterStats w;
+    rawCapture.getStats(s);
+    rawCapture.getWriterStats(w);
+
+    uint64_t records = s.videoFrames + s.audioChunks;
+    blog(LOG_INFO, "raw capture stat, video:%llu audio:%llu %.1f MB, "
+                   "write avg:%.3f ms max:%.3f ms, stalls:%llu failed:%llu",
+         (unsigned long long)s.videoFrames, (unsigned long long)s.audioChunks,
+         (double)s.bytes / (1024.0 * 1024.0),
+         records ? (double)s.writeTotalNs / 1000000.0 / (double)records : 0.0,
+         (double)s.writeMaxNs / 1000000.0, (unsigned long long)w.stalls,
+         (unsigned long long)s.failed);
+}
+
+void QtOBSContext::startReplay(const QString &path, bool maxRate, bool loop)
+{
+    if (!scene || !captureSource)
+        return;
+
+    stopReplay();
+
+    OBSData settings = obs_data_create();
+    obs_data_release(settings);
+    obs_data_set_string(settings, "path", path.toUtf8().constData());
+    obs_data_set_int(settings, "rate", maxRate ? RAW_REPLAY_RATE_MAX :
+                                                 RAW_REPLAY_RATE_ORIGINAL);
+    obs_data_set_bool(settings, "loop", loop);
+
+    replaySource = obs_source_create(RAW_REPLAY_SOURCE_ID, TAG "-RawReplay",
+                                     settings, nullptr);
+    obs_source_release(replaySource);
+    if (!replaySource) {
+        blog(LOG_WARNING, "create replay source failed");
+        return;
+    }
+
+    // 采集的是输出画面，铺满画布；隐藏窗口捕获源，避免它的开销影响测试结果
+    obs_sceneitem_t *item = obs_scene_add(scene, replaySource);
+    if (item) {
+        vec2 bounds;
+        vec2_set(&bounds, (float)baseWidth, (float)baseHeight);
+        obs_sceneitem_set_bounds_type(item, OBS_BOUNDS_STRETCH);
+        obs_sceneitem_set_bounds(item, &bounds);
+    }
+
+    obs_sceneitem_t *captureItem =
+            obs_scene_find_source(scene, obs_source_get_name(captureSource));
+    if (captureItem)
+        obs_sceneitem_set_visible(captureItem, false);
+
+    // 回放只渲染、不连接输出，立即重新检查以恢复空闲暂停
+    checkIdle();
+}
+
+void QtOBSContext::stopReplay()
+{
+    if (!replaySource)
+        return;
+
+    if (scene) {
+        obs_sceneitem_t *item =
+                obs_scene_find_source(scene, obs_source_get_name(replaySource));
+        if (item)
+            obs_sceneitem_remove(item);
+    }
+    if (scene && captureSource) {
+        obs_sceneitem_t *captureItem =
+                obs_scene_find_source(scene, obs_source_get_name(captureSource));
+        if (captureItem)
+            obs_sceneitem_set_visible(captureItem, true);
+    }
+
+    obs_source_remove(replaySource);
+    replaySource = nullptr;
+}
+
+void QtOBSContext::benchmarkRateDistortion(const QString &corpusDir,
+                                           const QString &outputDir,
+                                           int frames)
+{
+    if (!obs_get_video() || outputDir.isEmpty() || frames <= 1)
+        return;
+
+    RDBenchOptions options;
+    options.corpusDir = QDir::toNativeSeparators(corpusDir).toStdString();
+    options.outputDir = QDir::toNativeSeparators(outputDir).toStdString();
+    options.maxFrames = frames;
+    options.width     = outputWidth;
+    options.height    = outputHeight;
+    options.fps       = VIDEO_FPS;
+    options.x264opts  = getX264ThreadOpts("");
+
+    // 现行配置取自推流编码器设置，结果中标出它是否在 Pareto 前沿上
+    OBSData settings = getStreamEncSettings();
+    options.current.encoder     = videoEncoderId;
+    options.current.rateControl = obs_data_get_string(settings, "rate_control");
+    options.current.keyintSec   = (int)obs_data_get_int(settings, "keyint_sec");
+    if (videoEncoderId == "obs_x264") {
+        options.current.preset = obs_data_get_string(settings, "preset");
+        options.current.tune   = obs_data_get_string(settings, "tune");
+        options.current.value  = (int)obs_data_get_int(settings, "crf");
+    } else {
+        options.current.value  = (int)obs_data_get_int(settings, "bitrate");
+    }
+
+    std::vector<RDBenchPoint> points;
+    RunRDBench(options, points);
+}
+
+void QtOBSContext::setROIMode(int mode)
+{
+    if (mode < ROI_MODE_OFF || mode > ROI_MODE_AUTO)
+        return;
+    if (mode != ROI_MODE_OFF && videoEncoderId != "obs_x264")
+        blog(LOG_WARNING, "roi: not supported by %s, ignored",
+             videoEncoderId.c_str());
+
+    int previous = roiMode;
+    roiMode = mode;
+    if (!h264Streaming)
+        return;     // resetOutputs 按 roiMode 创建
+
+    std::string encoderId = getStreamEncoderId();
+    if (encoderId == obs_encoder_get_id(h264Streaming)) {
+        // 同一个 ROI 编码器，手动/自动在下一帧生效
+        obs_data_t *settings = obs_data_create();
+        obs_data_set_int(settings, "roi_mode", roiMode);
+        obs_encoder_update(h264Streaming, settings);
+        obs_data_release(settings);
+        return;
+    }
+
+    if (obs_encoder_active(h264Streaming)) {
+        blog(LOG_WARNING, "roi: streaming encoder is active, stop outputs "
+                          "before switching to %s", encoderId.c_str());
+        roiMode = previous;
+        return;
+    }
+
+    // 重建推流编码器并重新关联到各输出
+    h264Streaming = nullptr;
+    if (!resetOutputs())
+        emit errorOccurred(Init, QStringLiteral("切换 ROI 编码器失败"));
+}
+
+void QtOBSContext::setTextROI(const QList<QRect> &rects)
+{
+    roiRects = rects;
+    applyTextROI();
+}
+
+// 捕获画面坐标按 scaleScene 的缩放映射到输出画面
+void QtOBSContext::applyTextROI()
+{
+    if (!h264Streaming || orgWidth <= 0 || orgHeight <= 0 ||
+            strcmp(obs_encoder_get_id(h264Streaming), ROI_ENCODER_ID) != 0)
+        return;
+
+    obs_data_t *settings = obs_encoder_get_settings(h264Streaming);
+    float offset = (float)obs_data_get_double(settings, "roi_text_offset");
+    obs_data_release(settings);
+
+    std::vector<EncoderROI> rois;
+    for (const QRect &rect : roiRects) {
+        EncoderROI roi;
+        roi.left          = rect.left() * outputWidth / orgWidth;
+        roi.top           = rect.top() * outputHeight / orgHeight;
+        roi.right         = (rect.right() + 1) * outputWidth / orgWidth;
+        roi.bottom        = (rect.bottom() + 1) * outputHeight / orgHeight;
+        roi.qualityOffset = offset;
+        rois.push_back(roi);
+    }
+    SetEncoderROI(h264Streaming, rois);
+}
+
+void QtOBSContext::logROIStats()
+{
+    ROIEncoderStats s;
+    if (!GetROIEncoderStats(h264Streaming, s) || !s.frames)
+        return;
+
+    double blocks = s.totalBlocks ? (double)s.totalBlocks : 1.0;
+    blog(LOG_INFO, "roi stat, mode:%d manual rects:%d, frames:%llu "
+                   "(with roi %llu), regions avg:%.1f, text blocks:%.1f%% "
+                   "flat:%.1f%%, map avg:%.3f ms",
+         roiMode, (int)roiRects.size(), (unsigned long long)s.frames,
+         (unsigned long long)s.roiFrames,
+         (double)s.regions / (double)s.frames,
+         (double)s.textBlocks * 100.0 / blocks,
+         (double)s.flatBlocks * 100.0 / blocks,
+         (double)s.mapNs / (double)s.frames / 1000000.0);
+}
+
+void QtOBSContext::benchmarkROI(const QString &corpusDir,
+                                const QString &outputDir, int frames)
+{
+    if (!obs_get_video() || outputDir.isEmpty() || frames <= 1)
+        return;
+
+    RDBenchOptions options;
+    options.corpusDir = QDir::toNativeSeparators(corpusDir).toStdString();
+    options.outputDir = QDir::toNativeSeparators(outputDir).toStdString();
+    options.maxFrames = frames;
+    options.width     = outputWidth;
+    options.height    = outputHeight;
+    options.fps       = VIDEO_FPS;
+    options.x264opts  = getX264ThreadOpts("");
+
+    // 使用推流编码器的 x264 参数，只比较 ROI 的影响
+    OBSData settings = getStreamEncSettings();
+    options.current.preset    = videoEncoderPreset.empty() ? "veryfast"
+                              : videoEncoderPreset;
+    options.current.tune      = obs_data_get_string(settings, "tune");
+    options.current.keyintSec = (int)obs_data_get_int(settings, "keyint_sec");
+
+    ROIBenchResult result;
+    RunROIBench(options, result);
+}
+
+void QtOBSContext::startThumbnails(const QString &dir, int width,
+                                   int intervalMs, int quality,
+                                   double cpuBudget)
+{
+    if (!obs_get_video()) return;
+
+    if (!snapshots->startThumbnails(dir, width, intervalMs, quality, cpuBudget))
+        emit errorOccurred(Init, QStringLiteral("启动缩略图失败"));
+}
+
+void QtOBSContext::stopThumbnails()
+{
+    snapshots->stopThumbnails();
+}
+
+void QtOBSContext::takeSnapshot(const QString &path, int quality)
+{
+    if (!obs_get_video()) return;
+
+    if (!snapshots->takeStill(path, quality))
+        blog(LOG_WARNING, "take snapshot '%s' failed",
+             path.toStdString().c_str());
+}
+
+void QtOBSContext::logSnapshotStats()
+{
+    SnapshotStats s;
+    snapshots->getStats(s);
+    if (!s.thumbnails && !s.stills)
+        return;
+
+    // CPU 占用：编码线程 + tap 线程拷贝，占单核的百分比
+    uint64_t count = s.thumbnails + s.stills;
+    blog(LOG_INFO, "snapshot stat, thumbnails:%llu stills:%llu failed:%llu "
+                   "skipped busy:%llu budget:%llu, encode avg:%.2f ms, "
+                   "interval:%.0f ms, cpu:%.2f%%",
+         (unsigned long long)s.thumbnails, (unsigned long long)s.stills,
+         (unsigned long long)s.failed, (unsigned long long)s.skippedBusy,
+         (unsigned long long)s.skippedBudget,
+         (double)s.encodeCpuNs / 1000000.0 / (double)count, s.intervalMs,
+         s.elapsedNs ? (double)(s.encodeCpuNs + s.copyNs) * 100.0 /
+                       (double)s.elapsedNs : 0.0);
+}
+
+void QtOBSContext::handleEvents(const QVector<OBSEvent> &batch)
+{
+    for (const OBSEvent &event : batch) {
+        if (event.type == OBSEvent::OutputStarted) {
+            if (event.channel == RecordChannel)
+                emit recordStarted();
+            else if (event.channel == StreamChannel)
+                emit streamStarted();
+        } else if (event.type == OBSEvent::OutputStopped) {
+            // 每个输出报告在自己的类型上，HLS 出错不能影响录制的状态
+            int errorType = event.channel == StreamChannel ? Stream :
+                            event.channel == HLSChannel ? HLS :
+                            event.channel == BlockChannel ? BlockRecord :
+                            Record;
+            QString msg = event.channel == StreamChannel ?
+                          StreamErrorMessage(event.code) :
+                          RecordErrorMessage(event.code);
+            if (!msg.isEmpty()) {
+                // 出错前几分钟的指标和日志留作事后分析
+                dumpFlightRecorder();
+                emit errorOccurred(errorType, msg);
+            } else if (event.channel == RecordChannel)
+                emit recordStopped();
+            else if (event.channel == StreamChannel)
+                emit streamStopped();
+        } else if (event.type == OBSEvent::Stats &&
+                   event.channel == TapChannel) {
+            // 逐帧的丢帧事件，每个间隔只记录一次
+            if (event.timestampNs - lastTapDropLogNs < TAP_DROP_LOG_INTERVAL_NS)
+                continue;
+            lastTapDropLogNs = event.timestampNs;
+            blog(LOG_WARNING, "raw tap '%s' (%s) is dropping frames, "
+                              "seq %lld, dropped %lld",
+                 event.outputId, event.value[0] ? "video" : "audio",
+                 (long long)event.value[1], (long long)event.value[2]);
+        }
+    }
+}
+
+void QtOBSContext::logEventBusStats()
+{
+    OBSEventBusStats s;
+    events->getStats(s);
+    if (!s.posted)
+        return;
+
+    // 队列满的事件不计入 posted
+    uint64_t delivered = s.posted;
+    blog(LOG_INFO, "event bus stat, posted:%llu dropped:%llu batches:%llu "
+                   "avg batch:%.1f max batch:%llu, latency avg:%.3f ms "
+                   "max:%.3f ms",
+         (unsigned long long)s.posted, (unsigned long long)s.dropped,
+         (unsigned long long)s.batches,
+         s.batches ? (double)delivered / (double)s.batches : 0.0,
+         (unsigned long long)s.maxBatch,
+         delivered ? (double)s.latencyTotalNs / 1000000.0 / (double)delivered : 0.0,
+         (double)s.latencyMaxNs / 1000000.0);
+}
+
+void QtOBSContext::sampleFlightMetrics()
+{
+    if (!flight.isOpen())
+        return;
+
+    int64_t m[FLIGHT_METRIC_COUNT] = {};
+
+    uint64_t bytes;
+    int frames, dropped;
+    getRecordStats(bytes, frames, dropped);
+    m[FLIGHT_METRIC_RECORD_BYTES]   = (int64_t)bytes;
+    m[FLIGHT_METRIC_RECORD_FRAMES]  = frames;
+    m[FLIGHT_METRIC_RECORD_DROPPED] = dropped;
+
+    if (streamOutput && obs_output_active(streamOutput)) {
+        m[FLIGHT_METRIC_STREAM_BYTES] =
+                (int64_t)obs_output_get_total_bytes(streamOutput);
+        m[FLIGHT_METRIC_STREAM_FRAMES] =
+                obs_output_get_total_frames(streamOutput);
+        m[FLIGHT_METRIC_STREAM_DROPPED] =
+                obs_output_get_frames_dropped(streamOutput);
+    }
+
+    video_t *video = obs_get_video();
+    m[FLIGHT_METRIC_LAGGED_FRAMES]  = obs_get_lagged_frames();
+    m[FLIGHT_METRIC_SKIPPED_FRAMES] =
+            video ? video_output_get_skipped_frames(video) : 0;
+    m[FLIGHT_METRIC_FRAME_TIME_US]  =
+            (int64_t)(obs_get_average_frame_time_ns() / 1000);
+    m[FLIGHT_METRIC_ACTIVE_FPS_X100] = (int64_t)(obs_get_active_fps() * 100.0);
+    m[FLIGHT_METRIC_CPU_X100] =
+            cpuUsage ? (int64_t)(os_cpu_usage_info_query(cpuUsage) * 100.0) : 0;
+
+    // release 后 filePath 为 nullptr，dumpFlightRecorder 仍可能调用到这里
+    if (filePath) {
+        QString dir = QFileInfo(QString::fromUtf8(filePath)).absolutePath();
+        m[FLIGHT_METRIC_FREE_DISK_MB] = (int64_t)(
+                os_get_free_disk_space(dir.toUtf8().constData()) /
+                (1024 * 1024));
+    }
+
+    // 两个音频设备中绝对值较大的漂移
+    for (int channel : {MeterAudioInput, MeterAudioOutput}) {
+        AVSyncStats sync;
+        if (getAVSyncStats(channel, sync) &&
+                llabs(sync.driftNs / 1000) >
+                llabs(m[FLIGHT_METRIC_AUDIO_DRIFT_US]))
+            m[FLIGHT_METRIC_AUDIO_DRIFT_US] = sync.driftNs / 1000;
+    }
+
+    flight.writeMetrics(m, FLIGHT_METRIC_COUNT);
+}
+
+void QtOBSContext::dumpFlightRecorder(const QString &path)
+{
+    if (!flight.isOpen())
+        return;
+
+    QString file = path;
+    if (file.isEmpty())
+        file = flightDir + "/snapshot-" +
+               QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz") +
+               ".bin";
+
+    // 最新的一组指标也写进快照
+    sampleFlightMetrics();
+    flight.snapshot(file.toUtf8().constData());
+}
+
+void QtOBSContext::logFlightRecorderStats()
+{
+    if (!flight.isOpen())
+        return;
+
+    FlightRecorderStats s;
+    flight.getStats(s);
+    blog(LOG_INFO, "flight recorder stat, metrics:%llu logs:%llu events:%llu "
+                   "snapshots:%llu",
+         (unsigned long long)s.metrics, (unsigned long long)s.logs,
+         (unsigned long long)s.events, (unsigned long long)s.snapshots);
+}
+
+void QtOBSContext::setIdleSuspend(bool enable, int graceMs)
+{
+    idleEnabled = enable;
+    idleGraceMs = std::max(graceMs, 0);
+    if (!enable)
+        resumeIdle();
+}
+
+// 输出、raw 回调（tap、帧导出、缩略图）都会连接到 libobs 的 video/audio 输出
+bool QtOBSContext::outputsIdle()
+{
+    video_t *video = obs_get_video();
+    audio_t *audio = obs_get_audio();
+    if (!video)
+        return false;
+
+    return !video_output_active(video) && !(audio && audio_output_active(audio)) &&
+           !replaySource &&
+           !(layoutBenchTimer && layoutBenchTimer->isActive());
+}
+
+void QtOBSContext::checkIdle()
+{
+    uint64_t now = os_gettime_ns();
+    uint64_t elapsed = now - lastIdleCheckNs;
+    double cpu = idleCpu ? os_cpu_usage_info_query(idleCpu) : 0.0;
+    lastIdleCheckNs = now;
+
+    bool idle = outputsIdle();
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if (idleSuspended) {
+            idleStats.suspendedNs    += elapsed;
+            idleStats.suspendedCpuNs += cpu * (double)elapsed;
+        } else if (idle && idleSinceNs) {
+            idleStats.unsuspendedNs    += elapsed;
+            idleStats.unsuspendedCpuNs += cpu * (double)elapsed;
+        }
+    }
+
+    if (!idle) {
+        // 回放、布局基准测试只渲染、不连接输出，idleTick 看不到，在这里恢复
+        idleSinceNs = 0;
+        resumeIdle();
+        return;
+    }
+
+    if (!idleSinceNs)
+        idleSinceNs = now;
+    if (idleEnabled && !idleSuspended &&
+            now - idleSinceNs >= (uint64_t)idleGraceMs * 1000000ULL)
+        suspendIdle();
+}
+
+static const int idleAudioChannels[] = {
+    SOURCE_CHANNEL_AUDIO_INPUT,
+    SOURCE_CHANNEL_AUDIO_OUTPUT
+};
+
+void QtOBSContext::suspendIdle()
+{
+    std::lock_guard<std::mutex> lock(idleMutex);
+    if (idleSuspended)
+        return;
+
+    // 场景从输出通道移除后不再渲染，捕获源不在显示状态，窗口捕获的 tick 直接返回
+    idleTransition = obs_get_output_source(SOURCE_CHANNEL_TRANSITION);
+    obs_source_release(idleTransition);
+    if (!idleTransition)
+        return;
+    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, nullptr);
+
+    // 音频设备从输出通道移除后不再参与混音，降噪等滤镜禁用。设备本身没有暂停接口，
+    // 仍在采集（电平表不受影响）；音画同步滤镜保持运行，时间线连续，恢复后不丢失修正
+    auto collect = [] (obs_source_t *parent, obs_source_t *filter, void *param)
+    {
+        Q_UNUSED(parent);
+        if (obs_source_enabled(filter) &&
+                strcmp(obs_source_get_id(filter), AV_SYNC_FILTER_ID) != 0)
+            static_cast<std::vector<OBSSource> *>(param)->push_back(filter);
+    };
+    for (size_t i = 0; i < 2; i++) {
+        obs_source_t *source = obs_get_output_source(idleAudioChannels[i]);
+        idleAudio[i] = source;
+        obs_source_release(source);
+        if (!source)
+            continue;
+        obs_source_enum_filters(source, collect, &idleFilters);
+        obs_set_output_source(idleAudioChannels[i], nullptr);
+    }
+    for (OBSSource &filter : idleFilters)
+        obs_source_set_enabled(filter, false);
+
+    idleSuspended = true;
+    idleStats.suspends++;
+    blog(LOG_INFO, "idle: no output for %d ms, capture, rendering and audio "
+                   "mixing suspended, %d audio filters disabled",
+         idleGraceMs, (int)idleFilters.size());
+}
+
+void QtOBSContext::resumeIdle()
+{
+    std::lock_guard<std::mutex> lock(idleMutex);
+    resumeIdleLocked();
+}
+
+void QtOBSContext::idleTick()
+{
+    if (!idleSuspended.load(std::memory_order_acquire))
+        return;
+
+    video_t *video = obs_get_video();
+    audio_t *audio = obs_get_audio();
+    if (!(video && video_output_active(video)) &&
+            !(audio && audio_output_active(audio)))
+        return;
+
+    // 渲染线程不等待：obs 线程正在暂停/恢复时，下一帧再检查
+    std::unique_lock<std::mutex> lock(idleMutex, std::try_to_lock);
+    if (lock.owns_lock())
+        resumeIdleLocked();
+}
+
+void QtOBSContext::resumeIdleLocked()
+{
+    if (!idleSuspended)
+        return;
+
+    uint64_t start = os_gettime_ns();
+
+    // 在 tick 中恢复时，本帧的渲染即包含场景画面，窗口捕获在随后的源 tick 中取到窗口内容
+    obs_set_output_source(SOURCE_CHANNEL_TRANSITION, idleTransition);
+    for (size_t i = 0; i < 2; i++) {
+        if (idleAudio[i])
+            obs_set_output_source(idleAudioChannels[i], idleAudio[i]);
+        idleAudio[i] = nullptr;
+    }
+    for (OBSSource &filter : idleFilters)
+        obs_source_set_enabled(filter, true);
+    idleTransition = nullptr;
+    idleFilters.clear();
+
+    uint64_t elapsed = os_gettime_ns() - start;
+    idleSuspended = false;
+    idleSinceNs   = 0;
+    idleStats.resumeTotalNs += elapsed;
+    idleStats.resumeMaxNs    = std::max(idleStats.resumeMaxNs, elapsed);
+    blog(LOG_INFO, "idle: resumed in %.3f ms", (double)elapsed / 1000000.0);
+}
+
+void QtOBSContext::logIdleStats()
+{
+    std::lock_guard<std::mutex> lock(idleMutex);
+    if (!idleStats.suspends)
+        return;
+
+    // 没有输出但仍在渲染时的平均 CPU 与暂停时的差值即节省的部分
+    double suspendedCpu = idleStats.suspendedNs ?
+            idleStats.suspendedCpuNs / (double)idleStats.suspendedNs : 0.0;
+    double unsuspendedCpu = idleStats.unsuspendedNs ?
+            idleStats.unsuspendedCpuNs / (double)idleStats.unsuspendedNs : 0.0;
+    blog(LOG_INFO, "idle stat, suspends:%llu suspended:%.0f s, cpu idle "
+                   "rendering:%.2f%% suspended:%.2f%% saved:%.2f%%, "
+                   "resume avg:%.3f ms max:%.3f ms",
+         (unsigned long long)idleStats.suspends,
+         (double)idleStats.suspendedNs / 1000000000.0,
+         unsuspendedCpu, suspendedCpu, unsuspendedCpu - suspendedCpu,
+         (double)idleStats.resumeTotalNs / 1000000.0 /
+         (double)idleStats.suspends,
+         (double)idleStats.resumeMaxNs / 1000000.0);
+}
+
+void QtOBSContext::setPostProcessTypes(int types)
+{
+    postProcessTypes = types;
+}
+
+void QtOBSContext::enqueuePostProcess(const QString &file, int types)
+{
+    postProcess->enqueue(file, types);
+}
+
+void QtOBSContext::pausePostProcess(bool pause)
+{
+    postProcess->setPaused(pause);
+}
+
+void QtOBSContext::logPostProcessStats()
+{
+    postProcess->logStats();
+}
+
+void QtOBSContext::logHLSStats()
+{
+    if (!hlsOutput) return;
+
+    calldata_t cd = {0};
+    proc_handler_t *ph = obs_output_get_proc_handler(hlsOutput);
+    if (proc_handler_call(ph, "get_latency", &cd)) {
+        blog(LOG_INFO, "obs hls stat, part availability latency avg:%lld ms, "
+                       "max:%lld ms, parts:%lld",
+             calldata_int(&cd, "avg_ms"), calldata_int(&cd, "max_ms"),
+             calldata_int(&cd, "count"));
+    }
+    calldata_free(&cd);
+}
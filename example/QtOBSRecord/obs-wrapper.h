@@ -1,123 +1,552 @@
-﻿#pragma once
-
-#if _MSC_VER >= 1600
-#pragma execution_character_set("utf-8")
-#endif
-
-#include "obs.h"
-#include "obs.hpp"
-
-#define OUTPUT_FLV 0
-
-#include <string>
-#include <QSize>
-
-#include <QObject>
-
-class QtOBSContext : public QObject
-{
-    Q_OBJECT
-
-private:
-    char *filePath;
-    char *liveServer;
-    char *liveKey;
-
-    // 参考 struct obs_output
-    OBSService rtmpService;
-
-    OBSOutput recordOutput;
-    OBSOutput streamOutput;
-
-    OBSEncoder h264Streaming;
-
-    OBSEncoder aacTrack[MAX_AUDIO_MIXES];
-    std::string aacEncoderID[MAX_AUDIO_MIXES];
-
-    obs_scene_t *scene;
-    obs_source_t *fadeTransition;
-    obs_source_t *captureSource;
-    obs_properties_t *properties;
-
-    OBSSignal recordingStarted;
-    OBSSignal recordingStopping;
-    OBSSignal recordingStopped;
-    OBSSignal streamingStarted;
-    OBSSignal streamingStopping;
-    OBSSignal streamingStopped;
-
-    bool recordWhenStreaming;
-
-    int baseWidth;    // 场景画布分辨率
-    int baseHeight;
-    int outputWidth;  // 输出文件分辨率
-    int outputHeight;
-    int orgWidth;     // 窗口原始分辨率
-    int orgHeight;
-
-    uint64_t lastBytesSent;
-    uint64_t lastBytesSentTime;
-    int      firstTotal;
-    int      firstDropped;
-
-public:
-    explicit QtOBSContext(QObject *parent = nullptr);
-    ~QtOBSContext();
-
-    enum ErrorType { Init, Record, Stream };
-
-    const QSize getBaseSize() { return QSize(baseWidth, baseHeight); }
-    const QSize getOriginalSize() { return QSize(orgWidth, orgHeight); }
-
-signals:
-    void initialized();
-    void recordStarted();
-    void recordStopped();
-    void streamStarted();
-    void streamStopped();
-    void errorOccurred(const int, const QString &);
-
-public slots:
-    void initialize(const QString &configPath, const QString &windowTitle,
-                    const QSize &screenSize, const QRect &sourceRect);
-    void release();
-
-    void resetRecordFilePath(const QString &path);
-    void resetStreamLiveUrl(const QString &server, const QString &key);
-
-    void scaleScene(int w, int h);
-    void updateVideoSettings(bool cursor = true, bool compatibility = false,
-                             bool useWildcards = false);
-    void videoCrop(const QRect &);
-
-    void resetAudioInput(const QString &deviceId, const QString &deviceDesc);
-    void resetAudioOutput(const QString &deviceId, const QString &deviceDesc);
-
-    /* 处理单声道问题 */
-    void downmixMonoInput(bool enable);
-    void downmixMonoOutput(bool enable);
-
-    void muteAudioInput(bool);
-    void muteAudioOutput(bool);
-
-    void startRecord(const QString &output);
-    void stopRecord(bool force);
-
-    void startStream(const QString &server, const QString &key);
-    void stopStream(bool force);
-
-    void logStreamStats();
-
-private:
-    bool resetAudio();
-    int  resetVideo();
-
-    OBSData getStreamEncSettings();
-    bool initService();
-    bool resetOutputs();
-
-    bool setupRecord();
-    bool setupStream();
-
-    void addFilterToSource(obs_source_t *, const char *);
-};
+﻿#pragma once
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+#include "obs.h"
+#include "obs.hpp"
+
+#include "obs-thread-topology.h"
+#include "obs-audio-meter.h"
+#include "obs-audio-device-registry.h"
+#include "obs-audio-format.h"
+#include "obs-window-resolver.h"
+#include "obs-scene-layout.h"
+#include "obs-profiler-stats.h"
+#include "obs-frame-export.h"
+#include "obs-raw-tap.h"
+#include "obs-snapshot.h"
+#include "obs-post-process.h"
+#include "obs-event-bus.h"
+#include "obs-flight-recorder.h"
+#include "obs-raw-capture.h"
+#include "obs-av-sync.h"
+#include "obs-roi-encoder.h"
+
+#define OUTPUT_FLV 0
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <QSize>
+#include <QMargins>
+#include <QRect>
+#include <QList>
+#include <QMetaType>
+
+#include <QObject>
+#include <QTimer>
+
+class InitGraph;
+
+/* 多码率（simulcast）档位配置，所有档位共用 obs_get_video() 的同一路画面 */
+struct RenditionConfig
+{
+    QString name;     // 档位名称，如 "720p"，用于编码器名和输出文件名
+    int     width;    // 编码器缩放后的分辨率
+    int     height;
+    int     bitrate;  // kb/s
+    QString preset;   // x264 preset，为空则使用 veryfast
+
+    RenditionConfig() : width(0), height(0), bitrate(0) {}
+    RenditionConfig(const QString &n, int w, int h, int kbps,
+                    const QString &p = QString())
+        : name(n), width(w), height(h), bitrate(kbps), preset(p) {}
+};
+Q_DECLARE_METATYPE(RenditionConfig)
+
+/* 多源布局中的一个额外捕获源，主捕获源（应用窗口）始终在布局中 */
+struct LayoutSourceConfig
+{
+    QString  name;      // 唯一名称
+    QString  id;        // 源类型，如 window_capture、monitor_capture
+    QString  settings;  // 源设置（JSON），可以为空
+    QMargins crop;      // 各边剪裁的像素数
+
+    LayoutSourceConfig() {}
+    LayoutSourceConfig(const QString &n, const QString &i,
+                       const QString &s = QString(),
+                       const QMargins &c = QMargins())
+        : name(n), id(i), settings(s), crop(c) {}
+};
+Q_DECLARE_METATYPE(LayoutSourceConfig)
+
+class QtOBSContext : public QObject
+{
+    Q_OBJECT
+
+private:
+    char *filePath;
+    char *liveServer;
+    char *liveKey;
+
+    // 参考 struct obs_output
+    OBSService rtmpService;
+
+    OBSOutput recordOutput;
+    OBSOutput streamOutput;
+    OBSOutput hlsOutput;
+    OBSOutput blockOutput;
+
+    OBSEncoder h264Streaming;
+
+    // 参见 startRecord -> startRenditions，每个档位一个编码器 + 一个 ffmpeg_muxer 输出
+    struct Rendition {
+        RenditionConfig config;
+        OBSEncoder      encoder;
+        OBSOutput       output;
+        uint64_t        lastEncodeCalls;
+        uint64_t        lastEncodeTimeUs;
+    };
+    std::vector<Rendition> renditions;
+
+    OBSEncoder aacTrack[MAX_AUDIO_MIXES];
+    std::string aacEncoderID[MAX_AUDIO_MIXES];
+
+    // 启动时探测出的编码器，参见 probeEncoders
+    std::string videoEncoderId;
+    std::string videoEncoderPreset;
+    std::string audioEncoderId;
+
+    int noiseSuppressionMode;
+
+    // 音频管线格式，参见 setAudioFormatMode
+    int                 audioFormatMode;
+    AudioPipelineFormat audioFormat;
+
+    // 音频设备缓存，resetAudioInput/resetAudioOutput 在这里查找设备
+    std::unique_ptr<AudioDeviceRegistry> audioDevices;
+
+    // 麦克风/桌面音频电平，参见 getAudioLevels
+    AudioMeter inputMeter;
+    AudioMeter outputMeter;
+
+    // 音画同步滤镜的设置，参见 obs-av-sync.h
+    bool avSyncCorrect;
+    int  avSyncThresholdMs;
+
+    // ROI 编码，参见 setROIMode/setTextROI；roiRects 为捕获画面（剪裁后）的坐标
+    int          roiMode;
+    QList<QRect> roiRects;
+
+    // 初始化依赖图，参见 initialize；让出事件循环后仍在运行，release 时取消
+    InitGraph *initGraph;
+    // initialize/softReset 的参数，benchmarkReset 按此重新初始化
+    QString  initConfigPath;
+    QSize    initScreenSize;
+    QString  captureTitle;
+    QRect    captureRegion;
+    uint64_t coldStartupNs;    // obs_startup 和加载模块的耗时，本进程第一次初始化时测得
+    bool     videoPathReady;   // 初始化已运行到 video ready，release 时清除
+
+    // 管线线程的亲和性/优先级，配置文件为 configPath/thread-topology.json
+    ThreadTopology threadTopology;
+
+    obs_scene_t *scene;
+    obs_source_t *fadeTransition;
+    obs_source_t *captureSource;
+    obs_properties_t *properties;
+
+    // 额外捕获源的网格/画中画布局，参见 setSceneLayout
+    SceneLayout sceneLayout;
+
+    // 布局基准测试由定时器分档推进，不阻塞 obs 线程，参见 benchmarkSceneLayout
+    struct LayoutBench {
+        std::vector<LayoutSource> saved;
+        SceneLayout::Mode         savedMode;
+        OBSData                   settings;
+        ProfilerStatsMap          stats;
+        ProfilerEntryStats        render;      // 本档开始采样时的累计值
+        ProfilerEntryStats        tick;
+        uint32_t                  lagged;
+        uint64_t                  lockUs;
+        int                       maxSources;
+        int                       seconds;
+        int                       sources;     // 本档的额外源数量
+        bool                      sampling;    // false 为等待新源出画面
+    };
+    QTimer      *layoutBenchTimer;
+    LayoutBench layoutBench;
+
+    // 输出画面/音频导出到共享内存，供外部进程读取
+    FrameExporter frameExporter;
+    std::string   frameExportName;
+
+    // 进程内的原始画面/音频旁路
+    RawTapManager rawTaps;
+    // 原始画面/音频采集到文件，以及替换捕获源的重放源，用于可重复的性能测试
+    RawCaptureWriter rawCapture;
+    OBSSource        replaySource;
+    SnapshotGenerator *snapshots;
+
+    // libobs 输出线程的信号经事件总线批量交付到本线程，参见 handleEvents
+    OBSEventBus *events;
+    uint64_t    lastTapDropLogNs;   // tap 丢帧日志的限频
+
+    // 没有输出和 tap 时暂停捕获、渲染和音频混音，参见 checkIdle；
+    // 暂停/恢复可能发生在渲染线程（idleTick），由 idleMutex 保护
+    struct IdleStats {
+        uint64_t suspends;
+        uint64_t suspendedNs;       // 暂停的总时长
+        double   suspendedCpuNs;    // CPU 占用（百分比） * 时长
+        uint64_t unsuspendedNs;     // 没有输出但仍在渲染的总时长
+        double   unsuspendedCpuNs;
+        uint64_t resumeTotalNs;
+        uint64_t resumeMaxNs;
+    };
+    QTimer                    *idleTimer;
+    bool                      idleEnabled;
+    int                       idleGraceMs;
+    std::mutex                idleMutex;
+    std::atomic<bool>         idleSuspended;
+    std::atomic<uint64_t>     idleSinceNs;       // 最近一次变为没有输出的时间
+    uint64_t                  lastIdleCheckNs;
+    OBSSource                 idleTransition;    // 暂停期间从输出通道移除的场景
+    OBSSource                 idleAudio[2];      // 暂停期间从输出通道移除的音频设备
+    std::vector<OBSSource>    idleFilters;       // 暂停期间禁用的音频滤镜
+    struct os_cpu_usage_info  *idleCpu;
+    IdleStats                 idleStats;
+
+    // 最近的指标和日志，输出出错时写快照，参见 dumpFlightRecorder
+    FlightRecorder            flight;
+    QString                   flightDir;
+    QTimer                    *flightTimer;
+    struct os_cpu_usage_info  *cpuUsage;
+
+    // 录制完成后的转封装/代理/归档队列，直播输出卡顿时暂停
+    PostProcessQueue *postProcess;
+    int              postProcessTypes;   // 录制完成后自动添加的任务
+    uint32_t         lastLaggedFrames;
+    uint32_t         lastSkippedFrames;
+
+    // 捕获窗口的解析和自动重新绑定，参见 bindCaptureWindow
+    struct WindowResolverStats {
+        uint64_t lookups;
+        uint64_t lookupTotalUs;
+        uint64_t lookupMaxUs;
+        uint64_t rebinds;
+        uint64_t pollRebinds;      // 由兜底轮询（而非窗口事件）发现的重新绑定
+        uint64_t rebindTotalUs;
+        uint64_t rebindMaxUs;
+
+        WindowResolverStats() : lookups(0), lookupTotalUs(0), lookupMaxUs(0),
+            rebinds(0), pollRebinds(0), rebindTotalUs(0), rebindMaxUs(0) {}
+    };
+    WindowResolver      windowResolver;
+    WindowQuery         windowQuery;
+    WindowQuery         captureTarget;     // 为空时捕获本进程的窗口
+    WindowInfo          boundWindow;
+    WindowResolverStats windowStats;
+    QTimer              *windowTimer;
+    bool                windowDirty;
+    uint64_t            windowDirtyNs;
+    uint64_t            lastWindowCheckNs;
+    uint64_t            windowEnumUs;      // 初始化时工作线程枚举窗口的耗时
+
+    OBSSignal recordingStarted;
+    OBSSignal recordingStopping;
+    OBSSignal recordingStopped;
+    OBSSignal streamingStarted;
+    OBSSignal streamingStopping;
+    OBSSignal streamingStopped;
+    OBSSignal hlsStopped;
+    OBSSignal blockStopped;
+
+    bool recordWhenStreaming;
+
+    int baseWidth;    // 场景画布分辨率
+    int baseHeight;
+    int outputWidth;  // 输出文件分辨率
+    int outputHeight;
+    int orgWidth;     // 窗口原始分辨率
+    int orgHeight;
+
+    uint64_t lastBytesSent;
+    uint64_t lastBytesSentTime;
+    int      firstTotal;
+    int      firstDropped;
+
+public:
+    explicit QtOBSContext(QObject *parent = nullptr);
+    ~QtOBSContext();
+
+    enum ErrorType { Init, Record, Stream, HLS, BlockRecord };
+
+    /**
+     * 替换音频设备后端（如 FakeAudioDeviceBackend），需要在 initialize 之前调用，
+     * 接管 backend 的所有权
+     */
+    void setAudioDeviceBackend(AudioDeviceBackend *backend);
+
+    enum AudioMeterChannel { MeterAudioInput, MeterAudioOutput };
+
+    /**
+     * 读取电平快照，可在任意线程调用（不经过 obs 线程的事件队列），
+     * UI 按自己的刷新率轮询即可，参见 obs-audio-meter.h
+     */
+    bool getAudioLevels(int channel, AudioMeterLevels &levels) const;
+
+    // 音频设备相对视频时钟的漂移（channel 同 getAudioLevels），obs 线程中调用
+    bool getAVSyncStats(int channel, AVSyncStats &stats) const;
+
+    /* 麦克风降噪方式：始终降噪（默认） / 只在检测到说话时降噪 */
+    enum NoiseSuppressionMode { NoiseSuppressionAlways, NoiseSuppressionVAD };
+
+    /* 音频管线格式：固定 44100 Hz 立体声（默认） / 按设备的原生格式选择 */
+    enum AudioFormatMode { AudioFormatFixed, AudioFormatAuto };
+
+    /* 多源布局方式 */
+    enum SceneLayoutMode {
+        LayoutGrid             = SceneLayout::Grid,
+        LayoutPictureInPicture = SceneLayout::PictureInPicture
+    };
+
+    const QSize getBaseSize() { return QSize(baseWidth, baseHeight); }
+    const QSize getOriginalSize() { return QSize(orgWidth, orgHeight); }
+    obs_source_t *getCaptureSource() const { return captureSource; }
+
+    /* 捕获其它进程的窗口（录制工作进程使用），需要在 initialize 之前调用 */
+    void setCaptureTarget(uint pid, const QString &exe, const QString &className);
+
+    /**
+     * 进程内的原始画面/音频消费者（OCR、缩略图、校验和等），参见 obs-raw-tap.h。
+     * 可在任意线程添加/移除，需要在 initialized 之后；release 时全部移除
+     */
+    RawTapManager &getRawTaps() { return rawTaps; }
+
+    /* 输出信号和逐帧统计的事件总线，post 可在任意线程调用 */
+    OBSEventBus *eventBus() const { return events; }
+
+    /* 录制输出的累计字节数/帧数/丢帧数，需要在 obs 线程调用 */
+    void getRecordStats(uint64_t &bytes, int &frames, int &dropped);
+
+    // 由 obs 图形线程的 tick 回调调用，有输出或 raw 回调连接时在本帧渲染前恢复
+    void idleTick();
+
+signals:
+    void initialized();
+    /* 初始化中输出和捕获源已就绪，可以开始录制；之后麦克风/桌面音频陆续加入 */
+    void videoReady();
+    /* 初始化中麦克风/桌面音频源已创建 */
+    void audioReady();
+    void recordStarted();
+    void recordStopped();
+    void streamStarted();
+    void streamStopped();
+    void errorOccurred(const int, const QString &);
+    /* 缩略图 JPEG 数据，在编码线程中发出 */
+    void thumbnailReady(const QByteArray &jpeg, qint64 timestamp);
+
+public slots:
+    void initialize(const QString &configPath, const QString &windowTitle,
+                    const QSize &screenSize, const QRect &sourceRect);
+    void release();
+    /**
+     * 软重置：保留 libobs 核心、已加载的模块、图形/音频子系统、音频源和编码器，
+     * 只重建场景（转场、场景、窗口捕获源）和编码器与输出的绑定，用于更换捕获窗口
+     * 或区域。画布和输出分辨率不变，布局中的额外源被移除；需要在所有输出停止后调用，
+     * 成功后与 initialize 相同发出 videoReady 和 initialized。
+     * 拆除后重建失败时发出 Init 错误并 release，需要重新 initialize
+     */
+    void softReset(const QString &windowTitle, const QRect &sourceRect);
+    /* 交替软重置和 release + initialize 各 runs 次，测量从重置到录制开始的延迟，
+       录制文件写到 dir */
+    void benchmarkReset(const QString &dir, int runs = 5);
+
+    void resetRecordFilePath(const QString &path);
+    void resetStreamLiveUrl(const QString &server, const QString &key);
+
+    void scaleScene(int w, int h);
+
+    /* 多源布局，mode 为 SceneLayoutMode，每次调用只做一次场景原子更新 */
+    void setSceneLayout(int mode, const QList<LayoutSourceConfig> &sources);
+    void addLayoutSource(const LayoutSourceConfig &source);
+    void removeLayoutSource(const QString &name);
+    void cropLayoutSource(const QString &name, const QMargins &crop);
+    /* 额外源数量从 0 倍增到 maxSources，每档采样 seconds 秒的渲染耗时；
+       立即返回，由定时器逐档推进，结果写入日志 */
+    void benchmarkSceneLayout(int maxSources = 16, int seconds = 5);
+    void updateVideoSettings(bool cursor = true, bool compatibility = false,
+                             bool useWildcards = false);
+    void videoCrop(const QRect &);
+
+    void resetAudioInput(const QString &deviceId, const QString &deviceDesc);
+    void resetAudioOutput(const QString &deviceId, const QString &deviceDesc);
+
+    /* 处理单声道问题 */
+    void downmixMonoInput(bool enable);
+    void downmixMonoOutput(bool enable);
+
+    void muteAudioInput(bool);
+
+    void setNoiseSuppressionMode(int mode);
+    void logNoiseSuppressionStats();
+
+    /* 下次 initialize 时生效，运行中 obs_reset_audio 不能重新设置 */
+    void setAudioFormatMode(int mode);
+    /* 对比固定格式与自动选择的格式下，当前设备的转换和 AAC 编码每秒音频的 CPU 时间 */
+    void benchmarkAudioFormat(int seconds = 10);
+
+    /* 漂移超过 thresholdMs 时逐步修正音频源的 sync offset；默认只测量，
+       不改变音频时间戳，需要修正时显式开启 */
+    void setAVSyncCorrection(bool enable, int thresholdMs = 20);
+    void logAVSyncStats();
+
+    /* 更换捕获的窗口，pid 为 0、字符串为空表示不限制，标题支持 * 和 ? 通配符 */
+    void setCaptureWindow(uint pid, const QString &exe, const QString &className,
+                          const QString &titlePattern);
+    void logWindowResolverStats();
+
+    /* 每种组合处理 seconds 秒合成音频，结果折算为每分钟音频的 CPU 时间 */
+    void benchmarkNoiseSuppression(int seconds = 60);
+    void muteAudioOutput(bool);
+
+    void startRecord(const QString &output);
+    void stopRecord(bool force);
+
+    void startStream(const QString &server, const QString &key);
+    void stopStream(bool force);
+
+    void logStreamStats();
+    void logThreadStats();
+
+    /* 多码率档位，录制期间不可修改 */
+    void setRenditionLadder(const QList<RenditionConfig> &ladder);
+    void logRenditionStats();
+
+    /* 本地 LL-HLS 输出，使用推流编码器 h264Streaming 和 aacTrack[0] */
+    void startHLS(const QString &dir);
+    void stopHLS(bool force);
+    void logHLSStats();
+
+    /* fMP4 块写入录制（obs-block-file-output.h），同样使用 h264Streaming 和 aacTrack[0] */
+    void startBlockRecord(const QString &path, int queueDepth = 8,
+                          bool directIO = false, int preallocMB = 64);
+    void stopBlockRecord(bool force);
+    void logBlockRecordStats();
+    /* 1、8、32 路并发录制到 dir，对比 ffmpeg_muxer 和块写入输出，每组 seconds 秒 */
+    void benchmarkRecordWriters(const QString &dir, int seconds = 20);
+
+    /* 把输出画面（可选音频）发布到共享内存 name，读取端参见 frame-export-reader.h */
+    void startFrameExport(const QString &name, bool audio = false);
+    void stopFrameExport();
+    void logFrameExportStats();
+    /* 分别用一个快的和一个慢的读取端各读取 seconds 秒，对比写端的拷贝耗时 */
+    void benchmarkFrameExport(int seconds = 10);
+
+    void logRawTapStats();
+
+    /* 输出画面（和第 0 路混音）原样写入 path，格式参见 obs-raw-capture.h */
+    void startRawCapture(const QString &path, bool audio = true);
+    void stopRawCapture();
+    void logRawCaptureStats();
+    /* 用采集文件代替窗口捕获源；maxRate 为每渲染一帧送入下一帧，不按原始时间戳 */
+    void startReplay(const QString &path, bool maxRate = false, bool loop = true);
+    void stopReplay();
+
+    /* 用 corpusDir 中的采集文件（没有时用合成画面）遍历编码器参数，对比码率和画质，
+       结果写到 outputDir，耗时为分钟级，参见 obs-rd-bench.h */
+    void benchmarkRateDistortion(const QString &corpusDir,
+                                 const QString &outputDir, int frames = 120);
+
+    /* 推流编码器的 ROI 模式（ROIMode），仅对 obs_x264 有效：开启后改用 ROI_ENCODER_ID，
+       切换编码器需要先停止推流、LL-HLS 和块写入录制；手动/自动之间可随时切换 */
+    void setROIMode(int mode);
+    /* 提高画质的文字区域，捕获画面（剪裁后）坐标，ROI_MODE_MANUAL/AUTO 时生效 */
+    void setTextROI(const QList<QRect> &rects);
+    void logROIStats();
+    /* 对比开启/关闭自动 ROI 时文字区域 SSIM 相同的码率，结果写到 outputDir */
+    void benchmarkROI(const QString &corpusDir, const QString &outputDir,
+                      int frames = 120);
+
+    /* 周期缩略图写入 dir/thumbnail.jpg，cpuBudget 为允许占用单核的百分比 */
+    void startThumbnails(const QString &dir, int width = 320,
+                         int intervalMs = 1000, int quality = 70,
+                         double cpuBudget = 5.0);
+    void stopThumbnails();
+    /* 原始分辨率截图，格式由后缀决定（png/jpg） */
+    void takeSnapshot(const QString &path, int quality = 90);
+    void logSnapshotStats();
+
+    /* types 为 1 << PostProcessJob::Type 的组合，0 为录制完成后不自动处理 */
+    void setPostProcessTypes(int types);
+    void enqueuePostProcess(const QString &file, int types);
+    void pausePostProcess(bool pause);
+    void logPostProcessStats();
+
+    void logEventBusStats();
+
+    /* 飞行记录器快照，path 为空时写到配置目录 flight/ 下，按时间命名；
+       读取参见 QtOBSRecord --flight-dump */
+    void dumpFlightRecorder(const QString &path = QString());
+
+    /* 空闲暂停（默认关闭）：没有任何输出、tap 超过 graceMs 后暂停；输出或 tap
+       连接到 libobs 的视频/音频输出后，在下一帧渲染前恢复，参见 idleTick */
+    void setIdleSuspend(bool enable, int graceMs = 5000);
+    void logIdleStats();
+    void logFlightRecorderStats();
+
+private:
+    bool resetAudio(const std::vector<AudioDeviceFormat> &formats);
+    int  resetVideo();
+    void probeAudioFormats(std::vector<AudioDeviceFormat> &formats,
+                           bool current = true);
+    void checkAudioDeviceFormat(bool input, const std::string &id);
+
+    OBSData getStreamEncSettings();
+    std::string getStreamEncoderId() const;
+    void applyTextROI();
+    OBSData getRenditionEncSettings(const RenditionConfig &config);
+    std::string getRenditionEncoderId() const;
+    std::string getX264ThreadOpts(const char *separator);
+    void probeEncoders(const QString &configPath);
+    bool initService();
+    bool resetOutputs();
+    bool bindOutputs();
+    void connectOutputSignals();
+    void disconnectOutputSignals();
+
+    bool createScene();
+    // refresh 同 bindCaptureWindow
+    bool createCaptureSource(const QString &windowTitle, const QRect &sourceRect,
+                             bool refresh);
+    bool rebuildScene(const QString &windowTitle, const QRect &sourceRect);
+
+    bool setupRecord();
+    bool setupStream();
+    bool liveOutputActive();
+
+    bool resetRenditions();
+    void startRenditions();
+    void stopRenditions(bool force);
+
+    void addFilterToSource(obs_source_t *, const char *);
+    void setupNoiseSuppression();
+
+    void attachAudioMeters();
+    void setupAVSync();
+
+    void applySceneLayout(SceneLayout::Mode mode,
+                          const std::vector<LayoutSource> &sources);
+
+    // refresh 为 false 时使用已枚举的窗口列表
+    bool bindCaptureWindow(bool refresh = true);
+    void startWindowMonitor();
+
+    bool outputsIdle();
+    void suspendIdle();
+    void resumeIdle();
+    void resumeIdleLocked();
+    void applyLayoutBenchStep();
+
+private slots:
+    void onInitFinished(bool ok);
+    void checkCaptureWindow();
+    void handleEvents(const QVector<OBSEvent> &batch);
+    void sampleFlightMetrics();
+    void checkIdle();
+    void stepSceneLayoutBenchmark();
+};